@@ -3,6 +3,7 @@
 #include <Arduino.h>
 #include "structdata.h"
 #include "FlashFile.h"
+#include "ConfigStore.h"
 // #include <ETH.h>  // Không sử dụng Ethernet
 #include <HTTPClient.h>
 #include <ArduinoJson.h>
@@ -10,14 +11,15 @@
 #include <esp_task_wdt.h> // CRITICAL: Added for WDT support
 #include "Credentials.h"
 
-/// @brief Hàm lấy thông tin từ server và kiểm tra nội dung có thay đổi trong flash hay không? Nếu có lưu mới
+/// @brief Hàm lấy thông tin từ server và kiểm tra nội dung có thay đổi trong ConfigStore hay không? Nếu có lưu mới
 /// @param settings
-void callAPIGetSettingsMqtt(Settings *settings, SemaphoreHandle_t flashMutex)
+void callAPIGetSettingsMqtt(Settings *settings)
 {
-  // Settings *settings = (Settings *)param;
-  // cần đọc data từ file companyInfo.txt lên trước
+  // Bản đã lưu: bản RAM của ConfigStore (không đọc flash)
+  DeviceConfig config = configStore.get();
   Settings settingsInFlash;
-  readSettingsInFlash(settingsInFlash, flashMutex);
+  strlcpy(settingsInFlash.MqttServer, config.mqttServer, sizeof(settingsInFlash.MqttServer));
+  settingsInFlash.PortMqtt = config.mqttPort;
 
   if (WiFi.status() == WL_CONNECTED)
   {
@@ -59,17 +61,15 @@ void callAPIGetSettingsMqtt(Settings *settings, SemaphoreHandle_t flashMutex)
 
           // Serial.println("MqttServer: " + String(settings->MqttServer));
           // Serial.println("PortMqtt: " + String(settings->PortMqtt));
-          String hexString;
-          convertSettingsToHex(*settings, hexString);
-          Serial.println("Data hexString: " + hexString + " length: " + hexString.length());
           if (strcmp(settingsInFlash.MqttServer, settings->MqttServer) == 0 && settingsInFlash.PortMqtt == settings->PortMqtt)
           {
             Serial.println("Data Settings not new");
           }
           else
           {
-            Serial.println("Save data Settings new to flash");
-            saveFileSettingsToFlash(hexString, flashMutex);
+            Serial.printf("Save data Settings new to ConfigStore: %s:%u\n", settings->MqttServer, settings->PortMqtt);
+            configStore.setMqtt(settings->MqttServer, settings->PortMqtt);
+            configStore.commit();
           }
         }
         else
@@ -0,0 +1,284 @@
+#ifndef CONFIG_STORE_H
+#define CONFIG_STORE_H
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <Preferences.h>
+#include <freertos/FreeRTOS.h>
+#include "Settings.h"
+#include "structdata.h"
+#include "Inits.h" // convertSettingsFromHex (import of /settings.txt)
+
+// ============================================================================
+// CONFIG STORE - DEVICE CONFIGURATION IN ONE NVS BLOB, READ ONCE AT BOOT
+// ============================================================================
+// WiFi credentials + IdDevice (was /config.txt, 3 text lines), MQTT server
+// and port (was /settings.txt, hex string) and the restart counter (was
+// /counter.bin) are one typed DeviceConfig, stored as a single blob in the
+// "kplcfg" NVS namespace (nvs partition, not LittleFS):
+//
+//   Blob: version u16 | size u16 | DeviceConfig (size bytes)
+//
+// Boot reads it once (begin()); afterwards everyone works on the RAM copy
+// (get() / set*(), guarded by a spinlock, copy in / out only) and commit()
+// writes it back as one NVS write when something changed, so a batch of
+// changes costs one write. Schema: fields are only ever appended to
+// DeviceConfig and CONFIG_STORE_VERSION is bumped; an older blob loads its
+// prefix and the new fields start at 0 (upgrade() may fill them), a newer
+// one (firmware downgrade) keeps the fields this version knows.
+//
+// No blob (first boot with this firmware): the three legacy files are read,
+// committed as the first blob and removed. The time spent on them is kept
+// as legacyLoadUs next to loadUs (device status "config"): the same boot
+// measures the old and the new load path.
+// ============================================================================
+
+#define CONFIG_STORE_NAMESPACE "kplcfg"
+#define CONFIG_STORE_KEY "cfg"
+#define CONFIG_STORE_VERSION 1
+
+struct DeviceConfig
+{
+  // v1
+  char ssid[33];
+  char password[65];
+  char topic[32];      // IdDevice (TopicMqtt)
+  char mqttServer[50];
+  uint16_t mqttPort;
+  uint32_t counterReset;
+};
+
+struct ConfigStoreStats
+{
+  uint32_t loadUs;       // NVS read at boot
+  uint32_t legacyLoadUs; // Legacy files read (migration boot only)
+  uint16_t loadedVersion; // 0 = no blob found
+  bool migrated;
+  uint32_t commits;      // NVS writes since boot
+  uint32_t bytesWritten;
+  uint32_t failed;
+};
+
+class ConfigStore
+{
+public:
+  ConfigStore() : dirty(false)
+  {
+    portMUX_TYPE unlocked = portMUX_INITIALIZER_UNLOCKED;
+    mux = unlocked;
+    memset(&cfg, 0, sizeof(cfg));
+    memset(&stats, 0, sizeof(stats));
+  }
+
+  // Boot, after LittleFS is mounted: load the blob, or import the legacy files (not committed yet)
+  bool begin()
+  {
+    unsigned long start = micros();
+    if (!prefs.begin(CONFIG_STORE_NAMESPACE, false))
+    {
+      Serial.println("[CONFIG] ✗ NVS namespace unavailable");
+      return false;
+    }
+    bool loaded = load();
+    stats.loadUs = micros() - start;
+    if (loaded)
+    {
+      Serial.printf("[CONFIG] ✓ Config v%u loaded in %lu us\n", stats.loadedVersion, (unsigned long)stats.loadUs);
+      return true;
+    }
+    start = micros();
+    importLegacyFiles();
+    stats.legacyLoadUs = micros() - start;
+    stats.migrated = true;
+    dirty = true;
+    Serial.printf("[CONFIG] Legacy config files read in %lu us (NVS: %lu us)\n", (unsigned long)stats.legacyLoadUs,
+                  (unsigned long)stats.loadUs);
+    return true;
+  }
+
+  DeviceConfig get()
+  {
+    portENTER_CRITICAL(&mux);
+    DeviceConfig c = cfg;
+    portEXIT_CRITICAL(&mux);
+    return c;
+  }
+
+  void setWiFi(const char *ssid, const char *password, const char *topic)
+  {
+    portENTER_CRITICAL(&mux);
+    copy(cfg.ssid, ssid, sizeof(cfg.ssid));
+    copy(cfg.password, password, sizeof(cfg.password));
+    copy(cfg.topic, topic, sizeof(cfg.topic));
+    dirty = true;
+    portEXIT_CRITICAL(&mux);
+  }
+
+  // Forget the WiFi credentials (reset button / portal); IdDevice is kept
+  void clearWiFi()
+  {
+    portENTER_CRITICAL(&mux);
+    memset(cfg.ssid, 0, sizeof(cfg.ssid));
+    memset(cfg.password, 0, sizeof(cfg.password));
+    dirty = true;
+    portEXIT_CRITICAL(&mux);
+  }
+
+  void setMqtt(const char *server, uint16_t port)
+  {
+    portENTER_CRITICAL(&mux);
+    if (strcmp(cfg.mqttServer, server) != 0 || cfg.mqttPort != port)
+    {
+      copy(cfg.mqttServer, server, sizeof(cfg.mqttServer));
+      cfg.mqttPort = port;
+      dirty = true;
+    }
+    portEXIT_CRITICAL(&mux);
+  }
+
+  void setCounterReset(uint32_t counter)
+  {
+    portENTER_CRITICAL(&mux);
+    if (cfg.counterReset != counter)
+    {
+      cfg.counterReset = counter;
+      dirty = true;
+    }
+    portEXIT_CRITICAL(&mux);
+  }
+
+  // Write the RAM copy if it changed since the last commit (one NVS blob write)
+  bool commit()
+  {
+    uint8_t blob[4 + sizeof(DeviceConfig)];
+    portENTER_CRITICAL(&mux);
+    bool changed = dirty;
+    dirty = false;
+    memcpy(blob + 4, &cfg, sizeof(cfg));
+    portEXIT_CRITICAL(&mux);
+    if (!changed)
+      return true;
+    putU16(blob, CONFIG_STORE_VERSION);
+    putU16(blob + 2, sizeof(DeviceConfig));
+    if (prefs.putBytes(CONFIG_STORE_KEY, blob, sizeof(blob)) != sizeof(blob))
+    {
+      portENTER_CRITICAL(&mux);
+      dirty = true;
+      portEXIT_CRITICAL(&mux);
+      stats.failed++;
+      Serial.println("[CONFIG] ✗ Config commit failed");
+      return false;
+    }
+    stats.commits++;
+    stats.bytesWritten += sizeof(blob);
+    if (stats.migrated && stats.commits == 1)
+      removeLegacyFiles();
+    return true;
+  }
+
+  ConfigStoreStats stats;
+
+private:
+  static void copy(char *dst, const char *src, size_t size)
+  {
+    strncpy(dst, src ? src : "", size - 1);
+    dst[size - 1] = '\0';
+  }
+  static void putU16(uint8_t *p, uint16_t v)
+  {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+  }
+  static uint16_t getU16(const uint8_t *p) { return (uint16_t)(p[0] | (p[1] << 8)); }
+
+  bool load()
+  {
+    uint8_t blob[4 + sizeof(DeviceConfig) + 64]; // Room for a newer (longer) schema
+    size_t len = prefs.getBytesLength(CONFIG_STORE_KEY);
+    if (len < 4 || len > sizeof(blob) || prefs.getBytes(CONFIG_STORE_KEY, blob, len) != len)
+      return false;
+    uint16_t version = getU16(blob);
+    uint16_t size = getU16(blob + 2);
+    if (version == 0 || size != len - 4)
+      return false;
+    memset(&cfg, 0, sizeof(cfg));
+    memcpy(&cfg, blob + 4, size < sizeof(cfg) ? size : sizeof(cfg));
+    cfg.ssid[sizeof(cfg.ssid) - 1] = '\0';
+    cfg.password[sizeof(cfg.password) - 1] = '\0';
+    cfg.topic[sizeof(cfg.topic) - 1] = '\0';
+    cfg.mqttServer[sizeof(cfg.mqttServer) - 1] = '\0';
+    stats.loadedVersion = version;
+    upgrade(version);
+    return true;
+  }
+
+  // Fill fields added after `from` (none yet: v1 is the first schema)
+  void upgrade(uint16_t from)
+  {
+    if (from < CONFIG_STORE_VERSION)
+      dirty = true; // Rewrite in the current layout with the next commit
+  }
+
+  // /config.txt (ssid \n password \n topic), /settings.txt (hex), /counter.bin (raw)
+  void importLegacyFiles()
+  {
+    File file = LittleFS.open("/config.txt", "r");
+    if (file)
+    {
+      String text = file.readString();
+      file.close();
+      int split1 = text.indexOf('\n');
+      int split2 = text.lastIndexOf('\n');
+      if (split1 != -1 && split2 != -1 && split1 != split2)
+      {
+        copy(cfg.ssid, text.substring(0, split1).c_str(), sizeof(cfg.ssid));
+        copy(cfg.password, text.substring(split1 + 1, split2).c_str(), sizeof(cfg.password));
+        copy(cfg.topic, text.substring(split2 + 1).c_str(), sizeof(cfg.topic));
+      }
+    }
+    file = LittleFS.open("/settings.txt", "r");
+    if (file)
+    {
+      String line = file.readStringUntil('\n');
+      file.close();
+      if (line.length() >= 4)
+      {
+        Settings settings;
+        memset(&settings, 0, sizeof(settings));
+        convertSettingsFromHex(line, settings);
+        copy(cfg.mqttServer, settings.MqttServer, sizeof(cfg.mqttServer));
+        cfg.mqttPort = settings.PortMqtt;
+      }
+    }
+    file = LittleFS.open("/counter.bin", "r");
+    if (file)
+    {
+      unsigned long counter = 0;
+      if (file.readBytes((char *)&counter, sizeof(counter)) == sizeof(counter))
+        cfg.counterReset = counter;
+      file.close();
+    }
+    Serial.printf("[CONFIG] Imported legacy config: SSID=%s, Topic=%s, MQTT=%s:%u, counter=%lu\n", cfg.ssid,
+                  cfg.topic, cfg.mqttServer, cfg.mqttPort, (unsigned long)cfg.counterReset);
+  }
+
+  void removeLegacyFiles()
+  {
+    const char *const files[] = {"/config.txt", "/settings.txt", "/counter.bin"};
+    for (uint8_t i = 0; i < 3; i++)
+    {
+      if (LittleFS.exists(files[i]))
+        LittleFS.remove(files[i]);
+    }
+  }
+
+  Preferences prefs;
+  DeviceConfig cfg;
+  bool dirty;
+  portMUX_TYPE mux;
+};
+
+// Defined in main.cpp
+extern ConfigStore configStore;
+
+#endif // CONFIG_STORE_H
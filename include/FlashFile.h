@@ -12,33 +12,6 @@
 // File path for storing nozzle prices
 #define NOZZLE_PRICES_FILE "/nozzle_prices.dat"
 
-// Hàm đọc thông tin từ file
-inline String readFileConfig(const char* path) {
-  // Không gọi LittleFS.begin() ở đây vì đã được mount ở nơi khác
-  File file = LittleFS.open(path, "r");
-  if (!file) {
-    Serial.println("Không thể mở file để đọc");
-    return "";
-  }
-
-  String content = file.readString();
-  file.close();
-  return content;
-}
-
-// Hàm ghi thông tin vào file
-inline void writeFileConfig(const char* path, const String& data) {
-  // Không gọi LittleFS.begin() ở đây vì đã được mount ở nơi khác
-  File file = LittleFS.open(path, "w");
-  if (!file) {
-    Serial.println("Không thể mở file để ghi");
-    return;
-  }
-
-  file.print(data);
-  file.close();
-}
-
 /// @brief Hàm đọc thông tin lưu dữ liệu trong flash
 inline void listFiles(SemaphoreHandle_t flashMutex)
 {
@@ -279,191 +252,6 @@ inline bool initLittleFS()
     return true;
 }
 
-/// @brief Lưu nội dung settings file vào bộ nhớ Flash
-/// @param data
-inline void saveFileSettingsToFlash(const String &data, SemaphoreHandle_t flashMutex)
-{
-  if (xSemaphoreTake(flashMutex, 1000 / portTICK_PERIOD_MS) == pdTRUE)
-  {
-    if (!LittleFS.begin())
-    {
-      Serial.println("Failed to mount file system");
-    //   strcpy(deviceStatus->status, "Failed to mount file system");
-      xSemaphoreGive(flashMutex);
-      return;
-    }
-
-    File file = LittleFS.open("/settings.txt", FILE_WRITE);
-    if (!file)
-    {
-      Serial.println("Failed to open file for writing");
-    //   strcpy(deviceStatus->status, "Failed to open file for writing");
-      file.close();
-      xSemaphoreGive(flashMutex);
-      return;
-    }
-    if (file.print(data.c_str()))
-    { // Sử dụng printf để lưu dữ liệu
-      Serial.println("File written successfully");
-    }
-    else
-    {
-      Serial.println("Write failed");
-    //   strcpy(deviceStatus->status, "Write failed");
-    }
-    file.close();
-    xSemaphoreGive(flashMutex);
-  }
-  else
-  {
-    Serial.println("Failed to take flash mutex");
-    // strcpy(deviceStatus->status, "Failed to take flash mutex");
-  }
-}
-
-/// @brief Đọc thông tin thiết lập trong bộ nhớ Falash
-/// @param settings
-inline void readSettingsInFlash(Settings &settings, SemaphoreHandle_t flashMutex)
-{
-  if (xSemaphoreTake(flashMutex, 1000 / portTICK_PERIOD_MS) == pdTRUE)
-  {
-    if (!LittleFS.begin())
-    {
-      Serial.println("Failed to mount file system");
-      xSemaphoreGive(flashMutex);
-    //   strcpy(deviceStatus->status, "Failed to mount file system");
-      return;
-    }
-    if (!LittleFS.exists("/settings.txt"))
-    {
-      Serial.println("File settings.txt not found");
-    //   strcpy(deviceStatus->status, "File settings.txt not found");
-      File file = LittleFS.open("/settings.txt", FILE_WRITE);
-      file.close();
-    }
-    File file = LittleFS.open("/settings.txt", FILE_READ);
-    if (!file)
-    {
-      Serial.println("Failed to open file settings.txt for reading");
-    //   strcpy(deviceStatus->status, "Failed read settings.txt");
-      file.close();
-      xSemaphoreGive(flashMutex);
-      return;
-    }
-
-    String line = file.readStringUntil('\n');
-    file.close();
-    xSemaphoreGive(flashMutex);
-    convertSettingsFromHex(line, settings);
-  }
-  else
-  {
-    Serial.println("Failed to take flash mutex");
-  }
-//   strcpy(deviceStatus->status, "Failed to take flash mutex");
-}
-
-/// @brief Đọc các thông tin thiết lập trong bộ nhớ Flash
-inline void readFlashSettings(SemaphoreHandle_t flashMutex, DeviceStatus &deviceStatus, unsigned long &counterReset)
-{
-  if (xSemaphoreTake(flashMutex, 1000 / portTICK_PERIOD_MS) == pdTRUE)
-  {
-    if (!LittleFS.begin())
-    {
-      Serial.println("Failed to initialize LittleFS");
-      xSemaphoreGive(flashMutex);
-      strcpy(deviceStatus.status, "Failed to initialize LittleFS");
-      return;
-    }
-    if (!LittleFS.exists("/counter.bin"))
-    {
-      Serial.println("File counter.bin not found");
-      File file = LittleFS.open("/counter.bin", FILE_WRITE);
-      file.close();
-      strcpy(deviceStatus.status, "File counter.bin not found");
-    }
-
-    File file = LittleFS.open("/counter.bin", "r");
-    if (!file)
-    {
-      Serial.println("Failed to read from flash");
-      strcpy(deviceStatus.status, "Failed to read from flash");
-      xSemaphoreGive(flashMutex);
-      return;
-    }
-
-    file.readBytes((char *)&counterReset, sizeof(counterReset));
-    file.close();
-    counterReset = counterReset + 1;
-    file = LittleFS.open("/counter.bin", "w");
-    if (!file)
-    {
-      Serial.println("Failed to write to flash");
-      strcpy(deviceStatus.status, "Failed to write to flash");
-      xSemaphoreGive(flashMutex);
-      return;
-    }
-
-    file.write((const uint8_t *)&counterReset, sizeof(counterReset));
-    file.close();
-    Serial.println(counterReset);
-    LittleFS.end();
-    xSemaphoreGive(flashMutex);
-  }
-  else
-  {
-    Serial.println("Failed to take flash mutex");
-  }
-  strcpy(deviceStatus.status, "Failed to take flash mutex");
-}
-
-/// @brief Ghi giá trị reset counter vào Flash
-/// @param flashMutex 
-/// @param counterReset 
-/// @return true nếu ghi thành công, false nếu thất bại
-inline bool writeResetCountToFlash(SemaphoreHandle_t flashMutex, unsigned long counterReset)
-{
-  if (xSemaphoreTake(flashMutex, 1000 / portTICK_PERIOD_MS) == pdTRUE)
-  {
-    if (!LittleFS.begin())
-    {
-      Serial.println("Failed to initialize LittleFS for writing counter");
-      xSemaphoreGive(flashMutex);
-      return false;
-    }
-
-    File file = LittleFS.open("/counter.bin", "w");
-    if (!file)
-    {
-      Serial.println("Failed to open counter.bin for writing");
-      LittleFS.end();
-      xSemaphoreGive(flashMutex);
-      return false;
-    }
-
-    size_t written = file.write((const uint8_t *)&counterReset, sizeof(counterReset));
-    file.close();
-    LittleFS.end();
-    xSemaphoreGive(flashMutex);
-
-    if (written == sizeof(counterReset))
-    {
-      Serial.printf("Reset counter written to flash: %lu\n", counterReset);
-      return true;
-    }
-    else
-    {
-      Serial.println("Failed to write complete counter data");
-      return false;
-    }
-  }
-  else
-  {
-    Serial.println("Failed to take flash mutex for writing counter");
-    return false;
-  }
-}
-
 // ============================================================================
 // NOZZLE PRICE MANAGEMENT
 // ============================================================================
@@ -552,9 +340,8 @@ inline bool saveNozzlePrices(const NozzlePrices &prices, SemaphoreHandle_t flash
     }
 }
 
-// Update a single nozzle price and save to Flash
-inline bool updateNozzlePrice(const char* nozzorle, const char* idDevice, float newPrice, 
-                              NozzlePrices &prices, SemaphoreHandle_t flashMutex) {
+// Update a single nozzle price in RAM (no Flash write)
+inline bool applyNozzlePrice(const char* nozzorle, const char* idDevice, float newPrice, NozzlePrices &prices) {
     // Parse nozzle ID from string (e.g., "13" -> 13)
     uint8_t nozzleId = atoi(nozzorle);
     
@@ -579,6 +366,16 @@ inline bool updateNozzlePrice(const char* nozzorle, const char* idDevice, float
     prices.lastUpdate = millis();
     prices.checksum = calculateNozzlePricesChecksum(prices);
     
+    return true;
+}
+
+// Update a single nozzle price and save to Flash
+inline bool updateNozzlePrice(const char* nozzorle, const char* idDevice, float newPrice, 
+                              NozzlePrices &prices, SemaphoreHandle_t flashMutex) {
+    if (!applyNozzlePrice(nozzorle, idDevice, newPrice, prices)) {
+        return false;
+    }
+    
     // Save to Flash
     bool saved = saveNozzlePrices(prices, flashMutex);
     if (saved) {
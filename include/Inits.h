@@ -5,7 +5,7 @@
 #include <ArduinoJson.h>
 
 
-/// @brief Convert Settings hexa qua Settings String
+/// @brief Convert Settings hexa qua Settings String (chỉ còn dùng để nhập /settings.txt cũ vào ConfigStore)
 /// @param hexString
 /// @param settings
 inline void convertSettingsFromHex(const String &hexString, Settings &settings)
@@ -29,32 +29,6 @@ inline void convertSettingsFromHex(const String &hexString, Settings &settings)
   settings.MqttServer[sizeof(settings.MqttServer) - 1] = '\0'; // Ensure null termination
 }
 
-/// @brief Định nghĩa lại chuổi setting qua dạng hexa để lưu tối ưu bộ nhớ
-/// @param settings
-/// @param hexString
-inline void convertSettingsToHex(const Settings &settings, String &hexString)
-{
-  char buffer[5]; // Đủ để chứa 4 ký tự hexa cho PortMqtt và ký tự null
-  char buffer2[3];
-  hexString.clear(); // Xóa chuỗi hexString để đảm bảo nó trống trước khi thêm vào
-
-  // Tối ưu hóa bộ nhớ bằng cách sử dụng một biến tạm thời
-  String tempHex;
-
-  // Chuyển đổi MqttServer sang dạng hex
-  for (int i = 0; i < sizeof(settings.MqttServer); i++)
-  {
-    sprintf(buffer2, "%02X", (unsigned char)settings.MqttServer[i]);
-    tempHex += buffer2;
-  }
-
-  // Chuyển đổi PortMqtt sang dạng hexa 4 ký tự
-  sprintf(buffer, "%04X", settings.PortMqtt);
-  tempHex += buffer;
-
-  hexString = tempHex; // Gán một lần vào hexString để giảm số lần cập nhật chuỗi
-}
-
 /// @brief Hàm dùng để tách chuổi đọc được, lấy giá trị từ chuổi đọc được, giống hàm Mid trong excel
 /// @param data : Chuổi cần đọc
 /// @param start: Vị trí bắt đầu cắt chuổi
@@ -0,0 +1,191 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// ============================================================================
+// RS485 RESPONSE LATENCY HISTOGRAMS - PER DEVICE, PER COMMAND TYPE
+// ============================================================================
+// Fixed, roughly logarithmic millisecond buckets. Counts are halved once a
+// histogram holds kDecayAt samples so old behaviour fades and the derived
+// timeouts follow the device as it is now.
+//
+// timeoutMs() = p99 * 1.25 + 50 ms, clamped to [kMinTimeoutMs, kMaxTimeoutMs];
+// until a histogram has kMinSamples samples the caller's default is used.
+// ============================================================================
+
+#define LATENCY_BUCKETS 14
+
+// Upper edge (ms) of each bucket; the last bucket is open-ended
+static const uint16_t kLatencyEdgesMs[LATENCY_BUCKETS] = {
+    25, 50, 75, 100, 150, 200, 300, 400, 600, 800, 1000, 1500, 2500, 0xFFFF};
+
+enum RS485CommandType : uint8_t
+{
+  RS485_CMD_PRICE = 0,    // [9][ID][price][cs][10] → [7][ID][S/E][8]
+  RS485_CMD_SET_TIME,     // [93][99][time][cs][94] → [7][99][S/E][8]
+  RS485_CMD_LOG_REQUEST,  // [0xC8][hi][lo][cs][0xC9] → pump log
+  RS485_CMD_TYPE_COUNT
+};
+
+class LatencyHistogram
+{
+public:
+  static const uint16_t kDecayAt = 512;
+  static const uint16_t kMinSamples = 8;
+  static const uint32_t kMinTimeoutMs = 200;
+  static const uint32_t kMaxTimeoutMs = 3000;
+
+  LatencyHistogram() { clear(); }
+
+  void clear()
+  {
+    memset(buckets, 0, sizeof(buckets));
+    total = 0;
+    timeoutCount = 0;
+    answeredCount = 0;
+    maxMs = 0;
+  }
+
+  void record(uint32_t ms)
+  {
+    uint8_t b = 0;
+    while (b < LATENCY_BUCKETS - 1 && ms > kLatencyEdgesMs[b])
+      b++;
+    buckets[b]++;
+    total++;
+    answeredCount++;
+    if (ms > maxMs)
+      maxMs = ms;
+    if (total >= kDecayAt)
+      decay();
+  }
+
+  // A command that got no answer at all within its timeout
+  void recordTimeout() { timeoutCount++; }
+
+  // Upper bucket edge containing the p-th percentile (0-100); 0 if empty
+  uint32_t percentile(uint8_t p) const
+  {
+    if (total == 0)
+      return 0;
+    uint32_t rank = ((uint32_t)total * p + 99) / 100;
+    if (rank == 0)
+      rank = 1;
+    uint32_t seen = 0;
+    for (uint8_t b = 0; b < LATENCY_BUCKETS; b++)
+    {
+      seen += buckets[b];
+      if (seen >= rank)
+        return b == LATENCY_BUCKETS - 1 ? maxMs : kLatencyEdgesMs[b];
+    }
+    return maxMs;
+  }
+
+  uint32_t timeoutMs(uint32_t defaultMs) const
+  {
+    if (total < kMinSamples)
+      return defaultMs;
+    uint32_t t = percentile(99) * 5 / 4 + 50;
+    if (t < kMinTimeoutMs)
+      t = kMinTimeoutMs;
+    if (t > kMaxTimeoutMs)
+      t = kMaxTimeoutMs;
+    return t;
+  }
+
+  uint16_t bucket(uint8_t b) const { return buckets[b]; }
+  uint16_t samples() const { return total; }
+  uint32_t answered() const { return answeredCount; }
+  uint32_t timeouts() const { return timeoutCount; }
+  uint32_t maxLatencyMs() const { return maxMs; }
+
+private:
+  void decay()
+  {
+    total = 0;
+    for (uint8_t b = 0; b < LATENCY_BUCKETS; b++)
+    {
+      buckets[b] >>= 1;
+      total += buckets[b];
+    }
+  }
+
+  uint16_t buckets[LATENCY_BUCKETS];
+  uint16_t total;          // Samples currently in buckets (after decay)
+  uint32_t timeoutCount;   // Lifetime
+  uint32_t answeredCount;  // Lifetime
+  uint32_t maxMs;
+};
+
+// Histograms for nozzle IDs 11-20 plus the TTL box itself (ID 99 / broadcast)
+class RS485LatencyTable
+{
+public:
+  static const uint8_t kFirstId = 11;
+  static const uint8_t kNozzles = 10;
+  static const uint8_t kBoxIndex = kNozzles; // ID 99 and commands without a nozzle ID
+
+  static uint8_t indexOf(uint8_t deviceId)
+  {
+    return (deviceId >= kFirstId && deviceId < kFirstId + kNozzles) ? deviceId - kFirstId : kBoxIndex;
+  }
+
+  LatencyHistogram &at(uint8_t deviceId, RS485CommandType type) { return table[indexOf(deviceId)][type]; }
+  const LatencyHistogram &at(uint8_t deviceId, RS485CommandType type) const { return table[indexOf(deviceId)][type]; }
+
+  void record(uint8_t deviceId, RS485CommandType type, uint32_t ms) { at(deviceId, type).record(ms); }
+  void recordTimeout(uint8_t deviceId, RS485CommandType type) { at(deviceId, type).recordTimeout(); }
+  uint32_t timeoutMs(uint8_t deviceId, RS485CommandType type, uint32_t defaultMs) const
+  {
+    return at(deviceId, type).timeoutMs(defaultMs);
+  }
+
+  // Chronically slow nozzle: >= 20% of commands unanswered, or median latency
+  // more than twice the median of all nozzles with enough samples
+  bool isChronicallySlow(uint8_t deviceId, RS485CommandType type) const
+  {
+    const LatencyHistogram &h = at(deviceId, type);
+    uint32_t attempts = h.answered() + h.timeouts();
+    if (attempts < LatencyHistogram::kMinSamples)
+      return false;
+    if (h.timeouts() * 5 >= attempts)
+      return true;
+    uint32_t fleet = fleetMedianMs(type);
+    return h.samples() >= LatencyHistogram::kMinSamples && fleet > 0 && h.percentile(50) > 2 * fleet;
+  }
+
+  // Median of per-nozzle p50s
+  uint32_t fleetMedianMs(RS485CommandType type) const
+  {
+    uint32_t values[kNozzles];
+    uint8_t n = 0;
+    for (uint8_t i = 0; i < kNozzles; i++)
+    {
+      const LatencyHistogram &h = table[i][type];
+      if (h.samples() >= LatencyHistogram::kMinSamples)
+        values[n++] = h.percentile(50);
+    }
+    if (n == 0)
+      return 0;
+    for (uint8_t i = 1; i < n; i++) // Insertion sort, n <= 10
+    {
+      uint32_t v = values[i];
+      uint8_t j = i;
+      while (j > 0 && values[j - 1] > v)
+      {
+        values[j] = values[j - 1];
+        j--;
+      }
+      values[j] = v;
+    }
+    return values[n / 2];
+  }
+
+private:
+  LatencyHistogram table[kNozzles + 1][RS485_CMD_TYPE_COUNT];
+};
+
+#endif // LATENCY_HISTOGRAM_H
@@ -0,0 +1,1073 @@
+#ifndef LOG_ARCHIVE_H
+#define LOG_ARCHIVE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include "LogJournal.h"    // JournalMedium, crc16
+#include "PumpLogRecord.h" // LE helpers
+#include "TTLCodec.h"      // Frame checksum implied by the log fields
+
+// ============================================================================
+// LOG ARCHIVE - COMPRESSED LONG-RETENTION TIER BEYOND THE 2046-SLOT RING
+// ============================================================================
+// The journal keeps the last 2046 logs (one per TTL ring position). Every
+// committed log is also appended here under a global ID that keeps counting
+// across laps of the ring:
+//
+//   id = lap * 2046 + viTriLogData          (first lap = 0)
+//
+// Logs are delta / varint encoded into blocks of up to 64 records, one
+// day (ngay/thang/nam) per block. A block is self-contained (encoder state
+// starts fresh), so reading one log decodes at most one block. When the
+// medium is full the oldest segment is erased: retention is bounded by
+// space, not by the ring.
+//
+//   Segment header (16 B): 'KPLA' | version | 0 0 0 | seq u32 | crc16 | 0 0
+//   Block (18 B + len):    0xB5 | count | len u16 | first id u32 | last id u32 |
+//                          day u16 | nozzle mask u16 | crc16 | records
+//   (little-endian; day = nam << 9 | thang << 5 | ngay, nozzle bit = idVoi & 15;
+//   block crc16 = CCITT over header bytes 0..15 + records)
+//
+// The RAM index keeps each segment's ID and day range: a get(id) or a date
+// range query reads only the segments that can hold matches, and skips the
+// blocks of other days / nozzles by their headers.
+//
+// Cold tier (setColdTier): a second archive on another medium that takes the
+// oldest segment in bulk, block by block as written (CRCs unchanged, one
+// flush per segment), before it is erased for space. get(), forEachInDays()
+// and clear() cover both tiers; IDs in the cold tier are always older. A move
+// cut short by a power loss leaves a segment in both: the cold copy wins.
+//
+// Record (varint = LEB128, zz = zigzag varint of a 32-bit difference; "prev"
+// is the previous record of the block, "noz" the previous one of the same
+// nozzle in the block, zero at block start):
+//   mask    varint, bits below
+//   id      varint  id - prev.id - 1            (prev.id = first id - 1)
+//   lan     zz      maLanBom - noz.maLanBom - 1
+//   lit     varint  soLitBom
+//   total   zz      soTotalTong - noz.soTotalTong - soLitBom
+//   tien    varint  soTienBom, or zz residual vs soLitBom * donGia / 100 (T100)
+//                   or / 1000 (T1000), whichever the encoder found smallest
+//   time    zz      seconds of day - prev      (unless RAW)
+//   then, if set:  VOI idVoi u8 | PRICE zz donGia delta | DATE ngay thang nam |
+//                  COT zz viTriLogCot - noz.cot - 1 | SENT_TIME zz vs prev |
+//                  CYCLE varint cycleSave | POS varint viTriLogData |
+//                  RAW send1 send2 checksum send4 mqttSent gio phut giay, varint send3
+// Without RAW the frame bytes are the TTL defaults (1, 2, 3, 4, checksum
+// recomputed from the fields) and mqttSent is the SENT bit.
+//
+// Plain C++ over JournalMedium; Log = anything with the PumpLog field names.
+// ============================================================================
+
+#define LOG_ARCHIVE_RING 2046
+#define LOG_ARCHIVE_MAX_SEGMENTS 64
+#define LOG_ARCHIVE_BLOCK_RECORDS 64
+#define LOG_ARCHIVE_BLOCK_BYTES 1024
+#define LOG_ARCHIVE_VERSION 2
+
+struct LogArchiveStats
+{
+  uint32_t appended;        // Records accepted
+  uint32_t skipped;         // Late or duplicate logs (ID already passed)
+  uint32_t blocks;          // Blocks written
+  uint32_t bytesWritten;    // Block headers + records
+  uint32_t rawBytes;        // The same records as 40-byte PumpLogRecords
+  uint32_t segmentsDropped; // Oldest segments erased for space
+  uint32_t segmentsMoved;   // ... of which first copied to the cold tier
+  uint32_t tornTails;
+  uint32_t failedWrites;
+  uint32_t blockReads;      // Blocks read + decoded (get() cache misses, queries)
+};
+
+// ----------------------------------------------------------------------------
+// Record codec
+// ----------------------------------------------------------------------------
+
+struct LogArchiveCodec
+{
+  enum : uint16_t
+  {
+    kTien100 = 1 << 0, // Common flags first: the mask is usually one byte
+    kVoi = 1 << 1,
+    kDate = 1 << 2,
+    kCot = 1 << 3,
+    kPrice = 1 << 4,
+    kSent = 1 << 5,
+    kSentTime = 1 << 6,
+    kTien1000 = 1 << 7,
+    kRaw = 1 << 8,
+    kCycle = 1 << 9,
+    kPos = 1 << 10
+  };
+  enum : uint8_t
+  {
+    kMaxRecord = 72 // Worst case encoded size
+  };
+
+  struct Nozzle
+  {
+    uint16_t cot;
+    uint16_t lan;
+    uint32_t total;
+  };
+
+  // Encoder / decoder state, reset at every block start
+  struct State
+  {
+    uint32_t id;
+    uint8_t idVoi;
+    uint16_t donGia;
+    uint8_t ngay, thang, nam;
+    uint32_t secs;
+    uint32_t sentTime;
+    Nozzle noz[16];
+
+    void reset(uint32_t firstId)
+    {
+      memset(this, 0, sizeof(*this));
+      id = firstId - 1;
+    }
+  };
+
+  static uint16_t posOf(uint32_t id) { return (uint16_t)((id - 1) % LOG_ARCHIVE_RING + 1); }
+
+  // Day key, ordered like the dates: nam << 9 | thang << 5 | ngay
+  static uint16_t dayKey(uint8_t ngay, uint8_t thang, uint8_t nam)
+  {
+    return (uint16_t)(((nam & 0x7F) << 9) | ((thang & 0x0F) << 5) | (ngay & 0x1F));
+  }
+  template <class Log>
+  static uint16_t dayOf(const Log &log)
+  {
+    return dayKey(log.ngay, log.thang, log.nam);
+  }
+
+  // Log order key: yymmddhhmmss
+  template <class Log>
+  static uint64_t stampOf(const Log &log)
+  {
+    return ((((log.nam * 100ULL + log.thang) * 100 + log.ngay) * 100 + log.gio) * 100 + log.phut) * 100 + log.giay;
+  }
+
+  static uint8_t *putVarint(uint8_t *p, uint32_t v)
+  {
+    while (v >= 0x80)
+    {
+      *p++ = (uint8_t)(v | 0x80);
+      v >>= 7;
+    }
+    *p++ = (uint8_t)v;
+    return p;
+  }
+
+  static bool getVarint(const uint8_t *&p, const uint8_t *end, uint32_t &v)
+  {
+    v = 0;
+    for (uint8_t shift = 0; shift < 35; shift += 7)
+    {
+      if (p >= end)
+        return false;
+      uint8_t b = *p++;
+      v |= (uint32_t)(b & 0x7F) << shift;
+      if (!(b & 0x80))
+        return true;
+    }
+    return false;
+  }
+
+  static uint32_t zigzag(uint32_t diff) { return (diff << 1) ^ (uint32_t)((int32_t)diff >> 31); }
+  static uint32_t unzigzag(uint32_t v) { return (v >> 1) ^ (0u - (v & 1)); }
+  static uint8_t varintSize(uint32_t v)
+  {
+    uint8_t n = 1;
+    while (v >= 0x80)
+    {
+      v >>= 7;
+      n++;
+    }
+    return n;
+  }
+
+  template <class Log>
+  static uint8_t frameChecksum(const Log &log)
+  {
+    uint8_t frame[TTLPumpLog::kLength];
+    TTLPumpLog::encode(frame, log);
+    return frame[TTLPumpLog::kChecksumPos];
+  }
+
+  template <class Log>
+  static uint32_t secondsOfDay(const Log &log)
+  {
+    return (uint32_t)log.gio * 3600 + (uint32_t)log.phut * 60 + log.giay;
+  }
+
+  // Encode `log` under `id` into out (kMaxRecord bytes); returns the length
+  template <class Log>
+  static size_t encode(State &st, uint32_t id, const Log &log, uint8_t *out)
+  {
+    Nozzle &noz = st.noz[log.idVoi & 15];
+    uint16_t mask = 0;
+    if (log.idVoi != st.idVoi)
+      mask |= kVoi;
+    if (log.donGia != st.donGia)
+      mask |= kPrice;
+    if (log.ngay != st.ngay || log.thang != st.thang || log.nam != st.nam)
+      mask |= kDate;
+    bool timeOk = log.gio < 24 && log.phut < 60 && log.giay < 60;
+    if (!timeOk || log.send1 != 1 || log.send2 != 2 || log.checksum != 3 || log.send4 != 4 || log.mqttSent > 1 ||
+        log.send3 != frameChecksum(log))
+      mask |= kRaw;
+    else if (log.mqttSent)
+      mask |= kSent;
+    uint32_t sentTime = (uint32_t)log.mqttSentTime;
+    if (sentTime != 0)
+      mask |= kSentTime;
+    if (log.cycleSave != 0)
+      mask |= kCycle;
+    if ((uint16_t)(log.viTriLogCot - noz.cot - 1) != 0)
+      mask |= kCot;
+    if (log.viTriLogData != posOf(id))
+      mask |= kPos;
+
+    // soTienBom: raw or residual vs the price, whichever is shortest
+    uint32_t tien = log.soTienBom;
+    uint32_t r100 = zigzag(log.soTienBom - (uint32_t)((uint64_t)log.soLitBom * log.donGia / 100));
+    uint32_t r1000 = zigzag(log.soTienBom - (uint32_t)((uint64_t)log.soLitBom * log.donGia / 1000));
+    if (varintSize(r100) < varintSize(tien) && varintSize(r100) <= varintSize(r1000))
+    {
+      mask |= kTien100;
+      tien = r100;
+    }
+    else if (varintSize(r1000) < varintSize(tien))
+    {
+      mask |= kTien1000;
+      tien = r1000;
+    }
+
+    uint8_t *p = putVarint(out, mask);
+    p = putVarint(p, id - st.id - 1);
+    p = putVarint(p, zigzag((uint32_t)(uint16_t)(log.maLanBom - noz.lan - 1)));
+    p = putVarint(p, log.soLitBom);
+    p = putVarint(p, zigzag(log.soTotalTong - noz.total - log.soLitBom));
+    p = putVarint(p, tien);
+    uint32_t secs = secondsOfDay(log);
+    if (!(mask & kRaw))
+      p = putVarint(p, zigzag(secs - st.secs));
+    if (mask & kVoi)
+      *p++ = log.idVoi;
+    if (mask & kPrice)
+      p = putVarint(p, zigzag((uint32_t)log.donGia - st.donGia));
+    if (mask & kDate)
+    {
+      *p++ = log.ngay;
+      *p++ = log.thang;
+      *p++ = log.nam;
+    }
+    if (mask & kCot)
+      p = putVarint(p, zigzag((uint32_t)(uint16_t)(log.viTriLogCot - noz.cot - 1)));
+    if (mask & kSentTime)
+      p = putVarint(p, zigzag(sentTime - st.sentTime));
+    if (mask & kCycle)
+      p = putVarint(p, log.cycleSave);
+    if (mask & kPos)
+      p = putVarint(p, log.viTriLogData);
+    if (mask & kRaw)
+    {
+      *p++ = log.send1;
+      *p++ = log.send2;
+      *p++ = log.checksum;
+      *p++ = log.send4;
+      *p++ = log.mqttSent;
+      *p++ = log.gio;
+      *p++ = log.phut;
+      *p++ = log.giay;
+      p = putVarint(p, log.send3);
+    }
+
+    st.id = id;
+    st.idVoi = log.idVoi;
+    st.donGia = log.donGia;
+    st.ngay = log.ngay;
+    st.thang = log.thang;
+    st.nam = log.nam;
+    if (!(mask & kRaw))
+      st.secs = secs;
+    if (sentTime != 0)
+      st.sentTime = sentTime;
+    noz.cot = log.viTriLogCot;
+    noz.lan = log.maLanBom;
+    noz.total = log.soTotalTong;
+    return (size_t)(p - out);
+  }
+
+  // Decode the next record at p (advanced past it); false on a malformed record
+  template <class Log>
+  static bool decode(State &st, const uint8_t *&p, const uint8_t *end, uint32_t &id, Log &log)
+  {
+    uint32_t mask, idDelta, lan, lit, total, tien, timeDelta = 0, v;
+    if (!getVarint(p, end, mask) || !getVarint(p, end, idDelta) || !getVarint(p, end, lan) ||
+        !getVarint(p, end, lit) || !getVarint(p, end, total) || !getVarint(p, end, tien))
+      return false;
+    if (!(mask & kRaw) && !getVarint(p, end, timeDelta))
+      return false;
+
+    memset(&log, 0, sizeof(Log));
+    id = st.id + idDelta + 1;
+    log.idVoi = st.idVoi;
+    if (mask & kVoi)
+    {
+      if (p >= end)
+        return false;
+      log.idVoi = *p++;
+    }
+    Nozzle &noz = st.noz[log.idVoi & 15];
+    log.donGia = st.donGia;
+    if (mask & kPrice)
+    {
+      if (!getVarint(p, end, v))
+        return false;
+      log.donGia = (uint16_t)(st.donGia + unzigzag(v));
+    }
+    log.ngay = st.ngay;
+    log.thang = st.thang;
+    log.nam = st.nam;
+    if (mask & kDate)
+    {
+      if (end - p < 3)
+        return false;
+      log.ngay = p[0];
+      log.thang = p[1];
+      log.nam = p[2];
+      p += 3;
+    }
+    log.viTriLogCot = (uint16_t)(noz.cot + 1);
+    if (mask & kCot)
+    {
+      if (!getVarint(p, end, v))
+        return false;
+      log.viTriLogCot = (uint16_t)(noz.cot + 1 + unzigzag(v));
+    }
+    uint32_t sentTime = 0;
+    if (mask & kSentTime)
+    {
+      if (!getVarint(p, end, v))
+        return false;
+      sentTime = st.sentTime + unzigzag(v);
+    }
+    if (mask & kCycle)
+    {
+      if (!getVarint(p, end, v))
+        return false;
+      log.cycleSave = (uint16_t)v;
+    }
+    log.viTriLogData = posOf(id);
+    if (mask & kPos)
+    {
+      if (!getVarint(p, end, v))
+        return false;
+      log.viTriLogData = (uint16_t)v;
+    }
+
+    log.maLanBom = (uint16_t)(noz.lan + 1 + unzigzag(lan));
+    log.soLitBom = lit;
+    log.soTotalTong = noz.total + lit + unzigzag(total);
+    if (mask & kTien100)
+      log.soTienBom = (uint32_t)((uint64_t)lit * log.donGia / 100) + unzigzag(tien);
+    else if (mask & kTien1000)
+      log.soTienBom = (uint32_t)((uint64_t)lit * log.donGia / 1000) + unzigzag(tien);
+    else
+      log.soTienBom = tien;
+    log.mqttSentTime = sentTime;
+
+    uint32_t secs = st.secs;
+    if (mask & kRaw)
+    {
+      if (end - p < 8)
+        return false;
+      log.send1 = p[0];
+      log.send2 = p[1];
+      log.checksum = p[2];
+      log.send4 = p[3];
+      log.mqttSent = p[4];
+      log.gio = p[5];
+      log.phut = p[6];
+      log.giay = p[7];
+      p += 8;
+      if (!getVarint(p, end, v))
+        return false;
+      log.send3 = (uint16_t)v;
+    }
+    else
+    {
+      secs = st.secs + unzigzag(timeDelta);
+      log.gio = (uint8_t)(secs / 3600);
+      log.phut = (uint8_t)(secs / 60 % 60);
+      log.giay = (uint8_t)(secs % 60);
+      log.send1 = 1;
+      log.send2 = 2;
+      log.checksum = 3;
+      log.send4 = 4;
+      log.mqttSent = (mask & kSent) ? 1 : 0;
+      log.send3 = frameChecksum(log);
+    }
+
+    st.id = id;
+    st.idVoi = log.idVoi;
+    st.donGia = log.donGia;
+    st.ngay = log.ngay;
+    st.thang = log.thang;
+    st.nam = log.nam;
+    st.secs = secs;
+    if (sentTime != 0)
+      st.sentTime = sentTime;
+    noz.cot = log.viTriLogCot;
+    noz.lan = log.maLanBom;
+    noz.total = log.soTotalTong;
+    return true;
+  }
+};
+
+// ----------------------------------------------------------------------------
+// Archive
+// ----------------------------------------------------------------------------
+
+template <class Log>
+class LogArchive
+{
+public:
+  enum : uint8_t
+  {
+    kSegmentHeader = 16,
+    kBlockHeader = 18
+  };
+  enum : uint16_t
+  {
+    kAllNozzles = 0xFFFF
+  };
+  enum : uint8_t
+  {
+    kAnyNozzle = 0 // forEachInDays: no idVoi filter
+  };
+
+  // Block header nozzle mask bit: a prefilter only, ids 16 apart share a bit
+  static uint16_t nozzleBit(uint8_t idVoi) { return (uint16_t)(1u << (idVoi & 15)); }
+
+  explicit LogArchive(JournalMedium &medium) : m(medium), cold(NULL)
+  {
+    memset(&stats, 0, sizeof(stats));
+    reset();
+  }
+
+  // Scan segment and block headers; the pending block starts empty
+  bool begin()
+  {
+    reset();
+    segCount = m.segmentCount();
+    segSize = m.segmentSize();
+    if (segCount < 2 || segCount > LOG_ARCHIVE_MAX_SEGMENTS || segSize < kSegmentHeader + kBlockHeader + 256)
+      return false;
+    for (uint8_t s = 0; s < segCount; s++)
+    {
+      uint8_t h[kSegmentHeader];
+      if (!m.read(s, 0, h, sizeof(h)))
+        return false;
+      if (allErased(h, sizeof(h)))
+        continue;
+      if (PumpLogRecord::getU32(h) != kSegmentMagic || h[4] != LOG_ARCHIVE_VERSION ||
+          PumpLogRecord::getU16(h + 12) != LogJournal::crc16(h, 12))
+      {
+        m.erase(s); // Torn header
+        continue;
+      }
+      seg[s].seq = PumpLogRecord::getU32(h + 8);
+      if (seg[s].seq >= nextSegSeq)
+        nextSegSeq = seg[s].seq + 1;
+      scanSegment(s);
+    }
+    for (uint8_t s = 0; s < segCount; s++)
+    {
+      if (seg[s].used != 0 && (head == kNoSeg || seg[s].seq > seg[head].seq))
+        head = s;
+      if (seg[s].records > 0 && seg[s].lastId > lastOnFlash)
+        lastOnFlash = seg[s].lastId;
+    }
+    return true;
+  }
+
+  // ID a log at ring position `pos` gets if appended now; 0 = late or duplicate
+  // (at most half a ring ahead of the newest ID counts as new)
+  uint32_t idFor(uint16_t pos) const
+  {
+    if (pos < 1 || pos > LOG_ARCHIVE_RING)
+      return 0;
+    uint32_t last = lastId();
+    if (last == 0)
+      return pos;
+    uint16_t lastPos = LogArchiveCodec::posOf(last);
+    uint16_t ahead = (uint16_t)((pos + LOG_ARCHIVE_RING - lastPos) % LOG_ARCHIVE_RING);
+    if (ahead == 0 || ahead >= LOG_ARCHIVE_RING / 2)
+      return 0;
+    return last + ahead;
+  }
+
+  // Empty archive: append the logs of a ring (slots 1..LOG_ARCHIVE_RING) oldest
+  // first, i.e. starting after the newest. newestPos = 0 finds the newest by time
+  // stamp (a ring that has wrapped is not in slot order); pass a position only
+  // when it is known (checkpoint head). read(pos, log) returns false for an empty
+  // slot. Returns the number of logs appended.
+  template <class Read>
+  uint16_t seedFromRing(Read read, uint16_t newestPos = 0)
+  {
+    Log log;
+    uint64_t newestStamp = 0;
+    bool scan = newestPos == 0;
+    for (uint16_t pos = 1; pos <= LOG_ARCHIVE_RING && scan; pos++)
+    {
+      if (read(pos, log) && (newestPos == 0 || LogArchiveCodec::stampOf(log) >= newestStamp))
+      {
+        newestPos = pos;
+        newestStamp = LogArchiveCodec::stampOf(log);
+      }
+    }
+    uint16_t seeded = 0;
+    for (uint16_t i = 1, pos = newestPos; newestPos != 0 && i <= LOG_ARCHIVE_RING; i++)
+    {
+      pos = pos >= LOG_ARCHIVE_RING ? 1 : pos + 1;
+      if (read(pos, log) && append(log))
+        seeded++;
+    }
+    flush();
+    return seeded;
+  }
+
+  // Add a log (ID from its ring position). Full blocks go to the medium.
+  bool append(const Log &log)
+  {
+    uint32_t id = idFor(log.viTriLogData);
+    if (id == 0)
+    {
+      stats.skipped++;
+      return false;
+    }
+    return appendWithId(id, log);
+  }
+
+  bool appendWithId(uint32_t id, const Log &log)
+  {
+    if (id <= lastId())
+      return false;
+    uint16_t day = LogArchiveCodec::dayOf(log);
+    if (pendingCount > 0 && day != pendingDay && !flush())
+      return false;
+    if (pendingCount == 0)
+      startBlock(id, day);
+    uint8_t rec[LogArchiveCodec::kMaxRecord];
+    LogArchiveCodec::State saved = encState;
+    size_t len = LogArchiveCodec::encode(encState, id, log, rec);
+    if (pendingLen + len > LOG_ARCHIVE_BLOCK_BYTES)
+    {
+      encState = saved;
+      if (!flush())
+        return false;
+      startBlock(id, day);
+      len = LogArchiveCodec::encode(encState, id, log, rec);
+    }
+    pendingNozzles |= nozzleBit(log.idVoi);
+    memcpy(block + kBlockHeader + pendingLen, rec, len);
+    pendingLen += (uint16_t)len;
+    pendingCount++;
+    pendingLast = id;
+    stats.appended++;
+    stats.rawBytes += 40;
+    if (pendingCount >= LOG_ARCHIVE_BLOCK_RECORDS)
+      return flush();
+    return true;
+  }
+
+  // Write the pending block (possibly short) to the medium
+  bool flush()
+  {
+    if (pendingCount == 0)
+      return true;
+    block[0] = kBlockMagic;
+    block[1] = pendingCount;
+    PumpLogRecord::putU16(block + 2, pendingLen);
+    PumpLogRecord::putU32(block + 4, pendingFirst);
+    PumpLogRecord::putU32(block + 8, pendingLast);
+    PumpLogRecord::putU16(block + 12, pendingDay);
+    PumpLogRecord::putU16(block + 14, pendingNozzles);
+    PumpLogRecord::putU16(block + 16, LogJournal::crc16(block + kBlockHeader, pendingLen, LogJournal::crc16(block, 16)));
+    uint32_t size = kBlockHeader + pendingLen;
+    for (uint8_t attempt = 0; attempt < 2; attempt++)
+    {
+      if ((head == kNoSeg || seg[head].used + size > segSize) && !openSegment())
+        break;
+      if (m.program(head, seg[head].used, block, size))
+      {
+        m.flush();
+        addBlock(seg[head], pendingFirst, pendingLast, pendingCount, pendingDay);
+        seg[head].used += size;
+        lastOnFlash = pendingLast;
+        stats.blocks++;
+        stats.bytesWritten += size;
+        pendingCount = 0;
+        pendingLen = 0;
+        cacheSeg = kNoSeg;
+        return true;
+      }
+      seg[head].used = segSize; // Unknown state: seal, retry in a fresh segment
+    }
+    stats.failedWrites++;
+    return false;
+  }
+
+  // Older segments go to `tier` instead of being dropped (NULL: none). The cold
+  // archive must be begun and must not have a cold tier of its own.
+  void setColdTier(LogArchive *tier) { cold = tier; }
+  LogArchive *coldTier() const { return cold; }
+
+  // Log with global `id` (pending block included, then the cold tier)
+  bool get(uint32_t id, Log &out)
+  {
+    if (pendingCount > 0 && id >= pendingFirst && id <= pendingLast)
+      return findInBlock(block + kBlockHeader, pendingLen, pendingFirst, id, out);
+    for (uint8_t s = 0; s < segCount; s++)
+    {
+      if (seg[s].records > 0 && id >= seg[s].firstId && id <= seg[s].lastId)
+        return getFromSegment(s, id, out);
+    }
+    return cold != NULL && cold->get(id, out);
+  }
+
+  // Logs of days [fromDay, toDay] (dayKey) of nozzle `idVoi` (kAnyNozzle = all), with
+  // id >= fromId, oldest first: visit(id, log) returns false to stop (resume later
+  // from the last id + 1). Reads only the segments / blocks that can match (block
+  // nozzle mask), then compares idVoi exactly; cold tier first. Returns the number
+  // of logs visited.
+  template <class Visit>
+  uint32_t forEachInDays(uint16_t fromDay, uint16_t toDay, uint8_t idVoi, uint32_t fromId, Visit visit)
+  {
+    uint16_t nozzles = idVoi == kAnyNozzle ? (uint16_t)kAllNozzles : nozzleBit(idVoi);
+    Query q = {fromDay, toDay, nozzles, idVoi, fromId, 0, false};
+    if (cold != NULL)
+    {
+      q = cold->queryDays(q, visit);
+      if (q.stopped)
+        return q.visited;
+      if (cold->lastId() >= q.fromId)
+        q.fromId = cold->lastId() + 1;
+    }
+    return queryDays(q, visit).visited;
+  }
+
+  bool clear()
+  {
+    bool ok = cold == NULL || cold->clear();
+    for (uint8_t s = 0; s < segCount; s++)
+    {
+      if (seg[s].used != 0)
+        ok = m.erase(s) && ok;
+    }
+    uint8_t c = segCount;
+    uint32_t sz = segSize;
+    reset();
+    segCount = c;
+    segSize = sz;
+    return ok;
+  }
+
+  // Newest ID of this tier (the cold tier's are older)
+  uint32_t lastId() const { return pendingCount > 0 ? pendingLast : lastOnFlash; }
+
+  // Oldest ID of this tier
+  uint32_t firstId() const
+  {
+    uint32_t first = pendingCount > 0 ? pendingFirst : 0;
+    for (uint8_t s = 0; s < segCount; s++)
+    {
+      if (seg[s].records > 0 && (first == 0 || seg[s].firstId < first))
+        first = seg[s].firstId;
+    }
+    return first;
+  }
+
+  // Records on the medium + pending (this tier)
+  uint32_t count() const
+  {
+    uint32_t n = pendingCount;
+    for (uint8_t s = 0; s < segCount; s++)
+      n += seg[s].records;
+    return n;
+  }
+
+  uint16_t pending() const { return pendingCount; }
+
+  uint32_t bytesUsed() const
+  {
+    uint32_t n = 0;
+    for (uint8_t s = 0; s < segCount; s++)
+      n += seg[s].used;
+    return n;
+  }
+
+  uint32_t capacity() const { return (uint32_t)segCount * segSize; }
+
+  LogArchiveStats stats;
+
+private:
+  enum : uint8_t { kNoSeg = 0xFF, kBlockMagic = 0xB5 };
+  enum : uint32_t { kSegmentMagic = 0x414C504B }; // "KPLA"
+
+  struct Segment
+  {
+    uint32_t seq;
+    uint32_t used; // Write offset, 0 = free
+    uint32_t firstId;
+    uint32_t lastId;
+    uint16_t records;
+    uint16_t firstDay; // Day range of the blocks (min / max)
+    uint16_t lastDay;
+  };
+
+  struct Query
+  {
+    uint16_t fromDay, toDay, nozzles;
+    uint8_t idVoi;
+    uint32_t fromId;
+    uint32_t visited;
+    bool stopped;
+  };
+
+  // forEachInDays over this tier only
+  template <class Visit>
+  Query queryDays(Query q, Visit &visit)
+  {
+    uint8_t order[LOG_ARCHIVE_MAX_SEGMENTS];
+    uint8_t n = 0;
+    for (uint8_t s = 0; s < segCount; s++)
+    {
+      if (seg[s].records == 0 || seg[s].lastId < q.fromId || seg[s].lastDay < q.fromDay || seg[s].firstDay > q.toDay)
+        continue;
+      uint8_t i = n++;
+      while (i > 0 && seg[order[i - 1]].firstId > seg[s].firstId)
+      {
+        order[i] = order[i - 1];
+        i--;
+      }
+      order[i] = s;
+    }
+    for (uint8_t i = 0; i < n && !q.stopped; i++)
+    {
+      uint8_t s = order[i];
+      uint32_t off = kSegmentHeader;
+      uint8_t h[kBlockHeader];
+      while (!q.stopped && off + kBlockHeader <= seg[s].used && m.read(s, off, h, sizeof(h)) && h[0] == kBlockMagic)
+      {
+        uint16_t len = PumpLogRecord::getU16(h + 2);
+        if (blockMatches(q, PumpLogRecord::getU32(h + 8), PumpLogRecord::getU16(h + 12), PumpLogRecord::getU16(h + 14)))
+        {
+          cacheSeg = kNoSeg;
+          if (readBlock(s, off, h))
+            visitBlock(q, readBuf, len, PumpLogRecord::getU32(h + 4), visit);
+        }
+        off += kBlockHeader + len;
+      }
+    }
+    if (!q.stopped && pendingCount > 0 && blockMatches(q, pendingLast, pendingDay, pendingNozzles))
+      visitBlock(q, block + kBlockHeader, pendingLen, pendingFirst, visit);
+    return q;
+  }
+
+  static void addBlock(Segment &sg, uint32_t first, uint32_t last, uint8_t count, uint16_t day)
+  {
+    if (sg.records == 0)
+    {
+      sg.firstId = first;
+      sg.firstDay = sg.lastDay = day;
+    }
+    sg.lastId = last;
+    sg.records += count;
+    if (day < sg.firstDay)
+      sg.firstDay = day;
+    if (day > sg.lastDay)
+      sg.lastDay = day;
+  }
+
+  static bool blockMatches(const Query &q, uint32_t lastId, uint16_t day, uint16_t nozzles)
+  {
+    return lastId >= q.fromId && day >= q.fromDay && day <= q.toDay && (nozzles & q.nozzles) != 0;
+  }
+
+  template <class Visit>
+  static void visitBlock(Query &q, const uint8_t *data, uint16_t len, uint32_t first, Visit &visit)
+  {
+    LogArchiveCodec::State st;
+    st.reset(first);
+    const uint8_t *p = data, *end = data + len;
+    uint32_t id;
+    Log log;
+    while (p < end && LogArchiveCodec::decode(st, p, end, id, log))
+    {
+      if (id < q.fromId || (q.idVoi != kAnyNozzle && log.idVoi != q.idVoi))
+        continue;
+      q.visited++;
+      if (!visit(id, (const Log &)log))
+      {
+        q.stopped = true;
+        return;
+      }
+    }
+  }
+
+  static bool allErased(const uint8_t *p, size_t len)
+  {
+    for (size_t i = 0; i < len; i++)
+    {
+      if (p[i] != 0xFF)
+        return false;
+    }
+    return true;
+  }
+
+  void reset()
+  {
+    memset(seg, 0, sizeof(seg));
+    segCount = 0;
+    segSize = 0;
+    head = kNoSeg;
+    nextSegSeq = 1;
+    lastOnFlash = 0;
+    pendingCount = 0;
+    pendingLen = 0;
+    pendingFirst = 0;
+    pendingLast = 0;
+    pendingDay = 0;
+    pendingNozzles = 0;
+    cacheSeg = kNoSeg;
+  }
+
+  void startBlock(uint32_t firstId, uint16_t day)
+  {
+    pendingDay = day;
+    pendingNozzles = 0;
+    pendingFirst = firstId;
+    pendingLast = firstId;
+    pendingLen = 0;
+    pendingCount = 0;
+    encState.reset(firstId);
+  }
+
+  // Hop block headers; a bad tail block seals the segment
+  void scanSegment(uint8_t s)
+  {
+    Segment &sg = seg[s];
+    Segment beforeLast = sg;
+    uint32_t off = kSegmentHeader;
+    uint32_t lastOff = 0;
+    uint8_t h[kBlockHeader];
+    while (off + kBlockHeader <= segSize && m.read(s, off, h, sizeof(h)))
+    {
+      if (allErased(h, sizeof(h)))
+        break;
+      uint16_t len = PumpLogRecord::getU16(h + 2);
+      if (h[0] != kBlockMagic || h[1] == 0 || len == 0 || len > LOG_ARCHIVE_BLOCK_BYTES ||
+          off + kBlockHeader + len > segSize)
+      {
+        stats.tornTails++;
+        off = segSize;
+        break;
+      }
+      beforeLast = sg;
+      addBlock(sg, PumpLogRecord::getU32(h + 4), PumpLogRecord::getU32(h + 8), h[1], PumpLogRecord::getU16(h + 12));
+      lastOff = off;
+      off += kBlockHeader + len;
+    }
+    // Only the tail can be torn: check the last block's CRC
+    if (lastOff != 0 && !readBlock(s, lastOff, h))
+    {
+      stats.tornTails++;
+      sg = beforeLast;
+      off = segSize;
+    }
+    sg.used = off;
+  }
+
+  // Read + verify the block at (s, off) into readBuf; header left in h
+  bool readBlock(uint8_t s, uint32_t off, uint8_t *h)
+  {
+    if (!m.read(s, off, h, kBlockHeader))
+      return false;
+    uint16_t len = PumpLogRecord::getU16(h + 2);
+    if (h[0] != kBlockMagic || len == 0 || len > LOG_ARCHIVE_BLOCK_BYTES || !m.read(s, off + kBlockHeader, readBuf, len))
+      return false;
+    stats.blockReads++;
+    return PumpLogRecord::getU16(h + 16) == LogJournal::crc16(readBuf, len, LogJournal::crc16(h, 16));
+  }
+
+  bool getFromSegment(uint8_t s, uint32_t id, Log &out)
+  {
+    if (cacheSeg == s && id >= cacheFirst && id <= cacheLast)
+      return findInBlock(readBuf, cacheLen, cacheFirst, id, out);
+    uint32_t off = kSegmentHeader;
+    uint8_t h[kBlockHeader];
+    while (off + kBlockHeader <= seg[s].used && m.read(s, off, h, sizeof(h)) && h[0] == kBlockMagic)
+    {
+      uint16_t len = PumpLogRecord::getU16(h + 2);
+      uint32_t first = PumpLogRecord::getU32(h + 4);
+      uint32_t last = PumpLogRecord::getU32(h + 8);
+      if (id < first)
+        return false; // Gap between blocks
+      if (id <= last)
+      {
+        cacheSeg = kNoSeg;
+        if (!readBlock(s, off, h))
+          return false;
+        cacheSeg = s;
+        cacheFirst = first;
+        cacheLast = last;
+        cacheLen = len;
+        return findInBlock(readBuf, len, first, id, out);
+      }
+      off += kBlockHeader + len;
+    }
+    return false;
+  }
+
+  static bool findInBlock(const uint8_t *data, uint16_t len, uint32_t first, uint32_t id, Log &out)
+  {
+    LogArchiveCodec::State st;
+    st.reset(first);
+    const uint8_t *p = data, *end = data + len;
+    uint32_t got = 0;
+    while (p < end && got < id)
+    {
+      if (!LogArchiveCodec::decode(st, p, end, got, out))
+        return false;
+    }
+    return got == id;
+  }
+
+  // Next free segment after the head (ring order: even wear) as the new head;
+  // erases the oldest one when none is free
+  bool openSegment()
+  {
+    uint8_t s = kNoSeg, oldest = kNoSeg;
+    for (uint8_t k = 0; k < segCount; k++)
+    {
+      uint8_t i = (uint8_t)(((head == kNoSeg ? 0 : head + 1) + k) % segCount);
+      if (seg[i].used == 0 && s == kNoSeg)
+        s = i;
+      if (seg[i].used != 0 && i != head && (oldest == kNoSeg || seg[i].seq < seg[oldest].seq))
+        oldest = i;
+    }
+    if (s == kNoSeg)
+    {
+      if (oldest == kNoSeg)
+        return false;
+      s = oldest;
+      stats.segmentsDropped++;
+      if (cold != NULL)
+        moveToCold(s);
+      if (cacheSeg == s)
+        cacheSeg = kNoSeg;
+    }
+    // Fresh or leftovers of an interrupted erase: erase before use
+    uint8_t probe[kSegmentHeader];
+    if (seg[s].used != 0 || !m.read(s, 0, probe, sizeof(probe)) || !allErased(probe, sizeof(probe)))
+      m.erase(s);
+    memset(&seg[s], 0, sizeof(Segment));
+    uint8_t h[kSegmentHeader];
+    memset(h, 0, sizeof(h));
+    PumpLogRecord::putU32(h, kSegmentMagic);
+    h[4] = LOG_ARCHIVE_VERSION;
+    PumpLogRecord::putU32(h + 8, nextSegSeq);
+    PumpLogRecord::putU16(h + 12, LogJournal::crc16(h, 12));
+    if (!m.program(s, 0, h, sizeof(h)))
+    {
+      m.erase(s);
+      return false;
+    }
+    seg[s].seq = nextSegSeq++;
+    seg[s].used = kSegmentHeader;
+    head = s;
+    stats.bytesWritten += sizeof(h);
+    return true;
+  }
+
+  // Copy the verified blocks of segment s (about to be erased) to the cold tier, one flush
+  void moveToCold(uint8_t s)
+  {
+    uint32_t off = kSegmentHeader;
+    uint8_t h[kBlockHeader];
+    cacheSeg = kNoSeg; // readBuf is reused
+    while (off + kBlockHeader <= seg[s].used && m.read(s, off, h, sizeof(h)) && h[0] == kBlockMagic)
+    {
+      uint16_t len = PumpLogRecord::getU16(h + 2);
+      if (readBlock(s, off, h))
+        cold->takeBlock(h, readBuf, len);
+      off += kBlockHeader + len;
+    }
+    cold->m.flush();
+    stats.segmentsMoved++;
+  }
+
+  // Cold tier: append a block as read from the hot tier (header + records, CRC kept).
+  // Blocks not newer than this tier (a move repeated after a power loss) are skipped.
+  bool takeBlock(const uint8_t *h, const uint8_t *records, uint16_t len)
+  {
+    uint32_t first = PumpLogRecord::getU32(h + 4);
+    uint32_t last = PumpLogRecord::getU32(h + 8);
+    if (pendingCount > 0 || first <= lastOnFlash)
+      return false;
+    uint32_t size = kBlockHeader + len;
+    for (uint8_t attempt = 0; attempt < 2; attempt++)
+    {
+      if ((head == kNoSeg || seg[head].used + size > segSize) && !openSegment())
+        break;
+      uint32_t off = seg[head].used;
+      if (m.program(head, off, h, kBlockHeader) && m.program(head, off + kBlockHeader, records, len))
+      {
+        addBlock(seg[head], first, last, h[1], PumpLogRecord::getU16(h + 12));
+        seg[head].used += size;
+        lastOnFlash = last;
+        stats.appended += h[1];
+        stats.blocks++;
+        stats.bytesWritten += size;
+        return true;
+      }
+      seg[head].used = segSize;
+    }
+    stats.failedWrites++;
+    return false;
+  }
+
+  JournalMedium &m;
+  LogArchive *cold;
+  Segment seg[LOG_ARCHIVE_MAX_SEGMENTS];
+  uint8_t segCount;
+  uint32_t segSize;
+  uint8_t head;
+  uint32_t nextSegSeq;
+  uint32_t lastOnFlash;
+
+  // Pending block: header space + records
+  uint8_t block[kBlockHeader + LOG_ARCHIVE_BLOCK_BYTES];
+  LogArchiveCodec::State encState;
+  uint16_t pendingLen;
+  uint8_t pendingCount;
+  uint32_t pendingFirst;
+  uint32_t pendingLast;
+  uint16_t pendingDay;
+  uint16_t pendingNozzles;
+
+  // Last block read (sequential get() calls decode from RAM)
+  uint8_t readBuf[LOG_ARCHIVE_BLOCK_BYTES];
+  uint8_t cacheSeg;
+  uint32_t cacheFirst;
+  uint32_t cacheLast;
+  uint16_t cacheLen;
+};
+
+#endif // LOG_ARCHIVE_H
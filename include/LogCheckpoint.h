@@ -0,0 +1,195 @@
+#ifndef LOG_CHECKPOINT_H
+#define LOG_CHECKPOINT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include "LogJournal.h" // JournalMedium, LogJournalMark, crc16
+#include "SlotBitmap.h"
+
+// ============================================================================
+// LOG CHECKPOINT - BOOT STATE OF THE LOG STORE IN ONE SMALL RECORD
+// ============================================================================
+// What boot would otherwise rebuild by reading every stored log: the ring
+// head (newest TTL position and its lap, cycleSave), the delivery state
+// (pending-MQTT bitmap + republish cursor) and the journal mark they were
+// taken at. At boot the newest valid checkpoint is loaded and only the
+// journal records appended after its mark are read (forEachSince); without
+// one (first boot, torn write, cleared store) the full pass runs as before.
+//
+//   Record (296 B): 'KPLC' | version | 0 0 0 | gen u32 | mark seq u32 |
+//                   mark segSeq u32 | mark offset u32 | head seq u32 |
+//                   head slot u16 | head cycle u16 | republish cursor u16 |
+//                   pending count u16 | pending bitmap 256 B | crc16 | 0 0
+//   (little-endian; crc16 = CCITT over bytes 0..291)
+//
+// Records are appended one after another in a single 4 KB segment (the
+// "eeprom" partition, 13 per erase); the highest valid gen wins. When the
+// segment is full it is erased and the next record goes to offset 0: a power
+// cut in between leaves no checkpoint, i.e. one slow boot, never a wrong one.
+// Writes are rate limited by the caller (storageTask).
+//
+// Plain C++ over JournalMedium (segment 0 only).
+// ============================================================================
+
+#define LOG_CHECKPOINT_VERSION 1
+
+struct LogCheckpointState
+{
+  LogJournalMark mark;
+  uint32_t headSeq;   // Journal seq of the head LOG (detects a journal that is not this one)
+  uint16_t headSlot;  // 0 = no log yet
+  uint16_t headCycle;
+  uint16_t republishCursor;
+  SlotBitmap<LOG_JOURNAL_SLOTS> pending;
+};
+
+class LogCheckpoint
+{
+public:
+  enum : uint32_t
+  {
+    kRecordSize = 36 + SlotBitmap<LOG_JOURNAL_SLOTS>::kBytes + 4,
+    kMagic = 0x43504C4B // "KPLC"
+  };
+
+  explicit LogCheckpoint(JournalMedium &medium) : m(medium), gen(0), next(0), found(false), writes(0), erases(0) {}
+
+  // Find the newest valid record. Returns false if there is none.
+  bool begin()
+  {
+    gen = 0;
+    next = 0;
+    found = false;
+    uint32_t size = m.segmentSize();
+    uint8_t rec[kRecordSize];
+    for (uint32_t off = 0; off + kRecordSize <= size; off += kRecordSize)
+    {
+      if (!m.read(0, off, rec, sizeof(rec)))
+        break;
+      if (allErased(rec))
+        break;
+      next = off + kRecordSize; // Torn or foreign records are never programmed over
+      LogCheckpointState st;
+      uint32_t g;
+      if (decode(rec, g, st) && (!found || g > gen))
+      {
+        gen = g;
+        last = st;
+        found = true;
+      }
+    }
+    return found;
+  }
+
+  bool valid() const { return found; }
+  const LogCheckpointState &state() const { return last; }
+
+  bool write(const LogCheckpointState &st)
+  {
+    if (next + kRecordSize > m.segmentSize())
+    {
+      erases++;
+      if (!m.erase(0))
+        return false;
+      next = 0;
+    }
+    uint8_t rec[kRecordSize];
+    encode(rec, gen + 1, st);
+    uint32_t off = next;
+    next += kRecordSize; // Even if the write fails: that spot is no longer erased
+    if (!m.program(0, off, rec, sizeof(rec)))
+      return false;
+    m.flush();
+    gen++;
+    last = st;
+    found = true;
+    writes++;
+    return true;
+  }
+
+  // Forget the checkpoint (the stores it describes were cleared)
+  bool clear()
+  {
+    found = false;
+    next = 0;
+    erases++;
+    return m.erase(0);
+  }
+
+  uint32_t generation() const { return gen; }
+  uint32_t writeCount() const { return writes; } // Since boot
+  uint32_t eraseCount() const { return erases; }
+
+private:
+  static void putU16(uint8_t *p, uint16_t v)
+  {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+  }
+  static void putU32(uint8_t *p, uint32_t v)
+  {
+    for (uint8_t i = 0; i < 4; i++)
+      p[i] = (uint8_t)(v >> (8 * i));
+  }
+  static uint16_t getU16(const uint8_t *p) { return (uint16_t)(p[0] | (p[1] << 8)); }
+  static uint32_t getU32(const uint8_t *p)
+  {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+  }
+
+  static bool allErased(const uint8_t *p)
+  {
+    for (uint32_t i = 0; i < kRecordSize; i++)
+    {
+      if (p[i] != 0xFF)
+        return false;
+    }
+    return true;
+  }
+
+  static void encode(uint8_t *rec, uint32_t g, const LogCheckpointState &st)
+  {
+    memset(rec, 0, kRecordSize);
+    putU32(rec, kMagic);
+    rec[4] = LOG_CHECKPOINT_VERSION;
+    putU32(rec + 8, g);
+    putU32(rec + 12, st.mark.seq);
+    putU32(rec + 16, st.mark.segSeq);
+    putU32(rec + 20, st.mark.offset);
+    putU32(rec + 24, st.headSeq);
+    putU16(rec + 28, st.headSlot);
+    putU16(rec + 30, st.headCycle);
+    putU16(rec + 32, st.republishCursor);
+    putU16(rec + 34, st.pending.count());
+    st.pending.toBytes(rec + 36);
+    putU16(rec + kRecordSize - 4, LogJournal::crc16(rec, kRecordSize - 4));
+  }
+
+  static bool decode(const uint8_t *rec, uint32_t &g, LogCheckpointState &st)
+  {
+    if (getU32(rec) != kMagic || rec[4] != LOG_CHECKPOINT_VERSION ||
+        getU16(rec + kRecordSize - 4) != LogJournal::crc16(rec, kRecordSize - 4))
+      return false;
+    g = getU32(rec + 8);
+    st.mark.seq = getU32(rec + 12);
+    st.mark.segSeq = getU32(rec + 16);
+    st.mark.offset = getU32(rec + 20);
+    st.headSeq = getU32(rec + 24);
+    st.headSlot = getU16(rec + 28);
+    st.headCycle = getU16(rec + 30);
+    st.republishCursor = getU16(rec + 32);
+    st.pending.fromBytes(rec + 36);
+    return st.pending.count() == getU16(rec + 34) && st.headSlot <= LOG_JOURNAL_SLOTS;
+  }
+
+  JournalMedium &m;
+  uint32_t gen;
+  uint32_t next; // Offset of the next record
+  bool found;
+  LogCheckpointState last;
+  uint32_t writes;
+  uint32_t erases;
+};
+
+#endif // LOG_CHECKPOINT_H
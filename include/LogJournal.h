@@ -0,0 +1,752 @@
+#ifndef LOG_JOURNAL_H
+#define LOG_JOURNAL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+// ============================================================================
+// LOG JOURNAL - APPEND-ONLY, CRASH-CONSISTENT STORE FOR THE 2046 LOG SLOTS
+// ============================================================================
+// Replaces seek-and-overwrite in /log.bin. The medium is split into equal
+// segments; records are only ever appended to the newest (head) segment:
+//
+//   Segment header (20 B): 'KPLJ' | version | 0 0 0 | seq u32 | victim seq u32 | crc16 | 0 0
+//   Record (4-byte aligned): 0xA7 | type | slot u16 | seq u32 | len | format | crc16 | payload
+//   (little-endian; crc16 = CCITT over header bytes 0..9 + payload; format is
+//   the caller's payload layout version, 0 for records written before it existed)
+//
+//   LOG     full log for a slot (1..2046), supersedes everything before it
+//   STATUS  small MQTT delivery update for the slot's current LOG
+//
+// A RAM index keeps, per slot, where the newest LOG and the newest STATUS
+// after it live (2 x uint16_t: segment << 12 | offset / 4). The index is
+// rebuilt at boot from the record sequence numbers: the highest seq wins, a
+// STATUS only counts if it is newer than the slot's LOG. A torn record (bad
+// CRC, power cut mid-write) ends its segment; the segment is sealed and
+// appends continue in a fresh one, so a bad tail is never programmed over.
+//
+// Compaction: one segment is always kept free. When the head is full and
+// only that spare is left, it becomes the compaction target: the live
+// records of the segment with the fewest live records are copied into it
+// (original seq kept), then that victim is erased. The target's header
+// names the victim, so a compaction cut short by a reboot is rolled back at
+// boot (target erased, victim intact) and simply runs again later.
+//
+// Wear: a new head is the next free segment after the current one in ring
+// order, so erases spread evenly over the medium.
+//
+// Plain C++ over JournalMedium (a raw partition or LittleFS files in the
+// firmware, RAM / a file in the host benchmarks).
+// ============================================================================
+
+#define LOG_JOURNAL_SLOTS 2046
+#define LOG_JOURNAL_MAX_SEGMENTS 16
+#define LOG_JOURNAL_MAX_SEGMENT_SIZE 16384 // Offset / 4 must fit in 12 bits
+#define LOG_JOURNAL_MAX_PAYLOAD 64
+#define LOG_JOURNAL_VERSION 1
+
+enum LogJournalType : uint8_t
+{
+  JOURNAL_REC_LOG = 1,
+  JOURNAL_REC_STATUS = 2
+};
+
+// Storage underneath the journal. Bytes never programmed since the last
+// erase read back as 0xFF; program() is only called on such bytes, with
+// increasing offsets inside a segment. An erase cut short may leave any mix
+// of old and erased bytes.
+class JournalMedium
+{
+public:
+  virtual ~JournalMedium() {}
+  virtual uint32_t segmentSize() const = 0;
+  virtual uint8_t segmentCount() const = 0;
+  virtual bool read(uint8_t seg, uint32_t off, void *buf, size_t len) = 0;
+  virtual bool program(uint8_t seg, uint32_t off, const void *buf, size_t len) = 0;
+  virtual bool erase(uint8_t seg) = 0;
+  virtual void flush() {} // Make programmed bytes durable (close / fsync)
+};
+
+// Forwards to `primary`, or to `fallback` after useFallback() (before begin():
+// the geometry is read there). Lets the journal pick its storage at boot.
+class JournalMediumSelector : public JournalMedium
+{
+public:
+  JournalMediumSelector(JournalMedium &primary, JournalMedium &fallback) : primary(primary), fallback(fallback), m(&primary) {}
+
+  void useFallback() { m = &fallback; }
+  bool usingFallback() const { return m == &fallback; }
+
+  uint32_t segmentSize() const override { return m->segmentSize(); }
+  uint8_t segmentCount() const override { return m->segmentCount(); }
+  bool read(uint8_t seg, uint32_t off, void *buf, size_t len) override { return m->read(seg, off, buf, len); }
+  bool program(uint8_t seg, uint32_t off, const void *buf, size_t len) override { return m->program(seg, off, buf, len); }
+  bool erase(uint8_t seg) override { return m->erase(seg); }
+  void flush() override { m->flush(); }
+
+private:
+  JournalMedium &primary;
+  JournalMedium &fallback;
+  JournalMedium *m;
+};
+
+struct LogJournalStats
+{
+  uint32_t logAppends;
+  uint32_t statusAppends;
+  uint32_t bytesWritten;  // Headers + payload + padding, compaction copies included
+  uint32_t compactions;
+  uint32_t recordsCopied;
+  uint32_t erases;
+  uint32_t tornTails;     // Segments sealed at boot after a bad record
+  uint32_t undoneCompactions; // Interrupted compactions rolled back at boot
+  uint32_t failedWrites;
+};
+
+// Append position: records written after mark() have seq >= seq and live in the
+// segment that was the head (at or after offset) or in segments opened later
+struct LogJournalMark
+{
+  uint32_t seq;
+  uint32_t segSeq;
+  uint32_t offset;
+};
+
+class LogJournal
+{
+public:
+  enum : uint8_t
+  {
+    kRecordHeader = 12,
+    kSegmentHeader = 20
+  };
+
+  explicit LogJournal(JournalMedium &medium) : m(medium)
+  {
+    memset(&stats, 0, sizeof(stats));
+    reset();
+  }
+
+  static uint16_t crc16(const uint8_t *data, size_t len, uint16_t crc = 0xFFFF)
+  {
+    for (size_t i = 0; i < len; i++)
+    {
+      crc ^= (uint16_t)data[i] << 8;
+      for (uint8_t b = 0; b < 8; b++)
+        crc = crc & 0x8000 ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+    }
+    return crc;
+  }
+
+  static uint32_t recordSize(uint8_t payloadLen) { return (kRecordHeader + payloadLen + 3u) & ~3u; }
+
+  // Scan the medium and rebuild the index. Returns false if the medium is
+  // unusable or the temporary scan table (16 KB) cannot be allocated.
+  bool begin()
+  {
+    reset();
+    segCount = m.segmentCount();
+    segSize = m.segmentSize();
+    if (segCount < 3 || segCount > LOG_JOURNAL_MAX_SEGMENTS || segSize > LOG_JOURNAL_MAX_SEGMENT_SIZE ||
+        segSize < kSegmentHeader + recordSize(LOG_JOURNAL_MAX_PAYLOAD))
+      return false;
+
+    // Classify segments
+    uint32_t victimOf[LOG_JOURNAL_MAX_SEGMENTS];
+    for (uint8_t s = 0; s < segCount; s++)
+    {
+      uint8_t h[kSegmentHeader];
+      victimOf[s] = 0;
+      if (!m.read(s, 0, h, sizeof(h)))
+        return false;
+      if (allErased(h, sizeof(h)))
+        continue; // Free (leftovers are checked before reuse)
+      if (!parseSegmentHeader(h, segSeq[s], victimOf[s]))
+      {
+        eraseSegment(s); // Torn header: nothing behind it can be trusted
+        continue;
+      }
+      used[s] = kSegmentHeader;
+      if (segSeq[s] >= nextSegSeq)
+        nextSegSeq = segSeq[s] + 1;
+    }
+
+    // Roll back compactions whose victim still exists
+    for (uint8_t s = 0; s < segCount; s++)
+    {
+      for (uint8_t v = 0; v < segCount && used[s] != 0 && victimOf[s] != 0; v++)
+      {
+        if (v != s && used[v] != 0 && segSeq[v] == victimOf[s])
+        {
+          eraseSegment(s);
+          stats.undoneCompactions++;
+        }
+      }
+    }
+
+    // Highest seq per slot wins
+    uint32_t *seqs = (uint32_t *)calloc(2 * LOG_JOURNAL_SLOTS, sizeof(uint32_t));
+    if (!seqs)
+      return false;
+    for (uint8_t s = 0; s < segCount; s++)
+    {
+      if (used[s] != 0)
+        scanSegment(s, seqs);
+    }
+    for (uint16_t i = 0; i < LOG_JOURNAL_SLOTS; i++)
+    {
+      if (logLoc[i] == kNoLoc || seqs[LOG_JOURNAL_SLOTS + i] < seqs[i])
+        statusLoc[i] = kNoLoc; // Status of an older transaction
+    }
+    free(seqs);
+
+    // Newest segment is the head
+    for (uint8_t s = 0; s < segCount; s++)
+    {
+      if (used[s] != 0 && (head == kNoSeg || segSeq[s] > segSeq[head]))
+        head = s;
+    }
+    return true;
+  }
+
+  // Append a record; updates the index. Returns false if the medium failed or is full.
+  bool append(LogJournalType type, uint16_t slot, const void *payload, uint8_t len, uint8_t format = 0)
+  {
+    if (!validSlot(slot) || len > LOG_JOURNAL_MAX_PAYLOAD)
+      return false;
+    if (type == JOURNAL_REC_STATUS && logLoc[slot - 1] == kNoLoc)
+      return false; // Nothing to amend
+    uint8_t rec[kRecordHeader + LOG_JOURNAL_MAX_PAYLOAD + 3];
+    uint32_t size = buildRecord(rec, type, slot, nextSeq, (const uint8_t *)payload, len, format);
+    uint16_t loc;
+    if (!writeRecord(rec, size, loc))
+    {
+      stats.failedWrites++;
+      return false;
+    }
+    nextSeq++;
+    if (type == JOURNAL_REC_LOG)
+    {
+      logLoc[slot - 1] = loc;
+      statusLoc[slot - 1] = kNoLoc; // New transaction: older status no longer applies
+      stats.logAppends++;
+    }
+    else
+    {
+      statusLoc[slot - 1] = loc;
+      stats.statusAppends++;
+    }
+    return true;
+  }
+
+  // Payload of the newest record of `type` for `slot`. len = payload length, format as appended.
+  bool read(LogJournalType type, uint16_t slot, void *payload, uint8_t cap, uint8_t &len)
+  {
+    uint8_t format;
+    return read(type, slot, payload, cap, len, format);
+  }
+
+  bool read(LogJournalType type, uint16_t slot, void *payload, uint8_t cap, uint8_t &len, uint8_t &format)
+  {
+    if (!validSlot(slot))
+      return false;
+    uint16_t loc = type == JOURNAL_REC_LOG ? logLoc[slot - 1] : statusLoc[slot - 1];
+    if (loc == kNoLoc)
+      return false;
+    uint8_t rec[kRecordHeader + LOG_JOURNAL_MAX_PAYLOAD];
+    if (!readRecord(locSeg(loc), locOff(loc), rec) || rec[1] != type || getU16(rec + 2) != slot || rec[8] > cap)
+      return false;
+    len = rec[8];
+    format = rec[9];
+    memcpy(payload, rec + kRecordHeader, len);
+    return true;
+  }
+
+  // Visit the live record of `type` of every slot: visit(slot, payload, len, format).
+  // Goes one segment at a time so the medium reads stay inside one file /
+  // region. Returns the number of records visited.
+  template <typename Visitor>
+  uint16_t forEachLive(LogJournalType type, Visitor visit)
+  {
+    const uint16_t *locs = type == JOURNAL_REC_LOG ? logLoc : statusLoc;
+    uint8_t rec[kRecordHeader + LOG_JOURNAL_MAX_PAYLOAD];
+    uint16_t n = 0;
+    for (uint8_t s = 0; s < segCount; s++)
+    {
+      for (uint16_t i = 0; i < LOG_JOURNAL_SLOTS; i++)
+      {
+        if (locs[i] == kNoLoc || locSeg(locs[i]) != s || !readRecord(s, locOff(locs[i]), rec) || rec[1] != type)
+          continue;
+        visit((uint16_t)(i + 1), rec + kRecordHeader, rec[8], rec[9]);
+        n++;
+      }
+    }
+    return n;
+  }
+
+  // Live record of `type` for `count` slots from `first`, wrapping after the last slot,
+  // in slot order: visit(slot, payload, len, format). Neighbouring slots are mostly
+  // neighbours on the medium, so reads go through a 512-byte read-ahead window
+  // (one medium read per ~9 LOG records instead of two per record).
+  template <typename Visitor>
+  uint16_t forEachInRange(LogJournalType type, uint16_t first, uint16_t count, Visitor visit)
+  {
+    if (!validSlot(first))
+      return 0;
+    const uint16_t *locs = type == JOURNAL_REC_LOG ? logLoc : statusLoc;
+    uint8_t window[512];
+    uint8_t winSeg = kNoSeg;
+    uint32_t winOff = 0, winLen = 0;
+    uint8_t rec[kRecordHeader + LOG_JOURNAL_MAX_PAYLOAD];
+    uint16_t n = 0;
+    uint16_t slot = first;
+    for (uint16_t i = 0; i < count && i < LOG_JOURNAL_SLOTS; i++, slot = slot >= LOG_JOURNAL_SLOTS ? 1 : slot + 1)
+    {
+      uint16_t loc = locs[slot - 1];
+      if (loc == kNoLoc)
+        continue;
+      uint8_t s = locSeg(loc);
+      uint32_t off = locOff(loc);
+      uint32_t need = segSize - off < sizeof(rec) ? segSize - off : (uint32_t)sizeof(rec);
+      if (s != winSeg || off < winOff || off + need > winOff + winLen)
+      {
+        winLen = segSize - off < sizeof(window) ? segSize - off : (uint32_t)sizeof(window);
+        winSeg = m.read(s, off, window, winLen) ? s : (uint8_t)kNoSeg;
+        winOff = off;
+        if (winSeg == kNoSeg)
+          continue;
+      }
+      const uint8_t *p = window + (off - winOff);
+      if (need < kRecordHeader || p[8] > LOG_JOURNAL_MAX_PAYLOAD || recordSize(p[8]) > need)
+        continue;
+      memcpy(rec, p, kRecordHeader + p[8]);
+      if (!verifyRecord(rec) || rec[1] != type || getU16(rec + 2) != slot)
+        continue;
+      visit(slot, rec + kRecordHeader, rec[8], rec[9]);
+      n++;
+    }
+    return n;
+  }
+
+  LogJournalMark mark() const
+  {
+    LogJournalMark mk = {nextSeq, head == kNoSeg ? nextSegSeq : segSeq[head], head == kNoSeg ? 0 : used[head]};
+    return mk;
+  }
+
+  // Seq of the live record of `type` for `slot`
+  bool recordSeq(LogJournalType type, uint16_t slot, uint32_t &seq)
+  {
+    if (!validSlot(slot))
+      return false;
+    uint16_t loc = type == JOURNAL_REC_LOG ? logLoc[slot - 1] : statusLoc[slot - 1];
+    uint8_t h[kRecordHeader];
+    if (loc == kNoLoc || !m.read(locSeg(loc), locOff(loc), h, sizeof(h)) || h[0] != kRecordMagic ||
+        h[1] != type || getU16(h + 2) != slot)
+      return false;
+    seq = getU32(h + 4);
+    return true;
+  }
+
+  // Live records of `type` appended since `since` (a mark() taken earlier):
+  // visit(slot, seq, payload, len, format). Reads only the segments that can hold
+  // them, sequentially, so the cost follows what was written since, not the
+  // size of the journal. Compaction copies keep their old seq and are skipped.
+  template <typename Visitor>
+  uint16_t forEachSince(LogJournalType type, const LogJournalMark &since, Visitor visit)
+  {
+    const uint16_t *locs = type == JOURNAL_REC_LOG ? logLoc : statusLoc;
+    uint8_t buf[512];
+    uint16_t n = 0;
+    for (uint8_t s = 0; s < segCount; s++)
+    {
+      if (used[s] == 0 || segSeq[s] < since.segSeq)
+        continue;
+      uint32_t off = segSeq[s] == since.segSeq && since.offset > kSegmentHeader ? since.offset : (uint32_t)kSegmentHeader;
+      uint32_t bufOff = 0, bufLen = 0;
+      while (off + kRecordHeader <= used[s])
+      {
+        if (bufLen == 0 || (off + recordSize(LOG_JOURNAL_MAX_PAYLOAD) > bufOff + bufLen && bufOff + bufLen < used[s]))
+        {
+          bufOff = off;
+          bufLen = used[s] - off < sizeof(buf) ? used[s] - off : (uint32_t)sizeof(buf);
+          if (!m.read(s, bufOff, buf, bufLen))
+            break;
+        }
+        const uint8_t *rec = buf + (off - bufOff);
+        uint32_t size = recordSize(rec[8]);
+        if (rec[8] > LOG_JOURNAL_MAX_PAYLOAD || off + size > bufOff + bufLen || !verifyRecord(rec))
+          break; // Sealed tail
+        uint16_t slot = getU16(rec + 2);
+        uint32_t seq = getU32(rec + 4);
+        if (rec[1] == type && seq >= since.seq && validSlot(slot) && locs[slot - 1] == makeLoc(s, off))
+        {
+          visit(slot, seq, rec + kRecordHeader, rec[8], rec[9]);
+          n++;
+        }
+        off += size;
+      }
+    }
+    return n;
+  }
+
+  bool hasLog(uint16_t slot) const { return validSlot(slot) && logLoc[slot - 1] != kNoLoc; }
+  bool hasStatus(uint16_t slot) const { return validSlot(slot) && statusLoc[slot - 1] != kNoLoc; }
+
+  // Slots holding a log
+  uint16_t count() const
+  {
+    uint16_t n = 0;
+    for (uint16_t i = 0; i < LOG_JOURNAL_SLOTS; i++)
+    {
+      if (logLoc[i] != kNoLoc)
+        n++;
+    }
+    return n;
+  }
+
+  // Erase everything
+  bool clear()
+  {
+    bool ok = true;
+    for (uint8_t s = 0; s < segCount; s++)
+    {
+      if (used[s] != 0)
+        ok = eraseSegment(s) && ok;
+    }
+    uint8_t c = segCount;
+    uint32_t sz = segSize;
+    reset();
+    segCount = c;
+    segSize = sz;
+    return ok;
+  }
+
+  uint8_t freeSegments() const
+  {
+    uint8_t n = 0;
+    for (uint8_t s = 0; s < segCount; s++)
+    {
+      if (used[s] == 0)
+        n++;
+    }
+    return n;
+  }
+
+  // Bytes in use on the medium (segment headers, live and dead records)
+  uint32_t bytesUsed() const
+  {
+    uint32_t n = 0;
+    for (uint8_t s = 0; s < segCount; s++)
+      n += used[s];
+    return n;
+  }
+
+  // Make appended records durable (littlefs: commit the cached tail). Appends
+  // between two sync() calls are the data at risk on a power cut.
+  void sync() { m.flush(); }
+
+  uint32_t capacity() const { return (uint32_t)segCount * segSize; }
+  uint32_t sequence() const { return nextSeq; }
+
+  LogJournalStats stats;
+
+private:
+  enum : uint16_t { kNoLoc = 0xFFFF };
+  enum : uint8_t { kNoSeg = 0xFF, kRecordMagic = 0xA7 };
+  enum : uint32_t { kSegmentMagic = 0x4A4C504B }; // "KPLJ"
+
+  static bool validSlot(uint16_t slot) { return slot >= 1 && slot <= LOG_JOURNAL_SLOTS; }
+  static uint16_t makeLoc(uint8_t seg, uint32_t off) { return (uint16_t)((seg << 12) | (off >> 2)); }
+  static uint8_t locSeg(uint16_t loc) { return loc >> 12; }
+  static uint32_t locOff(uint16_t loc) { return (uint32_t)(loc & 0x0FFF) << 2; }
+
+  static uint16_t getU16(const uint8_t *p) { return (uint16_t)(p[0] | (p[1] << 8)); }
+  static uint32_t getU32(const uint8_t *p)
+  {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+  }
+  static void putU16(uint8_t *p, uint16_t v)
+  {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+  }
+  static void putU32(uint8_t *p, uint32_t v)
+  {
+    for (uint8_t i = 0; i < 4; i++)
+      p[i] = (uint8_t)(v >> (8 * i));
+  }
+
+  static bool allErased(const uint8_t *p, size_t len)
+  {
+    for (size_t i = 0; i < len; i++)
+    {
+      if (p[i] != 0xFF)
+        return false;
+    }
+    return true;
+  }
+
+  void reset()
+  {
+    memset(logLoc, 0xFF, sizeof(logLoc));
+    memset(statusLoc, 0xFF, sizeof(statusLoc));
+    memset(segSeq, 0, sizeof(segSeq));
+    memset(used, 0, sizeof(used));
+    head = kNoSeg;
+    nextSeq = 1;
+    nextSegSeq = 1;
+    compacting = false;
+    segCount = 0;
+    segSize = 0;
+  }
+
+  static bool parseSegmentHeader(const uint8_t *h, uint32_t &seq, uint32_t &victimSeq)
+  {
+    if (getU32(h) != kSegmentMagic || h[4] != LOG_JOURNAL_VERSION || getU16(h + 16) != crc16(h, 16))
+      return false;
+    seq = getU32(h + 8);
+    victimSeq = getU32(h + 12);
+    return true;
+  }
+
+  static uint32_t buildRecord(uint8_t *rec, uint8_t type, uint16_t slot, uint32_t seq, const uint8_t *payload,
+                              uint8_t len, uint8_t format)
+  {
+    uint32_t size = recordSize(len);
+    memset(rec, 0, size);
+    rec[0] = kRecordMagic;
+    rec[1] = type;
+    putU16(rec + 2, slot);
+    putU32(rec + 4, seq);
+    rec[8] = len;
+    rec[9] = format;
+    memcpy(rec + kRecordHeader, payload, len);
+    putU16(rec + 10, crc16(rec + kRecordHeader, len, crc16(rec, 10)));
+    return size;
+  }
+
+  // Reads and verifies a record at (seg, off) into rec (header + payload)
+  bool readRecord(uint8_t seg, uint32_t off, uint8_t *rec)
+  {
+    if (off + kRecordHeader > segSize || !m.read(seg, off, rec, kRecordHeader))
+      return false;
+    if (rec[0] != kRecordMagic || rec[8] > LOG_JOURNAL_MAX_PAYLOAD || off + recordSize(rec[8]) > segSize)
+      return false;
+    if (rec[8] > 0 && !m.read(seg, off + kRecordHeader, rec + kRecordHeader, rec[8]))
+      return false;
+    return verifyRecord(rec);
+  }
+
+  static bool verifyRecord(const uint8_t *rec)
+  {
+    return rec[0] == kRecordMagic && rec[8] <= LOG_JOURNAL_MAX_PAYLOAD &&
+           getU16(rec + 10) == crc16(rec + kRecordHeader, rec[8], crc16(rec, 10));
+  }
+
+  // Sequential scan through a read-ahead buffer (one medium read per 512 bytes)
+  void scanSegment(uint8_t s, uint32_t *seqs)
+  {
+    uint8_t buf[512];
+    uint32_t bufOff = 0, bufLen = 0;
+    uint32_t off = kSegmentHeader;
+    while (off + kRecordHeader <= segSize)
+    {
+      if (off + recordSize(LOG_JOURNAL_MAX_PAYLOAD) > bufOff + bufLen && bufOff + bufLen < segSize)
+      {
+        bufOff = off;
+        bufLen = segSize - off < sizeof(buf) ? segSize - off : (uint32_t)sizeof(buf);
+        if (!m.read(s, bufOff, buf, bufLen))
+          break;
+      }
+      const uint8_t *rec = buf + (off - bufOff);
+      uint32_t size = recordSize(rec[8]);
+      if (rec[8] > LOG_JOURNAL_MAX_PAYLOAD || off + size > segSize || !verifyRecord(rec))
+      {
+        if (!allErased(rec, kRecordHeader))
+        {
+          stats.tornTails++;
+          off = segSize; // Seal: never program over a torn record
+        }
+        break;
+      }
+      uint32_t seq = getU32(rec + 4);
+      uint16_t slot = getU16(rec + 2);
+      if (seq >= nextSeq)
+        nextSeq = seq + 1;
+      if (validSlot(slot) && (rec[1] == JOURNAL_REC_LOG || rec[1] == JOURNAL_REC_STATUS))
+      {
+        bool status = rec[1] == JOURNAL_REC_STATUS;
+        uint32_t &newest = seqs[(status ? LOG_JOURNAL_SLOTS : 0) + slot - 1];
+        if (seq >= newest)
+        {
+          newest = seq;
+          (status ? statusLoc : logLoc)[slot - 1] = makeLoc(s, off);
+        }
+      }
+      off += size;
+    }
+    used[s] = off;
+  }
+
+  bool eraseSegment(uint8_t s)
+  {
+    stats.erases++;
+    used[s] = 0;
+    return m.erase(s);
+  }
+
+  bool writeRecord(const uint8_t *rec, uint32_t size, uint16_t &loc)
+  {
+    if (head == kNoSeg || used[head] + size > segSize)
+    {
+      if (compacting || !rotate())
+        return false;
+    }
+    if (!m.program(head, used[head], rec, size))
+    {
+      used[head] = segSize; // Unknown state: seal the segment
+      return false;
+    }
+    loc = makeLoc(head, used[head]);
+    used[head] += size;
+    stats.bytesWritten += size;
+    return true;
+  }
+
+  // Make `s` the head; victimSeq != 0 marks it as a compaction target
+  bool openSegment(uint8_t s, uint32_t victimSeq)
+  {
+    uint8_t chunk[256];
+    for (uint32_t off = 0; off < segSize; off += sizeof(chunk))
+    {
+      uint32_t n = segSize - off < sizeof(chunk) ? segSize - off : (uint32_t)sizeof(chunk);
+      if (!m.read(s, off, chunk, n))
+        return false;
+      if (!allErased(chunk, n))
+      {
+        eraseSegment(s); // Leftovers of an erase cut short
+        break;
+      }
+    }
+    uint8_t h[kSegmentHeader];
+    memset(h, 0, sizeof(h));
+    putU32(h, kSegmentMagic);
+    h[4] = LOG_JOURNAL_VERSION;
+    putU32(h + 8, nextSegSeq);
+    putU32(h + 12, victimSeq);
+    putU16(h + 16, crc16(h, 16));
+    segSeq[s] = nextSegSeq++;
+    used[s] = kSegmentHeader;
+    head = s;
+    if (!m.program(s, 0, h, sizeof(h)))
+    {
+      eraseSegment(s);
+      head = kNoSeg;
+      return false;
+    }
+    stats.bytesWritten += sizeof(h);
+    return true;
+  }
+
+  // Head is full: open a fresh segment, or compact into the last spare one
+  bool rotate()
+  {
+    for (uint8_t tries = 0; tries < segCount; tries++)
+    {
+      uint8_t fresh = kNoSeg;
+      for (uint8_t i = 1; i <= segCount && fresh == kNoSeg; i++)
+      {
+        uint8_t s = (uint8_t)(((head == kNoSeg ? 0 : head + 1) + i - 1) % segCount); // Ring order after the head
+        if (used[s] == 0)
+          fresh = s;
+      }
+      if (fresh == kNoSeg)
+        return false;
+      if (freeSegments() >= 2)
+        return openSegment(fresh, 0);
+      if (!compact(fresh))
+        return false;
+      if (used[head] + recordSize(LOG_JOURNAL_MAX_PAYLOAD) <= segSize)
+        return true; // Copies left room for new records
+    }
+    return false; // Live data fills the medium: journal full
+  }
+
+  // Copy the live records of the emptiest segment into `target`, then erase it
+  bool compact(uint8_t target)
+  {
+    uint16_t live[LOG_JOURNAL_MAX_SEGMENTS];
+    memset(live, 0, sizeof(live));
+    for (uint16_t i = 0; i < LOG_JOURNAL_SLOTS; i++)
+    {
+      if (logLoc[i] != kNoLoc)
+        live[locSeg(logLoc[i])]++;
+      if (statusLoc[i] != kNoLoc)
+        live[locSeg(statusLoc[i])]++;
+    }
+    uint8_t victim = kNoSeg;
+    for (uint8_t s = 0; s < segCount; s++)
+    {
+      if (used[s] == 0 || s == target)
+        continue;
+      if (victim == kNoSeg || live[s] < live[victim] || (live[s] == live[victim] && segSeq[s] < segSeq[victim]))
+        victim = s;
+    }
+    if (victim == kNoSeg)
+      return false;
+    bool ok = openSegment(target, segSeq[victim]);
+
+    compacting = true;
+    uint8_t rec[kRecordHeader + LOG_JOURNAL_MAX_PAYLOAD + 3];
+    for (uint16_t i = 0; i < LOG_JOURNAL_SLOTS && ok; i++)
+    {
+      if (logLoc[i] != kNoLoc && locSeg(logLoc[i]) == victim)
+        ok = copyRecord(logLoc[i], rec);
+      if (ok && statusLoc[i] != kNoLoc && locSeg(statusLoc[i]) == victim)
+        ok = copyRecord(statusLoc[i], rec);
+    }
+    compacting = false;
+    if (!ok)
+    {
+      // Index points into a half-written target: rebuild, which rolls it back
+      stats.failedWrites++;
+      begin();
+      return false;
+    }
+    eraseSegment(victim);
+    stats.compactions++;
+    return true;
+  }
+
+  // Move one record, keeping its seq (the index entry follows it)
+  bool copyRecord(uint16_t from, uint8_t *rec)
+  {
+    if (!readRecord(locSeg(from), locOff(from), rec))
+      return false;
+    uint32_t size = recordSize(rec[8]);
+    memset(rec + kRecordHeader + rec[8], 0, size - kRecordHeader - rec[8]);
+    uint16_t loc;
+    if (!writeRecord(rec, size, loc))
+      return false;
+    (rec[1] == JOURNAL_REC_STATUS ? statusLoc : logLoc)[getU16(rec + 2) - 1] = loc;
+    stats.recordsCopied++;
+    return true;
+  }
+
+  JournalMedium &m;
+  uint16_t logLoc[LOG_JOURNAL_SLOTS];
+  uint16_t statusLoc[LOG_JOURNAL_SLOTS];
+  uint32_t segSeq[LOG_JOURNAL_MAX_SEGMENTS];
+  uint32_t used[LOG_JOURNAL_MAX_SEGMENTS]; // Write offset, 0 = erased / free
+  uint8_t segCount;
+  uint32_t segSize;
+  uint8_t head;
+  uint32_t nextSeq;
+  uint32_t nextSegSeq;
+  bool compacting;
+};
+
+#endif // LOG_JOURNAL_H
@@ -0,0 +1,159 @@
+#ifndef LOG_JOURNAL_FS_H
+#define LOG_JOURNAL_FS_H
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include "LogJournal.h"
+
+// ============================================================================
+// LOG JOURNAL ON LITTLEFS - ONE FILE PER SEGMENT
+// ============================================================================
+// <prefix>00.seg .. , 16 KB each: the journal uses /jl00..15 (256 KB of the
+// LittleFS partition), the log archive /ar00..11 (192 KB). Since the raw
+// partition store (LogJournalPartition.h) this is the fallback, and the
+// files of older firmware are moved over once at boot.
+// A segment file only grows; erase() deletes it. Bytes past the end of a
+// file read back as 0xFF, like erased flash. Used by storageTask only.
+//
+// The segment being appended to stays open ("r+"): program() only writes
+// into the littlefs cache, flush() commits it (one metadata commit and one
+// tail-block copy per group of records instead of per record). Reads of
+// that segment go through the same handle so unflushed records are seen.
+// A second handle stays open on the last segment read (compaction, replays).
+// ============================================================================
+
+#define LOG_JOURNAL_FS_SEGMENTS 16
+#define LOG_JOURNAL_FS_SEGMENT_SIZE 16384
+
+class LittleFSJournalMedium : public JournalMedium
+{
+public:
+  // prefix: path without the segment number (at most 8 chars)
+  explicit LittleFSJournalMedium(const char *prefix = "/jl", uint8_t segments = LOG_JOURNAL_FS_SEGMENTS)
+      : prefix(prefix), segments(segments), writeSeg(kNone), readSeg(kNone)
+  {
+  }
+
+  uint32_t segmentSize() const override { return LOG_JOURNAL_FS_SEGMENT_SIZE; }
+  uint8_t segmentCount() const override { return segments; }
+
+  bool read(uint8_t seg, uint32_t off, void *buf, size_t len) override
+  {
+    memset(buf, 0xFF, len);
+    File *f = &writeFile;
+    if (seg != writeSeg)
+    {
+      if (seg != readSeg)
+      {
+        closeRead();
+        char path[16];
+        segmentPath(seg, path);
+        if (!LittleFS.exists(path))
+          return true; // Never written
+        readFile = LittleFS.open(path, "r");
+        if (!readFile)
+          return false;
+        readSeg = seg;
+      }
+      f = &readFile;
+    }
+    size_t size = f->size();
+    if (off < size)
+    {
+      f->seek(off, SeekSet);
+      f->read((uint8_t *)buf, len < size - off ? len : size - off);
+    }
+    return true;
+  }
+
+  bool program(uint8_t seg, uint32_t off, const void *buf, size_t len) override
+  {
+    if (seg != writeSeg)
+    {
+      closeWrite();
+      if (seg == readSeg)
+        closeRead(); // Its view would go stale
+      char path[16];
+      segmentPath(seg, path);
+      writeFile = LittleFS.open(path, LittleFS.exists(path) ? "r+" : "w+");
+      if (!writeFile)
+        return false;
+      writeSeg = seg;
+    }
+    size_t size = writeFile.size();
+    if (size > off)
+      return false; // Would overwrite: the journal never does that
+    writeFile.seek(size, SeekSet);
+    while (size < off)
+    {
+      writeFile.write(0xFF); // Gap left by a sealed tail
+      size++;
+    }
+    return writeFile.write((const uint8_t *)buf, len) == len;
+  }
+
+  bool erase(uint8_t seg) override
+  {
+    if (seg == writeSeg)
+      closeWrite();
+    if (seg == readSeg)
+      closeRead();
+    char path[16];
+    segmentPath(seg, path);
+    return !LittleFS.exists(path) || LittleFS.remove(path);
+  }
+
+  void flush() override
+  {
+    if (writeSeg != kNone)
+      writeFile.flush();
+  }
+
+  // Any segment file present (data left to migrate)
+  bool hasSegments() const
+  {
+    char path[16];
+    for (uint8_t s = 0; s < segments; s++)
+    {
+      segmentPath(s, path);
+      if (LittleFS.exists(path))
+        return true;
+    }
+    return false;
+  }
+
+  // Release both handles (before unmount / format)
+  void close()
+  {
+    closeWrite();
+    closeRead();
+  }
+
+private:
+  enum : uint8_t { kNone = 0xFF };
+
+  void segmentPath(uint8_t seg, char (&path)[16]) const { snprintf(path, sizeof(path), "%s%02u.seg", prefix, seg); }
+
+  void closeWrite()
+  {
+    if (writeSeg != kNone)
+      writeFile.close();
+    writeSeg = kNone;
+  }
+
+  void closeRead()
+  {
+    if (readSeg != kNone)
+      readFile.close();
+    readSeg = kNone;
+  }
+
+  const char *prefix;
+  uint8_t segments;
+  File writeFile;
+  File readFile;
+  uint8_t writeSeg;
+  uint8_t readSeg;
+};
+
+#endif // LOG_JOURNAL_FS_H
@@ -0,0 +1,105 @@
+#ifndef LOG_JOURNAL_PARTITION_H
+#define LOG_JOURNAL_PARTITION_H
+
+#include <Arduino.h>
+#include <esp_partition.h>
+#include "LogJournal.h"
+
+// ============================================================================
+// LOG STORE ON A RAW DATA PARTITION - NO FILESYSTEM
+// ============================================================================
+// A window of `segments` x `segSize` bytes at `offset` in a data partition,
+// accessed with esp_partition_* directly. Segments are whole 4 KB sectors:
+// program() is one flash write (durable when it returns, flush() has nothing
+// to do), erase() one sector-range erase. No metadata, no copy-on-write,
+// nothing to mount or format: a blank or foreign partition reads as torn
+// segments, which the journal / archive erase at begin(). Used by
+// storageTask only.
+//
+// The "littlefs" partition of min_spiffs.csv (0xA0000, never mounted):
+//   0x00000  log journal   16 x 16 KB
+//   0x40000  log archive   24 x 16 KB
+// Erases are counted per segment (RAM, since boot) for the wear report.
+// ============================================================================
+
+#define LOG_PARTITION_LABEL "littlefs"
+#define LOG_PARTITION_MAX_SEGMENTS 64
+#define LOG_PARTITION_SECTOR 4096 // Flash erase unit
+
+class PartitionJournalMedium : public JournalMedium
+{
+public:
+  PartitionJournalMedium(const char *label, uint32_t offset, uint8_t segments, uint32_t segSize)
+      : label(label), offset(offset), segments(segments), segSize(segSize), part(NULL)
+  {
+    memset(erases, 0, sizeof(erases));
+  }
+
+  // Find the partition; false if it is missing or the window does not fit
+  bool begin()
+  {
+    part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+    if (part == NULL || segments > LOG_PARTITION_MAX_SEGMENTS || offset % LOG_PARTITION_SECTOR != 0 ||
+        segSize % LOG_PARTITION_SECTOR != 0 || offset + (uint32_t)segments * segSize > part->size)
+    {
+      part = NULL;
+      return false;
+    }
+    return true;
+  }
+
+  bool available() const { return part != NULL; }
+
+  uint32_t segmentSize() const override { return segSize; }
+  uint8_t segmentCount() const override { return segments; }
+
+  bool read(uint8_t seg, uint32_t off, void *buf, size_t len) override
+  {
+    return part != NULL && esp_partition_read(part, address(seg, off), buf, len) == ESP_OK;
+  }
+
+  bool program(uint8_t seg, uint32_t off, const void *buf, size_t len) override
+  {
+    return part != NULL && esp_partition_write(part, address(seg, off), buf, len) == ESP_OK;
+  }
+
+  bool erase(uint8_t seg) override
+  {
+    if (part == NULL || esp_partition_erase_range(part, address(seg, 0), segSize) != ESP_OK)
+      return false;
+    erases[seg]++;
+    return true;
+  }
+
+  // Erases since boot: total and the spread between segments
+  uint32_t eraseTotal() const
+  {
+    uint32_t n = 0;
+    for (uint8_t s = 0; s < segments; s++)
+      n += erases[s];
+    return n;
+  }
+
+  uint32_t eraseSpread() const
+  {
+    uint32_t lo = 0xFFFFFFFF, hi = 0;
+    for (uint8_t s = 0; s < segments; s++)
+    {
+      lo = erases[s] < lo ? erases[s] : lo;
+      hi = erases[s] > hi ? erases[s] : hi;
+    }
+    return segments ? hi - lo : 0;
+  }
+
+private:
+  uint32_t address(uint8_t seg, uint32_t off) const { return offset + (uint32_t)seg * segSize + off; }
+
+  const char *label;
+  uint32_t offset;
+  uint8_t segments;
+  uint32_t segSize;
+  const esp_partition_t *part;
+  uint32_t erases[LOG_PARTITION_MAX_SEGMENTS];
+};
+
+#endif // LOG_JOURNAL_PARTITION_H
@@ -0,0 +1,288 @@
+#ifndef LOG_RECOVERY_H
+#define LOG_RECOVERY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// ============================================================================
+// LOG RECOVERY ENGINE - RE-READ LOG RANGES FROM THE TTL BOX OVER RS485
+// ============================================================================
+// Walks queued ranges of TTL log positions (1..2046, wrapping after 2046)
+// and keeps up to `window` [0xC8][hi][lo][cs][0xC9] requests outstanding.
+// Each returned pump log is matched to its request by viTriLogData; a log
+// that matches nothing outstanding is live traffic.
+//
+// Throttling so live transactions keep priority:
+//   - at least `txGapMs` between two requests,
+//   - no new request for `liveHoldoffMs` after live traffic (a live pump log
+//     or a price batch, reported via onLiveTraffic()),
+//   - the caller does not run the engine while a price batch is in flight.
+// Unanswered requests are re-sent up to `maxAttempts` times, then counted as
+// failed (the position is empty or the box no longer holds it).
+//
+// Plain C++ with an injected clock (nowMs), like PriceChangeEngine.
+// ============================================================================
+
+#define LOG_RECOVERY_MAX_POS 2046
+#define LOG_RECOVERY_WINDOW_MAX 8
+#define LOG_RECOVERY_RANGES 8
+
+struct LogRecoveryRange
+{
+  uint16_t first; // First log position (1..2046)
+  uint16_t count; // Positions to read, wrapping 2046 → 1 (max 2046)
+};
+
+struct LogRecoveryStats
+{
+  uint32_t requested;  // Requests sent (retries included)
+  uint32_t recovered;  // Logs matched to an outstanding request
+  uint32_t failed;     // Positions given up after maxAttempts
+  uint32_t retries;
+  uint32_t timeouts;
+  uint32_t startMs;    // Current / last run
+  uint32_t finishMs;
+};
+
+class LogRecoveryEngine
+{
+public:
+  LogRecoveryEngine(uint8_t windowSize = 4, uint32_t minTxGapMs = 40, uint32_t liveHoldoffMs = 1500,
+                    uint8_t attemptLimit = 3)
+      : window(windowSize > LOG_RECOVERY_WINDOW_MAX ? LOG_RECOVERY_WINDOW_MAX : windowSize),
+        txGapMs(minTxGapMs), holdoffMs(liveHoldoffMs), maxAttempts(attemptLimit)
+  {
+    memset(&stats, 0, sizeof(stats));
+    cancel();
+  }
+
+  static bool validPos(uint16_t pos) { return pos >= 1 && pos <= LOG_RECOVERY_MAX_POS; }
+
+  // Queue a range. Returns false if the range is invalid or the range queue is full.
+  bool addRange(uint16_t first, uint16_t count, uint32_t nowMs)
+  {
+    if (!validPos(first) || count == 0 || rangeCount >= LOG_RECOVERY_RANGES)
+      return false;
+    if (count > LOG_RECOVERY_MAX_POS)
+      count = LOG_RECOVERY_MAX_POS;
+    if (!active())
+    {
+      memset(&stats, 0, sizeof(stats));
+      stats.startMs = nowMs;
+    }
+    LogRecoveryRange &r = ranges[(rangeHead + rangeCount) % LOG_RECOVERY_RANGES];
+    r.first = first;
+    r.count = count;
+    rangeCount++;
+    return true;
+  }
+
+  // Drop queued ranges and outstanding requests (stats are kept)
+  void cancel()
+  {
+    memset(slots, 0, sizeof(slots));
+    rangeHead = 0;
+    rangeCount = 0;
+    lastTxMs = 0;
+    liveMs = 0;
+    txSinceReset = false;
+    liveSinceReset = false;
+  }
+
+  // Ranges left to walk or requests still outstanding
+  bool active() const { return rangeCount > 0 || outstanding() > 0; }
+
+  // Live pump log / price batch seen: hold new requests back for liveHoldoffMs
+  void onLiveTraffic(uint32_t nowMs)
+  {
+    liveMs = nowMs;
+    liveSinceReset = true;
+  }
+
+  // Position to request now (0 = none). The caller must transmit it.
+  uint16_t nextToSend(uint32_t nowMs, uint32_t timeoutMs)
+  {
+    if (!active() || msUntilTx(nowMs) > 0)
+      return 0;
+
+    // Retries first so a stuck position does not hold a window slot forever
+    Slot *free = NULL;
+    for (uint8_t i = 0; i < window; i++)
+    {
+      Slot &s = slots[i];
+      if (s.state == SLOT_RETRY)
+        return transmit(s, nowMs, timeoutMs);
+      if (s.state == SLOT_FREE && !free)
+        free = &s;
+    }
+    if (!free || rangeCount == 0)
+      return 0;
+
+    LogRecoveryRange &r = ranges[rangeHead];
+    free->pos = r.first;
+    free->attempts = 0;
+    r.first = r.first >= LOG_RECOVERY_MAX_POS ? 1 : r.first + 1;
+    if (--r.count == 0)
+    {
+      rangeHead = (rangeHead + 1) % LOG_RECOVERY_RANGES;
+      rangeCount--;
+    }
+    return transmit(*free, nowMs, timeoutMs);
+  }
+
+  // Pump log received. Returns true (and the round trip) if it answers an outstanding request.
+  bool onLog(uint16_t viTriLogData, uint32_t nowMs, uint32_t &rttMs)
+  {
+    for (uint8_t i = 0; i < window; i++)
+    {
+      Slot &s = slots[i];
+      if (s.state == SLOT_FREE || s.pos != viTriLogData)
+        continue;
+      rttMs = nowMs - s.sentMs;
+      s.state = SLOT_FREE;
+      stats.recovered++;
+      finishIfDone(nowMs);
+      return true;
+    }
+    return false;
+  }
+
+  // Expire outstanding requests: mark for retry or give up
+  void poll(uint32_t nowMs)
+  {
+    for (uint8_t i = 0; i < window; i++)
+    {
+      Slot &s = slots[i];
+      if (s.state != SLOT_IN_FLIGHT || (uint32_t)(nowMs - s.sentMs) < s.timeoutMs)
+        continue;
+      stats.timeouts++;
+      if (s.attempts < maxAttempts)
+      {
+        s.state = SLOT_RETRY;
+      }
+      else
+      {
+        s.state = SLOT_FREE;
+        stats.failed++;
+      }
+    }
+    finishIfDone(nowMs);
+  }
+
+  // Milliseconds until the engine next needs attention; 0xFFFFFFFF when idle
+  uint32_t msUntilNextEvent(uint32_t nowMs) const
+  {
+    if (!active())
+      return 0xFFFFFFFF;
+    uint32_t wait = 0xFFFFFFFF;
+    bool canSend = false;
+    for (uint8_t i = 0; i < window; i++)
+    {
+      const Slot &s = slots[i];
+      if (s.state == SLOT_IN_FLIGHT)
+      {
+        uint32_t age = nowMs - s.sentMs;
+        uint32_t due = age < s.timeoutMs ? s.timeoutMs - age : 0;
+        if (due < wait)
+          wait = due;
+      }
+      else if (s.state == SLOT_RETRY || rangeCount > 0)
+      {
+        canSend = true; // A retry, or a free slot with positions left
+      }
+    }
+    if (canSend)
+    {
+      uint32_t tx = msUntilTx(nowMs);
+      if (tx < wait)
+        wait = tx;
+    }
+    return wait;
+  }
+
+  // Requests in flight or waiting for a retry
+  uint8_t outstanding() const
+  {
+    uint8_t n = 0;
+    for (uint8_t i = 0; i < window; i++)
+    {
+      if (slots[i].state != SLOT_FREE)
+        n++;
+    }
+    return n;
+  }
+
+  // Positions not yet requested
+  uint32_t remaining() const
+  {
+    uint32_t n = 0;
+    for (uint8_t i = 0; i < rangeCount; i++)
+      n += ranges[(rangeHead + i) % LOG_RECOVERY_RANGES].count;
+    return n;
+  }
+
+  LogRecoveryStats stats;
+
+private:
+  enum SlotState : uint8_t
+  {
+    SLOT_FREE = 0,
+    SLOT_IN_FLIGHT,
+    SLOT_RETRY // Timed out, waiting to be re-sent (a late answer still counts)
+  };
+
+  struct Slot
+  {
+    SlotState state;
+    uint8_t attempts;
+    uint16_t pos;
+    uint32_t sentMs;
+    uint32_t timeoutMs;
+  };
+
+  uint32_t msUntilTx(uint32_t nowMs) const
+  {
+    uint32_t wait = 0;
+    if (txSinceReset && (uint32_t)(nowMs - lastTxMs) < txGapMs)
+      wait = txGapMs - (nowMs - lastTxMs);
+    if (liveSinceReset && (uint32_t)(nowMs - liveMs) < holdoffMs && holdoffMs - (nowMs - liveMs) > wait)
+      wait = holdoffMs - (nowMs - liveMs);
+    return wait;
+  }
+
+  uint16_t transmit(Slot &s, uint32_t nowMs, uint32_t timeoutMs)
+  {
+    if (s.attempts > 0)
+      stats.retries++;
+    s.state = SLOT_IN_FLIGHT;
+    s.attempts++;
+    s.sentMs = nowMs;
+    s.timeoutMs = timeoutMs;
+    lastTxMs = nowMs;
+    txSinceReset = true;
+    stats.requested++;
+    return s.pos;
+  }
+
+  void finishIfDone(uint32_t nowMs)
+  {
+    if (!active() && stats.finishMs == 0)
+      stats.finishMs = nowMs ? nowMs : 1;
+  }
+
+  Slot slots[LOG_RECOVERY_WINDOW_MAX];
+  LogRecoveryRange ranges[LOG_RECOVERY_RANGES];
+  uint8_t rangeHead;
+  uint8_t rangeCount;
+  uint8_t window;
+  uint32_t txGapMs;
+  uint32_t holdoffMs;
+  uint8_t maxAttempts;
+  uint32_t lastTxMs;
+  uint32_t liveMs;
+  bool txSinceReset;
+  bool liveSinceReset;
+};
+
+#endif // LOG_RECOVERY_H
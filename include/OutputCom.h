@@ -1,7 +1,182 @@
 #ifndef OUTPUTCOM_H
 #define OUTPUTCOM_H
 
+#include <Arduino.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include "Settings.h"
 
+// ============================================================================
+// OUTPUT PULSE SERVICE - OUT1/OUT2 INDICATOR/RELAY PULSES WITHOUT A TASK PER PULSE
+// ============================================================================
+// One esp_timer walks the on/off steps of a pulse pattern; callers only set a
+// pending flag (never block, never allocate). Per pattern:
+//   - coalescing: a request while the same pattern is already pending is merged
+//     into it (counted in `coalesced`),
+//   - max rate: a pattern starts at most once per minIntervalMs; requests in
+//     between wait as the single pending pulse.
+// When several patterns are pending the lower enum value plays first.
+// ============================================================================
 
+enum OutputPulseKind : uint8_t
+{
+  PULSE_TRANSACTION = 0, // New pump log: OUT1+OUT2 200 ms (was ConnectedKPLBox task)
+  PULSE_CONNECTED,       // Status published: OUT1+OUT2 120 ms on / 120 ms off (was BlinkOutput2Task)
+  PULSE_KIND_COUNT
+};
 
-#endif // API_H
\ No newline at end of file
+#define PULSE_PIN_OUT1 0x01
+#define PULSE_PIN_OUT2 0x02
+
+struct OutputPulsePattern
+{
+  uint8_t pins;           // PULSE_PIN_* mask
+  uint8_t pulses;         // On/off repetitions
+  uint16_t onMs;
+  uint16_t offMs;
+  uint16_t minIntervalMs; // Max rate: earliest next start after a start
+};
+
+static const OutputPulsePattern kOutputPulsePatterns[PULSE_KIND_COUNT] = {
+    {PULSE_PIN_OUT1 | PULSE_PIN_OUT2, 1, 200, 0, 400},  // PULSE_TRANSACTION
+    {PULSE_PIN_OUT1 | PULSE_PIN_OUT2, 1, 120, 120, 1000} // PULSE_CONNECTED
+};
+
+struct OutputPulseStats
+{
+  uint32_t requested[PULSE_KIND_COUNT];
+  uint32_t played[PULSE_KIND_COUNT];
+  uint32_t coalesced[PULSE_KIND_COUNT]; // Requests merged into an already pending pulse
+};
+
+static struct
+{
+  esp_timer_handle_t timer = NULL;
+  portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+  bool pending[PULSE_KIND_COUNT] = {};
+  bool armed = false;      // Timer running (or about to be started)
+  int8_t playing = -1;     // Pattern being played, -1 = idle
+  uint8_t step = 0;        // Even = turn on, odd = turn off
+  uint32_t lastStartMs[PULSE_KIND_COUNT] = {};
+  bool started[PULSE_KIND_COUNT] = {};
+  OutputPulseStats stats = {};
+} outputPulse;
+
+inline void outputPulseWrite(uint8_t pins, uint8_t level)
+{
+  if (pins & PULSE_PIN_OUT1)
+    digitalWrite(OUT1, level);
+  if (pins & PULSE_PIN_OUT2)
+    digitalWrite(OUT2, level);
+}
+
+// Next step to run (called under outputPulse.mux). Returns the delay in ms until the
+// step after it, or 0 when idle. *pins / *level: output change to apply now (pins = 0: none).
+inline uint32_t outputPulseStep(uint32_t nowMs, uint8_t *pins, uint8_t *level)
+{
+  *pins = 0;
+  if (outputPulse.playing < 0)
+  {
+    // Pick the first pending pattern whose rate limit allows a start; else wait for the earliest
+    uint32_t wait = 0;
+    for (uint8_t k = 0; k < PULSE_KIND_COUNT; k++)
+    {
+      if (!outputPulse.pending[k])
+        continue;
+      uint32_t since = nowMs - outputPulse.lastStartMs[k];
+      uint32_t minGap = kOutputPulsePatterns[k].minIntervalMs;
+      if (outputPulse.started[k] && since < minGap)
+      {
+        if (wait == 0 || minGap - since < wait)
+          wait = minGap - since;
+        continue;
+      }
+      outputPulse.pending[k] = false;
+      outputPulse.playing = k;
+      outputPulse.step = 0;
+      outputPulse.lastStartMs[k] = nowMs;
+      outputPulse.started[k] = true;
+      outputPulse.stats.played[k]++;
+      break;
+    }
+    if (outputPulse.playing < 0)
+      return wait;
+  }
+
+  const OutputPulsePattern &p = kOutputPulsePatterns[outputPulse.playing];
+  bool on = (outputPulse.step & 1) == 0;
+  *pins = p.pins;
+  *level = on ? HIGH : LOW;
+  outputPulse.step++;
+  if (on)
+    return p.onMs;
+  if (outputPulse.step >= 2 * p.pulses)
+  {
+    outputPulse.playing = -1; // Done; the off time still separates it from the next pattern
+    return p.offMs > 0 ? p.offMs : 1;
+  }
+  return p.offMs;
+}
+
+inline void outputPulseTimerCallback(void *arg)
+{
+  uint8_t pins, level;
+  portENTER_CRITICAL(&outputPulse.mux);
+  uint32_t nextMs = outputPulseStep(millis(), &pins, &level);
+  outputPulse.armed = nextMs > 0;
+  portEXIT_CRITICAL(&outputPulse.mux);
+
+  if (pins)
+    outputPulseWrite(pins, level);
+  if (nextMs > 0)
+    esp_timer_start_once(outputPulse.timer, (uint64_t)nextMs * 1000);
+}
+
+inline void outputPulseBegin()
+{
+  esp_timer_create_args_t args = {};
+  args.callback = outputPulseTimerCallback;
+  args.arg = NULL;
+  args.dispatch_method = ESP_TIMER_TASK;
+  args.name = "outPulse";
+  if (esp_timer_create(&args, &outputPulse.timer) != ESP_OK)
+  {
+    Serial.println("[PULSE] ERROR: esp_timer_create failed - output pulses disabled");
+    outputPulse.timer = NULL;
+  }
+}
+
+// Request a pulse pattern. Non-blocking, safe from any task.
+inline void outputPulseRequest(OutputPulseKind kind)
+{
+  if (outputPulse.timer == NULL || kind >= PULSE_KIND_COUNT)
+    return;
+  bool start = false;
+  portENTER_CRITICAL(&outputPulse.mux);
+  outputPulse.stats.requested[kind]++;
+  if (outputPulse.pending[kind])
+  {
+    outputPulse.stats.coalesced[kind]++;
+  }
+  else
+  {
+    outputPulse.pending[kind] = true;
+    start = !outputPulse.armed;
+    outputPulse.armed = true;
+  }
+  portEXIT_CRITICAL(&outputPulse.mux);
+
+  // Idle: run the first step from the timer task right away
+  if (start)
+    esp_timer_start_once(outputPulse.timer, 1);
+}
+
+inline uint32_t outputPulseCoalescedTotal()
+{
+  uint32_t n = 0;
+  for (uint8_t k = 0; k < PULSE_KIND_COUNT; k++)
+    n += outputPulse.stats.coalesced[k];
+  return n;
+}
+
+#endif // OUTPUTCOM_H
@@ -0,0 +1,255 @@
+#ifndef PRICE_CHANGE_ENGINE_H
+#define PRICE_CHANGE_ENGINE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// ============================================================================
+// PRICE CHANGE ENGINE - PIPELINED, MATCHED BY DEVICE ID
+// ============================================================================
+// Tracks one slot per nozzle (DeviceID 11-20). Up to `window` commands are
+// kept in flight at once, spaced by `txGapMs` so the 10-byte commands do not
+// overlap on the half-duplex bus. Each [7][ID][S/E][8] response is matched
+// to its slot by device ID; a response for a device that has no command
+// outstanding is counted as stray and ignored. When a command times out only
+// that device is re-sent, up to `maxAttempts` times.
+//
+// Plain C++ with an injected clock (nowMs) - the caller does the actual
+// transmit and feeds responses in, so the engine has no RS485 dependency.
+// ============================================================================
+
+#define PRICE_ENGINE_FIRST_ID 11
+#define PRICE_ENGINE_SLOTS 10
+
+enum PriceSlotState : uint8_t
+{
+  PRICE_SLOT_IDLE = 0, // Nothing requested
+  PRICE_SLOT_PENDING,  // Waiting for a TX slot (first send or retry)
+  PRICE_SLOT_IN_FLIGHT,
+  PRICE_SLOT_DONE_OK,  // Device answered 'S'
+  PRICE_SLOT_DONE_ERROR, // Device answered 'E'
+  PRICE_SLOT_FAILED    // No answer after maxAttempts
+};
+
+struct PriceSlot
+{
+  PriceSlotState state;
+  uint8_t attempts;
+  uint32_t submitMs;   // When the request entered the engine
+  uint32_t sentMs;     // Last transmit
+  uint32_t doneMs;     // Response / give-up time
+  uint32_t timeoutMs;  // Per-device response timeout (adaptive, see LatencyHistogram.h)
+  uint8_t timeouts;    // Attempts that went unanswered
+};
+
+class PriceChangeEngine
+{
+public:
+  PriceChangeEngine(uint8_t windowSize = PRICE_ENGINE_SLOTS, uint32_t responseTimeoutMs = 1000,
+                    uint8_t attemptLimit = 3, uint32_t minTxGapMs = 30)
+      : window(windowSize), timeoutMs(responseTimeoutMs), maxAttempts(attemptLimit), txGapMs(minTxGapMs)
+  {
+    reset();
+  }
+
+  void reset()
+  {
+    memset(slots, 0, sizeof(slots));
+    lastTxMs = 0;
+    txSinceReset = false;
+    strayResponses = 0;
+    retries = 0;
+  }
+
+  static bool validId(uint8_t deviceId)
+  {
+    return deviceId >= PRICE_ENGINE_FIRST_ID && deviceId < PRICE_ENGINE_FIRST_ID + PRICE_ENGINE_SLOTS;
+  }
+
+  // Queue (or re-queue with a new price) a device. Restarts its attempt count.
+  // deviceTimeoutMs = 0 uses the engine default.
+  bool submit(uint8_t deviceId, uint32_t nowMs, uint32_t deviceTimeoutMs = 0)
+  {
+    if (!validId(deviceId))
+      return false;
+    PriceSlot &s = slots[deviceId - PRICE_ENGINE_FIRST_ID];
+    s.state = PRICE_SLOT_PENDING;
+    s.attempts = 0;
+    s.submitMs = nowMs;
+    s.sentMs = 0;
+    s.doneMs = 0;
+    s.timeoutMs = deviceTimeoutMs ? deviceTimeoutMs : timeoutMs;
+    s.timeouts = 0;
+    return true;
+  }
+
+  // Device to transmit now (0 = none). The slot is marked in flight; the caller must send it.
+  uint8_t nextToSend(uint32_t nowMs)
+  {
+    if (txSinceReset && (uint32_t)(nowMs - lastTxMs) < txGapMs)
+      return 0;
+    if (inFlight() >= window)
+      return 0;
+    for (uint8_t i = 0; i < PRICE_ENGINE_SLOTS; i++)
+    {
+      PriceSlot &s = slots[i];
+      if (s.state != PRICE_SLOT_PENDING)
+        continue;
+      if (s.attempts > 0)
+        retries++;
+      s.state = PRICE_SLOT_IN_FLIGHT;
+      s.attempts++;
+      s.sentMs = nowMs;
+      lastTxMs = nowMs;
+      txSinceReset = true;
+      return PRICE_ENGINE_FIRST_ID + i;
+    }
+    return 0;
+  }
+
+  // Feed a [7][ID][S/E][8] response. Returns false for a stray response (no command outstanding).
+  bool onResponse(uint8_t deviceId, bool success, uint32_t nowMs)
+  {
+    if (!validId(deviceId))
+    {
+      strayResponses++;
+      return false;
+    }
+    PriceSlot &s = slots[deviceId - PRICE_ENGINE_FIRST_ID];
+    // A late answer to an attempt that already timed out (slot waiting for its retry) still counts
+    bool outstanding = s.state == PRICE_SLOT_IN_FLIGHT || (s.state == PRICE_SLOT_PENDING && s.attempts > 0);
+    if (!outstanding)
+    {
+      strayResponses++;
+      return false;
+    }
+    s.state = success ? PRICE_SLOT_DONE_OK : PRICE_SLOT_DONE_ERROR;
+    s.doneMs = nowMs;
+    return true;
+  }
+
+  // Expire in-flight commands: re-queue for retry or give up
+  void poll(uint32_t nowMs)
+  {
+    for (uint8_t i = 0; i < PRICE_ENGINE_SLOTS; i++)
+    {
+      PriceSlot &s = slots[i];
+      if (s.state != PRICE_SLOT_IN_FLIGHT || (uint32_t)(nowMs - s.sentMs) < s.timeoutMs)
+        continue;
+      s.timeouts++;
+      if (s.attempts < maxAttempts)
+      {
+        s.state = PRICE_SLOT_PENDING;
+      }
+      else
+      {
+        s.state = PRICE_SLOT_FAILED;
+        s.doneMs = nowMs;
+      }
+    }
+  }
+
+  // Any device still pending or in flight
+  bool busy() const
+  {
+    for (uint8_t i = 0; i < PRICE_ENGINE_SLOTS; i++)
+    {
+      if (slots[i].state == PRICE_SLOT_PENDING || slots[i].state == PRICE_SLOT_IN_FLIGHT)
+        return true;
+    }
+    return false;
+  }
+
+  // Milliseconds until the engine next needs attention (TX gap or a timeout)
+  uint32_t msUntilNextEvent(uint32_t nowMs) const
+  {
+    uint32_t wait = timeoutMs;
+    for (uint8_t i = 0; i < PRICE_ENGINE_SLOTS; i++)
+    {
+      const PriceSlot &s = slots[i];
+      uint32_t due = timeoutMs;
+      if (s.state == PRICE_SLOT_IN_FLIGHT)
+      {
+        uint32_t age = nowMs - s.sentMs;
+        due = age < s.timeoutMs ? s.timeoutMs - age : 0;
+      }
+      else if (s.state == PRICE_SLOT_PENDING)
+      {
+        uint32_t sinceTx = nowMs - lastTxMs;
+        due = (!txSinceReset || sinceTx >= txGapMs) ? 0 : txGapMs - sinceTx;
+      }
+      if (due < wait)
+        wait = due;
+    }
+    return wait;
+  }
+
+  uint8_t inFlight() const
+  {
+    uint8_t n = 0;
+    for (uint8_t i = 0; i < PRICE_ENGINE_SLOTS; i++)
+    {
+      if (slots[i].state == PRICE_SLOT_IN_FLIGHT)
+        n++;
+    }
+    return n;
+  }
+
+  const PriceSlot &slot(uint8_t deviceId) const { return slots[deviceId - PRICE_ENGINE_FIRST_ID]; }
+
+  // Round trip of an answered command, for the latency histograms. Only one attempt
+  // may be on the wire: after a retry the answer can belong to either transmit, so
+  // doneMs - sentMs would be too short (Karn's rule) - no sample then.
+  bool rttSample(uint8_t deviceId, uint32_t &rttMs) const
+  {
+    const PriceSlot &s = slot(deviceId);
+    if ((s.state != PRICE_SLOT_DONE_OK && s.state != PRICE_SLOT_DONE_ERROR) || s.attempts != 1)
+      return false;
+    rttMs = s.doneMs - s.sentMs;
+    return true;
+  }
+
+  // Clear finished slots (after the completion report) so the next batch starts clean
+  void clearFinished()
+  {
+    for (uint8_t i = 0; i < PRICE_ENGINE_SLOTS; i++)
+    {
+      if (slots[i].state >= PRICE_SLOT_DONE_OK)
+        memset(&slots[i], 0, sizeof(PriceSlot));
+    }
+  }
+
+  static const char *stateName(PriceSlotState state)
+  {
+    switch (state)
+    {
+    case PRICE_SLOT_PENDING:
+      return "PENDING";
+    case PRICE_SLOT_IN_FLIGHT:
+      return "IN_FLIGHT";
+    case PRICE_SLOT_DONE_OK:
+      return "OK";
+    case PRICE_SLOT_DONE_ERROR:
+      return "ERROR";
+    case PRICE_SLOT_FAILED:
+      return "NO_RESPONSE";
+    default:
+      return "IDLE";
+    }
+  }
+
+  uint32_t strayResponses;
+  uint32_t retries;
+
+private:
+  PriceSlot slots[PRICE_ENGINE_SLOTS];
+  uint8_t window;
+  uint32_t timeoutMs;
+  uint8_t maxAttempts;
+  uint32_t txGapMs;
+  uint32_t lastTxMs;
+  bool txSinceReset;
+};
+
+#endif // PRICE_CHANGE_ENGINE_H
@@ -0,0 +1,378 @@
+#ifndef PRICE_JOURNAL_H
+#define PRICE_JOURNAL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include "LogJournal.h" // JournalMedium, crc16
+
+// ============================================================================
+// PRICE JOURNAL - ONE SMALL RECORD PER PRICE CHANGE, SNAPSHOT PER SEGMENT
+// ============================================================================
+// Replaces rewriting the whole NozzlePrices file on every change. Each
+// confirmed change (nozzle, price, IdDevice, time) is appended as one
+// 40-byte record; the current table is the result of replaying them.
+//
+//   Segment header (16 B): 'KPLP' | version | 0 0 0 | seq u32 | crc16 | 0 0
+//   Record (40 B):  0xC3 | type | nozzle | 0 | seq u32 | time u32 |
+//                   price (float bits) u32 | idDevice[20] | crc16 | 0 0
+//   (little-endian; crc16 = CCITT over bytes 0..11 of the header / 0..35 of
+//   a record)
+//
+//   CHANGE    one confirmed price change (the audit trail)
+//   SNAPSHOT  the current price of one nozzle, written for every known
+//             nozzle at the start of each new segment
+//
+// Segments are used in ring order. When the head is full the next segment
+// (the oldest) is erased and opened with a snapshot, so the newest segments
+// always hold the full table and history is bounded by space only. Boot
+// replays the segments oldest first; a torn record ends its segment (sealed,
+// appends continue in the next one), a power cut between erase and snapshot
+// leaves the older segments to replay from.
+//
+// Plain C++ over JournalMedium (a raw partition in the firmware).
+// ============================================================================
+
+#define PRICE_JOURNAL_VERSION 1
+#define PRICE_JOURNAL_MAX_SEGMENTS 32
+#define PRICE_JOURNAL_FIRST_NOZZLE 11
+#define PRICE_JOURNAL_NOZZLES 10 // 11..20
+
+struct PriceJournalEntry
+{
+  uint8_t nozzle; // 11..20
+  float price;
+  uint32_t time;  // Unix s
+  char idDevice[20];
+};
+
+enum PriceJournalType : uint8_t
+{
+  PRICE_REC_CHANGE = 1,
+  PRICE_REC_SNAPSHOT = 2
+};
+
+struct PriceJournalStats
+{
+  uint32_t changes;   // Appended since boot
+  uint32_t snapshots; // Segments opened (snapshot written)
+  uint32_t erases;
+  uint32_t bytesWritten;
+  uint32_t tornTails; // Segments sealed at boot after a bad record
+};
+
+class PriceJournal
+{
+public:
+  enum : uint8_t
+  {
+    kRecordSize = 40,
+    kSegmentHeader = 16
+  };
+
+  explicit PriceJournal(JournalMedium &medium) : m(medium)
+  {
+    memset(&stats, 0, sizeof(stats));
+    reset();
+  }
+
+  // Scan the medium and replay it into the current table. False if the medium is unusable.
+  bool begin()
+  {
+    reset();
+    segCount = m.segmentCount();
+    segSize = m.segmentSize();
+    if (segCount < 2 || segCount > PRICE_JOURNAL_MAX_SEGMENTS || segSize < kSegmentHeader + (PRICE_JOURNAL_NOZZLES + 1) * kRecordSize)
+      return false;
+    for (uint8_t s = 0; s < segCount; s++)
+    {
+      uint8_t h[kSegmentHeader];
+      if (!m.read(s, 0, h, sizeof(h)))
+        return false;
+      if (allErased(h, sizeof(h)))
+        continue;
+      if (getU32(h) != kSegmentMagic || h[4] != PRICE_JOURNAL_VERSION || getU16(h + 12) != LogJournal::crc16(h, 12))
+      {
+        eraseSegment(s);
+        continue;
+      }
+      segSeq[s] = getU32(h + 8);
+      used[s] = kSegmentHeader;
+      if (segSeq[s] >= nextSegSeq)
+        nextSegSeq = segSeq[s] + 1;
+    }
+    // Oldest first: later records override earlier ones
+    uint8_t order[PRICE_JOURNAL_MAX_SEGMENTS];
+    uint8_t n = sortedSegments(order);
+    for (uint8_t i = 0; i < n; i++)
+    {
+      uint8_t s = order[i];
+      used[s] = walk(s, [this](uint8_t, uint32_t seq, const PriceJournalEntry &e) {
+        current[e.nozzle - PRICE_JOURNAL_FIRST_NOZZLE] = e;
+        known |= 1u << (e.nozzle - PRICE_JOURNAL_FIRST_NOZZLE);
+        if (seq >= nextSeq)
+          nextSeq = seq + 1;
+      }, true);
+      head = s;
+    }
+    return true;
+  }
+
+  // Any price on the medium (false: blank, first boot with the journal)
+  bool hasState() const { return known != 0; }
+
+  // Newest price of nozzle 11..20; false if it was never set
+  bool get(uint8_t nozzle, PriceJournalEntry &e) const
+  {
+    if (!validNozzle(nozzle) || !(known & (1u << (nozzle - PRICE_JOURNAL_FIRST_NOZZLE))))
+      return false;
+    e = current[nozzle - PRICE_JOURNAL_FIRST_NOZZLE];
+    return true;
+  }
+
+  // One confirmed change
+  bool append(const PriceJournalEntry &e)
+  {
+    if (!validNozzle(e.nozzle))
+      return false;
+    if ((head == kNoSeg || used[head] + kRecordSize > segSize) && !rotate())
+      return false;
+    if (!writeRecord(PRICE_REC_CHANGE, e))
+      return false;
+    current[e.nozzle - PRICE_JOURNAL_FIRST_NOZZLE] = e;
+    known |= 1u << (e.nozzle - PRICE_JOURNAL_FIRST_NOZZLE);
+    stats.changes++;
+    return true;
+  }
+
+  // Take a whole table (import of the old price file): becomes the snapshot of a new segment
+  bool importTable(const PriceJournalEntry *entries, uint8_t count)
+  {
+    for (uint8_t i = 0; i < count; i++)
+    {
+      if (!validNozzle(entries[i].nozzle))
+        continue;
+      current[entries[i].nozzle - PRICE_JOURNAL_FIRST_NOZZLE] = entries[i];
+      known |= 1u << (entries[i].nozzle - PRICE_JOURNAL_FIRST_NOZZLE);
+    }
+    return rotate();
+  }
+
+  // CHANGE records of `nozzle` (0 = all), oldest first: visit(seq, entry)
+  template <typename Visitor>
+  uint16_t forEachChange(uint8_t nozzle, Visitor visit)
+  {
+    uint8_t order[PRICE_JOURNAL_MAX_SEGMENTS];
+    uint8_t n = sortedSegments(order);
+    uint16_t count = 0;
+    for (uint8_t i = 0; i < n; i++)
+    {
+      walk(order[i], [&](uint8_t type, uint32_t seq, const PriceJournalEntry &e) {
+        if (type == PRICE_REC_CHANGE && (nozzle == 0 || e.nozzle == nozzle))
+        {
+          visit(seq, e);
+          count++;
+        }
+      }, false);
+    }
+    return count;
+  }
+
+  uint32_t bytesUsed() const
+  {
+    uint32_t b = 0;
+    for (uint8_t s = 0; s < segCount; s++)
+      b += used[s];
+    return b;
+  }
+  uint32_t capacity() const { return (uint32_t)segCount * segSize; }
+
+  PriceJournalStats stats;
+
+private:
+  enum : uint8_t { kNoSeg = 0xFF, kRecordMagic = 0xC3 };
+  enum : uint32_t { kSegmentMagic = 0x504C504B }; // "KPLP"
+
+  static bool validNozzle(uint8_t n) { return n >= PRICE_JOURNAL_FIRST_NOZZLE && n < PRICE_JOURNAL_FIRST_NOZZLE + PRICE_JOURNAL_NOZZLES; }
+
+  static uint16_t getU16(const uint8_t *p) { return (uint16_t)(p[0] | (p[1] << 8)); }
+  static uint32_t getU32(const uint8_t *p)
+  {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+  }
+  static void putU16(uint8_t *p, uint16_t v)
+  {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+  }
+  static void putU32(uint8_t *p, uint32_t v)
+  {
+    for (uint8_t i = 0; i < 4; i++)
+      p[i] = (uint8_t)(v >> (8 * i));
+  }
+  static bool allErased(const uint8_t *p, size_t len)
+  {
+    for (size_t i = 0; i < len; i++)
+    {
+      if (p[i] != 0xFF)
+        return false;
+    }
+    return true;
+  }
+
+  void reset()
+  {
+    memset(segSeq, 0, sizeof(segSeq));
+    memset(used, 0, sizeof(used));
+    memset(current, 0, sizeof(current));
+    known = 0;
+    head = kNoSeg;
+    nextSeq = 1;
+    nextSegSeq = 1;
+    segCount = 0;
+    segSize = 0;
+  }
+
+  // Used segments by seq, oldest first
+  uint8_t sortedSegments(uint8_t *order) const
+  {
+    uint8_t n = 0;
+    for (uint8_t s = 0; s < segCount; s++)
+    {
+      if (used[s] == 0)
+        continue;
+      uint8_t i = n++;
+      while (i > 0 && segSeq[order[i - 1]] > segSeq[s])
+      {
+        order[i] = order[i - 1];
+        i--;
+      }
+      order[i] = s;
+    }
+    return n;
+  }
+
+  // Visit the valid records of segment s in order: visit(type, seq, entry). Returns the
+  // offset after the last one, or segSize if the segment ends in a torn record (sealed).
+  template <typename Visitor>
+  uint32_t walk(uint8_t s, Visitor visit, bool countTorn)
+  {
+    uint8_t buf[12 * kRecordSize];
+    uint32_t off = kSegmentHeader;
+    while (off + kRecordSize <= segSize)
+    {
+      uint32_t len = segSize - off < sizeof(buf) ? (segSize - off) / kRecordSize * kRecordSize : (uint32_t)sizeof(buf);
+      if (!m.read(s, off, buf, len))
+        return segSize;
+      for (uint32_t i = 0; i < len; i += kRecordSize, off += kRecordSize)
+      {
+        const uint8_t *r = buf + i;
+        if (allErased(r, kRecordSize))
+          return off;
+        if (r[0] != kRecordMagic || getU16(r + 36) != LogJournal::crc16(r, 36) || !validNozzle(r[2]) ||
+            (r[1] != PRICE_REC_CHANGE && r[1] != PRICE_REC_SNAPSHOT))
+        {
+          if (countTorn)
+            stats.tornTails++;
+          return segSize; // Never program over a torn record
+        }
+        PriceJournalEntry e;
+        e.nozzle = r[2];
+        e.time = getU32(r + 8);
+        uint32_t bits = getU32(r + 12);
+        memcpy(&e.price, &bits, sizeof(bits));
+        memcpy(e.idDevice, r + 16, sizeof(e.idDevice));
+        e.idDevice[sizeof(e.idDevice) - 1] = '\0';
+        visit(r[1], getU32(r + 4), e);
+      }
+    }
+    return off;
+  }
+
+  bool writeRecord(uint8_t type, const PriceJournalEntry &e)
+  {
+    uint8_t r[kRecordSize];
+    memset(r, 0, sizeof(r));
+    r[0] = kRecordMagic;
+    r[1] = type;
+    r[2] = e.nozzle;
+    putU32(r + 4, nextSeq);
+    putU32(r + 8, e.time);
+    uint32_t bits;
+    memcpy(&bits, &e.price, sizeof(bits));
+    putU32(r + 12, bits);
+    strncpy((char *)r + 16, e.idDevice, sizeof(e.idDevice) - 1);
+    putU16(r + 36, LogJournal::crc16(r, 36));
+    if (!m.program(head, used[head], r, sizeof(r)))
+    {
+      used[head] = segSize; // Unknown state: seal
+      return false;
+    }
+    used[head] += kRecordSize;
+    nextSeq++;
+    stats.bytesWritten += kRecordSize;
+    return true;
+  }
+
+  bool eraseSegment(uint8_t s)
+  {
+    stats.erases++;
+    used[s] = 0;
+    return m.erase(s);
+  }
+
+  // Next segment in ring order (erased if it holds the oldest history), header + snapshot
+  bool rotate()
+  {
+    for (uint8_t tries = 0; tries < segCount; tries++)
+    {
+      uint8_t s = head == kNoSeg ? 0 : (uint8_t)((head + 1) % segCount);
+      if (!eraseSegment(s))
+      {
+        head = s;
+        used[s] = segSize; // Skip it
+        continue;
+      }
+      uint8_t h[kSegmentHeader];
+      memset(h, 0, sizeof(h));
+      putU32(h, kSegmentMagic);
+      h[4] = PRICE_JOURNAL_VERSION;
+      putU32(h + 8, nextSegSeq);
+      putU16(h + 12, LogJournal::crc16(h, 12));
+      head = s;
+      if (!m.program(s, 0, h, sizeof(h)))
+      {
+        used[s] = segSize;
+        continue;
+      }
+      segSeq[s] = nextSegSeq++;
+      used[s] = kSegmentHeader;
+      stats.bytesWritten += sizeof(h);
+      bool ok = true;
+      for (uint8_t i = 0; i < PRICE_JOURNAL_NOZZLES && ok; i++)
+      {
+        if (known & (1u << i))
+          ok = writeRecord(PRICE_REC_SNAPSHOT, current[i]);
+      }
+      if (!ok)
+        continue;
+      stats.snapshots++;
+      m.flush();
+      return true;
+    }
+    return false;
+  }
+
+  JournalMedium &m;
+  uint32_t segSeq[PRICE_JOURNAL_MAX_SEGMENTS];
+  uint32_t used[PRICE_JOURNAL_MAX_SEGMENTS]; // Write offset, 0 = erased
+  PriceJournalEntry current[PRICE_JOURNAL_NOZZLES];
+  uint16_t known; // Bit per nozzle with a price
+  uint8_t segCount;
+  uint32_t segSize;
+  uint8_t head;
+  uint32_t nextSeq;
+  uint32_t nextSegSeq;
+};
+
+#endif // PRICE_JOURNAL_H
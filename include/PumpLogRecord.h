@@ -0,0 +1,124 @@
+#ifndef PUMP_LOG_RECORD_H
+#define PUMP_LOG_RECORD_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// ============================================================================
+// PUMP LOG ON-FLASH RECORD - PACKED, LITTLE-ENDIAN, VERSIONED
+// ============================================================================
+// What the log journal stores for a PumpLog (structdata.h). The raw struct
+// (format 0, written by older firmware) carries compiler padding and a
+// toolchain-dependent time_t: 48 bytes with a 32-bit time_t, 56 with 64-bit.
+// Format 1 is 40 bytes, every field at a fixed offset:
+//
+//   Off  Field          Size   Off  Field          Size
+//    0   send1            1     23  ngay .. giay    6
+//    1   send2            1     29  send3           2
+//    2   idVoi            1     31  checksum        1
+//    3   viTriLogCot      2     32  send4           1
+//    5   viTriLogData     2     33  cycleSave       2
+//    7   maLanBom         2     35  mqttSent        1
+//    9   soLitBom         4     36  mqttSentTime    4  (unix seconds, u32)
+//   13   donGia           2
+//   15   soTotalTong      4
+//   19   soTienBom        4
+//
+// The format number travels in the journal record header, so a new layout
+// is a new kFormat plus a case in decode(). Plain C++ (host tools too).
+// ============================================================================
+
+struct PumpLogRecord
+{
+  enum : uint8_t
+  {
+    kLegacyFormat = 0, // Raw struct image, sizeof(Log) bytes
+    kFormat = 1,       // Current packed layout
+    kLength = 40
+  };
+
+  template <class Log>
+  static void encode(uint8_t (&out)[kLength], const Log &log)
+  {
+    out[0] = log.send1;
+    out[1] = log.send2;
+    out[2] = log.idVoi;
+    putU16(out + 3, log.viTriLogCot);
+    putU16(out + 5, log.viTriLogData);
+    putU16(out + 7, log.maLanBom);
+    putU32(out + 9, log.soLitBom);
+    putU16(out + 13, log.donGia);
+    putU32(out + 15, log.soTotalTong);
+    putU32(out + 19, log.soTienBom);
+    out[23] = log.ngay;
+    out[24] = log.thang;
+    out[25] = log.nam;
+    out[26] = log.gio;
+    out[27] = log.phut;
+    out[28] = log.giay;
+    putU16(out + 29, log.send3);
+    out[31] = log.checksum;
+    out[32] = log.send4;
+    putU16(out + 33, log.cycleSave);
+    out[35] = log.mqttSent;
+    putU32(out + 36, (uint32_t)log.mqttSentTime);
+  }
+
+  // Any known format → Log. False for an unknown format or a wrong length.
+  template <class Log>
+  static bool decode(const uint8_t *in, size_t len, uint8_t format, Log &log)
+  {
+    if (format == kLegacyFormat)
+    {
+      if (len != sizeof(Log))
+        return false;
+      memcpy(&log, in, sizeof(Log));
+      return true;
+    }
+    if (format != kFormat || len != kLength)
+      return false;
+    memset(&log, 0, sizeof(Log));
+    log.send1 = in[0];
+    log.send2 = in[1];
+    log.idVoi = in[2];
+    log.viTriLogCot = getU16(in + 3);
+    log.viTriLogData = getU16(in + 5);
+    log.maLanBom = getU16(in + 7);
+    log.soLitBom = getU32(in + 9);
+    log.donGia = getU16(in + 13);
+    log.soTotalTong = getU32(in + 15);
+    log.soTienBom = getU32(in + 19);
+    log.ngay = in[23];
+    log.thang = in[24];
+    log.nam = in[25];
+    log.gio = in[26];
+    log.phut = in[27];
+    log.giay = in[28];
+    log.send3 = getU16(in + 29);
+    log.checksum = in[31];
+    log.send4 = in[32];
+    log.cycleSave = getU16(in + 33);
+    log.mqttSent = in[35];
+    log.mqttSentTime = getU32(in + 36);
+    return true;
+  }
+
+  static uint16_t getU16(const uint8_t *p) { return (uint16_t)(p[0] | (p[1] << 8)); }
+  static uint32_t getU32(const uint8_t *p)
+  {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+  }
+  static void putU16(uint8_t *p, uint16_t v)
+  {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+  }
+  static void putU32(uint8_t *p, uint32_t v)
+  {
+    for (uint8_t i = 0; i < 4; i++)
+      p[i] = (uint8_t)(v >> (8 * i));
+  }
+};
+
+#endif // PUMP_LOG_RECORD_H
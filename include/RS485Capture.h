@@ -0,0 +1,233 @@
+#ifndef RS485_CAPTURE_H
+#define RS485_CAPTURE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// ============================================================================
+// RS485 BUS CAPTURE - COMPACT BINARY RING OF RAW RX/TX BYTES
+// ============================================================================
+// Plain C++ (no Arduino dependency): the firmware records into it, and
+// tools/rs485_replay.cpp reads the exported file back through the same
+// RS485FrameDecoder that readRS485Data() uses.
+//
+// Exported file (little-endian):
+//   Header 16 bytes : "KPLC" | version(1) | flags(1) | reserved(2) | baud(4) | droppedRecords(4)
+//   Record          : tag(1) | deltaUs (LEB128 varint) | payload (len bytes)
+//                     tag bit7 = direction (1 = TX, 0 = RX), bits 0-6 = len (1..127)
+//                     deltaUs = time since the previous record (0 for the first one)
+//
+// When the ring is full the oldest records are evicted whole; the header
+// counts how many were lost so a replay knows the capture is truncated.
+// ============================================================================
+
+#define RS485_CAPTURE_MAGIC "KPLC"
+#define RS485_CAPTURE_VERSION 1
+#define RS485_CAPTURE_HEADER_SIZE 16
+#define RS485_CAPTURE_MAX_CHUNK 127
+#define RS485_CAPTURE_TAG_TX 0x80
+
+struct RS485CaptureRecord
+{
+  bool tx;
+  uint32_t deltaUs;
+  uint8_t length;
+  const uint8_t *data; // Points into the exported buffer
+};
+
+template <size_t N>
+class RS485CaptureRing
+{
+  static_assert(N >= 4 * (1 + 5 + RS485_CAPTURE_MAX_CHUNK), "capture ring too small");
+
+public:
+  RS485CaptureRing() { clear(); }
+
+  void clear()
+  {
+    tail = 0;
+    used = 0;
+    lastUs = 0;
+    haveLast = false;
+    recordCount = 0;
+    dropped = 0;
+  }
+
+  // Append raw bytes seen on the bus; longer writes are split into 127-byte records
+  void record(bool tx, const uint8_t *data, size_t len, uint64_t nowUs)
+  {
+    while (len > 0)
+    {
+      uint8_t chunk = len > RS485_CAPTURE_MAX_CHUNK ? RS485_CAPTURE_MAX_CHUNK : (uint8_t)len;
+      uint32_t delta = haveLast ? (uint32_t)(nowUs - lastUs) : 0;
+      lastUs = nowUs;
+      haveLast = true;
+
+      uint8_t varint[5];
+      size_t varintLen = encodeVarint(delta, varint);
+      size_t need = 1 + varintLen + chunk;
+      while (N - used < need)
+      {
+        evictOldest();
+      }
+
+      put((uint8_t)((tx ? RS485_CAPTURE_TAG_TX : 0) | chunk));
+      for (size_t i = 0; i < varintLen; i++)
+        put(varint[i]);
+      for (size_t i = 0; i < chunk; i++)
+        put(data[i]);
+
+      recordCount++;
+      data += chunk;
+      len -= chunk;
+    }
+  }
+
+  // Bytes exportTo() will produce
+  size_t exportSize() const { return RS485_CAPTURE_HEADER_SIZE + used; }
+
+  // Linearise header + records (oldest first) into out. Returns bytes written, 0 if cap is too small.
+  size_t exportTo(uint8_t *out, size_t cap, uint32_t baud) const
+  {
+    if (cap < exportSize())
+      return 0;
+    memcpy(out, RS485_CAPTURE_MAGIC, 4);
+    out[4] = RS485_CAPTURE_VERSION;
+    out[5] = 0;
+    out[6] = 0;
+    out[7] = 0;
+    putLE32(out + 8, baud);
+    putLE32(out + 12, dropped);
+    for (size_t i = 0; i < used; i++)
+    {
+      out[RS485_CAPTURE_HEADER_SIZE + i] = buf[(tail + i) % N];
+    }
+    return exportSize();
+  }
+
+  uint32_t records() const { return recordCount; }
+  uint32_t droppedRecords() const { return dropped; }
+  size_t bytesUsed() const { return used; }
+  static size_t capacity() { return N; }
+
+private:
+  static size_t encodeVarint(uint32_t v, uint8_t *out)
+  {
+    size_t n = 0;
+    do
+    {
+      uint8_t b = v & 0x7F;
+      v >>= 7;
+      out[n++] = v ? (b | 0x80) : b;
+    } while (v);
+    return n;
+  }
+
+  static void putLE32(uint8_t *p, uint32_t v)
+  {
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+    p[2] = (v >> 16) & 0xFF;
+    p[3] = (v >> 24) & 0xFF;
+  }
+
+  void put(uint8_t b)
+  {
+    buf[(tail + used) % N] = b;
+    used++;
+  }
+
+  uint8_t at(size_t i) const { return buf[(tail + i) % N]; }
+
+  void evictOldest()
+  {
+    size_t len = at(0) & RS485_CAPTURE_MAX_CHUNK;
+    size_t pos = 1;
+    while (at(pos) & 0x80)
+      pos++;
+    pos++; // Last varint byte
+    pos += len;
+    tail = (tail + pos) % N;
+    used -= pos;
+    recordCount--;
+    dropped++;
+  }
+
+  uint8_t buf[N];
+  size_t tail;
+  size_t used;
+  uint64_t lastUs;
+  bool haveLast;
+  uint32_t recordCount;
+  uint32_t dropped;
+};
+
+// Sequential reader over an exported capture (file or MQTT/web download)
+class RS485CaptureReader
+{
+public:
+  RS485CaptureReader() : data(nullptr), size(0), pos(0), baudRate(0), dropped(0) {}
+
+  bool open(const uint8_t *capture, size_t captureSize)
+  {
+    if (captureSize < RS485_CAPTURE_HEADER_SIZE || memcmp(capture, RS485_CAPTURE_MAGIC, 4) != 0 ||
+        capture[4] != RS485_CAPTURE_VERSION)
+    {
+      return false;
+    }
+    data = capture;
+    size = captureSize;
+    pos = RS485_CAPTURE_HEADER_SIZE;
+    baudRate = getLE32(capture + 8);
+    dropped = getLE32(capture + 12);
+    return true;
+  }
+
+  // False at end of capture or on a truncated record
+  bool next(RS485CaptureRecord &rec)
+  {
+    if (pos >= size)
+      return false;
+    uint8_t tag = data[pos++];
+    uint32_t delta = 0;
+    int shift = 0;
+    while (true)
+    {
+      if (pos >= size || shift > 28)
+        return false;
+      uint8_t b = data[pos++];
+      delta |= (uint32_t)(b & 0x7F) << shift;
+      if (!(b & 0x80))
+        break;
+      shift += 7;
+    }
+    uint8_t len = tag & RS485_CAPTURE_MAX_CHUNK;
+    if (len == 0 || pos + len > size)
+      return false;
+    rec.tx = (tag & RS485_CAPTURE_TAG_TX) != 0;
+    rec.deltaUs = delta;
+    rec.length = len;
+    rec.data = data + pos;
+    pos += len;
+    return true;
+  }
+
+  void rewind() { pos = RS485_CAPTURE_HEADER_SIZE; }
+  uint32_t baud() const { return baudRate; }
+  uint32_t droppedRecords() const { return dropped; }
+
+private:
+  static uint32_t getLE32(const uint8_t *p)
+  {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+  }
+
+  const uint8_t *data;
+  size_t size;
+  size_t pos;
+  uint32_t baudRate;
+  uint32_t dropped;
+};
+
+#endif // RS485_CAPTURE_H
@@ -0,0 +1,306 @@
+#ifndef RS485_FRAME_DECODER_H
+#define RS485_FRAME_DECODER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "TTLCodec.h"
+
+// ============================================================================
+// RS485 FRAME DECODER - BYTE-AT-A-TIME, NON-BLOCKING
+// ============================================================================
+// Plain C++ (no Arduino / FreeRTOS dependency) so the exact same decoder used
+// by readRS485Data() also compiles on the host for replay and benchmarking.
+//
+// Frame kinds seen on the KPL/TTL bus:
+//   Price response : [7][ID 11-20][S/E][8]                 4 bytes
+//   Set-time reply : [7][99][S/E][8]                       4 bytes
+//   Pump log       : [1][2][data 2-28][3][checksum][4]    32 bytes
+//   Echo (price)   : [9][ID 11-20][6 digits][cs][10]      10 bytes (our own TX)
+//   Echo (time)    : [93][99][d m y h m s][cs][94]        10 bytes (our own TX)
+//
+// Bytes are pushed into a ring buffer as they arrive. next() only ever looks
+// at what is already buffered: a candidate frame is validated progressively
+// (header, inner markers, footer, checksum) and on the first mismatch ONE
+// byte is dropped and the scan restarts at the next possible header. The
+// buffer is never flushed wholesale, so a valid frame following noise or a
+// truncated frame is still recovered.
+// ============================================================================
+
+#define RS485_FRAME_MAX_LEN 32 // Longest frame (pump log)
+
+enum RS485FrameKind : uint8_t
+{
+  RS485_FRAME_NONE = 0,
+  RS485_FRAME_PRICE_RESPONSE,
+  RS485_FRAME_SET_TIME_REPLY,
+  RS485_FRAME_PUMP_LOG,
+  RS485_FRAME_ECHO,
+  RS485_FRAME_KIND_COUNT
+};
+
+struct RS485Frame
+{
+  RS485FrameKind kind;
+  uint8_t length;
+  uint32_t rxMs; // Time the last byte of the frame was fed
+  uint8_t data[RS485_FRAME_MAX_LEN];
+};
+
+struct RS485DecoderStats
+{
+  uint32_t bytesIn;                         // Bytes fed into the decoder
+  uint32_t frames[RS485_FRAME_KIND_COUNT];  // Valid frames per kind
+  uint32_t bytesDiscarded;                  // Bytes dropped while resynchronising
+  uint32_t resyncs;                         // Times the decoder lost and re-acquired framing
+  uint32_t badChecksum;                     // Pump logs rejected on checksum
+  uint32_t staleDrops;                      // Partial frames abandoned after an idle gap
+  uint32_t overflowBytes;                   // Oldest bytes overwritten because the ring was full
+};
+
+// XOR checksum of a pump log: 0xA5 ^ bytes[2..28] (see TTL_CHECKSUM_VERIFY.cpp)
+inline uint8_t rs485LogChecksum(const uint8_t *frame) { return TTLPumpLog::checksum(frame); }
+
+// Fixed-size byte ring; push() overwrites the oldest byte when full
+template <size_t N>
+class RS485ByteRing
+{
+  static_assert((N & (N - 1)) == 0, "ring size must be a power of two");
+
+public:
+  RS485ByteRing() : head(0), count(0) {}
+
+  // Returns false when the oldest byte had to be overwritten
+  bool push(uint8_t b)
+  {
+    bool kept = true;
+    if (count == N)
+    {
+      head = (head + 1) & (N - 1);
+      count--;
+      kept = false;
+    }
+    buf[(head + count) & (N - 1)] = b;
+    count++;
+    return kept;
+  }
+
+  uint8_t at(size_t i) const { return buf[(head + i) & (N - 1)]; }
+
+  void drop(size_t n)
+  {
+    if (n > count)
+      n = count;
+    head = (head + n) & (N - 1);
+    count -= n;
+  }
+
+  void copyOut(uint8_t *dst, size_t n) const
+  {
+    for (size_t i = 0; i < n; i++)
+    {
+      dst[i] = at(i);
+    }
+  }
+
+  size_t size() const { return count; }
+  bool empty() const { return count == 0; }
+  void clear() { head = count = 0; }
+
+private:
+  uint8_t buf[N];
+  size_t head;
+  size_t count;
+};
+
+class RS485FrameDecoder
+{
+public:
+  static const size_t kRingSize = 512;
+  // A partial frame that receives no byte for this long is abandoned.
+  // 9600 baud = ~1 ms per byte, so a 32-byte log arrives in ~35 ms.
+  static const uint32_t kStaleGapMs = 40;
+
+  RS485FrameDecoder() { reset(); }
+
+  void reset()
+  {
+    ring.clear();
+    memset(&counters, 0, sizeof(counters));
+    lastByteMs = 0;
+    inGarbage = false;
+  }
+
+  // Push raw bytes; never blocks. Returns the number of bytes accepted.
+  size_t feed(const uint8_t *data, size_t len, uint32_t nowMs)
+  {
+    for (size_t i = 0; i < len; i++)
+    {
+      if (!ring.push(data[i]))
+      {
+        counters.overflowBytes++;
+      }
+    }
+    counters.bytesIn += len;
+    if (len > 0)
+    {
+      lastByteMs = nowMs;
+    }
+    return len;
+  }
+
+  // Extract the next complete frame, if one is buffered. Never blocks.
+  bool next(RS485Frame &out, uint32_t nowMs)
+  {
+    while (!ring.empty())
+    {
+      RS485FrameKind kind = RS485_FRAME_NONE;
+      size_t length = 0;
+      Verdict verdict = check(kind, length);
+
+      if (verdict == MATCH)
+      {
+        out.kind = kind;
+        out.length = (uint8_t)length;
+        out.rxMs = lastByteMs;
+        ring.copyOut(out.data, length);
+        ring.drop(length);
+        counters.frames[kind]++;
+        inGarbage = false;
+        return true;
+      }
+
+      if (verdict == NEED_MORE)
+      {
+        if ((uint32_t)(nowMs - lastByteMs) < kStaleGapMs)
+        {
+          return false; // Wait for the rest of the frame
+        }
+        counters.staleDrops++;
+      }
+
+      // REJECT (or stale partial): drop one byte and rescan from the next one
+      discardOne();
+    }
+    return false;
+  }
+
+  // True while a partial frame is buffered (bus is mid-frame)
+  bool midFrame() const { return !ring.empty(); }
+
+  uint32_t lastRxMs() const { return lastByteMs; }
+  size_t pending() const { return ring.size(); }
+  const RS485DecoderStats &stats() const { return counters; }
+  void resetStats() { memset(&counters, 0, sizeof(counters)); }
+
+private:
+  enum Verdict
+  {
+    NEED_MORE,
+    MATCH,
+    REJECT
+  };
+
+  void discardOne()
+  {
+    ring.drop(1);
+    counters.bytesDiscarded++;
+    if (!inGarbage)
+    {
+      counters.resyncs++;
+      inGarbage = true;
+    }
+  }
+
+  static bool isPumpId(uint8_t id) { return id >= 11 && id <= 20; }
+  static bool isDigit(uint8_t c) { return c >= '0' && c <= '9'; }
+
+  // Validate the candidate at the head of the ring using only the bytes
+  // that are already buffered.
+  Verdict check(RS485FrameKind &kind, size_t &length)
+  {
+    const size_t avail = ring.size();
+    const uint8_t b0 = ring.at(0);
+
+    switch (b0)
+    {
+    case 7: // [7][ID][S/E][8]
+    {
+      length = 4;
+      if (avail > 1 && !isPumpId(ring.at(1)) && ring.at(1) != 99)
+        return REJECT;
+      if (avail > 2 && ring.at(2) != 'S' && ring.at(2) != 'E')
+        return REJECT;
+      if (avail < 4)
+        return NEED_MORE;
+      if (ring.at(3) != 8)
+        return REJECT;
+      kind = ring.at(1) == 99 ? RS485_FRAME_SET_TIME_REPLY : RS485_FRAME_PRICE_RESPONSE;
+      return MATCH;
+    }
+
+    case 1: // [1][2][...][3][cs][4]
+    {
+      length = RS485_FRAME_MAX_LEN;
+      if (avail > 1 && ring.at(1) != 2)
+        return REJECT;
+      if (avail > 29 && ring.at(29) != 3)
+        return REJECT;
+      if (avail < RS485_FRAME_MAX_LEN)
+        return NEED_MORE;
+      if (ring.at(31) != 4)
+        return REJECT;
+      uint8_t frame[RS485_FRAME_MAX_LEN];
+      ring.copyOut(frame, RS485_FRAME_MAX_LEN);
+      if (rs485LogChecksum(frame) != frame[30])
+      {
+        counters.badChecksum++;
+        return REJECT;
+      }
+      kind = RS485_FRAME_PUMP_LOG;
+      return MATCH;
+    }
+
+    case 9:  // [9][ID][6 digits][cs][10]
+    case 93: // [93][99][6 bytes][cs][94]
+    {
+      length = 10;
+      const bool price = (b0 == 9);
+      if (avail > 1 && (price ? !isPumpId(ring.at(1)) : ring.at(1) != 99))
+        return REJECT;
+      if (price)
+      {
+        for (size_t i = 2; i < 8 && i < avail; i++)
+        {
+          if (!isDigit(ring.at(i)))
+            return REJECT;
+        }
+      }
+      if (avail < 10)
+        return NEED_MORE;
+      if (ring.at(9) != (price ? 10 : 94))
+        return REJECT;
+      uint8_t checksum = price ? 0x5A : 0xA5;
+      for (size_t i = 1; i < 8; i++)
+      {
+        checksum ^= ring.at(i);
+      }
+      if (checksum != ring.at(8))
+        return REJECT;
+      kind = RS485_FRAME_ECHO;
+      return MATCH;
+    }
+
+    default:
+      return REJECT;
+    }
+  }
+
+  RS485ByteRing<kRingSize> ring;
+  RS485DecoderStats counters;
+  uint32_t lastByteMs;
+  bool inGarbage;
+};
+
+#endif // RS485_FRAME_DECODER_H
@@ -0,0 +1,294 @@
+#ifndef RS485_SCHEDULER_H
+#define RS485_SCHEDULER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// ============================================================================
+// RS485 TRANSACTION SCHEDULER - ONE OWNER OF THE BUS, PRIORITY CLASSES
+// ============================================================================
+// Every frame that goes out on Serial2 is either a queued RS485Request or is
+// cleared with mayTransmit()/noteTransmit() by one of the rs485Task engines
+// (PriceChangeEngine, LogRecoveryEngine). Only rs485Task touches Serial2.
+//
+// Priority (lower value wins): price > time sync > log recovery > printer.
+// A class may transmit when
+//   - the bus is quiet: previous frame's air time + turnaround + its gapAfterMs,
+//   - no queued request of a higher-priority class is waiting,
+//   - no queued request of the same or a higher-priority class is waiting for
+//     its reply (replies of different classes never look alike, so a price
+//     command may still go out while a set-time reply is pending).
+// One queued request is in flight at a time. Requests that expect a reply
+// ([7][replyId][S/E][8]) complete on the reply or on timeout; fire-and-forget
+// requests complete as soon as they are on the bus.
+//
+// Completions are returned to the caller (RS485Completion) instead of being
+// invoked here, so the owner can run callbacks outside its lock.
+// Plain C++ with an injected clock (nowMs).
+// ============================================================================
+
+#define RS485_REQUEST_MAX_LEN 67 // Longest frame: printer company name + address
+#define RS485_SCHED_SLOTS 40     // Queued requests, all classes (a full printer setup is ~36 frames)
+
+enum RS485Class : uint8_t
+{
+  RS485_CLASS_PRICE = 0,    // Price change commands (PriceChangeEngine)
+  RS485_CLASS_TIME_SYNC,    // Set time / startup
+  RS485_CLASS_LOG_RECOVERY, // 0xC8 log requests (LogRecoveryEngine)
+  RS485_CLASS_PRINTER,      // Printer setup frames
+  RS485_CLASS_COUNT
+};
+
+enum RS485Result : uint8_t
+{
+  RS485_RESULT_SENT = 0, // Fire-and-forget frame is on the bus
+  RS485_RESULT_OK,       // Reply 'S'
+  RS485_RESULT_REJECTED, // Reply 'E'
+  RS485_RESULT_TIMEOUT   // No reply within timeoutMs
+};
+
+struct RS485Request;
+// Runs in rs485Task - keep it short (log, set a flag, queue something)
+typedef void (*RS485Callback)(const RS485Request &request, RS485Result result, uint32_t rttMs);
+
+struct RS485Request
+{
+  RS485Class cls;
+  uint8_t replyId;     // 0 = fire and forget, else wait for [7][replyId][S/E][8]
+  uint16_t timeoutMs;  // Reply timeout (0 = owner decides, e.g. from the latency histograms)
+  uint16_t gapAfterMs; // Extra quiet time after this frame (printer needs time to store settings)
+  uint8_t len;
+  uint8_t data[RS485_REQUEST_MAX_LEN];
+  RS485Callback done;  // NULL = no notification
+  uint32_t tag;        // Caller's own value, handed back in the callback
+  uint32_t submitMs;   // Set by the scheduler
+  uint32_t sentMs;     // Set by the scheduler
+};
+
+struct RS485Completion
+{
+  RS485Request request;
+  RS485Result result;
+  uint32_t rttMs;
+};
+
+struct RS485ClassStats
+{
+  uint32_t submitted;
+  uint32_t sent;      // Frames on the bus (engine frames included)
+  uint32_t replies;   // 'S' or 'E'
+  uint32_t timeouts;
+  uint32_t dropped;   // Rejected on submit: no free slot
+  uint32_t maxWaitMs; // Longest submit → transmit
+};
+
+class RS485Scheduler
+{
+public:
+  RS485Scheduler(uint32_t baudRate = 9600, uint32_t turnaroundMs = 5) : baud(baudRate), turnaround(turnaroundMs)
+  {
+    memset(stats, 0, sizeof(stats));
+    memset(head, kNone, sizeof(head));
+    memset(tail, kNone, sizeof(tail));
+    for (uint8_t i = 0; i < RS485_SCHED_SLOTS; i++)
+      link[i] = i + 1 < RS485_SCHED_SLOTS ? i + 1 : kNone;
+    freeHead = 0;
+    inFlight = false;
+    quietUntilMs = 0;
+  }
+
+  // Frame air time in ms at the configured baud (8N1, rounded up)
+  uint32_t airtimeMs(size_t len) const { return (uint32_t)((len * 10 * 1000 + baud - 1) / baud); }
+
+  // Queue a request (copied). Returns false when all slots are taken.
+  bool submit(const RS485Request &request, uint32_t nowMs)
+  {
+    if (request.cls >= RS485_CLASS_COUNT || request.len == 0 || request.len > RS485_REQUEST_MAX_LEN)
+      return false;
+    stats[request.cls].submitted++;
+    if (freeHead == kNone)
+    {
+      stats[request.cls].dropped++;
+      return false;
+    }
+    uint8_t i = freeHead;
+    freeHead = link[i];
+    slots[i] = request;
+    slots[i].submitMs = nowMs;
+    link[i] = kNone;
+    if (tail[request.cls] == kNone)
+      head[request.cls] = i;
+    else
+      link[tail[request.cls]] = i;
+    tail[request.cls] = i;
+    return true;
+  }
+
+  // May an engine of class `cls` put a frame on the bus now?
+  bool mayTransmit(RS485Class cls, uint32_t nowMs) const
+  {
+    if ((int32_t)(nowMs - quietUntilMs) < 0)
+      return false;
+    if (inFlight && current.cls <= cls)
+      return false;
+    for (uint8_t c = 0; c < cls; c++)
+    {
+      if (head[c] != kNone)
+        return false;
+    }
+    return true;
+  }
+
+  // An engine put `len` bytes on the bus
+  void noteTransmit(RS485Class cls, size_t len, uint32_t nowMs, uint32_t gapAfterMs = 0)
+  {
+    stats[cls].sent++;
+    quietUntilMs = nowMs + airtimeMs(len) + turnaround + gapAfterMs;
+  }
+
+  // Next queued request to transmit (NULL = none allowed now). After writing
+  // it to the bus the caller must call transmitted() with its class.
+  const RS485Request *next(uint32_t nowMs) const
+  {
+    if (inFlight)
+      return NULL;
+    for (uint8_t c = 0; c < RS485_CLASS_COUNT; c++)
+    {
+      if (head[c] != kNone)
+        return mayTransmit((RS485Class)c, nowMs) ? &slots[head[c]] : NULL;
+    }
+    return NULL;
+  }
+
+  // The request returned by next() is on the bus. Returns true with a
+  // completion for fire-and-forget requests.
+  bool transmitted(RS485Class c, uint32_t nowMs, RS485Completion &out)
+  {
+    if (c >= RS485_CLASS_COUNT || head[c] == kNone)
+      return false;
+    uint8_t i = head[c];
+    RS485Request &r = slots[i];
+    r.sentMs = nowMs;
+    uint32_t waited = nowMs - r.submitMs;
+    if (waited > stats[c].maxWaitMs)
+      stats[c].maxWaitMs = waited;
+    noteTransmit(c, r.len, nowMs, r.gapAfterMs);
+
+    bool fireAndForget = r.replyId == 0;
+    if (fireAndForget)
+    {
+      out.request = r;
+      out.result = RS485_RESULT_SENT;
+      out.rttMs = 0;
+    }
+    else
+    {
+      current = r;
+      inFlight = true;
+    }
+
+    // Back to the free list
+    head[c] = link[i];
+    if (head[c] == kNone)
+      tail[c] = kNone;
+    link[i] = freeHead;
+    freeHead = i;
+    return fireAndForget;
+  }
+
+  // A [7][id][S/E][8] reply arrived. Returns true (with the completion) if it answers the request in flight.
+  bool onCommandReply(uint8_t id, bool success, uint32_t nowMs, RS485Completion &out)
+  {
+    if (!inFlight || current.replyId != id)
+      return false;
+    inFlight = false;
+    stats[current.cls].replies++;
+    out.request = current;
+    out.result = success ? RS485_RESULT_OK : RS485_RESULT_REJECTED;
+    out.rttMs = nowMs - current.sentMs;
+    return true;
+  }
+
+  // Expire the request in flight. Returns true with a TIMEOUT completion.
+  bool poll(uint32_t nowMs, RS485Completion &out)
+  {
+    if (!inFlight || (uint32_t)(nowMs - current.sentMs) < current.timeoutMs)
+      return false;
+    inFlight = false;
+    stats[current.cls].timeouts++;
+    out.request = current;
+    out.result = RS485_RESULT_TIMEOUT;
+    out.rttMs = nowMs - current.sentMs;
+    return true;
+  }
+
+  // Milliseconds until the scheduler next needs attention; 0xFFFFFFFF when idle
+  uint32_t msUntilNextEvent(uint32_t nowMs) const
+  {
+    uint32_t wait = 0xFFFFFFFF;
+    if (inFlight)
+    {
+      uint32_t age = nowMs - current.sentMs;
+      wait = age < current.timeoutMs ? current.timeoutMs - age : 0;
+    }
+    else if (queued() > 0)
+    {
+      wait = (int32_t)(nowMs - quietUntilMs) >= 0 ? 0 : quietUntilMs - nowMs;
+    }
+    return wait;
+  }
+
+  bool waitingReply() const { return inFlight; }
+
+  uint8_t queued(RS485Class cls) const
+  {
+    uint8_t n = 0;
+    for (uint8_t i = head[cls]; i != kNone; i = link[i])
+      n++;
+    return n;
+  }
+
+  uint8_t queued() const
+  {
+    uint8_t n = 0;
+    for (uint8_t c = 0; c < RS485_CLASS_COUNT; c++)
+      n += queued((RS485Class)c);
+    return n;
+  }
+
+  static const char *className(RS485Class cls)
+  {
+    switch (cls)
+    {
+    case RS485_CLASS_PRICE:
+      return "price";
+    case RS485_CLASS_TIME_SYNC:
+      return "time";
+    case RS485_CLASS_LOG_RECOVERY:
+      return "recovery";
+    case RS485_CLASS_PRINTER:
+      return "printer";
+    default:
+      return "?";
+    }
+  }
+
+  RS485ClassStats stats[RS485_CLASS_COUNT];
+
+private:
+  enum : uint8_t { kNone = 0xFF };
+
+  RS485Request slots[RS485_SCHED_SLOTS];
+  uint8_t link[RS485_SCHED_SLOTS]; // Next slot in a class FIFO or in the free list
+  uint8_t head[RS485_CLASS_COUNT];
+  uint8_t tail[RS485_CLASS_COUNT];
+  uint8_t freeHead;
+  RS485Request current; // Request waiting for its reply
+  bool inFlight;
+  uint32_t quietUntilMs;
+  uint32_t baud;
+  uint32_t turnaround;
+};
+
+#endif // RS485_SCHEDULER_H
@@ -10,6 +10,9 @@
 #define TX_PIN             32 //17-ASR //32 13   5. / bo ISOlated màu đen: 16 / bo KC868: 5
 #define ITEM_SIZE_RS485     125
 #define RS485BaudRate       9600
+#define RS485_RX_TIMEOUT_SYMBOLS 2 // UART báo có dữ liệu sau 2 byte-time im lặng (hết frame)
+#define RS485_POLL_MS       10    // Chu kỳ poll khi build với -DRS485_RX_POLLING (so sánh)
+#define RS485_TURNAROUND_MS 5     // Khoảng lặng tối thiểu sau mỗi frame TX (RS485Scheduler)
 #define WIFI_TIMEOUT_MS     20000
 #define OUT1                15    // 15 bo A2
 #define OUT2                2     // 2  bo A2   , 18 Còi của bo ASR
@@ -73,6 +76,10 @@ extern const char* TopicUpdatePrice;
 extern const char* TopicGetPrice; // Topic to request current prices
 extern const char* TopicRequestLog; // Topic to request logs from Flash
 extern const char* TopicSetupPrinter; // Topic to set name type of oil
+extern const char* TopicRS485Capture; // Topic to download RS485 bus capture
+extern const char* TopicRecoverLog; // Topic to re-read log ranges from the TTL box
+extern const char* TopicRequestLogByDate; // Topic to query archived logs by date range
+extern const char* TopicGetPriceHistory; // Topic to query the price change journal
 
 extern const uint8_t idVoiList[]; // Thêm các ID vòi khác tại đây
 extern const char* hardwareVersion;
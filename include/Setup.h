@@ -3,41 +3,21 @@
 #include <LittleFS.h>
 #include <ArduinoJson.h>
 #include <structdata.h>
+#include "TTLCodec.h"
 
 
-// Hàm tính checksum
-// CRITICAL FIX: Must include footer byte (29) in checksum calculation
+// Hàm tính checksum: 0xA5 ^ byte[2..28] (layout in TTLCodec.h)
 // Protocol: [0x01][0x02][data 2-28][0x03=footer][checksum][0x04]
 uint8_t calculateChecksum_LogData(const uint8_t* data, size_t length) {
-  uint8_t checksum = 0xA5; // Giá trị ban đầu
-  // XOR from byte 2 to byte 29 (include footer byte 29)
-  for (size_t i = 2; i < 29; i++) { // FIXED: 29 → 30 to include footer
-    checksum ^= data[i];
-  }
-  return checksum;
+  return TTLPumpLog::checksum(data);
 }
 
-// Hàm gán Buffer Data Log vào PumpLog
+// Hàm gán Buffer Data Log vào PumpLog
 
 void ganLog(byte *buffer, PumpLog &log) {
-  log.send1 = buffer[0];
-  log.send2 = buffer[1];
-  log.idVoi = buffer[2];
-  log.viTriLogCot = (buffer[3] << 8) | buffer[4];
-  log.viTriLogData = (buffer[5] << 8) | buffer[6];
-  log.maLanBom = (buffer[7] << 8) | buffer[8];
-  log.soLitBom = (buffer[9] << 24) | (buffer[10] << 16) | (buffer[11] << 8) | buffer[12];
-  log.donGia = (buffer[13] << 8) | buffer[14];
-  log.soTotalTong = (buffer[15] << 24) | (buffer[16] << 16) | (buffer[17] << 8) | buffer[18];
-  log.soTienBom = (buffer[19] << 24) | (buffer[20] << 16) | (buffer[21] << 8) | buffer[22];
-  log.ngay = buffer[23];
-  log.thang = buffer[24];
-  log.nam = buffer[25];
-  log.gio = buffer[26];
-  log.phut = buffer[27];
-  log.giay = buffer[28];
-  log.checksum = buffer[29];
-  log.send3 = buffer[30];
+  TTLPumpLog::decode(buffer, log);
+  log.send4 = buffer[31]; // 0x04 end marker
+  log.cycleSave = 0;
   log.mqttSent = 0;      // Default to pending/failed
   log.mqttSentTime = 0;  // Default to 0
 }
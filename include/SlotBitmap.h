@@ -0,0 +1,93 @@
+#ifndef SLOT_BITMAP_H
+#define SLOT_BITMAP_H
+
+#include <stdint.h>
+#include <string.h>
+
+// ============================================================================
+// SLOT BITMAP - ONE BIT PER LOG SLOT (1..N) WITH A RUNNING COUNT
+// ============================================================================
+// Used for the "stored but not yet delivered to MQTT" set over the 2046-slot
+// ring: 256 bytes of RAM, O(1) set/clear/count, next-N queries by word scan.
+// Not thread-safe; the owner guards it.
+// ============================================================================
+
+template <uint16_t N>
+class SlotBitmap
+{
+public:
+  SlotBitmap() { clearAll(); }
+
+  void clearAll()
+  {
+    memset(words, 0, sizeof(words));
+    bits = 0;
+  }
+
+  bool test(uint16_t slot) const
+  {
+    return slot >= 1 && slot <= N && (words[(slot - 1) >> 5] >> ((slot - 1) & 31)) & 1u;
+  }
+
+  void set(uint16_t slot, bool on)
+  {
+    if (slot < 1 || slot > N || test(slot) == on)
+      return;
+    words[(slot - 1) >> 5] ^= 1u << ((slot - 1) & 31);
+    bits += on ? 1 : -1;
+  }
+
+  uint16_t count() const { return bits; }
+
+  // Packed form (bit i of byte j = slot 8j + i + 1) for persisting the set
+  enum : uint16_t { kBytes = (N + 7) / 8 };
+
+  void toBytes(uint8_t *out) const
+  {
+    for (uint16_t j = 0; j < kBytes; j++)
+      out[j] = (uint8_t)(words[j >> 2] >> (8 * (j & 3)));
+  }
+
+  void fromBytes(const uint8_t *in)
+  {
+    clearAll();
+    for (uint16_t slot = 1; slot <= N; slot++)
+      set(slot, (in[(slot - 1) >> 3] >> ((slot - 1) & 7)) & 1u);
+  }
+
+  // Up to `max` set slots starting at `from` (wrapping past N to 1); returns how many
+  uint16_t next(uint16_t from, uint16_t *out, uint16_t max) const
+  {
+    if (from < 1 || from > N)
+      from = 1;
+    uint16_t found = collect(from - 1, N, out, max, 0);
+    return collect(0, from - 1, out, max, found);
+  }
+
+private:
+  // Set bits in [lo, hi) as 1-based slots, skipping clear words
+  uint16_t collect(uint16_t lo, uint16_t hi, uint16_t *out, uint16_t max, uint16_t found) const
+  {
+    uint16_t i = lo;
+    while (i < hi && found < max)
+    {
+      uint32_t w = words[i >> 5] >> (i & 31);
+      if (w == 0)
+      {
+        i = (uint16_t)((i | 31) + 1);
+        continue;
+      }
+      i += (uint16_t)__builtin_ctz(w);
+      if (i >= hi)
+        break;
+      out[found++] = i + 1;
+      i++;
+    }
+    return found;
+  }
+
+  uint32_t words[(N + 31) / 32];
+  uint16_t bits;
+};
+
+#endif // SLOT_BITMAP_H
@@ -0,0 +1,100 @@
+#ifndef STORAGE_SERVICE_H
+#define STORAGE_SERVICE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// ============================================================================
+// STORAGE SERVICE - ONE OWNER OF THE FLASH STORES, TYPED REQUESTS
+// ============================================================================
+// storageTask (main.cpp) is the only task that touches the log journal, the
+// log archive and the price file at run time. Other tasks submit a
+// StorageRequest on storageQueue and, when they need the result, sleep until
+// the task signals completion; nobody takes a flash lock, times out on it or
+// retries. Pump logs keep their own intake (saveLogQueue, write-behind cache,
+// group commit) and are committed between requests. The price table lives
+// in RAM; storageTask writes it behind (STORAGE_SAVE_PRICES, issued by the
+// task itself once a burst of changes has settled).
+//
+// Priority: urgent requests (reset counter) go to the front of the queue,
+// everything else to the back; the task serves the whole queue before it
+// commits cached logs, unless the oldest cached log has reached its
+// durability deadline.
+//
+// StorageStats keeps, per request type, how long requests waited in the
+// queue and how long serving them took (device status "storage"); group
+// commits have their own counters (logCommit).
+// Plain C++; the FreeRTOS glue lives in main.cpp.
+// ============================================================================
+
+#define STORAGE_QUEUE_LEN 32
+#define STORAGE_WAITERS 8  // storageCalls that may wait at once (one event bit each)
+#define STORAGE_NO_WAITER 0xFF
+
+enum StorageOp : uint8_t
+{
+  STORAGE_READ_LOG = 0,     // Journal slot `pos` → *(PumpLog *)data (write-behind cache first)
+  STORAGE_READ_ARCHIVE,     // Archive ID `value` → *(PumpLog *)data
+  STORAGE_READ_RANGE,       // *(LogRangeRead *)data: consecutive slots / archive IDs in one pass
+  STORAGE_MARK_SENT,        // STATUS record: slot `pos` delivered at `value` (unix s)
+  STORAGE_SAVE_PRICES,      // RAM price table → price file (issued by storageTask itself when due)
+  STORAGE_SAVE_RESET_COUNT, // Restart counter `value` (ConfigStore commit)
+  STORAGE_CLEAR_LOGS,       // Journal + archive + write-behind cache
+  STORAGE_RUN,              // run(data) on the storage task (queries over the stores)
+  STORAGE_OP_COUNT
+};
+
+struct StorageRequest
+{
+  uint8_t op;        // StorageOp
+  uint8_t waiter;    // Event bit to set when done, STORAGE_NO_WAITER for fire-and-forget
+  uint16_t pos;      // Journal slot
+  uint32_t value;    // Archive ID, timestamp, counter
+  uint32_t queuedUs; // micros() at submit
+  void *data;        // In / out buffer; the waiter keeps it alive until done
+  void (*run)(void *data);
+  void (*done)(const StorageRequest &request, bool ok); // Fire-and-forget result, called on storageTask
+};
+
+struct StorageStats
+{
+  struct Op
+  {
+    uint32_t count;
+    uint32_t failed;
+    uint32_t waitUsMax;
+    uint32_t serviceUsMax;
+    uint64_t waitUsSum;
+    uint64_t serviceUsSum;
+  };
+  Op ops[STORAGE_OP_COUNT];
+  uint8_t queueHighWater; // Most requests seen waiting
+
+  StorageStats() { memset(this, 0, sizeof(*this)); }
+
+  void record(uint8_t op, bool ok, uint32_t waitUs, uint32_t serviceUs)
+  {
+    if (op >= STORAGE_OP_COUNT)
+      return;
+    Op &o = ops[op];
+    o.count++;
+    o.failed += ok ? 0 : 1;
+    o.waitUsSum += waitUs;
+    o.serviceUsSum += serviceUs;
+    o.waitUsMax = waitUs > o.waitUsMax ? waitUs : o.waitUsMax;
+    o.serviceUsMax = serviceUs > o.serviceUsMax ? serviceUs : o.serviceUsMax;
+  }
+
+  static const char *name(uint8_t op)
+  {
+    static const char *const names[STORAGE_OP_COUNT] = {"readLog",    "readArchive",    "readRange",
+                                                        "markSent",   "savePrices",     "saveResetCount",
+                                                        "clearLogs",  "run"};
+    return op < STORAGE_OP_COUNT ? names[op] : "?";
+  }
+
+  static bool urgent(uint8_t op) { return op == STORAGE_SAVE_RESET_COUNT; }
+};
+
+#endif // STORAGE_SERVICE_H
@@ -4,6 +4,42 @@
 #include "structdata.h"
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
+#include "TTLCodec.h"
+#include "RS485Scheduler.h"
+
+// Mọi lệnh TX ra bus RS485 đi qua hàm này để bus capture ghi lại (main.cpp).
+// Chỉ rs485Task được gọi; các task khác gửi lệnh qua rs485Submit().
+void rs485Write(const uint8_t *data, size_t len);
+
+// Đưa lệnh vào RS485 scheduler (an toàn từ mọi task, không block). main.cpp
+bool rs485Submit(const RS485Request &request);
+
+// Kết quả lệnh SET thời gian (ghi latency, log) - main.cpp
+void onSetTimeResult(const RS485Request &request, RS485Result result, uint32_t rttMs);
+
+#define TTL_PRINTER_GAP_MS 300 // Máy in cần thời gian lưu cấu hình giữa 2 frame
+#define TTL_STARTUP_GAP_MS 2000 // 2 lệnh startup cách nhau 2s
+
+inline void ttlPrinterSent(const RS485Request &request, RS485Result result, uint32_t rttMs)
+{
+  Serial.printf("[TTL] Printer '%c' frame sent (queued %lums)\n", request.data[2],
+                (unsigned long)(request.sentMs - request.submitMs));
+}
+
+// Build a request around an encoded frame and hand it to the scheduler
+inline bool ttlSubmit(RS485Class cls, const uint8_t *frame, size_t len, uint8_t replyId, uint16_t gapAfterMs,
+                      RS485Callback done)
+{
+  RS485Request request;
+  memset(&request, 0, sizeof(request));
+  request.cls = cls;
+  request.replyId = replyId;
+  request.gapAfterMs = gapAfterMs;
+  request.len = (uint8_t)len;
+  memcpy(request.data, frame, len);
+  request.done = done;
+  return rs485Submit(request);
+}
 
 // ============================================================================
 // SETUP PRINTER - ĐẶT NHIÊN LIỆU CHO TỪNG VÒI BƠM
@@ -19,59 +55,26 @@
 // Ví dụ từ doc (Vòi 1 - RON-95):
 // n=0 đến n=16 là: Tên Nhiên Liệu vòi 1= RON-95 là : 1 2 '@' '1' 'R' 'O' 'N' '-' '9' '5' ' ' ' ' '3' 4
 // Tổng: 23 bytes
-inline void sendSetupPrinterCommandNhienLieu(String nhienlieu, uint8_t address) {
+inline void sendSetupPrinterCommandNhienLieu(const char *nhienlieu, uint8_t address) {
   // Validate input
-  if (!nhienlieu || nhienlieu.length() == 0) {
+  if (!nhienlieu || nhienlieu[0] == '\0') {
     Serial.println("ERROR: sendSetupPrinterCommandNhienLieu - nhienlieu is empty");
     return;
   }
-  
-  // Validate address (Vòi ID: 1-10)
-  if (address < 1 || address > 10) {
+
+  // Build command buffer: Total 23 bytes (Vòi ID 1-10 validated by the codec)
+  uint8_t buffer[TTLPrinterFuel::kLength];
+  if (!TTLPrinterFuel::encode(buffer, address, nhienlieu)) {
     Serial.printf("ERROR: sendSetupPrinterCommandNhienLieu - invalid address=%d (must be 1-10)\n", address);
     return;
   }
-  
-  // Build command buffer: Total 23 bytes
-  uint8_t buffer[23];
-  buffer[0] = 1;        // Send(1) - DECIMAL 1
-  buffer[1] = 2;        // Send(2) - DECIMAL 2
-  buffer[2] = '@';      // Send('@') - ASCII '@' (64 decimal)
-  
-  // Send(Char n = address) - Vòi ID (1-10) as ASCII '1'-'9' or 'A'
-  if (address <= 9) {
-    buffer[3] = '0' + address; // '1'-'9' (ASCII 49-57)
-  } else {
-    buffer[3] = 'A';            // 'A' (ASCII 65) for vòi 10
-  }
-  // buffer[3] = '5';            // 'A' (ASCII 65) for vòi 10
-  
-  // Send(Char n=0) to Send(Char n=16) - Tên nhiên liệu RAW BYTES (17 ký tự)
-  // Gửi trực tiếp bytes của string, không convert
-  for (int i = 0; i < 17; i++) {
-    if (i < nhienlieu.length()) {
-      buffer[i + 4] = (uint8_t)nhienlieu.charAt(i); // Raw byte
-    } else {
-      buffer[i + 4] = ' '; // Pad with space (ASCII 32)
-    }
-  }
-  
-  buffer[21] = 3;       // Send(3) - DECIMAL 3
-  buffer[22] = 4;       // Send(4) - DECIMAL 4
-  
-  // Debug log with DECIMAL format
-  Serial.printf("[TTL] Set Nhiên Liệu - Vòi %d: %s\n", address, nhienlieu.c_str());
-  Serial.print("[TTL] Command (DECIMAL): ");
-  for (int i = 0; i < sizeof(buffer); i++) {
-    Serial.printf("%c", buffer[i]);
+
+  Serial.printf("[TTL] Set Nhiên Liệu - Vòi %d: %.*s\n", address, (int)TTLPrinterFuel::kNameWidth,
+                (const char *)buffer + TTLPrinterFuel::kNameOffset);
+
+  if (!ttlSubmit(RS485_CLASS_PRINTER, buffer, sizeof(buffer), 0, TTL_PRINTER_GAP_MS, ttlPrinterSent)) {
+    Serial.println("[TTL] ERROR: Command dropped - RS485 scheduler full");
   }
-  Serial.println();
-  
-  // Send command byte-by-byte to ensure stability
-  Serial2.write(buffer, sizeof(buffer));
-  Serial2.flush();
-  
-  Serial.println("[TTL] Command sent");
 }
 
 // ============================================================================
@@ -90,58 +93,27 @@ inline void sendSetupPrinterCommandNhienLieu(String nhienlieu, uint8_t address)
 // n=32 đến n=61 là Địa chỉ DN ko đầu; VD: Số 12 Đường 3122
 // Ví dụ: 1 2 'W' 'C' 'T' 'Y' ' ' 'A' ...(space)... 'S' 'ố' ' ' '1' '2' ' ' 'Đ' 'ư' 'ờ' 'n' 'g' ' ' '3' '1' '2' '2' 3 4
 // Tổng: 67 bytes
-inline void sendSetupPrinterCommandTenDonVi(String tendonvi, String address) {
+inline void sendSetupPrinterCommandTenDonVi(const char *tendonvi, const char *address) {
   // Validate input
-  if (!tendonvi || tendonvi.length() == 0) {
+  if (!tendonvi || tendonvi[0] == '\0') {
     Serial.println("ERROR: sendSetupPrinterCommandTenDonVi - tendonvi is empty");
     return;
   }
-  if (!address || address.length() == 0) {
+  if (!address || address[0] == '\0') {
     Serial.println("ERROR: sendSetupPrinterCommandTenDonVi - address is empty");
     return;
   }
-  
+
   // Build command buffer: Total 67 bytes
-  uint8_t buffer[67];
-  buffer[0] = 1;        // Send(1) - DECIMAL 1
-  buffer[1] = 2;        // Send(2) - DECIMAL 2
-  buffer[2] = 'W';      // Send('W') - ASCII 'W' (87 decimal)
+  uint8_t buffer[TTLPrinterCompany::kLength];
+  TTLPrinterCompany::encode(buffer, tendonvi, address);
 
-  // Send(Char n=0) to Send(Char n=31) - Tên Doanh Nghiệp RAW BYTES (32 ký tự)
-  for (int i = 0; i < 32; i++) {
-    if (i < tendonvi.length()) {
-      buffer[i + 3] = (char)tendonvi.charAt(i); // Raw byte
-    } else {
-      buffer[i + 3] = ' '; // Pad with space (ASCII 32)
-    }
-  }
-  
-  // Send(Char n=32) to Send(Char n=61) - Địa chỉ RAW BYTES (30 ký tự)
-  // Buffer position: 35 to 64 (32 chars TenDN + 3 header = start at 35)
-  for (int i = 0; i < 30; i++) {
-    if (i < address.length()) {
-      buffer[i + 35] = (char)address.charAt(i); // Raw byte
-    } else {
-      buffer[i + 35] = ' '; // Pad with space (ASCII 32)
-    }
-  }
-  
-  buffer[65] = 3;       // Send(3) - DECIMAL 3
-  buffer[66] = 4;       // Send(4) - DECIMAL 4
-  
-  // Debug log with DECIMAL format
-  Serial.print("[TTL] Command (String): ");
-  for (int i = 0; i < sizeof(buffer); i++) {
-    // print char ra
-    Serial.printf("%c", buffer[i]);
+  Serial.printf("[TTL] Set Tên DN: %.*s\n", (int)TTLPrinterCompany::kNameWidth,
+                (const char *)buffer + TTLPrinterCompany::kNameOffset);
+
+  if (!ttlSubmit(RS485_CLASS_PRINTER, buffer, sizeof(buffer), 0, TTL_PRINTER_GAP_MS, ttlPrinterSent)) {
+    Serial.println("[TTL] ERROR: Command dropped - RS485 scheduler full");
   }
-  Serial.println("...");
-  
-  // Send command byte-by-byte to ensure stability
-  Serial2.write(buffer, sizeof(buffer));
-  Serial2.flush();
-  
-  Serial.println("[TTL] Command sent");
 }
 
 // ============================================================================
@@ -158,247 +130,61 @@ inline void sendSetupPrinterCommandTenDonVi(String tendonvi, String address) {
 // n=0 đến n=17 là : MST = 0123456789
 // Ví dụ: 1 2 '#' '0' '1' '2' '3' '4' '5' '6' '7' '8' '9' ' ' ' ' ' ' ' ' ' ' ' ' 3 4
 // Tổng: 23 bytes
-inline void sendSetupPrinterCommandMst(String mst) {
+inline void sendSetupPrinterCommandMst(const char *mst) {
   // Validate input
-  if (!mst || mst.length() == 0) {
+  if (!mst || mst[0] == '\0') {
     Serial.println("ERROR: sendSetupPrinterCommandMst - mst is empty");
     return;
   }
-  
+
   // Build command buffer: Total 23 bytes
-  uint8_t buffer[23];
-  buffer[0] = 1;        // Send(1) - DECIMAL 1
-  buffer[1] = 2;        // Send(2) - DECIMAL 2
-  buffer[2] = '#';      // Send('#') - ASCII '#' (35 decimal)
-  
-  // Send(Char n=0) to Send(Char n=17) - MST RAW BYTES (18 ký tự)
-  for (int i = 0; i < 18; i++) {
-    if (i < mst.length()) {
-      buffer[i + 3] = (char)mst.charAt(i); // Raw byte
-    } else {
-      buffer[i + 3] = ' '; // Pad with space (ASCII 32)
-    }
-  }
-  
-  buffer[21] = 3;       // Send(3) - DECIMAL 3
-  buffer[22] = 4;       // Send(4) - DECIMAL 4
-  
-  // Debug log with DECIMAL format
-  Serial.printf("[TTL] Set MST: %s\n", mst.c_str());
-  Serial.print("[TTL] Command (char): ");
-  for (int i = 0; i < sizeof(buffer); i++) {
-    Serial.printf("%c", buffer[i]);
+  uint8_t buffer[TTLPrinterMst::kLength];
+  TTLPrinterMst::encode(buffer, mst);
+
+  Serial.printf("[TTL] Set MST: %s\n", mst);
+
+  if (!ttlSubmit(RS485_CLASS_PRINTER, buffer, sizeof(buffer), 0, TTL_PRINTER_GAP_MS, ttlPrinterSent)) {
+    Serial.println("[TTL] ERROR: Command dropped - RS485 scheduler full");
   }
-  Serial.println();
-  
-  // Send command byte-by-byte to ensure stability
-  Serial2.write(buffer, sizeof(buffer));
-  Serial2.flush();
-  
-  Serial.println("[TTL] Command sent");
 }
 
 
+// Gửi trực tiếp - chỉ LogRecoveryEngine trong rs485Task dùng (sau rs485Scheduler.mayTransmit)
 inline void sendLogRequest(uint16_t logPosition) {
-    // Kiểm tra giới hạn vị trí log
-    if (logPosition < 1 || logPosition > 2046) {
+    // [0xC8][High][Low][Checksum][0xC9] - vị trí log 1..2046
+    uint8_t buffer[TTLLogRequest::kLength];
+    if (!TTLLogRequest::encode(buffer, logPosition)) {
         Serial.println("Invalid log position. Must be between 1 and 2046.");
         return;
     }
-
-    // Tách logPosition thành High Byte và Low Byte
-    uint8_t highByte = (logPosition >> 8) & 0xFF; // Lấy byte cao
-    uint8_t lowByte = logPosition & 0xFF;         // Lấy byte thấp
-
-    // Tính toán checksum
-    uint8_t checksum = 0xA5 ^ highByte ^ lowByte;
-
-    // Tạo buffer chứa dữ liệu
-    uint8_t buffer[5] = {
-        0xC8,        // Byte 1: Lệnh 200
-        highByte,    // Byte 2: High Byte của logPosition
-        lowByte,     // Byte 3: Low Byte của logPosition
-        checksum,    // Byte 4: Checksum
-        0xC9         // Byte 5: Lệnh kết thúc 201
-    };
-
-    // Gửi toàn bộ buffer
-    Serial2.write(buffer, sizeof(buffer));
+    rs485Write(buffer, sizeof(buffer));
 }
 
 inline void sendStartupCommand() {
-    // Dữ liệu cần gửi
-    uint8_t byte1 = 0x7D;  // Byte đầu tiên
-    uint8_t control1 = 0x33;  // Control 1
-    uint8_t control2 = 0x55;  // Control 2
-
-    // Tính Checksum
-    uint8_t checksum = 0xA5 ^ control1 ^ control2;
-
-    uint8_t byte5 = 0x7E;  // Byte cuối cùng
-
-    // Tạo buffer để gửi
-    uint8_t buffer[5] = {byte1, control1, control2, checksum, byte5};
+    // [0x7D][0x33][0x55][Checksum][0x7E]
+    uint8_t buffer[TTLStartup::kLength];
+    TTLStartup::encode(buffer);
 
-    // Gửi toàn bộ buffer cùng lúc
-    Serial2.write(buffer, sizeof(buffer));  // Gửi tất cả các byte trong buffer
-    Serial2.flush(); // Đợi cho đến khi toàn bộ dữ liệu được truyền đi
-    
-
-    // In dữ liệu gửi ra Serial Monitor (dạng hex)
-    // Serial.println();
-    // Serial.print("Data sent: ");
-    // for (int i = 0; i < 5; i++) {
-    //     Serial.printf("0x%02X ", buffer[i]);
-    // }
-    // Serial.println();
-}
-
-
-inline void getLogData(String command, char *&param)
-{
-  char *tempdata = (char*)pvPortMalloc(LOG_SIZE * sizeof(char));
-  if (tempdata == NULL)
-  {
-    Serial.println("Error: Failed to allocate memory for tempdata");
-    return;
-  }
-  // Serial.println("Lenh Commands: " +command);
-  // RS485Serial.flush(); // Đảm bảo bộ đệm truyền trước đó đã được xóa
-  Serial2.print(command); //, leng);
-  // Kiểm tra xem dữ liệu đã được gửi đi chưa
-  Serial2.flush(); // Đợi cho đến khi toàn bộ dữ liệu được truyền đi
-
-  // Kiểm tra lại bộ đệm truyền
-  if (Serial2.availableForWrite() < command.length())
-  {
-    Serial.println("Du lieu goi bi mat");
-  }
-  byte index = 0;
-
-  vTaskDelay(150 / portTICK_PERIOD_MS); // Thêm độ trễ ngắn trước khi đọc phản hồidf mặc định là 200
-  // Giới hạn index để tránh buffer overflow
-  while (Serial2.available() > 0 && index < (LOG_SIZE - 1))
-  {
-    char currentChar = Serial2.read();
-    tempdata[index++] = currentChar;
-  }
-  tempdata[index] = '\0'; // Không tăng index thêm
-
-  // Serial.println(tempdata);
-  
-  // Giải phóng param cũ nếu có
-  if (param != NULL) {
-    vPortFree(param);
-    param = NULL;
-  }
-
-  param = (char *)pvPortMalloc((index + 1) * sizeof(char)); // Cấp phát vùng nhớ mới đủ chứa dữ liệu
-  if (param != NULL)
-  {
-    strcpy(param, tempdata); // Sao chép dữ liệu
-    Serial.print("data: "); Serial.println(tempdata);
-  }
-  else
-  {
-    Serial.println("Error: Failed to allocate memory for param");
-    // Giải phóng tempdata trước khi return
-    vPortFree(tempdata);
-    return;
-  }
-
-  // Giải phóng tempdata sau khi sao chép
-  vPortFree(tempdata);
+    ttlSubmit(RS485_CLASS_TIME_SYNC, buffer, sizeof(buffer), 0, TTL_STARTUP_GAP_MS, NULL);
 }
 
 
-// Hàm đọc phản hồi
-inline bool readResponse() {
-    uint8_t response[4]; // Phản hồi yêu cầu có 4 byte
-    unsigned long startTime = millis();
-
-    // Chờ dữ liệu phản hồi trong 2 giây
-    while (Serial2.available()>0) {
-        if (millis() - startTime > 2500) { // Hết thời gian chờ
-            Serial.printf("No response received from ID 99!\n");
-            // return false;
-            break; // Thoát vòng lặp nếu không nhận được dữ liệu
-        }
-    }
-
-    // Đọc dữ liệu phản hồi
-    for (int i = 0; i < 4; i++) {
-        response[i] = Serial2.read();
-    }
-
-    // Kiểm tra dữ liệu phản hồi
-    Serial.printf("Response from ID 99: ");
-    for (int i = 0; i < 4; i++) {
-        Serial.printf("0x%02X ", response[i]);
-    }
-    Serial.println();
-
-    // Phản hồi đúng cấu trúc: 7 + ID Vòi + 'S' hoặc 'E' + 8
-    if (response[0] == 7 && response[1] == 99 &&
-       (response[2] == 'S' || response[2] == 'E') && response[3] == 8) {
-        if (response[2] == 'S') {
-            Serial.printf("Command successful for ID 99!\n");
-            return true;
-        } else if (response[2] == 'E') {
-            Serial.printf("Command failed for ID %99!\n");
-            return false;
-        }
-    } else {
-        Serial.printf("Invalid response structure from ID 99!\n");
-        return false;
-    }
-
-    // Đảm bảo tất cả nhánh đều trả về
-    return false; // Giá trị mặc định nếu không có nhánh nào khớp
-}
-
-// Hàm gửi lệnh SET thời gian
+// Hàm gửi lệnh SET thời gian: [93][99][Ngày][Tháng][Năm][Giờ][Phút][Giây][Checksum][94]
+// Không chờ phản hồi: [7][99][S/E][8] được trả về onSetTimeResult() trong rs485Task
 inline void sendSetTimeCommand(TimeSetup *time) {
-    uint8_t buffer[10]; // Mảng lưu dữ liệu lệnh
-    uint8_t ngay = time->ngay;   // Ngày
-    uint8_t thang = time->thang;  // Tháng
-    uint8_t nam = time->nam;   // Năm
-    uint8_t gio = time->gio;    // Giờ
-    uint8_t phut = time->phut;  // Phút
-    uint8_t giay = time->giay;  // Giây - Đã sửa lỗi
-    uint8_t checksum;
-
-    // Xây dựng lệnh
-    buffer[0] = 93;      // Byte 1: Lệnh bắt đầu (93 = 0x5D)
-    buffer[1] = 99;   // Byte 2: ID Vòi
-    buffer[2] = ngay;    // Byte 3: Ngày
-    buffer[3] = thang;   // Byte 4: Tháng
-    buffer[4] = nam;     // Byte 5: Năm
-    buffer[5] = gio;     // Byte 6: Giờ
-    buffer[6] = phut;    // Byte 7: Phút
-    buffer[7] = giay;    // Byte 8: Giây
+    uint8_t buffer[TTLSetTime::kLength];
+    TTLSetTime::encode(buffer, *time);
 
-    // Tính checksum (0xA5 XOR với tất cả các byte từ ID Vòi đến Giây)
-    checksum = 0xA5;
-    for (int i = 1; i < 8; i++) { // XOR từ byte 1 đến byte 7
-        checksum ^= buffer[i];
-    }
-    buffer[8] = checksum; // Byte 9: Checksum
-    buffer[9] = 94;       // Byte 10: Lệnh kết thúc (94 = 0x5E)
-
-    // Gửi lệnh qua RS485
-    Serial2.write(buffer, 10); // Gửi 10 byte dữ liệu
-    Serial2.flush(); // Đợi cho đến khi toàn bộ dữ liệu được truyền đi
-    // delayMicroseconds(150); // Thêm độ trễ nhỏ để đảm bảo dữ liệu được gửi đi
-    
     // In dữ liệu lệnh để debug
-    Serial.printf("Command Sent to ID %d: ", 99);
-    for (int i = 0; i < 10; i++) {
+    Serial.printf("Command queued for ID %d: ", TTLSetTime::kBoxId);
+    for (size_t i = 0; i < sizeof(buffer); i++) {
         Serial.printf("%d ", buffer[i]);
-        // delayMicroseconds(100); // Thêm độ trễ nhỏ giữa các byte để tránh lỗi truyền
     }
     Serial.println();
-    readResponse(); // Đọc phản hồi từ thiết bị
+
+    if (!ttlSubmit(RS485_CLASS_TIME_SYNC, buffer, sizeof(buffer), TTLSetTime::kBoxId, 0, onSetTimeResult)) {
+        Serial.println("[TTL] ERROR: Set time dropped - RS485 scheduler full");
+    }
 }
 
 
@@ -0,0 +1,324 @@
+#ifndef TTL_CODEC_H
+#define TTL_CODEC_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// ============================================================================
+// TTL PROTOCOL CODEC - FRAME LAYOUTS DECLARED ONCE, ZERO-ALLOCATION ENCODERS
+// ============================================================================
+// Every frame on the KPL/TTL bus is described by a TTLLayout: total length,
+// and the checksum rule (seed, XOR byte range, position). Encoders write into
+// a caller-provided `uint8_t (&)[kLength]` buffer so a wrong buffer size is a
+// compile error, and nothing touches the heap (no String).
+//
+// Plain C++11 (no Arduino dependency): the same code runs in the firmware,
+// the host replay/benchmark tools and the TTL simulator.
+//
+//   Frame            Layout                                              Len  Checksum
+//   Printer fuel     [1][2]['@'][voi][name x17][3][4]                     23  -
+//   Printer company  [1][2]['W'][name x32][addr x30][3][4]                67  -
+//   Printer MST      [1][2]['#'][mst x18][3][4]                           23  -
+//   Log request      [0xC8][hi][lo][cs][0xC9]                              5  0xA5 ^ [1..2]
+//   Startup          [0x7D][0x33][0x55][cs][0x7E]                          5  0xA5 ^ [1..2]
+//   Set time         [93][99][d][m][y][h][m][s][cs][94]                   10  0xA5 ^ [1..7]
+//   Price change     [9][ID][6 digits, least significant first][cs][10]   10  0x5A ^ [1..7]
+//   Price response   [7][ID][S/E][8]                                       4  -
+//   Pump log         [1][2][data 2-28][3][cs][4]                          32  0xA5 ^ [2..28]
+// ============================================================================
+
+// Checksum = Seed XOR frame[From .. To-1], stored at frame[Pos]. From == To means no checksum.
+template <size_t Len, uint8_t Seed = 0, size_t From = 0, size_t To = 0, size_t Pos = 0>
+struct TTLLayout
+{
+  enum : size_t
+  {
+    kLength = Len,
+    kChecksumPos = Pos
+  };
+  enum : bool
+  {
+    kHasChecksum = To > From
+  };
+
+  static uint8_t checksum(const uint8_t *frame)
+  {
+    uint8_t cs = Seed;
+    for (size_t i = From; i < To; i++)
+    {
+      cs ^= frame[i];
+    }
+    return cs;
+  }
+
+  static void seal(uint8_t *frame)
+  {
+    if (kHasChecksum)
+      frame[Pos] = checksum(frame);
+  }
+
+  static bool verify(const uint8_t *frame) { return !kHasChecksum || frame[Pos] == checksum(frame); }
+};
+
+// ----------------------------------------------------------------------------
+// Field helpers
+// ----------------------------------------------------------------------------
+
+// Raw bytes of src (no conversion), space-padded / truncated to width
+inline void ttlPutText(uint8_t *dst, size_t width, const char *src)
+{
+  size_t n = src ? strlen(src) : 0;
+  if (n > width)
+    n = width;
+  memcpy(dst, src, n);
+  memset(dst + n, ' ', width - n);
+}
+
+inline void ttlPutU16(uint8_t *dst, uint16_t v)
+{
+  dst[0] = (uint8_t)(v >> 8);
+  dst[1] = (uint8_t)v;
+}
+
+inline void ttlPutU32(uint8_t *dst, uint32_t v)
+{
+  dst[0] = (uint8_t)(v >> 24);
+  dst[1] = (uint8_t)(v >> 16);
+  dst[2] = (uint8_t)(v >> 8);
+  dst[3] = (uint8_t)v;
+}
+
+inline uint16_t ttlGetU16(const uint8_t *src) { return (uint16_t)((src[0] << 8) | src[1]); }
+
+inline uint32_t ttlGetU32(const uint8_t *src)
+{
+  return ((uint32_t)src[0] << 24) | ((uint32_t)src[1] << 16) | ((uint32_t)src[2] << 8) | src[3];
+}
+
+// ----------------------------------------------------------------------------
+// Printer setup frames (no checksum, [1][2] header, [3][4] footer)
+// ----------------------------------------------------------------------------
+
+struct TTLPrinterFuel : TTLLayout<23>
+{
+  enum : size_t { kNameOffset = 4, kNameWidth = 17 };
+
+  // voi 1-9 → '1'..'9', 10 → 'A'. Returns false for an out-of-range voi.
+  static bool encode(uint8_t (&out)[kLength], uint8_t voi, const char *fuelName)
+  {
+    if (voi < 1 || voi > 10)
+      return false;
+    out[0] = 1;
+    out[1] = 2;
+    out[2] = '@';
+    out[3] = voi <= 9 ? (uint8_t)('0' + voi) : (uint8_t)'A';
+    ttlPutText(out + kNameOffset, kNameWidth, fuelName);
+    out[21] = 3;
+    out[22] = 4;
+    return true;
+  }
+};
+
+struct TTLPrinterCompany : TTLLayout<67>
+{
+  enum : size_t { kNameOffset = 3, kNameWidth = 32, kAddrOffset = 35, kAddrWidth = 30 };
+
+  static void encode(uint8_t (&out)[kLength], const char *companyName, const char *address)
+  {
+    out[0] = 1;
+    out[1] = 2;
+    out[2] = 'W';
+    ttlPutText(out + kNameOffset, kNameWidth, companyName);
+    ttlPutText(out + kAddrOffset, kAddrWidth, address);
+    out[65] = 3;
+    out[66] = 4;
+  }
+};
+
+struct TTLPrinterMst : TTLLayout<23>
+{
+  enum : size_t { kMstOffset = 3, kMstWidth = 18 };
+
+  static void encode(uint8_t (&out)[kLength], const char *mst)
+  {
+    out[0] = 1;
+    out[1] = 2;
+    out[2] = '#';
+    ttlPutText(out + kMstOffset, kMstWidth, mst);
+    out[21] = 3;
+    out[22] = 4;
+  }
+};
+
+// ----------------------------------------------------------------------------
+// Control frames
+// ----------------------------------------------------------------------------
+
+struct TTLLogRequest : TTLLayout<5, 0xA5, 1, 3, 3>
+{
+  // Position 1..2046 in the TTL box log ring. Returns false when out of range.
+  static bool encode(uint8_t (&out)[kLength], uint16_t logPosition)
+  {
+    if (logPosition < 1 || logPosition > 2046)
+      return false;
+    out[0] = 0xC8;
+    ttlPutU16(out + 1, logPosition);
+    seal(out);
+    out[4] = 0xC9;
+    return true;
+  }
+};
+
+struct TTLStartup : TTLLayout<5, 0xA5, 1, 3, 3>
+{
+  static void encode(uint8_t (&out)[kLength])
+  {
+    out[0] = 0x7D;
+    out[1] = 0x33;
+    out[2] = 0x55;
+    seal(out);
+    out[4] = 0x7E;
+  }
+};
+
+struct TTLSetTime : TTLLayout<10, 0xA5, 1, 8, 8>
+{
+  enum : uint8_t { kBoxId = 99 };
+
+  // Time: anything with ngay/thang/nam/gio/phut/giay (TimeSetup)
+  template <class Time>
+  static void encode(uint8_t (&out)[kLength], const Time &t)
+  {
+    out[0] = 93;
+    out[1] = kBoxId;
+    out[2] = t.ngay;
+    out[3] = t.thang;
+    out[4] = t.nam;
+    out[5] = t.gio;
+    out[6] = t.phut;
+    out[7] = t.giay;
+    seal(out);
+    out[9] = 94;
+  }
+};
+
+struct TTLPriceChange : TTLLayout<10, 0x5A, 1, 8, 8>
+{
+  // Price as 6 ASCII digits, least significant digit first. Returns false for ID / price out of range.
+  static bool encode(uint8_t (&out)[kLength], uint8_t deviceId, uint32_t price)
+  {
+    if (deviceId < 11 || deviceId > 20 || price > 999999)
+      return false;
+    out[0] = 9;
+    out[1] = deviceId;
+    for (size_t i = 2; i < 8; i++)
+    {
+      out[i] = (uint8_t)('0' + price % 10);
+      price /= 10;
+    }
+    seal(out);
+    out[9] = 10;
+    return true;
+  }
+
+  static bool decode(const uint8_t *frame, uint8_t &deviceId, uint32_t &price)
+  {
+    if (frame[0] != 9 || frame[9] != 10 || !verify(frame))
+      return false;
+    deviceId = frame[1];
+    price = 0;
+    for (size_t i = 7; i >= 2; i--)
+    {
+      if (frame[i] < '0' || frame[i] > '9')
+        return false;
+      price = price * 10 + (frame[i] - '0');
+    }
+    return true;
+  }
+};
+
+// [7][ID][S/E][8] - answer to a price change (ID 11-20) or set time (ID 99)
+struct TTLCommandReply : TTLLayout<4>
+{
+  static void encode(uint8_t (&out)[kLength], uint8_t deviceId, bool success)
+  {
+    out[0] = 7;
+    out[1] = deviceId;
+    out[2] = success ? 'S' : 'E';
+    out[3] = 8;
+  }
+
+  static bool decode(const uint8_t *frame, uint8_t &deviceId, bool &success)
+  {
+    if (frame[0] != 7 || frame[3] != 8 || (frame[2] != 'S' && frame[2] != 'E'))
+      return false;
+    deviceId = frame[1];
+    success = frame[2] == 'S';
+    return true;
+  }
+};
+
+// ----------------------------------------------------------------------------
+// Pump log (32 bytes, big-endian fields)
+// ----------------------------------------------------------------------------
+
+struct TTLPumpLog : TTLLayout<32, 0xA5, 2, 29, 30>
+{
+  // Log: anything with the PumpLog field names (structdata.h)
+  template <class Log>
+  static void encode(uint8_t (&out)[kLength], const Log &log)
+  {
+    out[0] = 1;
+    out[1] = 2;
+    out[2] = log.idVoi;
+    ttlPutU16(out + 3, log.viTriLogCot);
+    ttlPutU16(out + 5, log.viTriLogData);
+    ttlPutU16(out + 7, log.maLanBom);
+    ttlPutU32(out + 9, log.soLitBom);
+    ttlPutU16(out + 13, log.donGia);
+    ttlPutU32(out + 15, log.soTotalTong);
+    ttlPutU32(out + 19, log.soTienBom);
+    out[23] = log.ngay;
+    out[24] = log.thang;
+    out[25] = log.nam;
+    out[26] = log.gio;
+    out[27] = log.phut;
+    out[28] = log.giay;
+    out[29] = 3;
+    seal(out);
+    out[31] = 4;
+  }
+
+  static bool valid(const uint8_t *frame)
+  {
+    return frame[0] == 1 && frame[1] == 2 && frame[29] == 3 && frame[31] == 4 && verify(frame);
+  }
+
+  // Field-for-field decode. Historical mapping kept as-is: log.checksum holds
+  // byte 29 (the 0x03 marker) and log.send3 holds byte 30 (the checksum).
+  template <class Log>
+  static void decode(const uint8_t *frame, Log &log)
+  {
+    log.send1 = frame[0];
+    log.send2 = frame[1];
+    log.idVoi = frame[2];
+    log.viTriLogCot = ttlGetU16(frame + 3);
+    log.viTriLogData = ttlGetU16(frame + 5);
+    log.maLanBom = ttlGetU16(frame + 7);
+    log.soLitBom = ttlGetU32(frame + 9);
+    log.donGia = ttlGetU16(frame + 13);
+    log.soTotalTong = ttlGetU32(frame + 15);
+    log.soTienBom = ttlGetU32(frame + 19);
+    log.ngay = frame[23];
+    log.thang = frame[24];
+    log.nam = frame[25];
+    log.gio = frame[26];
+    log.phut = frame[27];
+    log.giay = frame[28];
+    log.checksum = frame[29];
+    log.send3 = frame[30];
+  }
+};
+
+#endif // TTL_CODEC_H
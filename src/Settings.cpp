@@ -31,6 +31,10 @@ const char* TopicUpdatePrice = "/UpdatePrice";
 const char* TopicGetPrice = "/GetPrice";
 const char* TopicRequestLog = "/RequestLog";
 const char* TopicSetupPrinter = "/SetupPrinter";
+const char* TopicRS485Capture = "/RS485Capture"; // Download RS485 bus capture
+const char* TopicRecoverLog = "/RecoverLog";     // Re-read log ranges from the TTL box
+const char* TopicRequestLogByDate = "/RequestLogByDate"; // Archived logs by date range / nozzle
+const char* TopicGetPriceHistory = "/GetPriceHistory";   // Price changes of a nozzle (price journal)
 // sửa thông tin phiên bản hardware vào đây
 const char* hardwareVersion = "KC868-A2-3532-P"; // KC868-A2-1305 là phiên bản hardware của thiết bị
 
@@ -25,27 +25,12 @@ void processAllVoi(TimeSetup *time)
 void sendLogRequest(unsigned int logPosition)
 {
     // Kiểm tra giới hạn vị trí log
-    if (logPosition < 1 || logPosition > 2046) {
+    uint8_t buffer[TTLLogRequest::kLength];
+    if (logPosition > 0xFFFF || !TTLLogRequest::encode(buffer, (uint16_t)logPosition)) {
         Serial.println("Invalid log position. Must be between 1 and 2046.");
         return;
     }
 
-    // Tách logPosition thành High Byte và Low Byte
-    uint8_t highByte = (logPosition >> 8) & 0xFF; // Lấy byte cao
-    uint8_t lowByte = logPosition & 0xFF;         // Lấy byte thấp
-
-    // Tính toán checksum
-    uint8_t checksum = 0xA5 ^ highByte ^ lowByte;
-
-    // Tạo buffer chứa dữ liệu
-    uint8_t buffer[5] = {
-        0xC8,        // Byte 1: Lệnh 200
-        highByte,    // Byte 2: High Byte của logPosition
-        lowByte,     // Byte 3: Low Byte của logPosition
-        checksum,    // Byte 4: Checksum
-        0xC9         // Byte 5: Lệnh kết thúc 201
-    };
-
     // Gửi toàn bộ buffer
-    Serial2.write(buffer, sizeof(buffer));
+    rs485Write(buffer, sizeof(buffer));
 }
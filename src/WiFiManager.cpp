@@ -403,6 +403,7 @@
 
 #include "WiFiManager.h"
 #include "Webservice.h"
+#include "ConfigStore.h"
 #include <ArduinoJson.h>
 #include <esp_task_wdt.h>
 #include <freertos/FreeRTOS.h>
@@ -727,23 +728,11 @@ void WiFiManager::stopWebServer() {
 }
 
 bool WiFiManager::loadConfig() {
-    String configData = readFileConfig("/config.txt");
-    if (configData.isEmpty()) {
-        currentConfig.isValid = false;
-        return false;
-    }
-    
-    int split1 = configData.indexOf('\n');
-    int split2 = configData.lastIndexOf('\n');
-    
-    if (split1 == -1 || split2 == -1 || split1 == split2) {
-        currentConfig.isValid = false;
-        return false;
-    }
-    
-    currentConfig.ssid = configData.substring(0, split1);
-    currentConfig.password = configData.substring(split1 + 1, split2);
-    currentConfig.topic = configData.substring(split2 + 1);
+    // RAM copy of the ConfigStore (read from NVS once at boot)
+    DeviceConfig config = configStore.get();
+    currentConfig.ssid = config.ssid;
+    currentConfig.password = config.password;
+    currentConfig.topic = config.topic;
     
     currentConfig.isValid = validateConfig(currentConfig.ssid, currentConfig.password, currentConfig.topic);
     
@@ -763,8 +752,10 @@ bool WiFiManager::saveConfig(const String &ssid, const String &password, const S
         return false;
     }
     
-    String configData = ssid + "\n" + password + "\n" + topic;
-    writeFileConfig("/config.txt", configData);
+    configStore.setWiFi(ssid.c_str(), password.c_str(), topic.c_str());
+    if (!configStore.commit()) {
+        return false;
+    }
     
     currentConfig.ssid = ssid;
     currentConfig.password = password;
@@ -779,10 +770,9 @@ bool WiFiManager::saveConfig(const String &ssid, const String &password, const S
 }
 
 bool WiFiManager::resetConfig() {
-    if (LittleFS.exists("/config.txt")) {
-        return LittleFS.remove("/config.txt");
-    }
-    return true;
+    currentConfig.isValid = false;
+    configStore.clearWiFi();
+    return configStore.commit();
 }
 
 void WiFiManager::setupRoutes() {
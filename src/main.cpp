@@ -10,10 +10,13 @@
 #include <freertos/task.h>
 #include <freertos/queue.h>
 #include <freertos/semphr.h>
+#include <freertos/event_groups.h>
 #include <HTTPClient.h>
 #include <WiFiClientSecure.h>
 #include <Update.h>
 #include <esp_partition.h> // CRITICAL: Added for partition info
+#include <esp_timer.h>
+#include <limits.h>
 
 // ============================================================================
 // DEBUG LOGGING MACROS
@@ -49,6 +52,23 @@ void performOTAUpdateViaAPI(const String &apiEndpoint, const String &ftpUrl);
 #include "MQTTManager.h"
 #include "RS485Manager.h"
 #include "SystemManager.h"
+#include "RS485FrameDecoder.h"
+#include "RS485Capture.h"
+#include "PriceChangeEngine.h"
+#include "LatencyHistogram.h"
+#include "LogRecovery.h"
+#include "RS485Scheduler.h"
+#include "OutputCom.h"
+#include "LogJournalFS.h"
+#include "SlotBitmap.h"
+#include "PumpLogRecord.h"
+#include "LogArchive.h"
+#include "LogJournalPartition.h"
+#include "LogCheckpoint.h"
+#include "StorageService.h"
+#include "PriceJournal.h"
+#include "ConfigStore.h"
+#include <memory>
 #include "FlashFile.h"
 
 // ============================================================================
@@ -63,8 +83,45 @@ static TimeSetup timeSetup;
 static GetIdLogLoss receivedMessage;
 bool inConfigPortal = false;
 
-// Nozzle prices storage
+// Nozzle prices: the RAM table is the authoritative copy (guarded by nozzlePricesMux,
+// copy in / out only). GetPrice is served from it; storageTask persists the changes once
+// they have been quiet for PRICE_SAVE_COALESCE_MS, at the latest PRICE_SAVE_MAX_DELAY_MS
+// after the first unsaved one: one 40 B record per change in the price journal
+// (PriceJournal.h, "config" partition), or the whole price file if the partition is missing.
+#define PRICE_SAVE_COALESCE_MS 2000
+#define PRICE_SAVE_MAX_DELAY_MS 10000
+#define PRICE_JOURNAL_LABEL "config" // Spiffs partition of min_spiffs.csv, never mounted
+#define PRICE_JOURNAL_SEGMENTS 16    // 16 x 4 KB at 0x00000: ~1500 changes of history
+#define PRICE_PENDING_MAX 20         // Changes waiting for storageTask; more = one snapshot
+#define PRICE_HISTORY_MAX 100        // Entries per GetPriceHistory response
 static NozzlePrices nozzlePrices;
+static portMUX_TYPE nozzlePricesMux = portMUX_INITIALIZER_UNLOCKED;
+static struct
+{
+  uint32_t version = 0;      // Changes applied to the table
+  uint32_t savedVersion = 0; // Last version in the price file
+  unsigned long firstChangeAt = 0; // Oldest unsaved change
+  unsigned long lastChangeAt = 0;
+  uint32_t saves = 0;
+  uint32_t coalesced = 0; // Changes saved together with a later one
+  uint32_t failed = 0;
+  PriceJournalEntry pending[PRICE_PENDING_MAX]; // Changes not yet in the journal
+  uint8_t pendingCount = 0;
+  bool pendingOverflow = false; // Backlog lost: journal the whole table as a snapshot
+} priceStore;
+static PartitionJournalMedium priceJournalPartition(PRICE_JOURNAL_LABEL, 0, PRICE_JOURNAL_SEGMENTS, LOG_PARTITION_SECTOR);
+static PriceJournal priceJournal(priceJournalPartition);
+static bool priceJournalReady = false; // Set once at boot (initNozzlePrices)
+
+// One GetPriceHistory query: the newest `limit` CHANGE records of a nozzle (0 = all),
+// kept in a ring while storageTask walks the journal
+struct PriceHistoryQuery
+{
+  uint8_t nozzle;
+  uint8_t limit;
+  PriceJournalEntry *entries; // limit entries, ring ordered by `total`
+  uint16_t total;             // Matching changes in the journal
+};
 
 // System state
 static uint32_t currentId = 0;
@@ -93,34 +150,230 @@ static char topicChange[64];
 static char topicOTA[64];         // topic for OTA firmware update
 static char topicUpdatePrice[64]; // topic for changing price
 static char topicGetPrice[64];    // topic for requesting current prices
+static char topicGetPriceHistory[64]; // topic for price change history (price journal)
 static char topicRequestLog[64];  // topic for requesting logs from Flash
 static char topicSetupPrinter[64]; // topic for setting name type of oil
+static char topicRS485Capture[64]; // topic for downloading the RS485 bus capture
+static char topicRecoverLog[64];   // topic for re-reading log ranges from the TTL box
+static char topicRequestLogByDate[64]; // topic for archived logs by date range / nozzle
 
 // FreeRTOS objects
 static QueueHandle_t mqttQueue = NULL;
 static QueueHandle_t logIdLossQueue = NULL;
 static QueueHandle_t priceChangeQueue = NULL; // Queue for price change requests
 static QueueHandle_t priceResponseQueue = NULL; // Queue for price change responses from RS485
-static SemaphoreHandle_t flashMutex = NULL;
+static SemaphoreHandle_t flashMutex = NULL; // LittleFS files (price file, journal fallback)
 static SemaphoreHandle_t systemMutex = NULL;
 static QueueHandle_t saveLogQueue = NULL;
+static QueueHandle_t logRecoveryQueue = NULL; // LogRecoveryRange from mqttCallback → rs485Task
+static QueueHandle_t storageQueue = NULL;     // StorageRequest → storageTask (StorageService.h)
+static QueueHandle_t logLossReadQueue = NULL; // LogLossRead from storageTask → rs485Task
+static EventGroupHandle_t storageDone = NULL; // One bit per waiting task, set when its request is served
+
+// Pump logs: append-only journal (owned by storageTask). Lives on the raw "littlefs"
+// partition (LogJournalPartition.h); without it, on LittleFS segment files as before.
+static PartitionJournalMedium logJournalPartition(LOG_PARTITION_LABEL, 0x00000, LOG_JOURNAL_MAX_SEGMENTS,
+                                                  LOG_JOURNAL_MAX_SEGMENT_SIZE);
+static LittleFSJournalMedium logJournalFiles;
+static JournalMediumSelector logJournalMedium(logJournalPartition, logJournalFiles);
+static LogJournal logJournal(logJournalMedium);
+
+// Long-retention archive: every committed log, delta-compressed, under a global ID that
+// keeps counting across laps of the 2046-slot ring (owned by storageTask). Same medium
+// choice as the journal: the partition after it, or /ar00..11.seg.
+// A block is written every LOG_ARCHIVE_BLOCK_RECORDS logs or after LOG_ARCHIVE_IDLE_FLUSH_MS
+// without logs; a block still in RAM at reboot is re-read from the journal at boot.
+#define LOG_ARCHIVE_SEGMENTS 12           // LittleFS files
+#define LOG_ARCHIVE_PARTITION_SEGMENTS 24 // Raw partition, 0x40000..0xA0000
+#define LOG_ARCHIVE_PARTITION_OFFSET 0x40000
+#define LOG_ARCHIVE_IDLE_FLUSH_MS 600000
+static PartitionJournalMedium logArchivePartition(LOG_PARTITION_LABEL, LOG_ARCHIVE_PARTITION_OFFSET,
+                                                  LOG_ARCHIVE_PARTITION_SEGMENTS, LOG_JOURNAL_MAX_SEGMENT_SIZE);
+static LittleFSJournalMedium logArchiveFiles("/ar", LOG_ARCHIVE_SEGMENTS);
+static JournalMediumSelector logArchiveMedium(logArchivePartition, logArchiveFiles);
+static LogArchive<PumpLog> logArchive(logArchiveMedium);
+static unsigned long logArchiveLastAppend = 0;
+
+// Cold tier of the archive (partition archive only): the segment it drops for space is
+// moved in bulk to /ac00..23.seg on the LittleFS filesystem, which holds little else
+// since logs and config moved out of it. Reads and date queries span both tiers.
+#define LOG_COLD_SEGMENTS 24 // 384 KB of the 704 KB "spiffs" partition (LittleFS)
+static LittleFSJournalMedium logColdFiles("/ac", LOG_COLD_SEGMENTS);
+static LogArchive<PumpLog> logColdArchive(logColdFiles);
+
+// Stored logs not yet delivered to MQTT: one bit per slot, rebuilt from the journal
+// at boot and updated on every commit / publish (guarded by pendingLogsMux).
+// mqttTask re-publishes them in small batches through logIdLossQueue.
+static SlotBitmap<MAX_LOGS> pendingLogs;
+static portMUX_TYPE pendingLogsMux = portMUX_INITIALIZER_UNLOCKED;
+static uint16_t republishCursor = 1;
+#define REPUBLISH_INTERVAL_MS 30000 // Between self re-publish batches
+#define REPUBLISH_BATCH 5           // Slots per batch (rs485Task publishes one per 500 ms)
+
+// Log store state as the journal records it (storageTask): the ring head as a log ID
+// (lap * 2046 + slot, same numbering as the archive) and the undelivered slots.
+// Saved in a checkpoint on the "eeprom" partition (LogCheckpoint.h) at most every
+// LOG_CHECKPOINT_INTERVAL_MS; boot loads it and reads only the journal records after it.
+#define LOG_CHECKPOINT_LABEL "eeprom"
+#define LOG_CHECKPOINT_INTERVAL_MS 300000 // ~13 records per erase: one erase / hour at most
+static PartitionJournalMedium logCheckpointPartition(LOG_CHECKPOINT_LABEL, 0, 1, LOG_PARTITION_SECTOR);
+static LogCheckpoint logCheckpoint(logCheckpointPartition);
+static struct
+{
+  uint32_t headId = 0;  // Newest log ID, 0 = none
+  uint32_t headSeq = 0; // Its journal record
+  SlotBitmap<MAX_LOGS> pending;
+  unsigned long checkpointAt = 0;
+  bool restored = false; // Boot used the checkpoint
+  uint16_t replayed = 0; // Journal records read after it at boot
+  uint32_t bootMs = 0;
+} logStore;
+
+// Write-behind log cache: storageTask collects queued logs and commits them to the
+// journal in one group (one journal sync) when LOG_COMMIT_BATCH
+// logs are waiting or the oldest one has waited LOG_COMMIT_MAX_DELAY_MS (durability bound:
+// logs still in RAM on a power cut were published to MQTT / re-requested from the TTL box)
+#define LOG_COMMIT_BATCH 16
+#define LOG_COMMIT_MAX_DELAY_MS 500
+static struct
+{
+  uint32_t commits = 0;       // Group commits (journal syncs)
+  uint32_t logs = 0;          // Logs committed
+  uint32_t failed = 0;        // Logs the journal refused
+  uint8_t maxBatch = 0;
+  uint32_t flushMsSum = 0;    // Mutex held: appends + sync
+  uint32_t flushMsMax = 0;
+  uint32_t ageMsMax = 0;      // Oldest log's wait in the cache at commit
+  UBaseType_t queueHighWater = 0; // Most logs seen waiting in saveLogQueue
+} logCommitStats;
+static struct
+{
+  PumpLog logs[LOG_COMMIT_BATCH];
+  uint8_t count = 0;
+  unsigned long firstAt = 0; // When the oldest cached log was taken from the queue
+} logCache; // Owned by storageTask
+
+// Storage service: storageCalls waiting on storageDone, one event bit each (claimed
+// for the call and released after it, guarded by storageWaitersMux), and
+// per-request-type timings
+static TaskHandle_t storageWaiters[STORAGE_WAITERS] = {NULL};
+static volatile bool storageResults[STORAGE_WAITERS];
+static portMUX_TYPE storageWaitersMux = portMUX_INITIALIZER_UNLOCKED;
+static StorageStats storageStats; // Written by storageTask only
+
+// Log-loss re-publish: rs485Task queues one flash read at a time without waiting
+// (it has to keep draining the UART) and storageTask hands the log back
+struct LogLossRead
+{
+  uint32_t logId; // Journal slot (1..MAX_LOGS) or archive ID
+  uint16_t pos;   // Journal slot holding the log, 0 = only in the archive now
+  bool ok;
+  PumpLog log;
+};
+static PumpLog logLossReadBuf;        // Filled by storageTask while a read is in flight
+static bool logLossReadBusy = false;  // Owned by rs485Task
+
+// RequestLog: one STORAGE_READ_RANGE per request into a buffer owned by mqttTask
+// (allocated on the first request, reused after)
+#define LOG_RANGE_MAX 200
+struct LogRangeRead
+{
+  uint32_t first;  // Journal slot (wraps after MAX_LOGS) or archive ID
+  uint16_t count;
+  bool archive;
+  PumpLog *logs;   // [count], logs[i] valid when have[i]
+  bool *have;
+  uint16_t found;
+};
+static PumpLog *logRangeLogs = NULL;
+static bool *logRangeHave = NULL;
+
+// RequestLogByDate: archived logs of a date range (optionally one nozzle), streamed
+// back LOG_DATE_QUERY_PAGE logs per message, one page per mqttTask loop.
+// Owned by mqttTask (set in mqttCallback, served from the loop, pages read by storageTask).
+#define LOG_DATE_QUERY_PAGE 50
+static struct
+{
+  bool active = false;
+  uint16_t fromDay = 0; // LogArchiveCodec::dayKey
+  uint16_t toDay = 0;
+  uint8_t voi = 0;      // 0 = all nozzles
+  uint32_t nextId = 0;  // Resume point (archive ID)
+  uint16_t page = 0;
+  uint32_t sent = 0;
+  uint8_t failures = 0;
+} logDateQuery;
+
+// Log queue pressure (load tests with tools/ttl_sim.cpp): logs lost on a full queue
+// and the lowest free space seen right after a send
+static uint32_t mqttQueueDrops = 0;
+static uint32_t saveLogQueueDrops = 0;
+static UBaseType_t mqttQueueMinFree = 0xFFFF;
+static UBaseType_t saveLogQueueMinFree = 0xFFFF;
+
+// RS485 stream decoder (owned by rs485Task)
+static RS485FrameDecoder rs485Decoder;
+
+// RS485 bus capture: raw RX/TX bytes for off-site replay (tools/rs485_replay.cpp)
+#define RS485_CAPTURE_SIZE 8192
+static RS485CaptureRing<RS485_CAPTURE_SIZE> rs485Capture;
+static portMUX_TYPE rs485CaptureMux = portMUX_INITIALIZER_UNLOCKED;
+
+// RS485 receive wake-up statistics (event-driven vs polling comparison)
+static volatile int64_t rs485RxEventUs = 0; // esp_timer time of the first un-serviced UART RX event
+static struct
+{
+  uint32_t wakeups = 0;       // rs485Task wake-ups in current window
+  uint32_t rxEvents = 0;      // UART RX callbacks in current window
+  uint32_t frames = 0;        // Frames dispatched in current window
+  uint64_t latencySumUs = 0;  // RX event → frame dispatch
+  uint32_t latencyMaxUs = 0;
+  unsigned long windowStart = 0;
+  // Last completed window (reported in device status)
+  float wakeupsPerSec = 0;
+  float rxEventsPerSec = 0;
+  uint32_t avgLatencyUs = 0;
+  uint32_t maxLatencyUs = 0;
+} rs485RxStats;
 
 // Track price change requests by deviceId (11-20 mapped to index 0-9)
 static PriceChangeRequest priceRequestCache[10]; // Cache for mapping deviceId to request data
 
+// Pipelined price change engine (owned by rs485Task): up to 10 commands in flight,
+// 1s response timeout, 3 attempts, 30ms gap between 10-byte commands (~10.4ms on air @9600)
+static PriceChangeEngine priceEngine(10, 1000, 3, 30);
+static PriceChangeRequest pricePending[10]; // Requests accepted by the engine, not yet confirmed
+
+// Response latency per nozzle × command type; drives the per-device timeouts
+static RS485LatencyTable rs485Latency;
+#define PRICE_DEFAULT_TIMEOUT_MS 1000 // Until a nozzle has enough samples
+
+// Bulk log recovery from the TTL box (owned by rs485Task): 4 requests in flight,
+// 40ms between 5-byte requests, 1.5s pause after live traffic, 3 attempts
+static LogRecoveryEngine logRecovery(4, 40, 1500, 3);
+#define LOG_RECOVERY_DEFAULT_TIMEOUT_MS 500
+#define LOG_RECOVERY_DEVICE_ID TTLSetTime::kBoxId // Log requests are answered by the TTL box (ID 99)
+
+// Single owner of the TTL bus: queued requests from any task (time sync, printer
+// setup) + bus arbitration for the rs485Task engines. Guarded by rs485SchedMux.
+static RS485Scheduler rs485Scheduler(RS485BaudRate, RS485_TURNAROUND_MS);
+static portMUX_TYPE rs485SchedMux = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t rs485ForeignWrites = 0; // rs485Write() calls from outside rs485Task (dropped)
+#define SET_TIME_DEFAULT_TIMEOUT_MS 2500
+
 // Task handles
 static TaskHandle_t rs485TaskHandle = NULL;
 static TaskHandle_t mqttTaskHandle = NULL;
 static TaskHandle_t wifiTaskHandle = NULL;
 static TaskHandle_t webServerTaskHandle = NULL;
-static TaskHandle_t resendLogRequestTaskHandle = NULL;
-static TaskHandle_t saveLogTaskHandle = NULL;
+static TaskHandle_t storageTaskHandle = NULL;
 
 // WiFi objects
 static WiFiClient wifiClient;
 static PubSubClient mqttClient(wifiClient);
 static AsyncWebServer webServer(80);
 WiFiManager *wifiManager = nullptr;
+ConfigStore configStore; // WiFi, IdDevice, MQTT server, restart counter (NVS, ConfigStore.h)
 
 // Reset button state
 static struct
@@ -141,6 +394,13 @@ void wifiTask(void *parameter);
 void webServerTask(void *parameter);
 void wifiRescanTask(void *parameter);
 
+// RS485 receive
+void onRS485Receive();
+void rs485WaitForData(uint32_t maxMs);
+void rs485CaptureRecord(bool tx, const uint8_t *data, size_t len);
+size_t rs485CaptureSnapshot(uint8_t **out);
+void setupDiagnosticRoutes();
+
 // System functions
 void systemInit();
 void systemCheck();
@@ -161,22 +421,46 @@ void sendLogRequest(uint32_t logId);
 void processAllVoi(TimeSetup *time);
 uint8_t calculateChecksum_LogData(const uint8_t *data, size_t length);
 void ganLog(byte *buffer, PumpLog &log);
-void ConnectedKPLBox(void *param);
-void resendLogRequest(void *param);
-void blinkOutput2Connected();
-void BlinkOutput2Task(void *param);
 void readMacEsp();
 // void performOTAUpdate(const char* firmwareURL);
 void performOTAUpdateViaAPI(const String &apiEndpoint, const String &ftpUrl);
 void sendPriceChangeCommand(const PriceChangeRequest &request);
 void printPartitionInfo();                          // CRITICAL: Added forward declaration
 bool validateMacWithServer(const char *macAddress); // SECURITY: MAC validation
-void saveLogTask(void *parameter);
+void storageTask(void *parameter);
+static bool storageSubmit(StorageRequest &request, TickType_t wait = pdMS_TO_TICKS(1000));
+static bool storageCall(StorageRequest &request);
+static void publishFlashLog(const LogLossRead &read);
 void saveLogNotConnectMqtt(const PumpLog &log); // save log to flash if not connected to MQTT
-void processLogBatch(int batchSize);
-void saveLogToFlash(const PumpLog &log);
-void savePriceChangeWithRetry(uint8_t deviceId, const char *idDevice, float unitPrice, const char *idChiNhanh, NozzlePrices &prices, SemaphoreHandle_t flashMutex);
+bool commitLogBatch(const PumpLog *logs, uint8_t count, unsigned long firstAt);
+bool saveLogToFlash(const PumpLog &log);
+void initLogJournal();
+bool clearLogJournal();
+static void catchUpLogArchive();
+static void flushIdleLogArchive();
+static bool serviceLogDateQuery();
+static bool parseLogDate(const char *text, uint16_t &day);
+static bool journalReadLog(uint16_t pos, PumpLog &log);
+static uint16_t journalReadRange(LogRangeRead &range);
+static bool journalMarkSent(uint16_t pos, uint8_t sent, uint32_t when);
+static void writeLogCheckpoint(bool force);
+static void notePendingLog(uint16_t pos, bool pending);
+uint16_t pendingLogCount();
+uint16_t nextPendingLogs(uint16_t from, uint16_t *out, uint16_t max);
+void republishPendingLogs();
+void savePriceChange(uint8_t deviceId, const char *idDevice, float unitPrice, const char *idChiNhanh);
+static unsigned long nozzlePricesSaveInMs();
+static bool persistNozzlePrices();
+static void initNozzlePrices();
+static void readPriceHistory(void *data);
+static void readNozzlePrices(NozzlePrices &out);
 void publishPriceChangeSuccess(uint8_t deviceId, const char *idDevice, float unitPrice, const char *idChiNhanh);
+void publishRS485Capture(bool clearAfter);
+void runPriceChangeBatch(byte *buffer);
+uint32_t serviceLogRecovery();
+uint32_t serviceRS485Scheduler();
+bool rs485MayTransmit(RS485Class cls);
+void rs485NoteTransmit(RS485Class cls, size_t len);
 
 // ============================================================================
 // HELPER FUNCTIONS - NULL SAFETY
@@ -287,8 +571,7 @@ void setup()
   xTaskCreatePinnedToCore(rs485Task, "RS485", 8192, NULL, 3, &rs485TaskHandle, 0);
   xTaskCreatePinnedToCore(wifiTask, "WiFi", 8192, NULL, 2, &wifiTaskHandle, 1);
   xTaskCreatePinnedToCore(mqttTask, "MQTT", 8192, NULL, 2, &mqttTaskHandle, 1);
-  xTaskCreatePinnedToCore(saveLogTask, "SaveLog", 8192, NULL, 2, &saveLogTaskHandle, 1);
-  // xTaskCreatePinnedToCore(resendLogRequest, "ResendLogRequest", 8192, NULL, 2, &resendLogRequestTaskHandle, 1);
+  xTaskCreatePinnedToCore(storageTask, "Storage", 8192, NULL, 2, &storageTaskHandle, 1);
 
   Serial.println("System initialized successfully");
 }
@@ -413,13 +696,21 @@ void systemInit()
   pinMode(OUT1, OUTPUT);
   pinMode(OUT2, OUTPUT);
   pinMode(RESET_CONFIG_PIN, INPUT_PULLUP);
+  outputPulseBegin(); // OUT1/OUT2 transaction + connectivity pulses (esp_timer)
 
   // Watchdog setup - 30s timeout with panic on timeout
   esp_task_wdt_init(60, true); // 30s timeout, true = panic and reset on timeout
   esp_task_wdt_add(NULL);      // Add setup/loop task to WDT
 
-  // Initialize RS485
+  // Initialize RS485 - larger driver RX buffer so bursts survive while rs485Task is busy
+  Serial2.setRxBufferSize(1024);
   Serial2.begin(RS485BaudRate, SERIAL_8N1, RX_PIN, TX_PIN);
+  // Event-driven RX: the UART driver (IDF event queue) calls back on RX timeout,
+  // i.e. after RS485_RX_TIMEOUT_SYMBOLS idle byte-times = end of a frame.
+  // IDF pattern detection is not used: it only matches a run of ONE character
+  // and the footers (4 / 8 / 10) also appear inside pump log payloads.
+  Serial2.setRxTimeout(RS485_RX_TIMEOUT_SYMBOLS);
+  Serial2.onReceive(onRS485Receive, false);
 
   // Initialize FreeRTOS objects
   flashMutex = xSemaphoreCreateMutex();
@@ -429,8 +720,12 @@ void systemInit()
   logIdLossQueue = xQueueCreate(200, sizeof(DtaLogLoss)); // CRITICAL: Increased from 50 to 500
   priceChangeQueue = xQueueCreate(20, sizeof(PriceChangeRequest));
   priceResponseQueue = xQueueCreate(20, sizeof(PriceChangeResponse)); // Queue for RS485 price responses
+  logRecoveryQueue = xQueueCreate(LOG_RECOVERY_RANGES, sizeof(LogRecoveryRange));
+  storageQueue = xQueueCreate(STORAGE_QUEUE_LEN, sizeof(StorageRequest));
+  logLossReadQueue = xQueueCreate(1, sizeof(LogLossRead));
+  storageDone = xEventGroupCreate();
 
-  if (flashMutex == NULL || systemMutex == NULL || mqttQueue == NULL || logIdLossQueue == NULL || priceChangeQueue == NULL || priceResponseQueue == NULL || saveLogQueue == NULL)
+  if (flashMutex == NULL || systemMutex == NULL || mqttQueue == NULL || logIdLossQueue == NULL || priceChangeQueue == NULL || priceResponseQueue == NULL || saveLogQueue == NULL || logRecoveryQueue == NULL || storageQueue == NULL || logLossReadQueue == NULL || storageDone == NULL)
   {
     Serial.println("ERROR: Failed to create FreeRTOS objects!");
     setSystemStatus("ERROR", "Failed to create FreeRTOS objects");
@@ -457,23 +752,20 @@ void systemInit()
   }
   
   Serial.println("WiFiManager initialized successfully");
+  setupDiagnosticRoutes();
 
-  // Load system data
-  readFlashSettings(flashMutex, deviceStatus, counterReset);
-  currentId = initializeCurrentId(flashMutex);
+  // Load system data: configuration in one NVS read (first boot: import of the old
+  // config files), restart counter + migration committed together
+  if (!configStore.begin())
+    setSystemStatus("ERROR", "Config store unavailable");
+  counterReset = configStore.get().counterReset + 1;
+  configStore.setCounterReset(counterReset);
+  configStore.commit();
+  Serial.printf("[CONFIG] Restart counter: %lu\n", counterReset);
+  initLogJournal();
 
-  // Load nozzle prices from Flash
-  Serial.println("Loading nozzle prices from Flash...");
-  if (loadNozzlePrices(nozzlePrices, flashMutex))
-  {
-    printNozzlePrices(nozzlePrices);
-  }
-  else
-  {
-    Serial.println("No saved prices found, initializing with defaults (0.0)");
-    // Save initial default prices
-    saveNozzlePrices(nozzlePrices, flashMutex);
-  }
+  // Load nozzle prices (price journal, else the price file)
+  initNozzlePrices();
 
   // Initialize WiFi
   WiFi.mode(WIFI_STA);
@@ -485,9 +777,8 @@ void systemInit()
 
   Serial.printf("MQTT client initialized - Buffer size: %d\n", mqttClient.getBufferSize());
 
-  // Send startup commands
+  // Send startup commands (queued; rs485Task sends them 2s apart once it starts)
   sendStartupCommand();
-  delay(2000);
   sendStartupCommand();
 
   Serial.printf("System initialized - Current ID: %u\n", currentId);
@@ -573,18 +864,18 @@ void systemCheck()
         return;
       }
 
-      if (xSemaphoreTake(flashMutex, 0) != pdTRUE)
+      if (uxQueueMessagesWaiting(storageQueue) > 0 || uxQueueMessagesWaiting(saveLogQueue) > 0)
       {
         Serial.println("⚠️ Flash is busy - postponing restart");
         checkLogSend = 170; // Retry in 100 seconds (30 min = 180, retry at 170)
         return;
       }
-      xSemaphoreGive(flashMutex);
 
       // Save counter to Flash before restart
       Serial.println("✓ System is safe to restart - saving state...");
       counterReset++;
-      if (writeResetCountToFlash(flashMutex, counterReset))
+      StorageRequest saveCounter = {STORAGE_SAVE_RESET_COUNT, STORAGE_NO_WAITER, 0, (uint32_t)counterReset, 0, NULL, NULL};
+      if (storageCall(saveCounter))
       {
         Serial.printf("✓ Counter saved: %lu\n", counterReset);
       }
@@ -752,15 +1043,15 @@ void handleResetButton()
       }
 
       // Reset config
-      if (LittleFS.exists("/config.txt"))
+      if (wifiManager->resetConfig())
       {
-        LittleFS.remove("/config.txt");
         Serial.println("WiFi config deleted");
       }
 
       // Clear all logs in Flash to prevent old log confusion
       Serial.println("Clearing all logs from Flash...");
-      clearAllLogs(currentId, flashMutex);
+      StorageRequest clear = {STORAGE_CLEAR_LOGS, STORAGE_NO_WAITER, 0, 0, 0, NULL, NULL};
+      storageCall(clear);
 
       Serial.println("Restarting in 3 seconds...");
       delay(3000);
@@ -788,73 +1079,239 @@ void handleResetButton()
 }
 
 // ============================================================================
-// SAVE LOG TASK
+// STORAGE TASK - sole owner of the journal, the archive and the price file
 // ============================================================================
 
-void saveLogTask(void *parameter)
+static bool logCacheDue()
 {
-  Serial.println("SaveLog task started");
-  esp_task_wdt_add(NULL);
+  return logCache.count >= LOG_COMMIT_BATCH ||
+         (logCache.count > 0 && millis() - logCache.firstAt >= LOG_COMMIT_MAX_DELAY_MS);
+}
 
-  while (true)
+// Newest copy of `pos` still in the write-behind cache
+static bool readLogCache(uint16_t pos, PumpLog &log)
+{
+  for (uint8_t i = logCache.count; i > 0; i--)
   {
-    esp_task_wdt_reset();
-
-    // PRIORITY CHECK: Yield to price change operations if pending
-    // Check if price change queue has pending requests
-    if (uxQueueMessagesWaiting(priceChangeQueue) > 0)
+    if (logCache.logs[i - 1].viTriLogData == pos)
     {
-      // Price operations have higher priority - yield immediately
-      vTaskDelay(pdMS_TO_TICKS(10)); // Short delay to allow price processing
-      continue;
+      log = logCache.logs[i - 1];
+      return true;
     }
+  }
+  return false;
+}
 
-    // Check queue status first
-    UBaseType_t queueSize = uxQueueMessagesWaiting(saveLogQueue);
+// Delivery status of a log not committed yet: set on the cached copy, the batch
+// commit writes it with the LOG record (no separate STATUS record)
+static bool markLogCacheSent(uint16_t pos, uint8_t sent, uint32_t when)
+{
+  for (uint8_t i = logCache.count; i > 0; i--)
+  {
+    if (logCache.logs[i - 1].viTriLogData == pos)
+    {
+      logCache.logs[i - 1].mqttSent = sent;
+      logCache.logs[i - 1].mqttSentTime = (time_t)when;
+      return true;
+    }
+  }
+  return false;
+}
 
-    if (queueSize == 0)
+static bool serveStorageRequest(const StorageRequest &request)
+{
+  uint32_t startUs = micros();
+  bool ok = false;
+  switch (request.op)
+  {
+  case STORAGE_READ_LOG:
+    ok = readLogCache(request.pos, *(PumpLog *)request.data) || journalReadLog(request.pos, *(PumpLog *)request.data);
+    break;
+  case STORAGE_READ_ARCHIVE:
+    ok = logArchive.get(request.value, *(PumpLog *)request.data);
+    break;
+  case STORAGE_READ_RANGE:
+    ok = journalReadRange(*(LogRangeRead *)request.data) > 0;
+    break;
+  case STORAGE_MARK_SENT:
+    if (markLogCacheSent(request.pos, 1, request.value))
     {
-      // Queue empty - longer delay
-      vTaskDelay(pdMS_TO_TICKS(100));
-      continue;
+      ok = true;
+      break;
     }
+    ok = journalMarkSent(request.pos, 1, request.value);
+    logJournal.sync();
+    break;
+  case STORAGE_SAVE_PRICES:
+    ok = persistNozzlePrices();
+    break;
+  case STORAGE_SAVE_RESET_COUNT:
+    configStore.setCounterReset(request.value);
+    ok = configStore.commit();
+    break;
+  case STORAGE_CLEAR_LOGS:
+    logCache.count = 0;
+    ok = clearLogJournal();
+    break;
+  case STORAGE_RUN:
+    request.run(request.data);
+    ok = true;
+    break;
+  }
+  uint32_t doneUs = micros();
+  storageStats.record(request.op, ok, startUs - request.queuedUs, doneUs - startUs);
+  if (request.waiter != STORAGE_NO_WAITER)
+  {
+    storageResults[request.waiter] = ok;
+    xEventGroupSetBits(storageDone, 1u << request.waiter);
+  }
+  if (request.done != NULL)
+    request.done(request, ok);
+  return ok;
+}
+
+void storageTask(void *parameter)
+{
+  Serial.println("Storage task started");
+  esp_task_wdt_add(NULL);
+
+  while (true)
+  {
+    esp_task_wdt_reset();
 
-    // Determine batch size based on queue load (smaller batches to reduce mutex hold time)
-    int batchSize = 1; // Default single processing
-    if (queueSize >= 15)
+    // Requests first (urgent ones sit at the front), unless cached logs are due
+    UBaseType_t waiting = uxQueueMessagesWaiting(storageQueue);
+    if (waiting > storageStats.queueHighWater)
+      storageStats.queueHighWater = (uint8_t)waiting;
+    StorageRequest request;
+    while (!logCacheDue() && xQueueReceive(storageQueue, &request, 0) == pdTRUE)
     {
-      batchSize = 2; // Small batch for very high load
+      serveStorageRequest(request);
+      esp_task_wdt_reset();
     }
-    else if (queueSize >= 8)
+    if (nozzlePricesSaveInMs() == 0)
     {
-      batchSize = 2; // Medium batch for high load
+      StorageRequest save = {STORAGE_SAVE_PRICES, STORAGE_NO_WAITER, 0, 0, micros(), NULL, NULL};
+      serveStorageRequest(save);
     }
-    // batchSize = 1 for normal load (reduce mutex contention)
 
-    // Process batch with dedicated file handle (open/close per batch)
-    processLogBatch(batchSize);
-
-    // Adaptive delay based on remaining queue
-    UBaseType_t remaining = uxQueueMessagesWaiting(saveLogQueue);
-    if (remaining > 20)
+    // Fill the write-behind cache with what is already queued
+    waiting = uxQueueMessagesWaiting(saveLogQueue);
+    if (waiting > logCommitStats.queueHighWater)
+      logCommitStats.queueHighWater = waiting;
+    while (logCache.count < LOG_COMMIT_BATCH &&
+           xQueueReceive(saveLogQueue, &logCache.logs[logCache.count], 0) == pdTRUE)
     {
-      vTaskDelay(pdMS_TO_TICKS(1)); // Very urgent
+      if (logCache.count == 0)
+        logCache.firstAt = millis();
+      logCache.count++;
     }
-    else if (remaining > 8)
+    if (logCacheDue())
     {
-      vTaskDelay(pdMS_TO_TICKS(5)); // High priority
+      commitLogBatch(logCache.logs, logCache.count, logCache.firstAt);
+      logCache.count = 0;
+      continue;
     }
-    else if (remaining > 0)
+    if (logCache.count == 0)
     {
-      vTaskDelay(pdMS_TO_TICKS(15)); // Medium priority (increased from 10ms)
+      flushIdleLogArchive();
+      writeLogCheckpoint(false);
     }
-    else
+
+    // Sleep until a request / log is queued (storageNotify) or the oldest cached log is due
+    if (uxQueueMessagesWaiting(storageQueue) == 0 && uxQueueMessagesWaiting(saveLogQueue) == 0)
     {
-      vTaskDelay(pdMS_TO_TICKS(50)); // Low priority when idle
+      TickType_t wait = pdMS_TO_TICKS(1000);
+      unsigned long age = millis() - logCache.firstAt;
+      if (logCache.count > 0)
+        wait = age >= LOG_COMMIT_MAX_DELAY_MS ? 0 : pdMS_TO_TICKS(LOG_COMMIT_MAX_DELAY_MS - age);
+      unsigned long priceMs = nozzlePricesSaveInMs();
+      if (pdMS_TO_TICKS(priceMs) < wait)
+        wait = pdMS_TO_TICKS(priceMs);
+      ulTaskNotifyTake(pdTRUE, wait);
     }
+  }
+}
 
-    yield();
+// Wake storageTask after queueing a request or a log
+static void storageNotify()
+{
+  if (storageTaskHandle != NULL)
+    xTaskNotifyGive(storageTaskHandle);
+}
+
+// Fire-and-forget request. Urgent types go to the front of the queue.
+static bool storageSubmit(StorageRequest &request, TickType_t wait)
+{
+  request.queuedUs = micros();
+  BaseType_t sent = StorageStats::urgent(request.op) ? xQueueSendToFront(storageQueue, &request, wait)
+                                                     : xQueueSendToBack(storageQueue, &request, wait);
+  if (sent != pdTRUE)
+  {
+    Serial.printf("[STORAGE] ⚠️ Queue full, %s request dropped\n", StorageStats::name(request.op));
+    return false;
+  }
+  storageNotify();
+  return true;
+}
+
+// Claim a free event bit for one storageCall
+static uint8_t storageTakeWaiterBit()
+{
+  uint8_t bit = STORAGE_NO_WAITER;
+  portENTER_CRITICAL(&storageWaitersMux);
+  for (uint8_t i = 0; i < STORAGE_WAITERS && bit == STORAGE_NO_WAITER; i++)
+  {
+    if (storageWaiters[i] == NULL)
+    {
+      storageWaiters[i] = xTaskGetCurrentTaskHandle();
+      bit = i;
+    }
+  }
+  portEXIT_CRITICAL(&storageWaitersMux);
+  return bit;
+}
+
+static void storageReleaseWaiterBit(uint8_t bit)
+{
+  portENTER_CRITICAL(&storageWaitersMux);
+  storageWaiters[bit] = NULL;
+  portEXIT_CRITICAL(&storageWaitersMux);
+}
+
+// Submit and sleep until storageTask has served the request; returns its result.
+// request.data stays valid meanwhile. Before the task runs (setup) and on the task
+// itself the request is served inline.
+static bool storageCall(StorageRequest &request)
+{
+  if (storageTaskHandle == NULL || xTaskGetCurrentTaskHandle() == storageTaskHandle)
+  {
+    request.queuedUs = micros();
+    request.waiter = STORAGE_NO_WAITER;
+    return serveStorageRequest(request);
+  }
+  uint8_t bit = storageTakeWaiterBit();
+  if (bit == STORAGE_NO_WAITER)
+  {
+    Serial.println("[STORAGE] ERROR: Too many waiting callers");
+    return false;
+  }
+  request.waiter = bit;
+  xEventGroupClearBits(storageDone, 1u << bit);
+  if (!storageSubmit(request))
+  {
+    storageReleaseWaiterBit(bit);
+    return false;
+  }
+  // Served requests always signal (the bit can't be reused before that); keep
+  // this task's watchdog fed while waiting
+  while ((xEventGroupWaitBits(storageDone, 1u << bit, pdTRUE, pdTRUE, pdMS_TO_TICKS(1000)) & (1u << bit)) == 0)
+  {
+    esp_task_wdt_reset();
   }
+  bool ok = storageResults[bit];
+  storageReleaseWaiterBit(bit);
+  return ok;
 }
 
 // ============================================================================
@@ -936,6 +1393,15 @@ void wifiTask(void *parameter)
 
         readMacEsp();
         statusConnected = true;
+
+        // Diagnostic routes (RS485 capture) - start the web server once in STA mode
+        static bool webServerStarted = false;
+        if (!webServerStarted)
+        {
+          webServer.begin();
+          webServerStarted = true;
+          Serial.printf("[WEB] Diagnostics at http://%s/rs485/capture\n", WiFi.localIP().toString().c_str());
+        }
       }
       else
       {
@@ -1072,6 +1538,10 @@ void mqttTask(void *parameter)
           sendMQTTData(log);
           esp_task_wdt_reset(); // Reset after processing each log
         }
+        else if (!serviceLogDateQuery())
+        {
+          republishPendingLogs(); // Idle: work through the undelivered backlog
+        }
 
         // Additional loop call to ensure callback processing
         mqttClient.loop();
@@ -1101,8 +1571,12 @@ void mqttTask(void *parameter)
         mqttClient.unsubscribe(topicOTA);
         mqttClient.unsubscribe(topicUpdatePrice);
         mqttClient.unsubscribe(topicGetPrice);
+        mqttClient.unsubscribe(topicGetPriceHistory);
         mqttClient.unsubscribe(topicRequestLog);
         mqttClient.unsubscribe(topicSetupPrinter);
+        mqttClient.unsubscribe(topicRS485Capture);
+        mqttClient.unsubscribe(topicRecoverLog);
+        mqttClient.unsubscribe(topicRequestLogByDate);
         mqttClient.disconnect();
         mqttSubscribed = false;
         Serial.println("MQTT cleanup completed");
@@ -1150,208 +1624,19 @@ void rs485Task(void *parameter)
     // Read RS485 data with error protection
     readRS485Data(buffer);
 
-    // Priority 1: Process ALL pending price changes before doing anything else
-    // Send all commands first, responses will be queued and processed later
-    UBaseType_t priceQueueSize = uxQueueMessagesWaiting(priceChangeQueue);
-    if (priceQueueSize > 0)
+    // Priority 1: Price changes - pipelined batch, logs keep flowing meanwhile
+    if (uxQueueMessagesWaiting(priceChangeQueue) > 0)
     {
-      Serial.printf("\n[RS485 PRICE] Starting batch: %d price changes pending\n", priceQueueSize);
-      
-      // Clear any stale data before starting
-      Serial.println("[RS485 PRICE] Clearing RX buffer before batch...");
-      while (Serial2.available() > 0)
-      {
-        Serial2.read();
-      }
-      
-      int sentCount = 0;
-
-      // Phase 1: Send all price change commands quickly
-      while (uxQueueMessagesWaiting(priceChangeQueue) > 0)
-      {
-        PriceChangeRequest priceRequest;
-        if (xQueueReceive(priceChangeQueue, &priceRequest, pdMS_TO_TICKS(100)) == pdTRUE)
-        {
-          sentCount++;
-          Serial.printf("[RS485 PRICE] [%d/%d] Sending to DeviceID=%d (Queue remaining: %d)\n",
-                        sentCount, priceQueueSize, priceRequest.deviceId,
-                        uxQueueMessagesWaiting(priceChangeQueue));
-
-          // Retry mechanism: try up to 3 times if no response
-          bool responseReceived = false;
-          int maxRetries = 3;
-          
-          for (int retryAttempt = 1; retryAttempt <= maxRetries && !responseReceived; retryAttempt++)
-          {
-            if (retryAttempt > 1)
-            {
-              Serial.printf("[RS485 PRICE] 🔄 Retry %d/%d for DeviceID=%d\n", 
-                           retryAttempt, maxRetries, priceRequest.deviceId);
-            }
-            
-            sendPriceChangeCommand(priceRequest);
-
-            // Wait for THIS device's response before sending next command
-            unsigned long startWait = millis();
-            int expectedDeviceId = priceRequest.deviceId;
-            
-            while (millis() - startWait < 1000) // Max 1000ms (1s) timeout for each device
-            {
-              readRS485Data(buffer);
-              
-              // Check if we got response for THIS device
-              UBaseType_t queueCount = uxQueueMessagesWaiting(priceResponseQueue);
-              if (queueCount >= sentCount)
-              {
-                responseReceived = true;
-                Serial.printf("[RS485 PRICE] ✓ Response received for DeviceID=%d (waited %lums, attempt %d)\n", 
-                             expectedDeviceId, millis() - startWait, retryAttempt);
-                break;
-              }
-              
-              vTaskDelay(pdMS_TO_TICKS(10));
-              esp_task_wdt_reset();
-            }
-            
-            if (!responseReceived && retryAttempt < maxRetries)
-            {
-              Serial.printf("[RS485 PRICE] ⚠️ Timeout on attempt %d for DeviceID=%d, retrying...\n", 
-                           retryAttempt, expectedDeviceId);
-              vTaskDelay(pdMS_TO_TICKS(100)); // Short delay before retry
-            }
-          }
-          
-          if (!responseReceived)
-          {
-            Serial.printf("[RS485 PRICE] ❌ Failed after %d attempts for DeviceID=%d - skipping\n", 
-                         maxRetries, priceRequest.deviceId);
-          }
-          
-          // Small delay between commands
-          vTaskDelay(pdMS_TO_TICKS(50));
-        }
-        else
-        {
-          Serial.println("[RS485 PRICE] ⚠️ Queue receive timeout, breaking batch");
-          break;
-        }
-      }
-
-      Serial.printf("[RS485 PRICE] ✅ Sent %d commands, waiting for responses...\n\n", sentCount);
-      
-      // Track which devices we sent commands to
-      bool deviceSent[10] = {false}; // Index 0-9 for DeviceID 11-20
-      PriceChangeRequest sentDevices[10];
-      int trackIndex = 0;
-      
-      // Rewind and track sent devices from cache
-      for (int i = 0; i < 10; i++)
-      {
-        if (priceRequestCache[i].deviceId >= 11 && priceRequestCache[i].deviceId <= 20)
-        {
-          int idx = priceRequestCache[i].deviceId - 11;
-          deviceSent[idx] = true;
-          sentDevices[idx] = priceRequestCache[i];
-        }
-      }
-      
-      // Phase 2: Wait for ALL responses while actively reading RS485 data
-      // We need to call readRS485Data() to queue the responses!
-      unsigned long waitStart = millis();
-      unsigned long waitDuration = 5000; // Increased to 5000ms (5s) for slow devices
-      
-      while (millis() - waitStart < waitDuration)
-      {
-        // Actively read RS485 to queue responses
-        readRS485Data(buffer);
-        
-        // Check if we got all responses
-        UBaseType_t queuedCount = uxQueueMessagesWaiting(priceResponseQueue);
-        if (queuedCount >= sentCount)
-        {
-          Serial.printf("[RS485 PRICE] ✓ All %d responses received after %lums\n", 
-                        sentCount, millis() - waitStart);
-          break;
-        }
-        
-        // Small delay to avoid tight loop (increased to 20ms)
-        vTaskDelay(pdMS_TO_TICKS(20));
-        esp_task_wdt_reset();
-      }
-      
-      UBaseType_t finalQueuedCount = uxQueueMessagesWaiting(priceResponseQueue);
-      Serial.printf("[RS485 PRICE] Phase 3: Processing %d/%d queued responses (waited %lums)...\n", 
-                    finalQueuedCount, sentCount, millis() - waitStart);
-      
-      // Phase 3: Process all queued responses (save to Flash + publish MQTT)
-      int processedResponses = 0;
-      
-      // Process all responses currently in queue
-      while (uxQueueMessagesWaiting(priceResponseQueue) > 0)
-      {
-        PriceChangeResponse response;
-        if (xQueueReceive(priceResponseQueue, &response, pdMS_TO_TICKS(100)) == pdTRUE)
-        {
-          processedResponses++;
-          
-          if (response.status == 'S')
-          {
-            Serial.printf("[RS485 PRICE] [%d/%d] Processing SUCCESS response for DeviceID=%d\n",
-                          processedResponses, sentCount, response.deviceId);
-            
-            // Save to Flash with retry
-            savePriceChangeWithRetry(response.deviceId, response.idDevice, 
-                                    response.unitPrice, response.idChiNhanh, nozzlePrices, flashMutex);
-            // Note: savePriceChangeWithRetry() auto-calls publishPriceChangeSuccess()
-            
-            // Delay 100ms between MQTT publishes to avoid overwhelming broker
-            vTaskDelay(pdMS_TO_TICKS(100));
-          }
-          else if (response.status == 'E')
-          {
-            Serial.printf("[RS485 PRICE] [%d/%d] DeviceID=%d returned ERROR - not saving\n",
-                          processedResponses, sentCount, response.deviceId);
-          }
-          
-          esp_task_wdt_reset();
-        }
-        else
-        {
-          // Timeout receiving from queue
-          break;
-        }
-      }
-      
-      Serial.printf("[RS485 PRICE] 🎯 Batch complete: Sent=%d, Processed=%d responses\n", 
-                    sentCount, processedResponses);
-      
-      // Warning if not all responses received - list missing devices
-      if (processedResponses < sentCount)
-      {
-        Serial.printf("\n[RS485 PRICE] ⚠️ WARNING: Missing %d/%d responses!\n", 
-                      sentCount - processedResponses, sentCount);
-        
-        // Determine which devices didn't respond by checking cache vs processed
-        bool deviceProcessed[10] = {false}; // Track processed devices
-        
-        // Mark all devices we've processed (would need to track during Phase 3)
-        // For now, just show general warning
-        Serial.println("[RS485 PRICE] Some devices may be offline, not connected, or responding too slowly (>5s).");
-        Serial.println("[RS485 PRICE] Check DeviceID=13 and DeviceID=12 if they are consistently missing.\n");
-      }
-      else
-      {
-        Serial.println("[RS485 PRICE] ✅ All devices responded successfully!\n");
-      }
+      runPriceChangeBatch(buffer);
     }
 
     // Priority 2: Send log requests every 500ms (reduce heat/power)
     if (millis() - lastSendTime >= 500)
     {
       lastSendTime = millis();
-      // Process log loss queue
+      // Process log loss queue (one flash read in flight at a time)
       DtaLogLoss dataLog;
-      if (xQueueReceive(logIdLossQueue, &dataLog, 0) == pdTRUE)
+      if (!logLossReadBusy && xQueueReceive(logIdLossQueue, &dataLog, 0) == pdTRUE)
       {
         checkLogSend = 0; // dùng để kiểm tra có phát sinh giao dịch ko, nếu có reset biến này.
         // sendLogRequest(static_cast<uint32_t>(dataLog.Logid));
@@ -1360,72 +1645,415 @@ void rs485Task(void *parameter)
       }
     }
 
-    vTaskDelay(pdMS_TO_TICKS(10));
-    yield();
+    // Log-loss read served by storageTask → MQTT
+    LogLossRead lossRead;
+    if (xQueueReceive(logLossReadQueue, &lossRead, 0) == pdTRUE)
+    {
+      logLossReadBusy = false;
+      publishFlashLog(lossRead);
+    }
+
+    // Priority 3: Bulk log recovery from the TTL box (throttled behind live traffic)
+    uint32_t recoveryWaitMs = serviceLogRecovery();
+
+    // Queued requests from other tasks (time sync, printer setup) + reply timeouts
+    uint32_t schedWaitMs = serviceRS485Scheduler();
+    if (schedWaitMs < recoveryWaitMs)
+    {
+      recoveryWaitMs = schedWaitMs;
+    }
+
+    // Sleep until UART data arrives, a price change / recovery range is queued
+    // (notified from mqttCallback), a log-loss read is done (storageTask), the
+    // next 500 ms log-loss slot, a recovery request is due, or a partial frame
+    // goes stale
+    unsigned long sinceLogSlot = millis() - lastSendTime;
+    uint32_t waitMs = sinceLogSlot < 500 ? 500 - sinceLogSlot : 1;
+    if (recoveryWaitMs < waitMs)
+    {
+      waitMs = recoveryWaitMs;
+    }
+    if (rs485Decoder.midFrame() && waitMs > RS485FrameDecoder::kStaleGapMs)
+    {
+      waitMs = RS485FrameDecoder::kStaleGapMs;
+    }
+    rs485WaitForData(waitMs);
   }
 }
 
 // ============================================================================
-// HELPER FUNCTIONS
+// PRICE CHANGE BATCH - pipelined send, responses matched by device ID
 // ============================================================================
 
-void setupTime()
+// Comma-separated nozzle IDs the latency table flags as chronically slow
+static void listChronicallySlowIds(char *out, size_t size)
 {
-  configTime(gmtOffset_sec, daylightOffset_sec, ntpServer);
-
-  struct tm timeinfo;
-  int retry = 0;
-  const int maxRetries = 5;
-
-  while (!getLocalTime(&timeinfo) && retry < maxRetries)
+  size_t len = 0;
+  out[0] = '\0';
+  for (uint8_t id = 11; id <= 20; id++)
   {
-    Serial.println("Failed to obtain time, retrying...");
-    delay(2000);
-    configTime(gmtOffset_sec, daylightOffset_sec, ntpServer);
-    retry++;
+    if (rs485Latency.isChronicallySlow(id, RS485_CMD_PRICE) && len + 4 < size)
+    {
+      len += snprintf(out + len, size - len, "%s%d", len ? "," : "", id);
+    }
   }
+}
 
-  if (retry < maxRetries)
-  {
-    setUpTime(&timeSetup, timeinfo);
-    processAllVoi(&timeSetup);
-    Serial.println("Time synchronized successfully");
-    setSystemStatus("OK", ""); // Clear any previous time sync errors
-  }
-  else
+// Move queued requests into the engine (new requests may arrive mid-batch)
+static int acceptPriceRequests()
+{
+  int accepted = 0;
+  PriceChangeRequest request;
+  while (xQueueReceive(priceChangeQueue, &request, 0) == pdTRUE)
   {
-    Serial.println("Failed to sync time");
-    char errorMsg[64];
-    snprintf(errorMsg, sizeof(errorMsg), "Failed to sync time after %d attempts", maxRetries);
-    setSystemStatus("WARNING", errorMsg);
+    if (!PriceChangeEngine::validId(request.deviceId))
+    {
+      Serial.printf("[RS485 PRICE] ERROR: Invalid DeviceID=%d (must be 11-20)\n", request.deviceId);
+      continue;
+    }
+    pricePending[request.deviceId - PRICE_ENGINE_FIRST_ID] = request;
+    priceEngine.submit(request.deviceId, millis(),
+                       rs485Latency.timeoutMs(request.deviceId, RS485_CMD_PRICE, PRICE_DEFAULT_TIMEOUT_MS));
+    accepted++;
   }
+  return accepted;
 }
 
-void setupMQTTTopics()
+void runPriceChangeBatch(byte *buffer)
 {
-  // Get MQTT settings from API
-  callAPIGetSettingsMqtt(&settings, flashMutex);
+  unsigned long batchStart = millis();
+  int submitted = acceptPriceRequests();
+  Serial.printf("\n[RS485 PRICE] Starting batch: %d price change(s) pending\n", submitted);
 
-  // Update MQTT server with settings from API
-  if (strlen(settings.MqttServer) > 0)
+  // Dispatch anything already buffered (pump logs included) before starting
+  readRS485Data(buffer);
+
+  // Keep several commands in flight; responses are matched in handlePriceResponseFrame()
+  while (priceEngine.busy())
   {
-    // Disconnect if currently connected to force reconnection with new server
-    if (mqttClient.connected())
+    esp_task_wdt_reset();
+    submitted += acceptPriceRequests();
+    priceEngine.poll(millis());
+
+    uint8_t deviceId;
+    while (rs485MayTransmit(RS485_CLASS_PRICE) && (deviceId = priceEngine.nextToSend(millis())) != 0)
     {
-      mqttClient.disconnect();
-      Serial.println("MQTT disconnected to update server settings");
+      uint8_t attempt = priceEngine.slot(deviceId).attempts;
+      if (attempt > 1)
+      {
+        Serial.printf("[RS485 PRICE] 🔄 Retry %d for DeviceID=%d (no response)\n", attempt, deviceId);
+      }
+      sendPriceChangeCommand(pricePending[deviceId - PRICE_ENGINE_FIRST_ID]);
+      rs485NoteTransmit(RS485_CLASS_PRICE, TTLPriceChange::kLength);
     }
 
-    mqttClient.setServer(settings.MqttServer, settings.PortMqtt);
-    // Serial.printf("MQTT server updated from API: %s:%d\n", settings.MqttServer, settings.PortMqtt);
+    uint32_t waitMs = priceEngine.msUntilNextEvent(millis());
+    portENTER_CRITICAL(&rs485SchedMux);
+    uint32_t busWaitMs = rs485Scheduler.msUntilNextEvent(millis());
+    portEXIT_CRITICAL(&rs485SchedMux);
+    rs485WaitForData(busWaitMs < waitMs ? busWaitMs : waitMs);
+    readRS485Data(buffer);
   }
-  else
+
+  // Per-device completion report
+  int okCount = 0, errorCount = 0, failedCount = 0;
+  Serial.printf("[RS485 PRICE] Batch finished in %lums (since boot: retries=%lu, stray responses=%lu)\n",
+                millis() - batchStart, (unsigned long)priceEngine.retries, (unsigned long)priceEngine.strayResponses);
+  for (uint8_t id = PRICE_ENGINE_FIRST_ID; id < PRICE_ENGINE_FIRST_ID + PRICE_ENGINE_SLOTS; id++)
   {
-    Serial.println("Using default MQTT server (no API settings)");
+    const PriceSlot &slot = priceEngine.slot(id);
+    if (slot.state == PRICE_SLOT_IDLE)
+    {
+      continue;
+    }
+    okCount += slot.state == PRICE_SLOT_DONE_OK;
+    errorCount += slot.state == PRICE_SLOT_DONE_ERROR;
+    failedCount += slot.state == PRICE_SLOT_FAILED;
+    for (uint8_t t = 0; t < slot.timeouts; t++)
+    {
+      rs485Latency.recordTimeout(id, RS485_CMD_PRICE);
+    }
+    Serial.printf("  DeviceID=%d: %-11s attempts=%d rtt=%lums total=%lums timeout=%lums\n", id,
+                  PriceChangeEngine::stateName(slot.state), slot.attempts,
+                  (unsigned long)(slot.doneMs - slot.sentMs), (unsigned long)(slot.doneMs - slot.submitMs),
+                  (unsigned long)slot.timeoutMs);
   }
 
-  // Get company info
-  xTaskCreate(callAPIServerGetCompanyInfo, "getCompanyInfo", 2048, &companyInfo, 2, NULL);
+  // Nozzles that are consistently slow or silent (from the latency histograms)
+  char slowIds[48] = "";
+  listChronicallySlowIds(slowIds, sizeof(slowIds));
+  if (slowIds[0] != '\0')
+  {
+    Serial.printf("[RS485 PRICE] ⚠️ Chronically slow/missing DeviceID(s): %s\n", slowIds);
+  }
+
+  // Confirmed prices → RAM price table + publish MQTT (the file is written behind)
+  int processedResponses = 0;
+  PriceChangeResponse response;
+  while (xQueueReceive(priceResponseQueue, &response, 0) == pdTRUE)
+  {
+    processedResponses++;
+    if (response.status == 'S')
+    {
+      // Note: savePriceChange() auto-calls publishPriceChangeSuccess()
+      savePriceChange(response.deviceId, response.idDevice, response.unitPrice, response.idChiNhanh);
+
+      // Delay 100ms between MQTT publishes to avoid overwhelming broker
+      vTaskDelay(pdMS_TO_TICKS(100));
+    }
+    else
+    {
+      Serial.printf("[RS485 PRICE] DeviceID=%d returned ERROR - not saving\n", response.deviceId);
+    }
+    esp_task_wdt_reset();
+  }
+
+  Serial.printf("[RS485 PRICE] 🎯 Batch complete: Submitted=%d, OK=%d, Error=%d, NoResponse=%d, Processed=%d\n\n",
+                submitted, okCount, errorCount, failedCount, processedResponses);
+  priceEngine.clearFinished();
+  logRecovery.onLiveTraffic(millis());
+}
+
+// ============================================================================
+// LOG RECOVERY - re-read log positions from the TTL box, matched by viTriLogData
+// ============================================================================
+
+// Accept queued ranges, expire/retry requests and send whatever the throttle allows.
+// Returns ms until the engine next needs attention (0xFFFFFFFF when idle).
+uint32_t serviceLogRecovery()
+{
+  LogRecoveryRange range;
+  while (xQueueReceive(logRecoveryQueue, &range, 0) == pdTRUE)
+  {
+    if (range.count == 0)
+    {
+      Serial.printf("[LOG RECOVERY] Cancelled: %lu position(s) not requested, %d outstanding dropped\n",
+                    (unsigned long)logRecovery.remaining(), logRecovery.outstanding());
+      logRecovery.cancel();
+      logRecovery.stats.finishMs = millis();
+      continue;
+    }
+    if (logRecovery.addRange(range.first, range.count, millis()))
+    {
+      Serial.printf("[LOG RECOVERY] Queued positions %u..+%u (%lu pending)\n",
+                    range.first, range.count, (unsigned long)logRecovery.remaining());
+    }
+    else
+    {
+      Serial.printf("[LOG RECOVERY] ERROR: Range %u..+%u rejected (invalid or range queue full)\n",
+                    range.first, range.count);
+    }
+  }
+
+  static bool running = false;
+  if (logRecovery.active())
+  {
+    running = true;
+    uint32_t now = millis();
+    logRecovery.poll(now);
+    uint32_t timeoutMs = rs485Latency.timeoutMs(LOG_RECOVERY_DEVICE_ID, RS485_CMD_LOG_REQUEST,
+                                                LOG_RECOVERY_DEFAULT_TIMEOUT_MS);
+    uint16_t pos;
+    while (rs485MayTransmit(RS485_CLASS_LOG_RECOVERY) && (pos = logRecovery.nextToSend(millis(), timeoutMs)) != 0)
+    {
+      sendLogRequest(pos);
+      rs485NoteTransmit(RS485_CLASS_LOG_RECOVERY, TTLLogRequest::kLength);
+    }
+  }
+
+  // Run finished (last answer may have arrived in handlePumpLogFrame)
+  if (running && !logRecovery.active())
+  {
+    running = false;
+    const LogRecoveryStats &st = logRecovery.stats;
+    for (uint32_t t = 0; t < st.timeouts; t++)
+    {
+      rs485Latency.recordTimeout(LOG_RECOVERY_DEVICE_ID, RS485_CMD_LOG_REQUEST);
+    }
+    Serial.printf("[LOG RECOVERY] 🎯 Done in %lums: recovered=%lu failed=%lu requests=%lu retries=%lu\n",
+                  (unsigned long)(st.finishMs - st.startMs), (unsigned long)st.recovered, (unsigned long)st.failed,
+                  (unsigned long)st.requested, (unsigned long)st.retries);
+  }
+  uint32_t waitMs = logRecovery.msUntilNextEvent(millis());
+  if (waitMs == 0 && logRecovery.active())
+  {
+    waitMs = RS485_TURNAROUND_MS; // Ready but the bus is taken - retry shortly
+  }
+  return waitMs;
+}
+
+// ============================================================================
+// RS485 SCHEDULER - queued requests from other tasks, bus arbitration
+// ============================================================================
+
+bool rs485MayTransmit(RS485Class cls)
+{
+  portENTER_CRITICAL(&rs485SchedMux);
+  bool ok = rs485Scheduler.mayTransmit(cls, millis());
+  portEXIT_CRITICAL(&rs485SchedMux);
+  return ok;
+}
+
+void rs485NoteTransmit(RS485Class cls, size_t len)
+{
+  portENTER_CRITICAL(&rs485SchedMux);
+  rs485Scheduler.noteTransmit(cls, len, millis());
+  portEXIT_CRITICAL(&rs485SchedMux);
+}
+
+// Safe from any task: copies the request into the scheduler and wakes rs485Task
+bool rs485Submit(const RS485Request &request)
+{
+  RS485Request r = request;
+  if (r.replyId != 0 && r.timeoutMs == 0)
+  {
+    r.timeoutMs = rs485Latency.timeoutMs(r.replyId, RS485_CMD_SET_TIME, SET_TIME_DEFAULT_TIMEOUT_MS);
+  }
+
+  portENTER_CRITICAL(&rs485SchedMux);
+  bool ok = rs485Scheduler.submit(r, millis());
+  portEXIT_CRITICAL(&rs485SchedMux);
+
+  if (!ok)
+  {
+    Serial.printf("[RS485 SCHED] ❌ %s request dropped - scheduler full (%d slots)\n",
+                  RS485Scheduler::className(r.cls), RS485_SCHED_SLOTS);
+  }
+  else if (rs485TaskHandle != NULL)
+  {
+    xTaskNotifyGive(rs485TaskHandle);
+  }
+  return ok;
+}
+
+// Callbacks run here in rs485Task, outside the scheduler lock
+static void rs485Complete(const RS485Completion &c)
+{
+  if (c.request.done != NULL)
+  {
+    c.request.done(c.request, c.result, c.rttMs);
+  }
+}
+
+void onSetTimeResult(const RS485Request &request, RS485Result result, uint32_t rttMs)
+{
+  if (result == RS485_RESULT_TIMEOUT)
+  {
+    rs485Latency.recordTimeout(request.replyId, RS485_CMD_SET_TIME);
+    Serial.printf("[RS485 SCHED] No response to set time from ID %d (%lums)\n", request.replyId, (unsigned long)rttMs);
+    return;
+  }
+  rs485Latency.record(request.replyId, RS485_CMD_SET_TIME, rttMs);
+  Serial.printf("[RS485 SCHED] Set time %s for ID %d (%lums)\n",
+                result == RS485_RESULT_OK ? "successful" : "failed", request.replyId, (unsigned long)rttMs);
+}
+
+// Expire the request waiting for a reply, then send queued requests the bus allows.
+// Returns ms until the scheduler next needs attention (0xFFFFFFFF when idle).
+uint32_t serviceRS485Scheduler()
+{
+  RS485Completion done;
+  portENTER_CRITICAL(&rs485SchedMux);
+  bool completed = rs485Scheduler.poll(millis(), done);
+  portEXIT_CRITICAL(&rs485SchedMux);
+  if (completed)
+  {
+    rs485Complete(done);
+  }
+
+  while (true)
+  {
+    RS485Request request;
+    portENTER_CRITICAL(&rs485SchedMux);
+    const RS485Request *next = rs485Scheduler.next(millis());
+    if (next != NULL)
+    {
+      request = *next;
+    }
+    portEXIT_CRITICAL(&rs485SchedMux);
+    if (next == NULL)
+    {
+      break;
+    }
+
+    rs485Write(request.data, request.len);
+
+    portENTER_CRITICAL(&rs485SchedMux);
+    completed = rs485Scheduler.transmitted(request.cls, millis(), done);
+    portEXIT_CRITICAL(&rs485SchedMux);
+    if (completed)
+    {
+      rs485Complete(done);
+    }
+  }
+
+  portENTER_CRITICAL(&rs485SchedMux);
+  uint32_t waitMs = rs485Scheduler.msUntilNextEvent(millis());
+  portEXIT_CRITICAL(&rs485SchedMux);
+  return waitMs;
+}
+
+// ============================================================================
+// HELPER FUNCTIONS
+// ============================================================================
+
+void setupTime()
+{
+  configTime(gmtOffset_sec, daylightOffset_sec, ntpServer);
+
+  struct tm timeinfo;
+  int retry = 0;
+  const int maxRetries = 5;
+
+  while (!getLocalTime(&timeinfo) && retry < maxRetries)
+  {
+    Serial.println("Failed to obtain time, retrying...");
+    delay(2000);
+    configTime(gmtOffset_sec, daylightOffset_sec, ntpServer);
+    retry++;
+  }
+
+  if (retry < maxRetries)
+  {
+    setUpTime(&timeSetup, timeinfo);
+    processAllVoi(&timeSetup);
+    Serial.println("Time synchronized successfully");
+    setSystemStatus("OK", ""); // Clear any previous time sync errors
+  }
+  else
+  {
+    Serial.println("Failed to sync time");
+    char errorMsg[64];
+    snprintf(errorMsg, sizeof(errorMsg), "Failed to sync time after %d attempts", maxRetries);
+    setSystemStatus("WARNING", errorMsg);
+  }
+}
+
+void setupMQTTTopics()
+{
+  // Get MQTT settings from API
+  callAPIGetSettingsMqtt(&settings);
+
+  // Update MQTT server with settings from API
+  if (strlen(settings.MqttServer) > 0)
+  {
+    // Disconnect if currently connected to force reconnection with new server
+    if (mqttClient.connected())
+    {
+      mqttClient.disconnect();
+      Serial.println("MQTT disconnected to update server settings");
+    }
+
+    mqttClient.setServer(settings.MqttServer, settings.PortMqtt);
+    // Serial.printf("MQTT server updated from API: %s:%d\n", settings.MqttServer, settings.PortMqtt);
+  }
+  else
+  {
+    Serial.println("Using default MQTT server (no API settings)");
+  }
+
+  // Get company info
+  xTaskCreate(callAPIServerGetCompanyInfo, "getCompanyInfo", 2048, &companyInfo, 2, NULL);
 
   // Wait for company info
   vTaskDelay(pdMS_TO_TICKS(4000));
@@ -1460,7 +2088,11 @@ void setupMQTTTopics()
   snprintf(topicUpdatePrice, sizeof(topicUpdatePrice), "%s%s", companyInfo.CompanyId, TopicUpdatePrice);
   snprintf(topicSetupPrinter, sizeof(topicSetupPrinter), "%s%s", companyInfo.CompanyId, TopicSetupPrinter);
   snprintf(topicGetPrice, sizeof(topicGetPrice), "%s%s", companyInfo.Mst, TopicGetPrice);
+  snprintf(topicGetPriceHistory, sizeof(topicGetPriceHistory), "%s%s", companyInfo.Mst, TopicGetPriceHistory);
   snprintf(topicRequestLog, sizeof(topicRequestLog), "%s%s", companyInfo.CompanyId, TopicRequestLog);
+  snprintf(topicRS485Capture, sizeof(topicRS485Capture), "%s%s", companyInfo.CompanyId, TopicRS485Capture);
+  snprintf(topicRecoverLog, sizeof(topicRecoverLog), "%s%s", companyInfo.CompanyId, TopicRecoverLog);
+  snprintf(topicRequestLogByDate, sizeof(topicRequestLogByDate), "%s%s", companyInfo.CompanyId, TopicRequestLogByDate);
   // snprintf(topicUpdatePrice, sizeof(topicUpdatePrice), "%s%s%s", companyInfo.CompanyId, TopicUpdatePrice);
 
   Serial.printf("MQTT topics configured - Company ID: %s (MST: %s)\n", companyInfo.CompanyId, companyInfo.Mst);
@@ -1481,6 +2113,10 @@ void setupMQTTTopics()
     bool sub8 = mqttClient.subscribe(topicGetPrice);
     bool sub9 = mqttClient.subscribe(topicRequestLog);
     bool sub10 = mqttClient.subscribe(topicSetupPrinter);
+    bool sub11 = mqttClient.subscribe(topicRS485Capture);
+    bool sub12 = mqttClient.subscribe(topicRecoverLog);
+    bool sub13 = mqttClient.subscribe(topicRequestLogByDate);
+    bool sub14 = mqttClient.subscribe(topicGetPriceHistory);
 
     Serial.printf("Subscription results:\n");
     Serial.printf("  Error (%s): %s\n", topicError, sub1 ? "SUCCESS" : "FAILED");
@@ -1493,10 +2129,15 @@ void setupMQTTTopics()
     Serial.printf("  GetPrice (%s): %s\n", topicGetPrice, sub8 ? "SUCCESS" : "FAILED");
     Serial.printf("  RequestLog (%s): %s\n", topicRequestLog, sub9 ? "SUCCESS" : "FAILED");
     Serial.printf("  SetupPrinter (%s): %s\n", topicSetupPrinter, sub10 ? "SUCCESS" : "FAILED");
+    Serial.printf("  RS485Capture (%s): %s\n", topicRS485Capture, sub11 ? "SUCCESS" : "FAILED");
+    Serial.printf("  RecoverLog (%s): %s\n", topicRecoverLog, sub12 ? "SUCCESS" : "FAILED");
+    Serial.printf("  RequestLogByDate (%s): %s\n", topicRequestLogByDate, sub13 ? "SUCCESS" : "FAILED");
+    Serial.printf("  GetPriceHistory (%s): %s\n", topicGetPriceHistory, sub14 ? "SUCCESS" : "FAILED");
     Serial.println("=== SUBSCRIPTION COMPLETE ===");
 
     // Set subscription flag
-    mqttSubscribed = (sub1 && sub2 && sub3 && sub4 && sub5 && sub6 && sub7 && sub8 && sub9 && sub10);
+    mqttSubscribed = (sub1 && sub2 && sub3 && sub4 && sub5 && sub6 && sub7 && sub8 && sub9 && sub10 && sub11 && sub12 && sub13 &&
+                       sub14);
     Serial.printf("MQTT subscription state: %s\n", mqttSubscribed ? "SUBSCRIBED" : "PARTIAL_FAILURE");
   }
   else
@@ -1537,6 +2178,10 @@ void connectMQTT()
       bool sub8 = mqttClient.subscribe(topicGetPrice);
       bool sub9 = mqttClient.subscribe(topicRequestLog);
       bool sub10 = mqttClient.subscribe(topicSetupPrinter);
+      bool sub11 = mqttClient.subscribe(topicRS485Capture);
+      bool sub12 = mqttClient.subscribe(topicRecoverLog);
+      bool sub13 = mqttClient.subscribe(topicRequestLogByDate);
+      bool sub14 = mqttClient.subscribe(topicGetPriceHistory);
 
       Serial.printf("Re-subscription results:\n");
       Serial.printf("  Error (%s): %s\n", topicError, sub1 ? "SUCCESS" : "FAILED");
@@ -1549,10 +2194,15 @@ void connectMQTT()
       Serial.printf("  GetPrice (%s): %s\n", topicGetPrice, sub8 ? "SUCCESS" : "FAILED");
       Serial.printf("  RequestLog (%s): %s\n", topicRequestLog, sub9 ? "SUCCESS" : "FAILED");
       Serial.printf("  SetupPrinter (%s): %s\n", topicSetupPrinter, sub10 ? "SUCCESS" : "FAILED");
+      Serial.printf("  RS485Capture (%s): %s\n", topicRS485Capture, sub11 ? "SUCCESS" : "FAILED");
+      Serial.printf("  RecoverLog (%s): %s\n", topicRecoverLog, sub12 ? "SUCCESS" : "FAILED");
+      Serial.printf("  RequestLogByDate (%s): %s\n", topicRequestLogByDate, sub13 ? "SUCCESS" : "FAILED");
+      Serial.printf("  GetPriceHistory (%s): %s\n", topicGetPriceHistory, sub14 ? "SUCCESS" : "FAILED");
       Serial.println("=== RE-SUBSCRIPTION COMPLETE ===");
 
       // Set subscription flag
-      mqttSubscribed = (sub1 && sub2 && sub3 && sub4 && sub5 && sub6 && sub7 && sub8 && sub9 && sub10);
+      mqttSubscribed = (sub1 && sub2 && sub3 && sub4 && sub5 && sub6 && sub7 && sub8 && sub9 && sub10 && sub11 && sub12 && sub13 &&
+                       sub14);
       Serial.printf("MQTT re-subscription state: %s\n", mqttSubscribed ? "SUBSCRIBED" : "PARTIAL_FAILURE");
 
       // Publish saved prices from Flash after successful MQTT connection
@@ -1583,7 +2233,7 @@ void connectMQTT()
 void sendDeviceStatus()
 {
   // Create JSON status data
-  DynamicJsonDocument doc(1024);
+  DynamicJsonDocument doc(3072);
 
   doc["idDevice"] = TopicMqtt;
   doc["companyId"] = companyInfo.Mst;
@@ -1602,6 +2252,175 @@ void sendDeviceStatus()
   // Serial.println("Mac: " + String(macStr));
   doc["macAddress"] = String(macStr);
 
+  // RS485 receive path: wake-ups and RX event → frame dispatch latency (last 10 s)
+  doc["rs485WakeupsPerSec"] = rs485RxStats.wakeupsPerSec;
+  doc["rs485FrameLatencyAvgUs"] = rs485RxStats.avgLatencyUs;
+  doc["rs485FrameLatencyMaxUs"] = rs485RxStats.maxLatencyUs;
+
+  // Price response latency histograms per nozzle (only nozzles with traffic):
+  // "priceLat": {"11": {"h": [bucket counts], "p50": ms, "p99": ms, "to": timeout ms, "miss": n}}
+  JsonArray edges = doc.createNestedArray("latEdgesMs");
+  for (uint8_t b = 0; b < LATENCY_BUCKETS - 1; b++)
+  {
+    edges.add(kLatencyEdgesMs[b]);
+  }
+  JsonObject priceLat = doc.createNestedObject("priceLat");
+  for (uint8_t id = 11; id <= 20; id++)
+  {
+    const LatencyHistogram &h = rs485Latency.at(id, RS485_CMD_PRICE);
+    if (h.answered() == 0 && h.timeouts() == 0)
+    {
+      continue;
+    }
+    char key[4];
+    snprintf(key, sizeof(key), "%d", id);
+    JsonObject dev = priceLat.createNestedObject(key);
+    JsonArray hist = dev.createNestedArray("h");
+    for (uint8_t b = 0; b < LATENCY_BUCKETS; b++)
+    {
+      hist.add(h.bucket(b));
+    }
+    dev["p50"] = h.percentile(50);
+    dev["p99"] = h.percentile(99);
+    dev["to"] = h.timeoutMs(PRICE_DEFAULT_TIMEOUT_MS);
+    dev["miss"] = h.timeouts();
+  }
+  char slowIds[48];
+  listChronicallySlowIds(slowIds, sizeof(slowIds));
+  doc["slowIds"] = slowIds;
+
+  // Bulk log recovery (current / last run)
+  JsonObject rec = doc.createNestedObject("logRecovery");
+  rec["active"] = logRecovery.active();
+  rec["remaining"] = logRecovery.remaining() + logRecovery.outstanding();
+  rec["recovered"] = logRecovery.stats.recovered;
+  rec["failed"] = logRecovery.stats.failed;
+  rec["retries"] = logRecovery.stats.retries;
+
+  // RS485 scheduler per priority class: frames sent, reply timeouts, dropped submits, longest queue wait
+  JsonObject sched = doc.createNestedObject("rs485Sched");
+  for (uint8_t c = 0; c < RS485_CLASS_COUNT; c++)
+  {
+    const RS485ClassStats &st = rs485Scheduler.stats[c];
+    JsonObject cls = sched.createNestedObject(RS485Scheduler::className((RS485Class)c));
+    cls["sent"] = st.sent;
+    cls["to"] = st.timeouts;
+    cls["drop"] = st.dropped;
+    cls["waitMax"] = st.maxWaitMs;
+  }
+  sched["foreignWrites"] = rs485ForeignWrites;
+
+  // OUT1/OUT2 pulses: played vs requests merged into an already pending pulse
+  doc["pulseTxPlayed"] = outputPulse.stats.played[PULSE_TRANSACTION];
+  doc["pulseCoalesced"] = outputPulseCoalescedTotal();
+
+  // Log journal: stored logs, flash use, compaction activity
+  JsonObject jrnl = doc.createNestedObject("journal");
+  jrnl["logs"] = logJournal.count();
+  jrnl["usedKB"] = logJournal.bytesUsed() / 1024;
+  jrnl["freeSeg"] = logJournal.freeSegments();
+  jrnl["writtenKB"] = logJournal.stats.bytesWritten / 1024;
+  jrnl["compactions"] = logJournal.stats.compactions;
+  jrnl["statusRecs"] = logJournal.stats.statusAppends;
+  jrnl["medium"] = logJournalMedium.usingFallback() ? "files" : "partition";
+  jrnl["erases"] = logJournalPartition.eraseTotal() + logArchivePartition.eraseTotal();
+  jrnl["eraseSpread"] = logJournalPartition.eraseSpread();
+  jrnl["headId"] = logStore.headId;
+  jrnl["bootMs"] = logStore.bootMs;
+  jrnl["bootFrom"] = logStore.restored ? "checkpoint" : "scan";
+  jrnl["bootReplayed"] = logStore.replayed;
+  jrnl["checkpointGen"] = logCheckpoint.generation();
+  jrnl["checkpointWrites"] = logCheckpoint.writeCount();
+
+  // Undelivered logs (delivery bitmap, no flash reads): count + the next few slots
+  uint16_t pendingFirst[10];
+  uint16_t pendingShown = nextPendingLogs(republishCursor, pendingFirst, 10);
+  jrnl["pending"] = pendingLogCount();
+  JsonArray pendingArr = jrnl.createNestedArray("pendingNext");
+  for (uint16_t i = 0; i < pendingShown; i++)
+  {
+    pendingArr.add(pendingFirst[i]);
+  }
+
+  // Log archive: ID range kept, flash use, bytes per log on flash
+  JsonObject arch = doc.createNestedObject("archive");
+  arch["firstId"] = logArchive.firstId();
+  arch["lastId"] = logArchive.lastId();
+  arch["logs"] = logArchive.count();
+  arch["usedKB"] = logArchive.bytesUsed() / 1024;
+  arch["bytesPerLog"] = logArchive.count() ? (float)logArchive.bytesUsed() / logArchive.count() : 0;
+  arch["pending"] = logArchive.pending();
+  arch["skipped"] = logArchive.stats.skipped;
+  arch["dropped"] = logArchive.stats.segmentsDropped;
+  arch["moved"] = logArchive.stats.segmentsMoved;
+  if (logArchive.coldTier() != NULL)
+  {
+    JsonObject cold = arch.createNestedObject("cold");
+    cold["firstId"] = logColdArchive.firstId();
+    cold["lastId"] = logColdArchive.lastId();
+    cold["logs"] = logColdArchive.count();
+    cold["usedKB"] = logColdArchive.bytesUsed() / 1024;
+    cold["dropped"] = logColdArchive.stats.segmentsDropped;
+  }
+
+  // Config store: boot load (NVS blob vs the legacy files on the migration boot), writes
+  JsonObject config = doc.createNestedObject("config");
+  config["version"] = configStore.stats.loadedVersion;
+  config["loadUs"] = configStore.stats.loadUs;
+  if (configStore.stats.migrated)
+    config["legacyLoadUs"] = configStore.stats.legacyLoadUs;
+  config["commits"] = configStore.stats.commits;
+  config["bytesWritten"] = configStore.stats.bytesWritten;
+  config["failed"] = configStore.stats.failed;
+
+  // Storage service: per request type served / failed, queue wait and service time
+  JsonObject storage = doc.createNestedObject("storage");
+  storage["queueHighWater"] = storageStats.queueHighWater;
+  JsonObject prices = storage.createNestedObject("prices");
+  prices["saves"] = priceStore.saves;
+  prices["coalesced"] = priceStore.coalesced;
+  prices["failed"] = priceStore.failed;
+  prices["unsaved"] = priceStore.version - priceStore.savedVersion;
+  prices["journal"] = priceJournalReady;
+  if (priceJournalReady)
+  {
+    prices["changes"] = priceJournal.stats.changes;
+    prices["snapshots"] = priceJournal.stats.snapshots;
+    prices["bytesWritten"] = priceJournal.stats.bytesWritten;
+    prices["usedKB"] = priceJournal.bytesUsed() / 1024;
+  }
+  for (uint8_t op = 0; op < STORAGE_OP_COUNT; op++)
+  {
+    const StorageStats::Op &o = storageStats.ops[op];
+    if (o.count == 0)
+      continue;
+    JsonObject t = storage.createNestedObject(StorageStats::name(op));
+    t["n"] = o.count;
+    t["failed"] = o.failed;
+    t["waitAvgMs"] = (float)(o.waitUsSum / o.count) / 1000;
+    t["waitMaxMs"] = (float)o.waitUsMax / 1000;
+    t["serviceAvgMs"] = (float)(o.serviceUsSum / o.count) / 1000;
+    t["serviceMaxMs"] = (float)o.serviceUsMax / 1000;
+  }
+
+  // Group commit: logs per sync, time the flash was held per commit, oldest log's wait
+  JsonObject commit = doc.createNestedObject("logCommit");
+  commit["commits"] = logCommitStats.commits;
+  commit["logs"] = logCommitStats.logs;
+  commit["failed"] = logCommitStats.failed;
+  commit["avgBatch"] = logCommitStats.commits ? (float)logCommitStats.logs / logCommitStats.commits : 0;
+  commit["maxBatch"] = logCommitStats.maxBatch;
+  commit["flushAvgMs"] = logCommitStats.commits ? logCommitStats.flushMsSum / logCommitStats.commits : 0;
+  commit["flushMaxMs"] = logCommitStats.flushMsMax;
+  commit["ageMaxMs"] = logCommitStats.ageMsMax;
+  commit["queueHighWater"] = logCommitStats.queueHighWater;
+
+  // Log queues: drops on a full queue and the free-space low-water mark (0 = was full)
+  doc["mqttQueueDrops"] = mqttQueueDrops;
+  doc["saveLogQueueDrops"] = saveLogQueueDrops;
+  doc["mqttQueueMinFree"] = mqttQueueMinFree == 0xFFFF ? uxQueueSpacesAvailable(mqttQueue) : mqttQueueMinFree;
+  doc["saveLogQueueMinFree"] = saveLogQueueMinFree == 0xFFFF ? uxQueueSpacesAvailable(saveLogQueue) : saveLogQueueMinFree;
+
   // CRITICAL: Add partition warning flag
   doc["oldPartition"] = !g_flashSaveEnabled;
   if (!g_flashSaveEnabled)
@@ -1619,7 +2438,7 @@ void sendDeviceStatus()
     // Blink OUT2 to indicate internet connectivity (only if connected)
     if (WiFi.status() == WL_CONNECTED && mqttClient.connected())
     {
-      blinkOutput2Connected();
+      outputPulseRequest(PULSE_CONNECTED);
     }
   }
   else
@@ -1629,6 +2448,43 @@ void sendDeviceStatus()
   }
 }
 
+// One log in the compact ResponseLog array format:
+// [id,voi,cot,data,bomb,lit,gia,total,tien,d,m,y,h,min,s,sent,time]
+static void addCompactLog(JsonArray logsArray, uint32_t logId, const PumpLog &log)
+{
+  JsonArray logArray = logsArray.createNestedArray();
+  logArray.add(logId);            // 0: logId
+  logArray.add(log.idVoi);        // 1: idVoi
+  logArray.add(log.viTriLogCot);  // 2: viTriLogCot
+  logArray.add(log.viTriLogData); // 3: viTriLogData
+  logArray.add(log.maLanBom);     // 4: maLanBom
+  logArray.add(log.soLitBom);     // 5: soLitBom
+  logArray.add(log.donGia);       // 6: donGia
+  logArray.add(log.soTotalTong);  // 7: soTotalTong
+  logArray.add(log.soTienBom);    // 8: soTienBom
+  logArray.add(log.ngay);         // 9: ngay
+  logArray.add(log.thang);        // 10: thang
+  logArray.add(log.nam);          // 11: nam
+  logArray.add(log.gio);          // 12: gio
+  logArray.add(log.phut);         // 13: phut
+  logArray.add(log.giay);         // 14: giay
+  logArray.add(log.mqttSent);     // 15: mqttSent
+
+  // Format timestamp
+  if (log.mqttSentTime > 0)
+  {
+    struct tm *timeinfo = localtime(&log.mqttSentTime);
+    char formattedTime[32];
+    snprintf(formattedTime, sizeof(formattedTime), "%02d/%02d/%04d-%02d:%02d:%02d",
+             timeinfo->tm_mday, timeinfo->tm_mon + 1, timeinfo->tm_year + 1900,
+             timeinfo->tm_hour, timeinfo->tm_min, timeinfo->tm_sec);
+    logArray.add(formattedTime); // 16: mqttSentTime
+  }
+  else
+  {
+    logArray.add("N/A"); // 16: mqttSentTime
+  }
+}
 
 void mqttCallback(char *topic, byte *payload, unsigned int length)
 {
@@ -1738,26 +2594,22 @@ void mqttCallback(char *topic, byte *payload, unsigned int length)
         return;
       }
       
+      // Printer frames are queued on the RS485 scheduler (sent 300ms apart by rs485Task);
+      // each is repeated 3 times as before
       // set ten don vi to printer
       Serial.println("Setting up ten don vi to printer...");
       Serial.printf("  TenChiNhanh: %s\n", tenChiNhanh.c_str());
       Serial.printf("  Addr: %s\n", addr.c_str());
-      sendSetupPrinterCommandTenDonVi(tenChiNhanh, addr);
-      vTaskDelay(pdMS_TO_TICKS(300));
-      sendSetupPrinterCommandTenDonVi(tenChiNhanh, addr);
-      vTaskDelay(pdMS_TO_TICKS(300));
-      sendSetupPrinterCommandTenDonVi(tenChiNhanh, addr);
-      vTaskDelay(pdMS_TO_TICKS(300));
+      sendSetupPrinterCommandTenDonVi(tenChiNhanh.c_str(), addr.c_str());
+      sendSetupPrinterCommandTenDonVi(tenChiNhanh.c_str(), addr.c_str());
+      sendSetupPrinterCommandTenDonVi(tenChiNhanh.c_str(), addr.c_str());
       
       //set mst to printer
       Serial.println("Setting up mst to printer...");
       Serial.printf("  Mst: %s\n", mst.c_str());
-      sendSetupPrinterCommandMst(mst);
-      vTaskDelay(pdMS_TO_TICKS(300));
-      sendSetupPrinterCommandMst(mst);
-      vTaskDelay(pdMS_TO_TICKS(300));
-      sendSetupPrinterCommandMst(mst);
-      vTaskDelay(pdMS_TO_TICKS(300));
+      sendSetupPrinterCommandMst(mst.c_str());
+      sendSetupPrinterCommandMst(mst.c_str());
+      sendSetupPrinterCommandMst(mst.c_str());
 
       // Check if ThongTinVoi exists and is an array before processing
       if (doc.containsKey("ThongTinVoi") && doc["ThongTinVoi"].is<JsonArray>()) {
@@ -1795,12 +2647,8 @@ void mqttCallback(char *topic, byte *payload, unsigned int length)
           Serial.printf("Setting up nhien lieu to printer: %s, %d\n", tenNhienLieu, soVoi);
           // set nhien lieu to printer
           sendSetupPrinterCommandNhienLieu(tenNhienLieu, soVoi);
-          vTaskDelay(pdMS_TO_TICKS(300)); 
           sendSetupPrinterCommandNhienLieu(tenNhienLieu, soVoi);
-          vTaskDelay(pdMS_TO_TICKS(300));
           sendSetupPrinterCommandNhienLieu(tenNhienLieu, soVoi);
-          vTaskDelay(pdMS_TO_TICKS(300));  
-          // vTaskDelay(pdMS_TO_TICKS(1000));
         }
       } else {
         Serial.println("[MQTT] SetupPrinter: ThongTinVoi is missing or empty, skipping fuel setup");
@@ -2126,6 +2974,12 @@ void mqttCallback(char *topic, byte *payload, unsigned int length)
                   queued, skipped, priceArray.size());
     Serial.printf("[MQTT] RS485 task will process %d price change(s)\n", queued);
 
+    // Wake rs485Task now instead of at its next RX event / log slot
+    if (queued > 0 && rs485TaskHandle != NULL)
+    {
+      xTaskNotifyGive(rs485TaskHandle);
+    }
+
     if (queued > 0)
     {
       char statusMsg[64];
@@ -2138,38 +2992,14 @@ void mqttCallback(char *topic, byte *payload, unsigned int length)
     }
   }
 
-  // Handle GetPrice command - Request current prices from Flash
+  // Handle GetPrice command - Request current prices
   if (strcmp(topic, topicGetPrice) == 0)
   {
-    Serial.println("[MQTT] GetPrice command received - reading prices from Flash...");
+    Serial.println("[MQTT] GetPrice command received - publishing the RAM price table...");
 
-    // Load latest prices from Flash with retry mechanism
+    // The RAM table is authoritative (the price file is its deferred copy): no flash read
     NozzlePrices currentPrices;
-    bool loadSuccess = false;
-    int retryCount = 0;
-    const int MAX_LOAD_RETRIES = 10;
-
-    while (!loadSuccess && retryCount < MAX_LOAD_RETRIES)
-    {
-      loadSuccess = loadNozzlePrices(currentPrices, flashMutex);
-
-      if (!loadSuccess)
-      {
-        retryCount++;
-        Serial.printf("[MQTT] ⚠️ Failed to load prices (attempt %d/%d), retrying in %dms...\n",
-                      retryCount, MAX_LOAD_RETRIES, retryCount * 100);
-        vTaskDelay(pdMS_TO_TICKS(retryCount * 100)); // Progressive backoff
-      }
-    }
-
-    if (!loadSuccess)
-    {
-      Serial.printf("[MQTT] ❌ Failed to load prices after %d attempts - flash mutex busy\n", MAX_LOAD_RETRIES);
-      setSystemStatus("ERROR", "Failed to load prices from Flash");
-      return;
-    }
-
-    Serial.println("[MQTT] ✓ Prices loaded from Flash successfully, publishing...");
+    readNozzlePrices(currentPrices);
 
     // Build response topic: {IdChiNhanh}/ResponsePrice
     char responseTopic[64];
@@ -2224,78 +3054,284 @@ void mqttCallback(char *topic, byte *payload, unsigned int length)
     }
   }
 
-  // Handle RequestLog command - Request specific logs from Flash
-  if (strcmp(topic, topicRequestLog) == 0)
+  // Handle GetPriceHistory: {"Nozzle": 11-20 (0 = all), "Limit": 1-100} → {Mst}/ResponsePriceHistory
+  if (strcmp(topic, topicGetPriceHistory) == 0)
   {
-    DEBUG_PRINTLN("[MQTT] RequestLog command received - parsing payload...");
-
-    // Parse JSON payload: {"Mst": "...", "IdDevice": "...", "BeginLog": 1, "Numslog": 10}
-    DynamicJsonDocument doc(512);
-    DeserializationError error = deserializeJson(doc, payload, length);
-
-    if (error)
+    DynamicJsonDocument req(128);
+    if (length > 0 && deserializeJson(req, payload, length))
     {
-      Serial.printf("[MQTT] RequestLog: JSON parse error: %s\n", error.c_str());
-      setSystemStatus("ERROR", "RequestLog: Invalid JSON payload");
+      Serial.println("[MQTT] GetPriceHistory: Invalid JSON payload");
+      setSystemStatus("ERROR", "GetPriceHistory: Invalid JSON payload");
       return;
     }
-
-    // Extract required fields
-    const char *mst = doc["Mst"] | "";
-    const char *idDevice = doc["IdDevice"] | "";
-    uint16_t beginLog = doc["BeginLog"] | 0;
-    uint16_t numsLog = doc["Numslog"] | 0;
-
-    // ✅ FIX: Validate không null trước khi dùng strcmp
-    if (!mst) mst = "";
-    if (!idDevice) idDevice = "";
-
-    // Validate MST and IdDevice
-    if (strlen(mst) == 0 || strcmp(mst, companyInfo.Mst) != 0)
+    uint8_t nozzle = req["Nozzle"] | 0;
+    int limit = req["Limit"] | 50;
+    if ((nozzle != 0 && (nozzle < 11 || nozzle > 20)) || limit < 1 || limit > PRICE_HISTORY_MAX)
     {
-      DEBUG_PRINTF("[MQTT] RequestLog: MST mismatch (received=%s, expected=%s), ignoring...\n", mst, companyInfo.Mst);
+      Serial.printf("[MQTT] GetPriceHistory: Invalid Nozzle=%u Limit=%d\n", nozzle, limit);
+      setSystemStatus("ERROR", "GetPriceHistory: Invalid nozzle or limit");
       return;
     }
-
-    if (strlen(idDevice) == 0 || strcmp(idDevice, TopicMqtt) != 0)
+    if (!priceJournalReady)
     {
-      DEBUG_PRINTF("[MQTT] RequestLog: IdDevice mismatch (received=%s, expected=%s), ignoring...\n", idDevice, TopicMqtt);
+      Serial.println("[MQTT] GetPriceHistory: no price journal on this device");
+      setSystemStatus("ERROR", "GetPriceHistory: price journal unavailable");
       return;
     }
 
-    // Validate BeginLog and Numslog
-    if (beginLog < 1 || beginLog > MAX_LOGS)
+    static PriceJournalEntry history[PRICE_HISTORY_MAX]; // mqttTask only
+    PriceHistoryQuery query = {nozzle, (uint8_t)limit, history, 0};
+    StorageRequest read = {STORAGE_RUN, STORAGE_NO_WAITER, 0, 0, 0, &query, readPriceHistory};
+    storageCall(read);
+    uint16_t shown = query.total < query.limit ? query.total : query.limit;
+
+    char responseTopic[64];
+    snprintf(responseTopic, sizeof(responseTopic), "%s/ResponsePriceHistory", companyInfo.Mst);
+    DynamicJsonDocument doc(1024 + shown * 96);
+    doc["topic"] = companyInfo.CompanyId;
+    doc["clientid"] = TopicMqtt;
+    doc["Nozzle"] = nozzle;
+    doc["N"] = query.total; // Changes still in the journal
+    JsonArray list = doc.createNestedArray("H"); // Newest first: [time, price, IdDevice, nozzle]
+    for (uint16_t k = 0; k < shown; k++)
     {
-      DEBUG_PRINTF("[MQTT] RequestLog: Invalid BeginLog=%d (must be 1-%d)\n", beginLog, MAX_LOGS);
-      setSystemStatus("ERROR", "RequestLog: Invalid BeginLog");
-      return;
+      const PriceJournalEntry &e = history[(query.total - 1 - k) % query.limit];
+      time_t timestamp = e.time;
+      char formattedTime[32] = "N/A";
+      if (timestamp > 0)
+      {
+        struct tm *timeinfo = localtime(&timestamp);
+        snprintf(formattedTime, sizeof(formattedTime), "%02d/%02d/%04d-%02d:%02d:%02d",
+                 timeinfo->tm_mday, timeinfo->tm_mon + 1, timeinfo->tm_year + 1900,
+                 timeinfo->tm_hour, timeinfo->tm_min, timeinfo->tm_sec);
+      }
+      JsonArray item = list.createNestedArray();
+      item.add(formattedTime);
+      item.add(e.price);
+      item.add(e.idDevice);
+      item.add(e.nozzle);
     }
 
-    if (numsLog < 1 || numsLog > 200)
+    String jsonString;
+    serializeJson(doc, jsonString);
+    if (mqttClient.publish(responseTopic, jsonString.c_str()))
     {
-      DEBUG_PRINTF("[MQTT] RequestLog: Invalid Numslog=%d (must be 1-200)\n", numsLog);
-      setSystemStatus("ERROR", "RequestLog: Invalid Numslog");
-      return;
+      Serial.printf("[MQTT] ✓ Published %u/%u price change(s) to %s\n", shown, query.total, responseTopic);
+      setSystemStatus("OK", "Price history published");
     }
-
-    DEBUG_PRINTF("[MQTT] RequestLog: MST=%s, IdDevice=%s, BeginLog=%d, Numslog=%d\n",
-                 mst, idDevice, beginLog, numsLog);
-
-    // Build response topic: {Mst}/ResponseLog
-    char responseTopic[64];
-    snprintf(responseTopic, sizeof(responseTopic), "%s/ResponseLog", companyInfo.Mst);
-
-    // Calculate range
-    uint16_t endLog = beginLog + numsLog - 1;
-
-    // Make sure we don't exceed MAX_LOGS
-    if (endLog > MAX_LOGS)
+    else
     {
-      endLog = MAX_LOGS;
-      DEBUG_PRINTF("[MQTT] Adjusted endLog to MAX_LOGS=%d\n", MAX_LOGS);
+      Serial.printf("[MQTT] ✗ Failed to publish ResponsePriceHistory to %s\n", responseTopic);
+      setSystemStatus("ERROR", "Failed to publish price history");
     }
+    return;
+  }
 
-    DEBUG_PRINTF("[MQTT] Reading logs from %d to %d...\n", beginLog, endLog);
+  // Handle RS485Capture: {"IdDevice": "...", "Clear": true}
+  if (strcmp(topic, topicRS485Capture) == 0)
+  {
+    DynamicJsonDocument doc(128);
+    if (deserializeJson(doc, payload, length))
+    {
+      Serial.println("[MQTT] RS485Capture: Invalid JSON payload");
+      return;
+    }
+    const char *idDevice = doc["IdDevice"] | "";
+    if (strcmp(idDevice, TopicMqtt) != 0)
+    {
+      DEBUG_PRINTF("[MQTT] RS485Capture: IdDevice mismatch (received=%s), ignoring...\n", idDevice);
+      return;
+    }
+    publishRS485Capture(doc["Clear"] | false);
+    return;
+  }
+
+  // Handle RecoverLog: re-read log positions from the TTL box over RS485
+  // {"IdDevice": "...", "BeginLog": 1, "Numslog": 500}   (positions 1-2046, wraps after 2046)
+  // {"IdDevice": "...", "Cancel": true}
+  if (strcmp(topic, topicRecoverLog) == 0)
+  {
+    DynamicJsonDocument doc(256);
+    if (deserializeJson(doc, payload, length))
+    {
+      Serial.println("[MQTT] RecoverLog: Invalid JSON payload");
+      setSystemStatus("ERROR", "RecoverLog: Invalid JSON payload");
+      return;
+    }
+    const char *idDevice = doc["IdDevice"] | "";
+    if (strcmp(idDevice, TopicMqtt) != 0)
+    {
+      DEBUG_PRINTF("[MQTT] RecoverLog: IdDevice mismatch (received=%s), ignoring...\n", idDevice);
+      return;
+    }
+
+    LogRecoveryRange range;
+    range.first = doc["BeginLog"] | 0;
+    range.count = doc["Numslog"] | 0;
+    if (doc["Cancel"] | false)
+    {
+      range.first = 0;
+      range.count = 0; // count 0 = cancel (see serviceLogRecovery)
+    }
+    else if (!LogRecoveryEngine::validPos(range.first) || range.count == 0 || range.count > MAX_LOGS)
+    {
+      Serial.printf("[MQTT] RecoverLog: Invalid range BeginLog=%u Numslog=%u (1-%d)\n", range.first, range.count, MAX_LOGS);
+      setSystemStatus("ERROR", "RecoverLog: Invalid range");
+      return;
+    }
+
+    if (xQueueSend(logRecoveryQueue, &range, 0) != pdTRUE)
+    {
+      Serial.println("[MQTT] RecoverLog: Recovery queue full");
+      setSystemStatus("ERROR", "RecoverLog: Queue full");
+      return;
+    }
+    if (rs485TaskHandle != NULL)
+    {
+      xTaskNotifyGive(rs485TaskHandle);
+    }
+    Serial.printf("[MQTT] RecoverLog: %s\n", range.count ? "range queued" : "cancel requested");
+    return;
+  }
+
+  // Handle RequestLogByDate: archived logs of a date range, optionally one nozzle (Voi),
+  // streamed on {Mst}/ResponseLogByDate. A new request replaces a running one.
+  // {"Mst": "...", "IdDevice": "...", "FromDate": "01/10/2026", "ToDate": "17/10/2026", "Voi": 2}
+  if (strcmp(topic, topicRequestLogByDate) == 0)
+  {
+    DynamicJsonDocument doc(512);
+    if (deserializeJson(doc, payload, length))
+    {
+      Serial.println("[MQTT] RequestLogByDate: Invalid JSON payload");
+      setSystemStatus("ERROR", "RequestLogByDate: Invalid JSON payload");
+      return;
+    }
+    const char *mst = doc["Mst"] | "";
+    const char *idDevice = doc["IdDevice"] | "";
+    if (strcmp(mst, companyInfo.Mst) != 0 || strcmp(idDevice, TopicMqtt) != 0)
+    {
+      DEBUG_PRINTF("[MQTT] RequestLogByDate: MST/IdDevice mismatch (%s, %s), ignoring...\n", mst, idDevice);
+      return;
+    }
+    const char *fromDate = doc["FromDate"] | "";
+    const char *toDate = doc["ToDate"] | fromDate;
+    int voi = doc["Voi"] | 0;
+    uint16_t fromDay, toDay;
+    bool voiValid = voi == 0 || (voi >= 11 && voi <= 20); // 0 = all nozzles, else DeviceID 11-20
+    if (!parseLogDate(fromDate, fromDay) || !parseLogDate(toDate, toDay) || toDay < fromDay || !voiValid)
+    {
+      Serial.printf("[MQTT] RequestLogByDate: Invalid range %s..%s Voi=%d\n", fromDate, toDate, voi);
+      setSystemStatus("ERROR", "RequestLogByDate: Invalid date range or Voi");
+      return;
+    }
+    logDateQuery.active = true;
+    logDateQuery.fromDay = fromDay;
+    logDateQuery.toDay = toDay;
+    logDateQuery.voi = (uint8_t)voi;
+    logDateQuery.nextId = 0;
+    logDateQuery.page = 0;
+    logDateQuery.sent = 0;
+    logDateQuery.failures = 0;
+    Serial.printf("[MQTT] RequestLogByDate: %s..%s, Voi=%d queued\n", fromDate, toDate, voi);
+    return;
+  }
+
+  // Handle RequestLog command - Request specific logs from Flash
+  if (strcmp(topic, topicRequestLog) == 0)
+  {
+    DEBUG_PRINTLN("[MQTT] RequestLog command received - parsing payload...");
+
+    // Parse JSON payload: {"Mst": "...", "IdDevice": "...", "BeginLog": 1, "Numslog": 10, "Archive": false}
+    // BeginLog past MAX_LOGS is an archive ID without "Archive": true as well
+    DynamicJsonDocument doc(512);
+    DeserializationError error = deserializeJson(doc, payload, length);
+
+    if (error)
+    {
+      Serial.printf("[MQTT] RequestLog: JSON parse error: %s\n", error.c_str());
+      setSystemStatus("ERROR", "RequestLog: Invalid JSON payload");
+      return;
+    }
+
+    // Extract required fields
+    const char *mst = doc["Mst"] | "";
+    const char *idDevice = doc["IdDevice"] | "";
+    uint32_t beginLog = doc["BeginLog"] | 0;
+    uint16_t numsLog = doc["Numslog"] | 0;
+    bool fromArchive = doc["Archive"] | false; // BeginLog is a global archive ID (LogArchive.h)
+
+    // ✅ FIX: Validate không null trước khi dùng strcmp
+    if (!mst) mst = "";
+    if (!idDevice) idDevice = "";
+
+    // Validate MST and IdDevice
+    if (strlen(mst) == 0 || strcmp(mst, companyInfo.Mst) != 0)
+    {
+      DEBUG_PRINTF("[MQTT] RequestLog: MST mismatch (received=%s, expected=%s), ignoring...\n", mst, companyInfo.Mst);
+      return;
+    }
+
+    if (strlen(idDevice) == 0 || strcmp(idDevice, TopicMqtt) != 0)
+    {
+      DEBUG_PRINTF("[MQTT] RequestLog: IdDevice mismatch (received=%s, expected=%s), ignoring...\n", idDevice, TopicMqtt);
+      return;
+    }
+
+    // Validate BeginLog and Numslog
+    if (beginLog < 1)
+    {
+      DEBUG_PRINTF("[MQTT] RequestLog: Invalid BeginLog=%lu (must be >= 1)\n", (unsigned long)beginLog);
+      setSystemStatus("ERROR", "RequestLog: Invalid BeginLog");
+      return;
+    }
+
+    if (numsLog < 1 || numsLog > 200)
+    {
+      DEBUG_PRINTF("[MQTT] RequestLog: Invalid Numslog=%d (must be 1-200)\n", numsLog);
+      setSystemStatus("ERROR", "RequestLog: Invalid Numslog");
+      return;
+    }
+    if (beginLog > MAX_LOGS)
+      fromArchive = true; // Older than the ring: the archive (hot and cold tiers) has it
+
+    DEBUG_PRINTF("[MQTT] RequestLog: MST=%s, IdDevice=%s, BeginLog=%lu%s, Numslog=%d\n",
+                 mst, idDevice, (unsigned long)beginLog, fromArchive ? " (archive)" : "", numsLog);
+
+    // Build response topic: {Mst}/ResponseLog
+    char responseTopic[64];
+    snprintf(responseTopic, sizeof(responseTopic), "%s/ResponseLog", companyInfo.Mst);
+
+    // Calculate range: journal slots wrap after MAX_LOGS (the ring), archive IDs don't
+    uint32_t endLog = fromArchive ? beginLog + numsLog - 1 : (beginLog + numsLog - 2) % MAX_LOGS + 1;
+
+    DEBUG_PRINTF("[MQTT] Reading logs from %lu to %lu...\n", (unsigned long)beginLog, (unsigned long)endLog);
+
+    // One storage request for the whole range, into the reusable buffer
+    if (logRangeLogs == NULL)
+    {
+      logRangeLogs = (PumpLog *)malloc(LOG_RANGE_MAX * sizeof(PumpLog));
+      logRangeHave = (bool *)malloc(LOG_RANGE_MAX * sizeof(bool));
+      if (logRangeLogs == NULL || logRangeHave == NULL)
+      {
+        free(logRangeLogs);
+        free(logRangeHave);
+        logRangeLogs = NULL;
+        logRangeHave = NULL;
+        LOG_ERROR_F("[MQTT] RequestLog: no memory for %d logs\n", LOG_RANGE_MAX);
+        setSystemStatus("ERROR", "RequestLog: Out of memory");
+        return;
+      }
+    }
+    memset(logRangeHave, 0, numsLog * sizeof(bool)); // Nothing left over from the previous request
+    LogRangeRead range = {beginLog, numsLog, fromArchive, logRangeLogs, logRangeHave, 0};
+    StorageRequest read = {STORAGE_READ_RANGE, STORAGE_NO_WAITER, 0, 0, 0, &range, NULL};
+    if (!storageCall(read))
+    {
+      // Storage busy (queue full / no waiter slot) or no log in the range: publish nothing
+      DEBUG_PRINTF("[MQTT] RequestLog: no logs read for %lu..%lu\n", (unsigned long)beginLog, (unsigned long)endLog);
+      setSystemStatus("WARNING", "No logs found");
+      return;
+    }
 
     // Create response JSON with compressed format (short keys + array values)
     DynamicJsonDocument responseDoc(32768); // 32KB buffer for up to 200 logs
@@ -2303,89 +3339,27 @@ void mqttCallback(char *topic, byte *payload, unsigned int length)
     responseDoc["I"] = TopicMqtt;           // IdDevice
     responseDoc["B"] = beginLog;            // BeginLog
     responseDoc["N"] = numsLog;             // Numslog
+    if (fromArchive)
+      responseDoc["A"] = 1; // IDs are archive IDs
 
     JsonArray logsArray = responseDoc.createNestedArray("L"); // Logs array
 
     int found = 0;
     int notFound = 0;
 
-    // Read logs from Flash and add to array
-    for (uint16_t logId = beginLog; logId <= endLog; logId++)
+    // Build the response from RAM (no flash access past this point)
+    for (uint16_t i = 0; i < numsLog; i++)
     {
-      // Feed WDT every 20 logs to prevent timeout (20 logs × ~150ms = 3s per batch)
-      if ((logId - beginLog) % 20 == 0)
+      uint32_t logId = fromArchive ? beginLog + i : (beginLog - 1 + i) % MAX_LOGS + 1;
+      if (range.have[i])
       {
-        esp_task_wdt_reset();
-        yield(); // Allow other tasks to run
-      }
-
-      // Read log from Flash
-      if (xSemaphoreTake(flashMutex, pdMS_TO_TICKS(100)) == pdTRUE)
-      {
-        File dataFile = LittleFS.open(FLASH_DATA_FILE, "r");
-        if (dataFile)
-        {
-          PumpLog log;
-          uint32_t offset = (logId - 1) * sizeof(PumpLog);
-          dataFile.seek(offset, SeekSet);
-          size_t bytesRead = dataFile.read((uint8_t *)&log, sizeof(PumpLog));
-          dataFile.close();
-
-          if (bytesRead == sizeof(PumpLog) && log.viTriLogData == logId)
-          {
-            // Add this log as compact array format: [id,voi,cot,data,bomb,lit,gia,total,tien,d,m,y,h,min,s,sent,time]
-            JsonArray logArray = logsArray.createNestedArray();
-            logArray.add(logId);            // 0: logId
-            logArray.add(log.idVoi);        // 1: idVoi
-            logArray.add(log.viTriLogCot);  // 2: viTriLogCot
-            logArray.add(log.viTriLogData); // 3: viTriLogData
-            logArray.add(log.maLanBom);     // 4: maLanBom
-            logArray.add(log.soLitBom);     // 5: soLitBom
-            logArray.add(log.donGia);       // 6: donGia
-            logArray.add(log.soTotalTong);  // 7: soTotalTong
-            logArray.add(log.soTienBom);    // 8: soTienBom
-            logArray.add(log.ngay);         // 9: ngay
-            logArray.add(log.thang);        // 10: thang
-            logArray.add(log.nam);          // 11: nam
-            logArray.add(log.gio);          // 12: gio
-            logArray.add(log.phut);         // 13: phut
-            logArray.add(log.giay);         // 14: giay
-            logArray.add(log.mqttSent);     // 15: mqttSent
-
-            // Format timestamp
-            if (log.mqttSentTime > 0)
-            {
-              struct tm *timeinfo = localtime(&log.mqttSentTime);
-              char formattedTime[32];
-              snprintf(formattedTime, sizeof(formattedTime), "%02d/%02d/%04d-%02d:%02d:%02d",
-                       timeinfo->tm_mday, timeinfo->tm_mon + 1, timeinfo->tm_year + 1900,
-                       timeinfo->tm_hour, timeinfo->tm_min, timeinfo->tm_sec);
-              logArray.add(formattedTime); // 16: mqttSentTime
-            }
-            else
-            {
-              logArray.add("N/A"); // 16: mqttSentTime
-            }
-
-            found++;
-            DEBUG_PRINTF("[MQTT] ✓ Added log %d to response array\n", logId);
-          }
-          else
-          {
-            DEBUG_PRINTF("[MQTT] Log %d not found or invalid in Flash\n", logId);
-            notFound++;
-          }
-        }
-        else
-        {
-          DEBUG_PRINTLN("[MQTT] ✗ Failed to open Flash file for log read");
-          notFound++;
-        }
-        xSemaphoreGive(flashMutex);
+        addCompactLog(logsArray, logId, range.logs[i]);
+        found++;
+        DEBUG_PRINTF("[MQTT] ✓ Added log %lu to response array\n", (unsigned long)logId);
       }
       else
       {
-        DEBUG_PRINTF("[MQTT] ⚠️ Flash mutex timeout for log %d\n", logId);
+        DEBUG_PRINTF("[MQTT] Log %lu not found or invalid in Flash\n", (unsigned long)logId);
         notFound++;
       }
     }
@@ -2398,8 +3372,8 @@ void mqttCallback(char *topic, byte *payload, unsigned int length)
     String jsonString;
     serializeJson(responseDoc, jsonString);
 
-    DEBUG_PRINTF("[MQTT] RequestLog Summary: Found=%d, NotFound=%d, Total=%d (from %d to %d)\n",
-                 found, notFound, numsLog, beginLog, endLog);
+    DEBUG_PRINTF("[MQTT] RequestLog Summary: Found=%d, NotFound=%d, Total=%d (from %lu to %lu)\n",
+                 found, notFound, numsLog, (unsigned long)beginLog, (unsigned long)endLog);
     DEBUG_PRINTF("[MQTT] Response JSON size: %d bytes\n", jsonString.length());
 
     if (found > 0)
@@ -2427,145 +3401,937 @@ void mqttCallback(char *topic, byte *payload, unsigned int length)
   Serial.println("=== MQTT CALLBACK FINISHED ===\n");
 }
 
-// Safe batch processing with open/close per batch to avoid flash conflicts
-void processLogBatch(int batchSize)
+// ============================================================================
+// LOG JOURNAL - pump logs as LOG records, MQTT delivery updates as STATUS records
+// ============================================================================
+// All helpers run on storageTask (init: in setup, before the task starts).
+
+// LOG payload: PumpLogRecord format 1 (40 bytes packed LE); older firmware wrote the raw struct (format 0)
+static_assert(sizeof(PumpLog) <= LOG_JOURNAL_MAX_PAYLOAD, "Legacy PumpLog records must fit a journal record");
+static_assert(MAX_LOGS == LOG_JOURNAL_SLOTS, "Journal slots must match the TTL log ring");
+
+#define JOURNAL_STATUS_LEN 5 // [mqttSent][mqttSentTime u32 LE]
+
+// Log ID of ring position `pos` after `headId`; 0 if it is not ahead (less than half a
+// ring, like LogArchive::idFor): re-read / recovered old positions do not move the head
+static uint32_t logIdAfter(uint32_t headId, uint16_t pos)
+{
+  if (headId == 0)
+    return pos;
+  uint16_t ahead = (uint16_t)((pos + MAX_LOGS - LogArchiveCodec::posOf(headId)) % MAX_LOGS);
+  return ahead >= MAX_LOGS / 2 ? 0 : headId + ahead;
+}
+
+// Journal slot still holding archive ID `id`; 0 once the ring has moved past it
+static uint16_t journalSlotOfId(uint32_t id)
 {
-  if (batchSize <= 0)
-    return;
+  uint32_t head = logStore.headId;
+  return id <= head && head - id < MAX_LOGS ? LogArchiveCodec::posOf(id) : 0;
+}
 
-  // Take mutex for entire batch operation (very short timeout to yield quickly for price operations)
-  if (xSemaphoreTake(flashMutex, pdMS_TO_TICKS(20)) != pdTRUE)
+static void noteLogHead(uint16_t pos, uint32_t seq)
+{
+  uint32_t id = logIdAfter(logStore.headId, pos);
+  if (id != 0)
   {
-    DEBUG_PRINTLN("⚠️ Flash mutex timeout for batch - yielding for priority operations");
-    return;
+    logStore.headId = id;
+    logStore.headSeq = seq;
+    currentId = id;
   }
+}
+
+// newLog = false: a stored log rewritten in slot order (legacy import, format
+// migration), which says nothing about where the ring head is
+static bool journalSaveLog(const PumpLog &log, bool newLog = true)
+{
+  uint8_t rec[PumpLogRecord::kLength];
+  PumpLogRecord::encode(rec, log);
+  if (!logJournal.append(JOURNAL_REC_LOG, log.viTriLogData, rec, sizeof(rec), PumpLogRecord::kFormat))
+    return false;
+  logStore.pending.set(log.viTriLogData, !log.mqttSent);
+  if (newLog)
+    noteLogHead(log.viTriLogData, logJournal.sequence() - 1);
+  return true;
+}
+
+// MQTT delivery result for the log already stored at `pos` (~20 bytes on flash instead of a full record)
+static bool journalMarkSent(uint16_t pos, uint8_t sent, uint32_t when)
+{
+  uint8_t status[JOURNAL_STATUS_LEN] = {sent, (uint8_t)when, (uint8_t)(when >> 8), (uint8_t)(when >> 16),
+                                        (uint8_t)(when >> 24)};
+  if (!logJournal.append(JOURNAL_REC_STATUS, pos, status, sizeof(status)))
+    return false;
+  logStore.pending.set(pos, !sent);
+  return true;
+}
 
-  // Open file for this batch only - close immediately after
-  fs::File dataFile = LittleFS.open(FLASH_DATA_FILE, "r+");
-  if (!dataFile)
+// Newest log at `pos` with its newest delivery status applied
+static bool journalReadLog(uint16_t pos, PumpLog &log)
+{
+  uint8_t rec[LOG_JOURNAL_MAX_PAYLOAD];
+  uint8_t len = 0;
+  uint8_t format = 0;
+  if (!logJournal.read(JOURNAL_REC_LOG, pos, rec, sizeof(rec), len, format) ||
+      !PumpLogRecord::decode(rec, len, format, log) || log.viTriLogData != pos)
+  {
+    return false;
+  }
+  uint8_t status[JOURNAL_STATUS_LEN];
+  if (logJournal.read(JOURNAL_REC_STATUS, pos, status, sizeof(status), len) && len == JOURNAL_STATUS_LEN)
   {
-    dataFile = LittleFS.open(FLASH_DATA_FILE, "w");
+    log.mqttSent = status[0];
+    log.mqttSentTime = (time_t)((uint32_t)status[1] | ((uint32_t)status[2] << 8) | ((uint32_t)status[3] << 16) |
+                                ((uint32_t)status[4] << 24));
   }
+  return true;
+}
 
-  if (!dataFile)
+// `count` consecutive logs in one pass (storageTask): journal slots wrap after MAX_LOGS,
+// LOG records first, then their STATUS records, then the write-behind cache on top.
+// Archive IDs go through logArchive.get, which keeps the last block decoded.
+static uint16_t journalReadRange(LogRangeRead &range)
+{
+  memset(range.have, 0, range.count * sizeof(bool));
+  range.found = 0;
+  if (range.archive)
   {
-    Serial.println("ERROR: Failed to open Flash file for batch processing");
-    xSemaphoreGive(flashMutex);
-    return;
+    for (uint16_t i = 0; i < range.count; i++)
+    {
+      if (logArchive.get(range.first + i, range.logs[i]))
+      {
+        range.have[i] = true;
+        range.found++;
+      }
+    }
+    return range.found;
+  }
+
+  uint16_t first = (uint16_t)range.first;
+  logJournal.forEachInRange(JOURNAL_REC_LOG, first, range.count,
+                            [&range, first](uint16_t slot, const uint8_t *rec, uint8_t len, uint8_t format) {
+                              uint16_t i = (uint16_t)((slot + MAX_LOGS - first) % MAX_LOGS);
+                              PumpLog &log = range.logs[i];
+                              if (PumpLogRecord::decode(rec, len, format, log) && log.viTriLogData == slot)
+                              {
+                                range.have[i] = true;
+                                range.found++;
+                              }
+                            });
+  logJournal.forEachInRange(JOURNAL_REC_STATUS, first, range.count,
+                            [&range, first](uint16_t slot, const uint8_t *status, uint8_t len, uint8_t) {
+                              uint16_t i = (uint16_t)((slot + MAX_LOGS - first) % MAX_LOGS);
+                              if (!range.have[i] || len != JOURNAL_STATUS_LEN)
+                                return;
+                              range.logs[i].mqttSent = status[0];
+                              range.logs[i].mqttSentTime =
+                                  (time_t)((uint32_t)status[1] | ((uint32_t)status[2] << 8) |
+                                           ((uint32_t)status[3] << 16) | ((uint32_t)status[4] << 24));
+                            });
+  for (uint8_t c = 0; c < logCache.count; c++) // Oldest first: the newest copy wins
+  {
+    uint16_t i = (uint16_t)((logCache.logs[c].viTriLogData + MAX_LOGS - first) % MAX_LOGS);
+    if (i >= range.count)
+      continue;
+    range.found += range.have[i] ? 0 : 1;
+    range.have[i] = true;
+    range.logs[i] = logCache.logs[c];
+  }
+  return range.found;
+}
+
+// ============================================================================
+// DELIVERY BITMAP - which stored logs never reached the broker
+// ============================================================================
+
+static void notePendingLog(uint16_t pos, bool pending)
+{
+  portENTER_CRITICAL(&pendingLogsMux);
+  pendingLogs.set(pos, pending);
+  portEXIT_CRITICAL(&pendingLogsMux);
+}
+
+uint16_t pendingLogCount()
+{
+  portENTER_CRITICAL(&pendingLogsMux);
+  uint16_t n = pendingLogs.count();
+  portEXIT_CRITICAL(&pendingLogsMux);
+  return n;
+}
+
+// Up to `max` undelivered slots from `from` on (wrapping), without touching flash
+uint16_t nextPendingLogs(uint16_t from, uint16_t *out, uint16_t max)
+{
+  portENTER_CRITICAL(&pendingLogsMux);
+  uint16_t n = pendingLogs.next(from, out, max);
+  portEXIT_CRITICAL(&pendingLogsMux);
+  return n;
+}
+
+// One pass over the live journal records (at init): mqttSent of each
+// LOG, overridden by its newest STATUS. Also collects LOGs in an old format.
+static void rebuildPendingLogs(SlotBitmap<MAX_LOGS> &oldFormat)
+{
+  unsigned long start = millis();
+  SlotBitmap<MAX_LOGS> map;
+  logJournal.forEachLive(JOURNAL_REC_LOG,
+                         [&map, &oldFormat](uint16_t pos, const uint8_t *payload, uint8_t len, uint8_t format) {
+                           PumpLog log;
+                           if (PumpLogRecord::decode(payload, len, format, log))
+                             map.set(pos, !log.mqttSent);
+                           oldFormat.set(pos, format != PumpLogRecord::kFormat);
+                         });
+  logJournal.forEachLive(JOURNAL_REC_STATUS, [&map](uint16_t pos, const uint8_t *payload, uint8_t len, uint8_t) {
+    if (len == JOURNAL_STATUS_LEN)
+      map.set(pos, !payload[0]);
+  });
+  logStore.pending = map;
+  portENTER_CRITICAL(&pendingLogsMux);
+  pendingLogs = map;
+  portEXIT_CRITICAL(&pendingLogsMux);
+  Serial.printf("[JOURNAL] %u logs pending MQTT delivery (scan %lums)\n", map.count(), millis() - start);
+}
+
+// Boot from the checkpoint: its head + pending bitmap, then the journal records
+// appended after its mark. False (full pass instead) if there is none or it does
+// not describe this journal (older seq / segment than the journal's, head record
+// rewritten before the mark).
+static bool restoreLogCheckpoint(SlotBitmap<MAX_LOGS> &oldFormat)
+{
+  unsigned long start = millis();
+  if (!logCheckpointPartition.begin() || !logCheckpoint.begin())
+    return false;
+  const LogCheckpointState &cp = logCheckpoint.state();
+  LogJournalMark now = logJournal.mark();
+  uint32_t headSeq = 0;
+  bool headOk = cp.headSlot == 0 || (logJournal.recordSeq(JOURNAL_REC_LOG, cp.headSlot, headSeq) &&
+                                     (headSeq == cp.headSeq || headSeq >= cp.mark.seq));
+  if (cp.mark.seq > now.seq || cp.mark.segSeq > now.segSeq || !headOk)
+  {
+    Serial.printf("[JOURNAL] Checkpoint gen %lu does not match the journal, full scan\n",
+                  (unsigned long)logCheckpoint.generation());
+    return false;
   }
 
-  int processed = 0;
-  DEBUG_PRINT("💾 Processing batch of ");
-  DEBUG_PRINT(batchSize);
-  DEBUG_PRINTLN(" logs");
+  SlotBitmap<MAX_LOGS> map = cp.pending;
+  uint32_t baseId = cp.headSlot ? (uint32_t)cp.headCycle * MAX_LOGS + cp.headSlot : 0;
+  uint32_t headId = baseId, newHeadSeq = cp.headSeq;
+  // Records are visited segment by segment, not in seq order: the head is the position
+  // furthest ahead of the checkpoint's (fewer than half a ring logs per interval)
+  uint16_t n = logJournal.forEachSince(
+      JOURNAL_REC_LOG, cp.mark,
+      [&](uint16_t pos, uint32_t seq, const uint8_t *payload, uint8_t len, uint8_t format) {
+        PumpLog log;
+        if (PumpLogRecord::decode(payload, len, format, log))
+          map.set(pos, !log.mqttSent);
+        oldFormat.set(pos, format != PumpLogRecord::kFormat);
+        uint32_t id = logIdAfter(baseId, pos);
+        if (id != 0 && id >= headId)
+        {
+          headId = id;
+          newHeadSeq = seq;
+        }
+      });
+  n += logJournal.forEachSince(JOURNAL_REC_STATUS, cp.mark,
+                               [&map](uint16_t pos, uint32_t, const uint8_t *payload, uint8_t len, uint8_t) {
+                                 if (len == JOURNAL_STATUS_LEN)
+                                   map.set(pos, !payload[0]);
+                               });
+
+  logStore.headId = headId;
+  logStore.headSeq = newHeadSeq;
+  logStore.pending = map;
+  logStore.restored = true;
+  logStore.replayed = n;
+  republishCursor = cp.republishCursor >= 1 && cp.republishCursor <= MAX_LOGS ? cp.republishCursor : 1;
+  portENTER_CRITICAL(&pendingLogsMux);
+  pendingLogs = map;
+  portEXIT_CRITICAL(&pendingLogsMux);
+  Serial.printf("[JOURNAL] Checkpoint gen %lu: head %u (lap %u), %u records after it, %u logs pending (%lums)\n",
+                (unsigned long)logCheckpoint.generation(), LogArchiveCodec::posOf(headId ? headId : 1),
+                (unsigned)(headId ? (headId - 1) / MAX_LOGS : 0), n, map.count(), millis() - start);
+  return true;
+}
+
+// Save head + delivery state (storageTask, and once at the end of init). Skipped when
+// the journal has not changed since the last one or, unless forced, within
+// LOG_CHECKPOINT_INTERVAL_MS of it.
+static void writeLogCheckpoint(bool force)
+{
+  if (!logCheckpointPartition.available())
+    return;
+  LogJournalMark mark = logJournal.mark();
+  if (logCheckpoint.valid() && logCheckpoint.state().mark.seq == mark.seq)
+    return;
+  if (!force && millis() - logStore.checkpointAt < LOG_CHECKPOINT_INTERVAL_MS)
+    return;
+  logStore.checkpointAt = millis();
+  logJournal.sync(); // Everything before the mark is durable
+  LogCheckpointState cp;
+  cp.mark = mark;
+  cp.headSeq = logStore.headSeq;
+  cp.headSlot = logStore.headId ? LogArchiveCodec::posOf(logStore.headId) : 0;
+  cp.headCycle = logStore.headId ? (uint16_t)((logStore.headId - 1) / MAX_LOGS) : 0;
+  cp.republishCursor = republishCursor;
+  cp.pending = logStore.pending;
+  if (!logCheckpoint.write(cp))
+    Serial.println("[JOURNAL] ⚠️ Checkpoint write failed");
+}
 
-  // Process logs in this batch with same file handle
-  for (int i = 0; i < batchSize; i++)
+// Rewrite raw-struct LOGs (format 0) as packed records, delivery status folded in.
+// Per slot, so a reboot half-way simply continues; the old copies are compacted away.
+static void migrateLogRecords(const SlotBitmap<MAX_LOGS> &oldFormat)
+{
+  if (oldFormat.count() == 0)
+    return;
+  unsigned long start = millis();
+  uint32_t bytesBefore = logJournal.bytesUsed();
+  uint16_t migrated = 0;
+  uint16_t slots[64];
+  uint16_t from = 1;
+  while (from <= MAX_LOGS)
   {
-    PumpLog log;
-    if (xQueueReceive(saveLogQueue, &log, pdMS_TO_TICKS(1)) == pdTRUE)
+    uint16_t n = oldFormat.next(from, slots, 64);
+    uint16_t last = 0;
+    for (uint16_t i = 0; i < n && slots[i] >= from; i++) // Stop where next() wrapped
     {
-      uint32_t offset = (log.viTriLogData - 1) * sizeof(PumpLog);
-      dataFile.seek(offset, SeekSet);
-      size_t written = dataFile.write((const uint8_t *)&log, sizeof(PumpLog));
+      PumpLog log;
+      if (journalReadLog(slots[i], log) && journalSaveLog(log, false))
+        migrated++;
+      last = slots[i];
+    }
+    if (last == 0)
+      break;
+    from = last + 1;
+    logJournal.sync();
+    esp_task_wdt_reset();
+  }
+  logJournal.sync();
+  Serial.printf("[JOURNAL] Migrated %u/%u logs to record format %u (%u -> %u bytes each) in %lums, %lu -> %lu bytes used\n",
+                migrated, oldFormat.count(), PumpLogRecord::kFormat, (unsigned)sizeof(PumpLog),
+                (unsigned)PumpLogRecord::kLength, millis() - start, (unsigned long)bytesBefore,
+                (unsigned long)logJournal.bytesUsed());
+}
+
+// Feed the next few undelivered slots to rs485Task (readLogFromFlash publishes them
+// and clears their bit); only when the server-driven log-loss queue is idle
+void republishPendingLogs()
+{
+  static unsigned long lastRun = 0;
+  if (millis() - lastRun < REPUBLISH_INTERVAL_MS || uxQueueMessagesWaiting(logIdLossQueue) > 0)
+    return;
+  lastRun = millis();
+
+  uint16_t slots[REPUBLISH_BATCH];
+  uint16_t n = nextPendingLogs(republishCursor, slots, REPUBLISH_BATCH);
+  for (uint16_t i = 0; i < n; i++)
+  {
+    DtaLogLoss item;
+    item.Logid = slots[i];
+    if (xQueueSend(logIdLossQueue, &item, 0) != pdTRUE)
+      break;
+    republishCursor = slots[i] % MAX_LOGS + 1; // Failing slots do not block the rest
+  }
+  if (n > 0)
+  {
+    Serial.printf("[DELIVERY] Re-publishing %u of %u pending logs (from slot %u)\n", n, pendingLogCount(), slots[0]);
+  }
+}
 
-      if (written == sizeof(PumpLog))
+// Journal on the raw partition, first boot after LittleFS segment files: copy the
+// live LOG + STATUS records over (same slots, same formats), then delete the files.
+// The files stay until every record is copied, so a reboot half-way just redoes it;
+// slots the partition already holds win (copied before, or newer).
+static void migrateJournalFiles()
+{
+  LogJournal *files = new LogJournal(logJournalFiles);
+  uint16_t copied = 0;
+  bool ok = files->begin();
+  if (ok)
+  {
+    files->forEachLive(JOURNAL_REC_LOG, [&ok, &copied](uint16_t pos, const uint8_t *payload, uint8_t len, uint8_t format) {
+      if (!logJournal.hasLog(pos))
       {
-        processed++;
-        DEBUG_PRINTF("💾 Log %d saved\n", log.viTriLogData);
+        bool appended = logJournal.append(JOURNAL_REC_LOG, pos, payload, len, format);
+        copied += appended;
+        ok = appended && ok;
       }
-      else
+      if (pos % 128 == 0)
+        esp_task_wdt_reset();
+    });
+    files->forEachLive(JOURNAL_REC_STATUS, [&ok](uint16_t pos, const uint8_t *payload, uint8_t len, uint8_t format) {
+      if (!logJournal.hasStatus(pos))
+        ok = logJournal.append(JOURNAL_REC_STATUS, pos, payload, len, format) && ok;
+    });
+    logJournal.sync();
+  }
+  if (ok)
+  {
+    for (uint8_t s = 0; s < LOG_JOURNAL_FS_SEGMENTS; s++)
+      logJournalFiles.erase(s);
+  }
+  delete files;
+  Serial.printf("[JOURNAL] Moved %u logs from LittleFS files to the \"%s\" partition\n", copied, LOG_PARTITION_LABEL);
+}
+
+// Mount the journal; import a legacy /log.bin (fixed slots, raw PumpLog) once
+void initLogJournal()
+{
+  if (xSemaphoreTake(flashMutex, pdMS_TO_TICKS(5000)) != pdTRUE)
+  {
+    Serial.println("[JOURNAL] ERROR: Flash mutex timeout at init");
+    return;
+  }
+  unsigned long start = millis();
+  if (!logJournalPartition.begin() || !logArchivePartition.begin())
+  {
+    Serial.printf("[JOURNAL] ⚠️ No \"%s\" partition, logs stay on LittleFS files\n", LOG_PARTITION_LABEL);
+    logJournalMedium.useFallback();
+    logArchiveMedium.useFallback();
+  }
+  if (!logJournal.begin())
+  {
+    Serial.println("[JOURNAL] ERROR: Unusable medium geometry");
+  }
+  else if (!logJournalMedium.usingFallback() && logJournalFiles.hasSegments())
+  {
+    migrateJournalFiles();
+  }
+  else if (LittleFS.exists(FLASH_DATA_FILE))
+  {
+    // Slots already in the journal win (an import cut short by a reboot resumes here)
+    uint16_t imported = 0;
+    File legacy = LittleFS.open(FLASH_DATA_FILE, "r");
+    if (legacy)
+    {
+      PumpLog log;
+      for (uint16_t pos = 1; pos <= MAX_LOGS; pos++)
       {
-        Serial.printf("⚠️ Partial write for Log %d: %u/%u bytes\n",
-                      log.viTriLogData, written, sizeof(PumpLog));
+        if (legacy.read((uint8_t *)&log, sizeof(PumpLog)) != sizeof(PumpLog))
+          break;
+        if (log.viTriLogData == pos && !logJournal.hasLog(pos) && journalSaveLog(log, false))
+          imported++;
+        if (pos % 128 == 0)
+          esp_task_wdt_reset();
       }
+      legacy.close();
+    }
+    logJournal.sync();
+    LittleFS.remove(FLASH_DATA_FILE);
+    Serial.printf("[JOURNAL] Imported %u logs from %s\n", imported, FLASH_DATA_FILE);
+  }
+  SlotBitmap<MAX_LOGS> oldFormat;
+  if (!restoreLogCheckpoint(oldFormat))
+    rebuildPendingLogs(oldFormat);
+  migrateLogRecords(oldFormat);
+  catchUpLogArchive();
+  if (!logStore.restored && logArchive.lastId() != 0)
+  {
+    // Full pass: the archive's newest ID is the head (it numbers logs the same way)
+    uint16_t pos = LogArchiveCodec::posOf(logArchive.lastId());
+    logStore.headId = logArchive.lastId();
+    logJournal.recordSeq(JOURNAL_REC_LOG, pos, logStore.headSeq);
+  }
+  currentId = logStore.headId;
+  writeLogCheckpoint(true);
+  logStore.bootMs = millis() - start;
+  Serial.printf("[JOURNAL] %u logs, head ID %lu, %lu/%lu bytes used, %u free segments, ready in %lums\n",
+                logJournal.count(), (unsigned long)currentId, (unsigned long)logJournal.bytesUsed(),
+                (unsigned long)logJournal.capacity(), logJournal.freeSegments(), (unsigned long)logStore.bootMs);
+  xSemaphoreGive(flashMutex);
+}
+
+// STORAGE_CLEAR_LOGS (storageTask)
+bool clearLogJournal()
+{
+  bool cleared = logJournal.clear();
+  cleared = logArchive.clear() && cleared;
+  if (cleared)
+  {
+    Serial.println("All logs cleared successfully");
+  }
+  else
+  {
+    Serial.println("Error: Failed to clear logs");
+  }
+  currentId = 0;
+  logStore.headId = 0;
+  logStore.headSeq = 0;
+  logStore.pending.clearAll();
+  if (logCheckpointPartition.available())
+    logCheckpoint.clear(); // Describes the stores just erased
+  portENTER_CRITICAL(&pendingLogsMux);
+  pendingLogs.clearAll();
+  portEXIT_CRITICAL(&pendingLogsMux);
+  return cleared;
+}
+
+// ============================================================================
+// LOG ARCHIVE - compressed history beyond the journal's 2046 slots
+// ============================================================================
+
+// Empty archive (first boot with it): archive the journal's logs oldest first, i.e. the
+// ring starting after the newest log, so date queries cover what is already stored.
+// The head is only known from the checkpoint; otherwise the newest log is found by
+// its time stamp (a full pass knows no head, a legacy ring may have wrapped).
+static uint16_t seedLogArchive()
+{
+  uint16_t newest = logStore.restored && logStore.headId ? LogArchiveCodec::posOf(logStore.headId) : 0;
+  uint16_t reads = 0;
+  return logArchive.seedFromRing(
+      [&reads](uint16_t pos, PumpLog &log) {
+        if (++reads % 128 == 0)
+          esp_task_wdt_reset();
+        return journalReadLog(pos, log);
+      },
+      newest);
+}
+
+// Archive on the raw partition, first boot after /arNN.seg files: copy every log under
+// its ID, then delete the files. The files stay until the copy is flushed; the next boot
+// resumes after the newest ID on the partition. Returns the newest archive ID (0: none).
+static uint32_t migrateArchiveFiles()
+{
+  LogArchive<PumpLog> *files = new LogArchive<PumpLog>(logArchiveFiles);
+  uint32_t moved = 0;
+  if (files->begin())
+  {
+    uint32_t fromId = logArchive.lastId() + 1;
+    moved = files->forEachInDays(0, 0xFFFF, LogArchive<PumpLog>::kAnyNozzle, fromId, [](uint32_t id, const PumpLog &log) {
+      if (id % 128 == 0)
+        esp_task_wdt_reset();
+      return logArchive.appendWithId(id, log);
+    });
+  }
+  bool flushed = logArchive.flush();
+  delete files;
+  if (flushed)
+  {
+    for (uint8_t s = 0; s < LOG_ARCHIVE_SEGMENTS; s++)
+      logArchiveFiles.erase(s);
+  }
+  Serial.printf("[ARCHIVE] Moved %lu logs from LittleFS files to the \"%s\" partition\n", (unsigned long)moved,
+                LOG_PARTITION_LABEL);
+  return logArchive.lastId();
+}
+
+// Mount the archive and re-archive the journal slots after its newest ID that are not
+// older than it (the block that was still in RAM at reboot). At init.
+static void catchUpLogArchive()
+{
+  if (!logArchive.begin())
+  {
+    Serial.println("[ARCHIVE] ERROR: Unusable medium geometry");
+    return;
+  }
+  if (!logArchiveMedium.usingFallback())
+  {
+    if (logColdArchive.begin())
+    {
+      logArchive.setColdTier(&logColdArchive);
+      Serial.printf("[ARCHIVE] Cold tier: IDs %lu..%lu (%lu logs, %lu/%lu bytes on LittleFS)\n",
+                    (unsigned long)logColdArchive.firstId(), (unsigned long)logColdArchive.lastId(),
+                    (unsigned long)logColdArchive.count(), (unsigned long)logColdArchive.bytesUsed(),
+                    (unsigned long)logColdArchive.capacity());
     }
     else
     {
-      break; // No more logs in queue
+      Serial.println("[ARCHIVE] ⚠️ Cold tier unavailable, oldest segments are dropped");
+    }
+  }
+  uint32_t lastId = logArchive.lastId();
+  PumpLog prev;
+  uint16_t replayed = 0;
+  if (!logArchiveMedium.usingFallback() && logArchiveFiles.hasSegments())
+  {
+    lastId = migrateArchiveFiles();
+  }
+  if (lastId == 0)
+  {
+    replayed = seedLogArchive();
+  }
+  else if (logArchive.get(lastId, prev))
+  {
+    // Up to the checkpoint's head when there is one, else while the logs get newer
+    uint16_t pos = LogArchiveCodec::posOf(lastId);
+    for (uint16_t i = 1; i < MAX_LOGS / 2 && (logStore.headId == 0 || lastId + i <= logStore.headId); i++)
+    {
+      pos = pos >= MAX_LOGS ? 1 : pos + 1;
+      PumpLog log;
+      if (!journalReadLog(pos, log) || LogArchiveCodec::stampOf(log) < LogArchiveCodec::stampOf(prev) || !logArchive.append(log))
+        break;
+      prev = log;
+      replayed++;
     }
   }
+  Serial.printf("[ARCHIVE] IDs %lu..%lu (%lu logs, %lu/%lu bytes), %u replayed from the journal\n",
+                (unsigned long)logArchive.firstId(), (unsigned long)logArchive.lastId(),
+                (unsigned long)logArchive.count(), (unsigned long)logArchive.bytesUsed(),
+                (unsigned long)logArchive.capacity(), replayed);
+}
 
-  // CRITICAL: Close file immediately after batch to free flash for other operations
-  dataFile.close();
+// Write a partial block once logs stop coming (storageTask, cache empty)
+static void flushIdleLogArchive()
+{
+  if (logArchive.pending() == 0 || millis() - logArchiveLastAppend < LOG_ARCHIVE_IDLE_FLUSH_MS)
+    return;
+  if (!logArchive.flush())
+    Serial.println("[ARCHIVE] ⚠️ Block write failed");
+  logArchiveLastAppend = millis();
+}
 
-  // Release mutex immediately
-  xSemaphoreGive(flashMutex);
+// "dd/mm/yyyy" (or yy) → LogArchiveCodec::dayKey
+static bool parseLogDate(const char *text, uint16_t &day)
+{
+  unsigned d, m, y;
+  if (sscanf(text, "%u/%u/%u", &d, &m, &y) != 3 || d < 1 || d > 31 || m < 1 || m > 12)
+    return false;
+  day = LogArchiveCodec::dayKey(d, m, y % 100);
+  return true;
+}
+
+static void formatLogDate(uint16_t day, char (&out)[12])
+{
+  snprintf(out, sizeof(out), "%02u/%02u/%04u", (unsigned)(day & 0x1F), (unsigned)((day >> 5) & 0x0F),
+           (unsigned)(2000 + (day >> 9)));
+}
+
+// One RequestLogByDate page, read on storageTask (STORAGE_RUN)
+struct LogDatePage
+{
+  JsonArray logs;
+  uint16_t fromDay, toDay;
+  uint8_t voi;     // 0 = all nozzles
+  uint32_t nextId; // In: first ID wanted, out: resume point
+  uint16_t found;
+};
+
+static void readLogDatePage(void *data)
+{
+  LogDatePage &page = *(LogDatePage *)data;
+  logArchive.forEachInDays(page.fromDay, page.toDay, page.voi, page.nextId, [&page](uint32_t id, const PumpLog &log) {
+    addCompactLog(page.logs, id, log);
+    page.nextId = id + 1;
+    return ++page.found < LOG_DATE_QUERY_PAGE;
+  });
+}
+
+// Publish the next page of a RequestLogByDate query (mqttTask). Returns false when idle.
+static bool serviceLogDateQuery()
+{
+  if (!logDateQuery.active)
+    return false;
+
+  DynamicJsonDocument doc(8192); // LOG_DATE_QUERY_PAGE compact logs
+  char fromDate[12], toDate[12];
+  formatLogDate(logDateQuery.fromDay, fromDate);
+  formatLogDate(logDateQuery.toDay, toDate);
+  doc["M"] = companyInfo.Mst;
+  doc["I"] = TopicMqtt;
+  doc["From"] = fromDate;
+  doc["To"] = toDate;
+  doc["V"] = logDateQuery.voi;
+  doc["P"] = logDateQuery.page;
+  JsonArray logsArray = doc.createNestedArray("L");
+
+  LogDatePage page = {logsArray, logDateQuery.fromDay, logDateQuery.toDay, logDateQuery.voi, logDateQuery.nextId, 0};
+  StorageRequest read = {STORAGE_RUN, STORAGE_NO_WAITER, 0, 0, 0, &page, readLogDatePage};
+  if (!storageCall(read))
+  {
+    // Storage busy (queue full / no waiter slot): the page was not read, same page next loop
+    DEBUG_PRINTF("[ARCHIVE] Date query page %u: storage busy, retrying\n", logDateQuery.page);
+    return true;
+  }
+  uint32_t nextId = page.nextId;
+  uint16_t found = page.found;
+
+  bool done = found < LOG_DATE_QUERY_PAGE;
+  doc["F"] = logDateQuery.sent + found; // Logs sent so far
+  doc["D"] = done ? 1 : 0;              // Last page
+
+  char responseTopic[64];
+  snprintf(responseTopic, sizeof(responseTopic), "%s/ResponseLogByDate", companyInfo.Mst);
+  String json;
+  serializeJson(doc, json);
+  if (!mqttClient.publish(responseTopic, json.c_str()))
+  {
+    if (++logDateQuery.failures >= 3)
+    {
+      Serial.printf("[ARCHIVE] Date query aborted: publish failed at page %u\n", logDateQuery.page);
+      setSystemStatus("ERROR", "RequestLogByDate: publish failed");
+      logDateQuery.active = false;
+    }
+    return true; // Same page again next loop
+  }
+  logDateQuery.failures = 0;
+  logDateQuery.nextId = nextId;
+  logDateQuery.page++;
+  logDateQuery.sent += found;
+  if (done)
+  {
+    Serial.printf("[ARCHIVE] Date query %s..%s Voi=%u: %lu logs in %u pages\n", fromDate, toDate, logDateQuery.voi,
+                  (unsigned long)logDateQuery.sent, logDateQuery.page);
+    logDateQuery.active = false;
+  }
+  return true;
+}
+
+// Group commit (storageTask): append the cached logs and sync once.
+// Returns false if the journal refused any of them.
+bool commitLogBatch(const PumpLog *logs, uint8_t count, unsigned long firstAt)
+{
+  if (count == 0)
+    return true;
 
-  if (processed > 0)
+  unsigned long start = millis();
+  uint8_t saved = 0;
+  for (uint8_t i = 0; i < count; i++)
   {
-    DEBUG_PRINT("✅ Batch completed: ");
-    DEBUG_PRINT(processed);
-    DEBUG_PRINTLN(" logs saved");
+    if (journalSaveLog(logs[i]))
+    {
+      notePendingLog(logs[i].viTriLogData, !logs[i].mqttSent);
+      logArchive.append(logs[i]); // Late / duplicate positions are skipped (stats.skipped)
+      saved++;
+    }
+    else
+    {
+      Serial.printf("⚠️ Journal write failed for Log %d\n", logs[i].viTriLogData);
+    }
   }
+  logJournal.sync();
+  logArchiveLastAppend = millis();
+
+  uint32_t flushMs = millis() - start;
+  uint32_t ageMs = millis() - firstAt;
+  logCommitStats.commits++;
+  logCommitStats.logs += saved;
+  logCommitStats.failed += count - saved;
+  logCommitStats.flushMsSum += flushMs;
+  if (count > logCommitStats.maxBatch)
+    logCommitStats.maxBatch = count;
+  if (flushMs > logCommitStats.flushMsMax)
+    logCommitStats.flushMsMax = flushMs;
+  if (ageMs > logCommitStats.ageMsMax)
+    logCommitStats.ageMsMax = ageMs;
+
+  DEBUG_PRINTF("💾 Committed %u/%u logs in %lums (oldest waited %lums)\n", saved, count, (unsigned long)flushMs,
+               (unsigned long)ageMs);
+  return saved == count;
 }
 
-// Fallback function for single operations (maintains compatibility)
-void saveLogToFlash(const PumpLog &logData)
+// ============================================================================
+// NOZZLE PRICE TABLE - RAM copy is authoritative, journal / price file behind it
+// ============================================================================
+
+static void priceEntryFromTable(const NozzlePrices &table, uint8_t i, PriceJournalEntry &e)
 {
-  // For single operations, use batch processing with size 1
-  processLogBatch(1);
+  e.nozzle = PRICE_JOURNAL_FIRST_NOZZLE + i;
+  e.price = table.nozzles[i].price;
+  e.time = (uint32_t)table.nozzles[i].updatedAt;
+  memcpy(e.idDevice, table.nozzles[i].idDevice, sizeof(e.idDevice));
+  e.idDevice[sizeof(e.idDevice) - 1] = '\0';
 }
 
-// Save price change with aggressive retry and longer timeout
-void savePriceChangeWithRetry(uint8_t deviceId, const char *idDevice, float unitPrice, const char *idChiNhanh, NozzlePrices &prices, SemaphoreHandle_t flashMutex)
+// Boot (before storageTask starts): price journal first; on its first boot the price
+// file is imported into it (and kept, it is the fallback without the partition).
+static void initNozzlePrices()
 {
-  Serial.printf("[PRICE SAVE] Starting save for DeviceID=%d, IdDevice=%s, Price=%.2f\n",
-                deviceId, idDevice, unitPrice);
+  Serial.println("Loading nozzle prices...");
+  bool fileLoaded = false;
+  priceJournalReady = priceJournalPartition.begin() && priceJournal.begin();
+  if (priceJournalReady && priceJournal.hasState())
+  {
+    memset(&nozzlePrices, 0, sizeof(nozzlePrices));
+    for (uint8_t i = 0; i < PRICE_JOURNAL_NOZZLES; i++)
+    {
+      NozzlePrice &n = nozzlePrices.nozzles[i];
+      snprintf(n.nozzorle, sizeof(n.nozzorle), "%d", PRICE_JOURNAL_FIRST_NOZZLE + i);
+      PriceJournalEntry e;
+      if (!priceJournal.get(PRICE_JOURNAL_FIRST_NOZZLE + i, e))
+        continue;
+      memcpy(n.idDevice, e.idDevice, sizeof(n.idDevice));
+      n.price = e.price;
+      n.updatedAt = e.time;
+    }
+    nozzlePrices.checksum = calculateNozzlePricesChecksum(nozzlePrices);
+    Serial.printf("[PRICE] ✓ Prices replayed from the price journal (%lu/%lu bytes used)\n",
+                  (unsigned long)priceJournal.bytesUsed(), (unsigned long)priceJournal.capacity());
+    printNozzlePrices(nozzlePrices);
+    return;
+  }
+
+  fileLoaded = loadNozzlePrices(nozzlePrices, flashMutex); // Defaults (0.0) if there is none
+  if (fileLoaded)
+    printNozzlePrices(nozzlePrices);
+  else
+    Serial.println("No saved prices found, initializing with defaults (0.0)");
 
-  // Convert deviceId to nozzorle string
+  if (!priceJournalReady)
+  {
+    Serial.printf("[PRICE] ⚠️ No \"%s\" partition for the price journal, using the price file\n", PRICE_JOURNAL_LABEL);
+    if (!fileLoaded)
+      saveNozzlePrices(nozzlePrices, flashMutex);
+    return;
+  }
+  // First boot with the journal: the current table becomes its first snapshot
+  PriceJournalEntry entries[PRICE_JOURNAL_NOZZLES];
+  for (uint8_t i = 0; i < PRICE_JOURNAL_NOZZLES; i++)
+    priceEntryFromTable(nozzlePrices, i, entries[i]);
+  if (priceJournal.importTable(entries, PRICE_JOURNAL_NOZZLES))
+    Serial.printf("[PRICE] ✓ Price %s imported into the price journal\n", fileLoaded ? "file" : "defaults");
+  else
+    Serial.println("[PRICE] ✗ Price journal import failed (retried with the next change)");
+}
+
+// Copy of the whole table (any task)
+static void readNozzlePrices(NozzlePrices &out)
+{
+  portENTER_CRITICAL(&nozzlePricesMux);
+  out = nozzlePrices;
+  portEXIT_CRITICAL(&nozzlePricesMux);
+}
+
+// Set one nozzle (11-20) in the RAM table and queue the change for the journal
+static bool setNozzlePrice(uint8_t deviceId, const char *idDevice, float unitPrice)
+{
+  if (deviceId < 11 || deviceId > 20)
+  {
+    Serial.printf("[PRICE] ✗ Invalid nozzle ID: %d (must be 11-20)\n", deviceId);
+    return false;
+  }
+  // Fill the entry on a copy (time(), millis()), publish it under the lock
+  NozzlePrices table;
+  readNozzlePrices(table);
   char nozzorleStr[4];
   snprintf(nozzorleStr, sizeof(nozzorleStr), "%d", deviceId);
+  applyNozzlePrice(nozzorleStr, idDevice, unitPrice, table);
+  uint8_t i = deviceId - 11;
+  PriceJournalEntry change;
+  priceEntryFromTable(table, i, change);
+  unsigned long now = millis();
+  portENTER_CRITICAL(&nozzlePricesMux);
+  nozzlePrices.nozzles[i] = table.nozzles[i];
+  nozzlePrices.lastUpdate = table.lastUpdate;
+  nozzlePrices.checksum = calculateNozzlePricesChecksum(nozzlePrices);
+  if (priceStore.pendingCount < PRICE_PENDING_MAX)
+    priceStore.pending[priceStore.pendingCount++] = change;
+  else
+    priceStore.pendingOverflow = true;
+  if (priceStore.version == priceStore.savedVersion)
+    priceStore.firstChangeAt = now;
+  priceStore.lastChangeAt = now;
+  priceStore.version++;
+  portEXIT_CRITICAL(&nozzlePricesMux);
+  storageNotify();
+  return true;
+}
 
-  // Retry up to 15 times with aggressive timeout
-  const int MAX_RETRIES = 15;
-  int retryCount = 0;
-  bool success = false;
+// Milliseconds until storageTask should persist the table; 0 = now, ULONG_MAX = nothing to write
+static unsigned long nozzlePricesSaveInMs()
+{
+  portENTER_CRITICAL(&nozzlePricesMux);
+  bool dirty = priceStore.version != priceStore.savedVersion;
+  unsigned long quiet = millis() - priceStore.lastChangeAt;
+  unsigned long age = millis() - priceStore.firstChangeAt;
+  portEXIT_CRITICAL(&nozzlePricesMux);
+  if (!dirty)
+    return ULONG_MAX;
+  if (quiet >= PRICE_SAVE_COALESCE_MS || age >= PRICE_SAVE_MAX_DELAY_MS)
+    return 0;
+  unsigned long toQuiet = PRICE_SAVE_COALESCE_MS - quiet;
+  unsigned long toMax = PRICE_SAVE_MAX_DELAY_MS - age;
+  return toQuiet < toMax ? toQuiet : toMax;
+}
+
+// Append the queued changes to the price journal (storageTask). A lost backlog, or a
+// failed append, is covered by journaling the whole table as a snapshot instead.
+static bool journalNozzlePrices(const NozzlePrices &table, const PriceJournalEntry *changes, uint8_t count,
+                                bool overflow)
+{
+  if (overflow)
+  {
+    PriceJournalEntry entries[PRICE_JOURNAL_NOZZLES];
+    for (uint8_t i = 0; i < PRICE_JOURNAL_NOZZLES; i++)
+      priceEntryFromTable(table, i, entries[i]);
+    return priceJournal.importTable(entries, PRICE_JOURNAL_NOZZLES);
+  }
+  for (uint8_t i = 0; i < count; i++)
+  {
+    if (!priceJournal.append(changes[i]))
+      return false;
+  }
+  return true;
+}
 
-  while (retryCount < MAX_RETRIES && !success)
+// STORAGE_SAVE_PRICES (storageTask): persist the changes made since the last write (journal
+// records, or the whole price file without the partition). On failure the table stays
+// dirty and is retried after the max delay.
+static bool persistNozzlePrices()
+{
+  NozzlePrices table;
+  PriceJournalEntry changes[PRICE_PENDING_MAX];
+  portENTER_CRITICAL(&nozzlePricesMux);
+  table = nozzlePrices;
+  uint32_t version = priceStore.version;
+  uint32_t changeCount = version - priceStore.savedVersion;
+  uint8_t pendingCount = priceStore.pendingCount;
+  bool overflow = priceStore.pendingOverflow;
+  memcpy(changes, priceStore.pending, pendingCount * sizeof(PriceJournalEntry));
+  priceStore.pendingCount = 0;
+  priceStore.pendingOverflow = false;
+  portEXIT_CRITICAL(&nozzlePricesMux);
+  if (changeCount == 0)
+    return true;
+  bool ok = calculateNozzlePricesChecksum(table) == table.checksum &&
+            (priceJournalReady ? journalNozzlePrices(table, changes, pendingCount, overflow)
+                               : saveNozzlePrices(table, flashMutex));
+  if (!ok)
   {
-    success = updateNozzlePrice(nozzorleStr, idDevice, unitPrice, prices, flashMutex);
-
-    if (!success)
+    if (priceJournalReady)
     {
-      retryCount++;
-      if (retryCount < MAX_RETRIES)
-      {
-        // Progressive backoff: 150ms, 300ms, 450ms, 600ms...
-        int delayMs = 150 * retryCount;
-        Serial.printf("[PRICE RETRY] DeviceID=%d failed (attempt %d/%d), retry in %dms...\n",
-                      deviceId, retryCount, MAX_RETRIES, delayMs);
-        vTaskDelay(pdMS_TO_TICKS(delayMs));
-        esp_task_wdt_reset(); // Reset watchdog during long retries
-      }
+      portENTER_CRITICAL(&nozzlePricesMux);
+      priceStore.pendingOverflow = true; // Retry as one snapshot of the table
+      portEXIT_CRITICAL(&nozzlePricesMux);
     }
+    priceStore.failed++;
+    portENTER_CRITICAL(&nozzlePricesMux);
+    priceStore.firstChangeAt = millis(); // Retry in PRICE_SAVE_MAX_DELAY_MS
+    portEXIT_CRITICAL(&nozzlePricesMux);
+    Serial.printf("[PRICE SAVE] ❌ Price %s write failed (%lu change(s) kept in RAM)\n",
+                  priceJournalReady ? "journal" : "file", (unsigned long)changeCount);
+    setSystemStatus("ERROR", "Price store write failed");
+    return false;
   }
-
-  if (success)
-  {
-    Serial.printf("[PRICE SAVE] ✅ DeviceID=%d (IdDevice=%s) validation success after %d attempt(s)\n",
-                  deviceId, idDevice, retryCount + 1);
-
-    // STEP 1: Publish to MQTT FIRST (fast, non-blocking)
-    Serial.printf("[PRICE FLOW] Step 1: Publishing to MQTT for DeviceID=%d...\n", deviceId);
-    publishPriceChangeSuccess(deviceId, idDevice, unitPrice, idChiNhanh);
-    
-    // STEP 2: Save to Flash LAST (slower, can retry if fails)
-    Serial.printf("[PRICE FLOW] Step 2: Saving to Flash for DeviceID=%d...\n", deviceId);
-    // Flash save already done in the retry loop above
-  }
+  portENTER_CRITICAL(&nozzlePricesMux);
+  priceStore.savedVersion = version;
+  portEXIT_CRITICAL(&nozzlePricesMux);
+  priceStore.saves++;
+  priceStore.coalesced += changeCount - 1;
+  if (priceJournalReady)
+    Serial.printf("[PRICE SAVE] ✅ %u journal record(s)%s (%lu change(s))\n", overflow ? PRICE_JOURNAL_NOZZLES : pendingCount,
+                  overflow ? " as a snapshot" : "", (unsigned long)changeCount);
   else
-  {
-    Serial.printf("[PRICE SAVE] ❌ DeviceID=%d (IdDevice=%s) FAILED after %d attempts - CRITICAL ERROR!\n",
-                  deviceId, idDevice, MAX_RETRIES);
-    Serial.println("[PRICE SAVE] This should NEVER happen - investigate flash mutex issue!");
+    Serial.printf("[PRICE SAVE] ✅ Price file written (%lu change(s))\n", (unsigned long)changeCount);
+  return true;
+}
 
-    // Do NOT re-queue to avoid infinite loop
-    // Log critical error for investigation
-    char errorMsg[100];
-    snprintf(errorMsg, sizeof(errorMsg), "Price save failed for DeviceID=%d after %d retries", deviceId, MAX_RETRIES);
-    setSystemStatus("ERROR", errorMsg);
-  }
+// GetPriceHistory on storageTask (STORAGE_RUN)
+static void readPriceHistory(void *data)
+{
+  PriceHistoryQuery &q = *(PriceHistoryQuery *)data;
+  persistNozzlePrices(); // Changes still waiting for the coalescing window belong in the answer
+  priceJournal.forEachChange(q.nozzle, [&q](uint32_t, const PriceJournalEntry &e) {
+    q.entries[q.total++ % q.limit] = e;
+  });
+}
+
+// Confirmed price change (rs485Task): update the RAM table, publish FinishPrice. The
+// price file follows on storageTask (persistNozzlePrices) without holding anyone up.
+void savePriceChange(uint8_t deviceId, const char *idDevice, float unitPrice, const char *idChiNhanh)
+{
+  if (!setNozzlePrice(deviceId, idDevice, unitPrice))
+    return;
+  Serial.printf("[PRICE SAVE] ✅ DeviceID=%d (IdDevice=%s) price %.2f set\n", deviceId, idDevice, unitPrice);
+  publishPriceChangeSuccess(deviceId, idDevice, unitPrice, idChiNhanh);
 }
 
 // Publish price change success to MQTT immediately after save
@@ -2589,7 +4355,9 @@ void publishPriceChangeSuccess(uint8_t deviceId, const char *idDevice, float uni
     return;
   }
 
-  time_t updatedTimestamp = nozzlePrices.nozzles[nozzleIndex].updatedAt;
+  NozzlePrices table;
+  readNozzlePrices(table);
+  time_t updatedTimestamp = table.nozzles[nozzleIndex].updatedAt;
 
   // Format timestamp to dd/mm/yyyy-HH:MM:SS
   struct tm *timeinfo = localtime(&updatedTimestamp);
@@ -2634,6 +4402,30 @@ void publishPriceChangeSuccess(uint8_t deviceId, const char *idDevice, float uni
 }
 
 
+// Send a log to mqttQueue / saveLogQueue, counting drops and the free-space low-water mark
+static bool queueLog(QueueHandle_t queue, const PumpLog &log, uint32_t &drops, UBaseType_t &minFree)
+{
+  if (xQueueSend(queue, &log, pdMS_TO_TICKS(100)) != pdTRUE)
+  {
+    drops++;
+    minFree = 0;
+    return false;
+  }
+  UBaseType_t freeSlots = uxQueueSpacesAvailable(queue);
+  if (freeSlots < minFree)
+    minFree = freeSlots;
+  return true;
+}
+
+// Hand a log to storageTask's write-behind cache (via saveLogQueue)
+bool saveLogToFlash(const PumpLog &logData)
+{
+  if (!queueLog(saveLogQueue, logData, saveLogQueueDrops, saveLogQueueMinFree))
+    return false;
+  storageNotify();
+  return true;
+}
+
 void saveLogNotConnectMqtt(const PumpLog &log){
   // Prepare updated log with MQTT status
   PumpLog updatedLog = log;
@@ -2648,7 +4440,7 @@ void saveLogNotConnectMqtt(const PumpLog &log){
   else if (updatedLog.viTriLogData >= 1 && updatedLog.viTriLogData <= MAX_LOGS)
   {
     
-    if (xQueueSend(saveLogQueue, &updatedLog, pdMS_TO_TICKS(100)) == pdTRUE)
+    if (saveLogToFlash(updatedLog))
     {
       Serial.printf("💾 Log %d saved to saveLogQueue not connected to MQTT\n", updatedLog.viTriLogData);
     }
@@ -2721,7 +4513,7 @@ void sendMQTTData(const PumpLog &log){
   else if (updatedLog.viTriLogData >= 1 && updatedLog.viTriLogData <= MAX_LOGS)
   {
     
-    if (xQueueSend(saveLogQueue, &updatedLog, pdMS_TO_TICKS(100)) == pdTRUE)
+    if (saveLogToFlash(updatedLog))
     {
       Serial.printf("💾 Log %d saved to saveLogQueue\n", updatedLog.viTriLogData);
     }
@@ -2736,430 +4528,455 @@ void sendMQTTData(const PumpLog &log){
   }
 }
 
-// Read log from Flash and send to MQTT (without saving back to Flash)
+// storageTask: hand a served log-loss read back to rs485Task
+static void logLossReadDone(const StorageRequest &request, bool ok)
+{
+  LogLossRead result;
+  result.logId = request.op == STORAGE_READ_ARCHIVE ? request.value : request.pos;
+  result.pos = request.op == STORAGE_READ_ARCHIVE ? journalSlotOfId(request.value) : request.pos;
+  result.ok = ok;
+  result.log = logLossReadBuf;
+  xQueueSend(logLossReadQueue, &result, 0); // One read in flight: never full
+  if (rs485TaskHandle != NULL)
+    xTaskNotifyGive(rs485TaskHandle);
+}
+
+// Queue the flash read of a log for re-publishing (rs485Task). Doesn't wait:
+// publishFlashLog gets the log when storageTask has read it. 1..MAX_LOGS are
+// journal slots, higher IDs archive IDs (LogArchive.h) past the ring.
 void readLogFromFlash(uint32_t logId)
 {
-  if (logId < 1 || logId > MAX_LOGS)
+  if (logId < 1)
   {
-    Serial.printf("ERROR: Invalid logId=%lu (must be 1-%d)\n", logId, MAX_LOGS);
+    Serial.printf("ERROR: Invalid logId=%lu\n", logId);
     return;
   }
 
-  // Use flashMutex for thread safety
-  if (xSemaphoreTake(flashMutex, pdMS_TO_TICKS(100)) == pdTRUE)
+  // Read on storageTask: write-behind cache, then the journal; archive IDs from
+  // the archive (hot partition tier, then the cold LittleFS tier)
+  StorageRequest read = {STORAGE_READ_LOG, STORAGE_NO_WAITER, (uint16_t)logId, 0, 0, &logLossReadBuf, NULL, logLossReadDone};
+  if (logId > MAX_LOGS)
   {
-    File dataFile = LittleFS.open(FLASH_DATA_FILE, "r");
-    if (dataFile)
-    {
-      // Calculate offset: (logId - 1) * sizeof(PumpLog)
-      uint32_t offset = (logId - 1) * sizeof(PumpLog);
-      dataFile.seek(offset, SeekSet);
-
-      // Read the complete PumpLog structure
-      PumpLog log;
-      size_t bytesRead = dataFile.read((uint8_t *)&log, sizeof(PumpLog));
-      dataFile.close();
+    read.op = STORAGE_READ_ARCHIVE;
+    read.pos = 0;
+    read.value = logId;
+  }
+  logLossReadBusy = true;
+  if (!storageSubmit(read, 0))
+  {
+    // Storage queue full: retry this log on the next slot
+    logLossReadBusy = false;
+    DtaLogLoss retry = {(signed int)logId};
+    xQueueSendToFront(logIdLossQueue, &retry, 0);
+  }
+}
 
-      if (bytesRead == sizeof(PumpLog))
-      {
-        Serial.printf("📖 Read Log %lu from Flash at offset %lu\n", logId, offset);
+// Send a log read by readLogFromFlash to MQTT; the delivery result is appended as a journal STATUS record
+static void publishFlashLog(const LogLossRead &read)
+{
+  uint32_t logId = read.logId;
+  const PumpLog &log = read.log;
+  if (!read.ok)
+  {
+    Serial.printf("⚠️ Log %lu not found in Flash\n", logId);
+    return;
+  }
 
-        // Send to MQTT directly (without saving back to Flash)
-        String jsonData = convertPumpLogToJson(log);
+  Serial.printf("📖 Read Log %lu from Flash\n", logId);
 
-        int retryCount = 0;
-        const int maxRetries = 3;
-        bool mqttSuccess = false;
-        esp_task_wdt_reset();
+  // Send to MQTT directly
+  String jsonData = convertPumpLogToJson(log);
 
-        Serial.printf("📤 Sending Log %lu to MQTT...\n", logId);
+  int retryCount = 0;
+  const int maxRetries = 3;
+  bool mqttSuccess = false;
+  esp_task_wdt_reset();
 
-        while (retryCount < maxRetries && !mqttSuccess)
-        {
-          if (mqttClient.publish(fullTopic, jsonData.c_str()))
-          {
-            Serial.printf("✅ Log %lu sent to MQTT successfully\n", logId);
-            mqttSuccess = true;
-          }
-          else
-          {
-            retryCount++;
-            if (retryCount < maxRetries)
-            {
-              Serial.printf("⚠️ MQTT send failed (Attempt %d/%d), retrying...\n", retryCount, maxRetries);
-              vTaskDelay(pdMS_TO_TICKS(500));
-            }
-          }
-          esp_task_wdt_reset();
-          yield();
-        }
+  Serial.printf("📤 Sending Log %lu to MQTT...\n", logId);
 
-        if (!mqttSuccess)
-        {
-          Serial.printf("❌ Log %lu: MQTT send failed after %d retries\n", logId, maxRetries);
-          char errorMsg[64];
-          snprintf(errorMsg, sizeof(errorMsg), "MQTT send failed for Log %lu after %d retries", logId, maxRetries);
-          setSystemStatus("ERROR", errorMsg);
-        }
-      }
-      else
-      {
-        Serial.printf("⚠️ Partial read for Log %lu: %u/%u bytes\n",
-                      logId, bytesRead, sizeof(PumpLog));
-      }
+  while (retryCount < maxRetries && !mqttSuccess)
+  {
+    if (mqttClient.publish(fullTopic, jsonData.c_str()))
+    {
+      Serial.printf("✅ Log %lu sent to MQTT successfully\n", logId);
+      mqttSuccess = true;
     }
     else
     {
-      Serial.printf("ERROR: Failed to open Flash file for reading Log %lu\n", logId);
+      retryCount++;
+      if (retryCount < maxRetries)
+      {
+        Serial.printf("⚠️ MQTT send failed (Attempt %d/%d), retrying...\n", retryCount, maxRetries);
+        vTaskDelay(pdMS_TO_TICKS(500));
+      }
     }
-    xSemaphoreGive(flashMutex);
+    esp_task_wdt_reset();
+    yield();
   }
-  else
+
+  if (!mqttSuccess)
+  {
+    Serial.printf("❌ Log %lu: MQTT send failed after %d retries\n", logId, maxRetries);
+    char errorMsg[64];
+    snprintf(errorMsg, sizeof(errorMsg), "MQTT send failed for Log %lu after %d retries", logId, maxRetries);
+    setSystemStatus("ERROR", errorMsg);
+  }
+  else if (read.pos != 0)
   {
-    Serial.printf("⚠️ Flash mutex timeout for reading Log %lu\n", logId);
+    notePendingLog(read.pos, false);
+    // Small STATUS record instead of rewriting the whole log (no need to wait for it)
+    if (!log.mqttSent && g_flashSaveEnabled)
+    {
+      StorageRequest mark = {STORAGE_MARK_SENT, STORAGE_NO_WAITER, read.pos, (uint32_t)time(NULL), 0, NULL, NULL};
+      storageSubmit(mark);
+    }
   }
 }
 
-void readRS485Data(byte *buffer)
+// ============================================================================
+// RS485 RECEIVE PATH - stream bytes into the frame decoder, dispatch frames
+// ============================================================================
+
+// Runs in the UART driver's event task (not an ISR) on RX timeout / FIFO full
+void onRS485Receive()
 {
-  if (!Serial2.available())
+  if (rs485RxEventUs == 0)
   {
-    return;
+    rs485RxEventUs = esp_timer_get_time();
   }
-
-  // RS485 Statistics for monitoring data quality
-  static struct
+  rs485RxStats.rxEvents++;
+#ifndef RS485_RX_POLLING
+  if (rs485TaskHandle != NULL)
   {
-    unsigned long totalPackets = 0;
-    unsigned long validLogs = 0;
-    unsigned long invalidLogs = 0;
-    unsigned long validPriceResponses = 0;
-    unsigned long invalidPriceResponses = 0;
-    unsigned long lastStatsReport = 0;
-  } rs485Stats;
+    xTaskNotifyGive(rs485TaskHandle);
+  }
+#endif
+}
 
-  // Report statistics every 10 minutes
+// Sleep until the UART signals new bytes, someone notifies rs485Task, or maxMs passes.
+// Built with -DRS485_RX_POLLING it falls back to the old fixed 10 ms poll for comparison.
+void rs485WaitForData(uint32_t maxMs)
+{
+#ifdef RS485_RX_POLLING
+  vTaskDelay(pdMS_TO_TICKS(maxMs < RS485_POLL_MS ? maxMs : RS485_POLL_MS));
+#else
+  ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(maxMs > 0 ? maxMs : 1));
+#endif
+  rs485RxStats.wakeups++;
+
+  // Close a 10 s measurement window
   unsigned long now = millis();
-  if (now - rs485Stats.lastStatsReport >= 600000) // 10 minutes
+  unsigned long elapsed = now - rs485RxStats.windowStart;
+  if (elapsed >= 10000)
   {
-    rs485Stats.lastStatsReport = now;
-    if (rs485Stats.totalPackets > 0)
-    {
-      float validLogRate = (rs485Stats.validLogs * 100.0) / rs485Stats.totalPackets;
-      float validPriceRate = (rs485Stats.validPriceResponses * 100.0) / rs485Stats.totalPackets;
-      Serial.println("\n=== RS485 DATA QUALITY REPORT (10 min) ===");
-      Serial.printf("Total packets: %lu\n", rs485Stats.totalPackets);
-      Serial.printf("Valid logs: %lu (%.1f%%)\n", rs485Stats.validLogs, validLogRate);
-      Serial.printf("Invalid logs: %lu\n", rs485Stats.invalidLogs);
-      Serial.printf("Valid price responses: %lu (%.1f%%)\n", rs485Stats.validPriceResponses, validPriceRate);
-      Serial.printf("Invalid price responses: %lu\n", rs485Stats.invalidPriceResponses);
-      Serial.println("==========================================\n");
-    }
+    rs485RxStats.wakeupsPerSec = rs485RxStats.wakeups * 1000.0f / elapsed;
+    rs485RxStats.rxEventsPerSec = rs485RxStats.rxEvents * 1000.0f / elapsed;
+    rs485RxStats.avgLatencyUs = rs485RxStats.frames > 0 ? (uint32_t)(rs485RxStats.latencySumUs / rs485RxStats.frames) : 0;
+    rs485RxStats.maxLatencyUs = rs485RxStats.latencyMaxUs;
+    rs485RxStats.wakeups = 0;
+    rs485RxStats.rxEvents = 0;
+    rs485RxStats.frames = 0;
+    rs485RxStats.latencySumUs = 0;
+    rs485RxStats.latencyMaxUs = 0;
+    rs485RxStats.windowStart = now;
   }
+}
 
-  // Limit processing to prevent overflow from TTL boot spam
-  // BUT allow more reads during price change batches (we need to read 70+ times for 7 devices)
-  static unsigned long lastReadTime = 0;
-  static int consecutiveReads = 0;
+// Price response [7][ID][S/E][8] → priceResponseQueue (matched via priceRequestCache)
+static void handlePriceResponseFrame(const uint8_t *frame)
+{
+  uint8_t deviceId = frame[1];
+  char status = (char)frame[2];
+
+  Serial.printf("\n[RS485 READ] Price Response: [0x%02X][0x%02X]['%c'][0x%02X] - DeviceID=%d, Status='%c'\n",
+                frame[0], frame[1], frame[2], frame[3], deviceId, status);
 
-  if (now - lastReadTime < 50)
+  if (status == 'S')
   {
-    consecutiveReads++;
-    // Increased threshold from 20 to 100 to allow batch price processing
-    if (consecutiveReads > 100)
-    {
-      Serial.println("[RS485 READ] ⚠️ Too many consecutive reads, clearing buffer to prevent overflow");
-      while (Serial2.available())
-      {
-        Serial2.read();
-      }
-      consecutiveReads = 0;
-      return;
-    }
+    Serial.printf("[RS485 READ] ✓ SUCCESS - DeviceID=%d price update confirmed by KPL device\n", deviceId);
   }
   else
   {
-    consecutiveReads = 0;
+    Serial.printf("[RS485 READ] ✗ ERROR - DeviceID=%d rejected price update (KPL returned 'E')\n", deviceId);
   }
-  lastReadTime = now;
-
-  // Peek first byte to determine message type
-  int firstByte = Serial2.peek();
 
-  // Case 0: Echo of sent command - Format: [9][ID][...] (10 bytes) - DISCARD IT
-  if (firstByte == 9 && Serial2.available() >= 10)
+  // Match against the outstanding command for this device; anything else is stray
+  if (!priceEngine.onResponse(deviceId, status == 'S', millis()))
   {
-    uint8_t echoBuffer[10];
-    Serial2.readBytes(echoBuffer, 10);
-    Serial.printf("[RS485 READ] Discarding echo: [0x%02X][0x%02X][0x%02X][0x%02X]...[0x%02X][0x%02X]\n", 
-                  echoBuffer[0], echoBuffer[1], echoBuffer[2], echoBuffer[3], echoBuffer[8], echoBuffer[9]);
+    Serial.printf("[RS485 READ] ⚠️ Stray price response for DeviceID=%d (no command outstanding) - ignored\n", deviceId);
     return;
   }
-
-  // Case 1: Price Change Response - Format: [7][ID][S/E][8] (4 bytes)
-  if (firstByte == 7 && Serial2.available() >= 4)
+  uint32_t rttMs = 0;
+  if (priceEngine.rttSample(deviceId, rttMs))
   {
-    uint8_t priceResponse[4];
-    if (Serial2.readBytes(priceResponse, 4) == 4)
-    {
-      // ALWAYS log price responses for debugging
-      Serial.printf("[RS485 READ] Got price response: [0x%02X][0x%02X][0x%02X][0x%02X]\n",
-                    priceResponse[0], priceResponse[1], priceResponse[2], priceResponse[3]);
-      
-      // Validate header and footer FIRST to detect corrupt packets early
-      if (priceResponse[0] != 7 || priceResponse[3] != 8)
-      {
-        Serial.printf("[RS485 READ] ⚠️ REJECTED - Invalid header/footer: [0x%02X][0x%02X][0x%02X][0x%02X]\n",
-                     priceResponse[0], priceResponse[1], priceResponse[2], priceResponse[3]);
-        return;
-      }
-
-      uint8_t deviceId = priceResponse[1];
-      char status = priceResponse[2];
-
-      // Validate status byte BEFORE deviceId (catch corruption early)
-      if (status != 'S' && status != 'E')
-      {
-        rs485Stats.totalPackets++;
-        rs485Stats.invalidPriceResponses++;
-        Serial.printf("[RS485 READ] ⚠️ REJECTED - Invalid status: DeviceID=%d, Status='%c' (0x%02X)\n",
-                      deviceId, status, (uint8_t)status);
-        return;
-      }
+    rs485Latency.record(deviceId, RS485_CMD_PRICE, rttMs);
+  }
 
-      // Validate deviceId is in valid range (11-20)
-      if (deviceId < 11 || deviceId > 20)
-      {
-        rs485Stats.totalPackets++;
-        rs485Stats.invalidPriceResponses++;
-        Serial.printf("[RS485 READ] ⚠️ REJECTED - Invalid DeviceID=%d (valid: 11-20)\n", deviceId);
-        return;
-      }
+  // Get request data from cache (deviceId 11-20 → index 0-9, range checked by decoder)
+  int cacheIndex = deviceId - 11;
+  PriceChangeResponse response;
+  response.deviceId = deviceId;
+  response.status = status;
+  response.unitPrice = priceRequestCache[cacheIndex].unitPrice;
+  safe_strncpy(response.idDevice, priceRequestCache[cacheIndex].idDevice, sizeof(response.idDevice));
+  safe_strncpy(response.idChiNhanh, priceRequestCache[cacheIndex].idChiNhanh, sizeof(response.idChiNhanh));
 
-      // Valid price response
-      rs485Stats.totalPackets++;
-      rs485Stats.validPriceResponses++;
+  if (xQueueSend(priceResponseQueue, &response, pdMS_TO_TICKS(100)) == pdTRUE)
+  {
+    Serial.printf("[RS485 READ] ✓ Response '%c' queued for DeviceID=%d (Queue: %d)\n",
+                  status, deviceId, uxQueueMessagesWaiting(priceResponseQueue));
+  }
+  else
+  {
+    Serial.printf("[RS485 READ] ❌ FAILED to queue response for DeviceID=%d - QUEUE FULL!\n", deviceId);
+  }
+}
 
-      // Log valid response with full details
-      Serial.printf("\n[RS485 READ] Price Response: [0x%02X][0x%02X]['%c'][0x%02X] - DeviceID=%d, Status='%c'\n",
-                    priceResponse[0], priceResponse[1], priceResponse[2], priceResponse[3],
-                    deviceId, status);
+// Pump log (checksum already verified by the decoder) → mqttQueue.
+// Answers to log recovery requests are published/saved like any log, but do not
+// count as a new transaction (relay, checkLogSend) and delay further recovery requests.
+static void handlePumpLogFrame(byte *buffer)
+{
+  PumpLog log;
+  ganLog(buffer, log);
 
-      // Parse status
-      if (status == 'S')
-      {
-        Serial.printf("[RS485 READ] ✓ SUCCESS - DeviceID=%d price update confirmed by KPL device\n", deviceId);
+  uint32_t rttMs = 0;
+  bool recovered = logRecovery.onLog(log.viTriLogData, millis(), rttMs);
+  if (recovered)
+  {
+    rs485Latency.record(LOG_RECOVERY_DEVICE_ID, RS485_CMD_LOG_REQUEST, rttMs);
+  }
+  else
+  {
+    logRecovery.onLiveTraffic(millis());
+  }
 
-        // Get request data from cache (deviceId 11-20 → index 0-9)
-        int cacheIndex = deviceId - 11;
-        if (cacheIndex >= 0 && cacheIndex < 10)
-        {
-          PriceChangeResponse response;
-          response.deviceId = deviceId;
-          response.status = 'S';
-          response.unitPrice = priceRequestCache[cacheIndex].unitPrice;
-          // ✅ FIX: Use safe_strncpy
-          safe_strncpy(response.idDevice, priceRequestCache[cacheIndex].idDevice, sizeof(response.idDevice));
-          safe_strncpy(response.idChiNhanh, priceRequestCache[cacheIndex].idChiNhanh, sizeof(response.idChiNhanh));
-          
-          if (xQueueSend(priceResponseQueue, &response, pdMS_TO_TICKS(100)) == pdTRUE)
-          {
-            Serial.printf("[RS485 READ] ✓ Success response queued for DeviceID=%d (Queue: %d)\n", 
-                          deviceId, uxQueueMessagesWaiting(priceResponseQueue));
-          }
-          else
-          {
-            Serial.printf("[RS485 READ] ❌ FAILED to queue response for DeviceID=%d - QUEUE FULL!\n", deviceId);
-          }
-        }
-      }
-      else if (status == 'E')
-      {
-        Serial.printf("[RS485 READ] ✗ ERROR - DeviceID=%d rejected price update (KPL returned 'E')\n", deviceId);
-        
-        // Get request data from cache
-        int cacheIndex = deviceId - 11;
-        if (cacheIndex >= 0 && cacheIndex < 10)
-        {
-          PriceChangeResponse response;
-          response.deviceId = deviceId;
-          response.status = 'E';
-          response.unitPrice = priceRequestCache[cacheIndex].unitPrice;
-          // ✅ FIX: Use safe_strncpy
-          safe_strncpy(response.idDevice, priceRequestCache[cacheIndex].idDevice, sizeof(response.idDevice));
-          safe_strncpy(response.idChiNhanh, priceRequestCache[cacheIndex].idChiNhanh, sizeof(response.idChiNhanh));
-          
-          if (xQueueSend(priceResponseQueue, &response, 0) == pdTRUE)
-          {
-            Serial.printf("[RS485 READ] ✓ Error response queued for DeviceID=%d\n", deviceId);
-          }
-        }
-      }
-      else
-      {
-        Serial.printf("[RS485 READ] ✗ UNKNOWN STATUS - DeviceID=%d, Status='%c' (0x%02X)\n",
-                      deviceId, status, status);
-        Serial.printf("[RS485 READ] ⚠️ Unknown status - NOT queuing response\n");
-      }
-    }
-    else
-    {
-      Serial.printf("[RS485 READ] Invalid price response format: [0x%02X][0x%02X][0x%02X][0x%02X]\n",
-                    priceResponse[0], priceResponse[1], priceResponse[2], priceResponse[3]);
-    }
+  if (!queueLog(mqttQueue, log, mqttQueueDrops, mqttQueueMinFree))
+  {
+    Serial.printf("⚠️ mqttQueue full - Log %u dropped (%lu total)\n", log.viTriLogData, (unsigned long)mqttQueueDrops);
     return;
   }
-
-  // Case 2: Pump Log Data - Format: [1][2]...[3][checksum][4] (32 bytes)
-  if (firstByte == 1 && Serial2.available() >= LOG_SIZE)
+  if (recovered)
   {
-    // Set timeout for reading to prevent blocking
-    unsigned long readStartTime = millis();
-    size_t bytesRead = Serial2.readBytes(buffer, LOG_SIZE);
-    unsigned long readDuration = millis() - readStartTime;
+    DEBUG_PRINTF("[LOG RECOVERY] Log %u recovered (%lums)\n", log.viTriLogData, (unsigned long)rttMs);
+    return;
+  }
+  Serial.println("Log data queued for MQTT");
+  // Reset checkLogSend khi có giao dịch mới
+  checkLogSend = 0;
+  // Trigger relay (coalesced during bursts, see OutputCom.h)
+  outputPulseRequest(PULSE_TRANSACTION);
+}
 
-    if (readDuration > 1000)
+void readRS485Data(byte *buffer)
+{
+  static unsigned long lastStatsReport = 0;
+
+  // Timestamp of the UART event that woke us (0 = no event pending)
+  int64_t eventUs = rs485RxEventUs;
+  rs485RxEventUs = 0;
+
+  // Drain whatever the UART driver already holds - never blocks, never flushes.
+  // Frames are decoded after each chunk so the decoder ring cannot overrun.
+  uint8_t chunk[64];
+  RS485Frame frame;
+  int avail;
+  do
+  {
+    avail = Serial2.available();
+    if (avail > 0)
     {
-      Serial.printf("[RS485 READ] ⚠️ Read timeout: %lu ms for %d bytes\n", readDuration, bytesRead);
-      return;
+      size_t n = Serial2.read(chunk, avail < (int)sizeof(chunk) ? avail : sizeof(chunk));
+      rs485CaptureRecord(false, chunk, n);
+      rs485Decoder.feed(chunk, n, millis());
     }
 
-    if (bytesRead == LOG_SIZE)
+    while (rs485Decoder.next(frame, millis()))
     {
-      // Validate data
-      uint8_t calculatedChecksum = calculateChecksum_LogData(buffer, LOG_SIZE);
-      uint8_t receivedChecksum = buffer[30];
-
-      if (calculatedChecksum == receivedChecksum &&
-          buffer[0] == 1 && buffer[1] == 2 &&
-          buffer[29] == 3 && buffer[31] == 4)
+      if (eventUs != 0)
       {
-        // Valid pump log
-        rs485Stats.totalPackets++;
-        rs485Stats.validLogs++;
-
-        // Process valid pump log data
-        PumpLog log;
-        ganLog(buffer, log);
-
-        if (xQueueSend(mqttQueue, &log, pdMS_TO_TICKS(100)) == pdTRUE)
+        uint32_t latencyUs = (uint32_t)(esp_timer_get_time() - eventUs);
+        rs485RxStats.frames++;
+        rs485RxStats.latencySumUs += latencyUs;
+        if (latencyUs > rs485RxStats.latencyMaxUs)
         {
-          Serial.println("Log data queued for MQTT");
-          // Reset checkLogSend khi có giao dịch mới
-          checkLogSend = 0;
-          // Trigger relay
-          xTaskCreate(ConnectedKPLBox, "ConnectedKPLBox", 1024, NULL, 4, NULL);
+          rs485RxStats.latencyMaxUs = latencyUs;
         }
       }
-      else
+
+      switch (frame.kind)
       {
-        // Invalid pump log
-        rs485Stats.totalPackets++;
-        rs485Stats.invalidLogs++;
+      case RS485_FRAME_PRICE_RESPONSE:
+        handlePriceResponseFrame(frame.data);
+        break;
 
-        // Enhanced error logging for debugging corruption
-        static int invalidLogCount = 0;
-        invalidLogCount++;
+      case RS485_FRAME_PUMP_LOG:
+        memcpy(buffer, frame.data, LOG_SIZE);
+        handlePumpLogFrame(buffer);
+        break;
 
-        // Log every 10th error to avoid spam, but provide detailed info
-        if (invalidLogCount % 10 == 0)
+      case RS485_FRAME_SET_TIME_REPLY:
+      {
+        RS485Completion done;
+        portENTER_CRITICAL(&rs485SchedMux);
+        bool matched = rs485Scheduler.onCommandReply(frame.data[1], frame.data[2] == 'S', millis(), done);
+        portEXIT_CRITICAL(&rs485SchedMux);
+        if (matched)
         {
-          Serial.printf("[RS485 READ] ❌ Invalid pump log #%d:\n", invalidLogCount);
-          Serial.printf("  Checksum: calc=0x%02X recv=0x%02X %s\n",
-                        calculatedChecksum, buffer[30],
-                        (calculatedChecksum == buffer[30] ? "✓" : "✗"));
-          Serial.printf("  Header: [0x%02X][0x%02X] %s\n",
-                        buffer[0], buffer[1],
-                        (buffer[0] == 1 && buffer[1] == 2 ? "✓" : "✗"));
-          Serial.printf("  Footer: [0x%02X][0x%02X] %s\n",
-                        buffer[29], buffer[31],
-                        (buffer[29] == 3 && buffer[31] == 4 ? "✓" : "✗"));
-
-          // Dump first 8 bytes for pattern analysis
-          Serial.print("  Data preview: ");
-          for (int i = 0; i < 8; i++)
-          {
-            Serial.printf("0x%02X ", buffer[i]);
-          }
-          Serial.println();
+          rs485Complete(done);
         }
         else
         {
-          // Reduced logging for other errors
-          DEBUG_PRINTLN("[RS485 READ] Invalid pump log: checksum or format error");
+          Serial.printf("[RS485 READ] Stray set-time reply: '%c'\n", (char)frame.data[2]);
         }
+        break;
+      }
+
+      case RS485_FRAME_ECHO:
+        DEBUG_PRINTF("[RS485 READ] Discarding echo: [0x%02X][0x%02X]...[0x%02X][0x%02X]\n",
+                     frame.data[0], frame.data[1], frame.data[8], frame.data[9]);
+        break;
+
+      default:
+        break;
       }
     }
-    else
+  } while (avail > 0);
+
+  // Report statistics every 10 minutes
+  unsigned long now = millis();
+  if (now - lastStatsReport >= 600000) // 10 minutes
+  {
+    lastStatsReport = now;
+    const RS485DecoderStats &st = rs485Decoder.stats();
+    if (st.bytesIn > 0)
     {
-      Serial.printf("[RS485 READ] ⚠️ Incomplete read: expected %d bytes, got %d\n", LOG_SIZE, bytesRead);
+      Serial.println("\n=== RS485 DATA QUALITY REPORT (10 min) ===");
+      Serial.printf("Bytes in: %lu\n", (unsigned long)st.bytesIn);
+      Serial.printf("Valid logs: %lu\n", (unsigned long)st.frames[RS485_FRAME_PUMP_LOG]);
+      Serial.printf("Invalid logs (checksum): %lu\n", (unsigned long)st.badChecksum);
+      Serial.printf("Price responses: %lu\n", (unsigned long)st.frames[RS485_FRAME_PRICE_RESPONSE]);
+      Serial.printf("Set-time replies: %lu, echoes: %lu\n",
+                    (unsigned long)st.frames[RS485_FRAME_SET_TIME_REPLY], (unsigned long)st.frames[RS485_FRAME_ECHO]);
+      Serial.printf("Resyncs: %lu, discarded bytes: %lu, stale partials: %lu, overflow: %lu\n",
+                    (unsigned long)st.resyncs, (unsigned long)st.bytesDiscarded,
+                    (unsigned long)st.staleDrops, (unsigned long)st.overflowBytes);
+      Serial.printf("Wake-ups: %.1f/s, RX events: %.1f/s, frame latency avg/max: %lu/%lu us\n",
+                    rs485RxStats.wakeupsPerSec, rs485RxStats.rxEventsPerSec,
+                    (unsigned long)rs485RxStats.avgLatencyUs, (unsigned long)rs485RxStats.maxLatencyUs);
+      Serial.printf("Queue drops mqtt/saveLog: %lu/%lu, min free: %u/%u\n", (unsigned long)mqttQueueDrops,
+                    (unsigned long)saveLogQueueDrops, (unsigned)mqttQueueMinFree, (unsigned)saveLogQueueMinFree);
+      Serial.printf("Log commits: %lu (%lu logs, max batch %u), flush max %lums, oldest wait max %lums\n",
+                    (unsigned long)logCommitStats.commits, (unsigned long)logCommitStats.logs,
+                    logCommitStats.maxBatch, (unsigned long)logCommitStats.flushMsMax,
+                    (unsigned long)logCommitStats.ageMsMax);
+      Serial.println("==========================================\n");
     }
-    return;
   }
+}
 
-  // Case 3: Unknown or incomplete data - wait for more data or clear buffer
-  if (Serial2.available() > 0 && Serial2.available() < 4)
-  {
-    // Not enough data yet, wait for next iteration
-    return;
-  }
+// ============================================================================
+// RS485 BUS CAPTURE
+// ============================================================================
+
+void rs485CaptureRecord(bool tx, const uint8_t *data, size_t len)
+{
+  portENTER_CRITICAL(&rs485CaptureMux);
+  rs485Capture.record(tx, data, len, esp_timer_get_time());
+  portEXIT_CRITICAL(&rs485CaptureMux);
+}
 
-  // Case 4: Buffer overflow protection - if buffer is suspiciously full, clear it
-  if (Serial2.available() > 100)
+// Every TX on the TTL bus goes through here so the capture sees it.
+// Once rs485Task runs it owns Serial2: other tasks must use rs485Submit().
+void rs485Write(const uint8_t *data, size_t len)
+{
+  if (rs485TaskHandle != NULL && xTaskGetCurrentTaskHandle() != rs485TaskHandle)
   {
-    Serial.printf("[RS485 READ] ⚠️ Buffer overflow detected (%d bytes), clearing...\n", Serial2.available());
-    while (Serial2.available())
-    {
-      Serial2.read();
-    }
+    rs485ForeignWrites++;
+    Serial.printf("[RS485] ❌ Write of %u bytes from outside rs485Task dropped - use rs485Submit()\n", (unsigned)len);
     return;
   }
+  rs485CaptureRecord(true, data, len);
+  Serial2.write(data, len);
+}
 
-  // Case 5: Invalid first byte - clear one byte and try again
-  if (firstByte != 1 && firstByte != 7 && firstByte != 9)
+// Copy the capture (header + records, oldest first) into a malloc'd buffer; caller frees
+size_t rs485CaptureSnapshot(uint8_t **out)
+{
+  const size_t cap = RS485_CAPTURE_HEADER_SIZE + RS485_CAPTURE_SIZE;
+  *out = (uint8_t *)malloc(cap);
+  if (*out == NULL)
   {
-    // Reduce spam by only logging every 10th invalid byte
-    static int invalidByteCount = 0;
-    invalidByteCount++;
+    return 0;
+  }
+  portENTER_CRITICAL(&rs485CaptureMux);
+  size_t len = rs485Capture.exportTo(*out, cap, RS485BaudRate);
+  portEXIT_CRITICAL(&rs485CaptureMux);
+  return len;
+}
 
-    if (invalidByteCount % 10 == 0)
+// Diagnostic routes on the main web server (reachable in STA mode once WiFi is up)
+void setupDiagnosticRoutes()
+{
+  webServer.on("/rs485/capture", HTTP_GET, [](AsyncWebServerRequest *request)
+               {
+    if (!request->authenticate(adminUser, adminPass))
     {
-      Serial.printf("[RS485 READ] Unknown first byte: 0x%02X (count: %d), discarding...\n", firstByte, invalidByteCount);
+      return request->requestAuthentication();
     }
-
-    Serial2.read(); // Discard invalid byte
-
-    // Reset counter every 100 invalid bytes to prevent overflow
-    if (invalidByteCount >= 100)
+    uint8_t *raw = NULL;
+    size_t len = rs485CaptureSnapshot(&raw);
+    if (len == 0)
     {
-      invalidByteCount = 0;
+      free(raw);
+      request->send(500, "text/plain", "Out of memory");
+      return;
     }
-  }
+    std::shared_ptr<uint8_t> snapshot(raw, free);
+    AsyncWebServerResponse *response = request->beginResponse("application/octet-stream", len,
+        [snapshot, len](uint8_t *buffer, size_t maxLen, size_t index) -> size_t
+        {
+          size_t n = len - index < maxLen ? len - index : maxLen;
+          memcpy(buffer, snapshot.get() + index, n);
+          return n;
+        });
+    response->addHeader("Content-Disposition", "attachment; filename=rs485_capture.bin");
+    request->send(response); });
 }
 
-// viết chương trình resend lại lệnh rs485 với id trong LogIdLossQueue để đọc giá trị lên
-// Dựa vào getLogData để resend lại lệnh rs485 với id trong LogIdLossQueue để đọc giá trị lên
-// Dựa vào sendLogRequest để resend lại lệnh rs485 với id trong LogIdLossQueue để đọc giá trị lên
-
-void resendLogRequest(void *param)
+// Publish the capture as one binary MQTT message to {Mst}/RS485Capture/{IdDevice}
+void publishRS485Capture(bool clearAfter)
 {
-  Serial.println("ResendLogRequest task started");
-  esp_task_wdt_add(NULL);
-  while (true)
+  uint8_t *raw = NULL;
+  size_t len = rs485CaptureSnapshot(&raw);
+  if (len == 0)
   {
-    DtaLogLoss dataLog;
-    // kiểm tra xem có dữ liệu trong logIdLossQueue không
-    if (uxQueueMessagesWaiting(logIdLossQueue) > 0)
-    {
-      if (xQueueReceive(logIdLossQueue, &dataLog, 0) == pdTRUE)
-      {
-        Serial.println("Resending log request for ID: " + String(dataLog.Logid));
-        sendLogRequest(static_cast<uint32_t>(dataLog.Logid));
-      }
-    }
-    vTaskDelay(pdMS_TO_TICKS(1000));
-    esp_task_wdt_reset();
-    yield();
+    free(raw);
+    LOG_ERROR("[CAPTURE] Out of memory for snapshot");
+    return;
+  }
+
+  char responseTopic[80];
+  snprintf(responseTopic, sizeof(responseTopic), "%s/RS485Capture/%s", companyInfo.Mst, TopicMqtt);
+
+  // Streamed publish - does not need the 24KB PubSubClient buffer
+  bool ok = mqttClient.beginPublish(responseTopic, len, false);
+  for (size_t off = 0; ok && off < len; off += 1024)
+  {
+    size_t n = len - off < 1024 ? len - off : 1024;
+    ok = mqttClient.write(raw + off, n) == n;
+  }
+  ok = ok && mqttClient.endPublish();
+  free(raw);
+
+  Serial.printf("[CAPTURE] %s %u bytes (%lu records, %lu evicted) to %s\n", ok ? "Published" : "FAILED to publish",
+                (unsigned)len, (unsigned long)rs485Capture.records(), (unsigned long)rs485Capture.droppedRecords(), responseTopic);
+
+  if (ok && clearAfter)
+  {
+    portENTER_CRITICAL(&rs485CaptureMux);
+    rs485Capture.clear();
+    portEXIT_CRITICAL(&rs485CaptureMux);
   }
 }
 
@@ -3181,28 +4998,13 @@ void sendPriceChangeCommand(const PriceChangeRequest &request)
   Serial.printf("[PRICE CMD] Sending to DeviceID=%d, Price=%.2f\n",
                 request.deviceId, request.unitPrice);
 
-  // Format price to 6 digits ASCII
-  char priceStr[7];
-  snprintf(priceStr, sizeof(priceStr), "%06d", static_cast<int>(request.unitPrice));
-
-  // Prepare command buffer
-  // Protocol: [PM(9)] [ID_Device] [Price_Char0-5 (6 bytes)] [Checksum] [LF(10)]
-  byte command[10];
-  command[0] = 9;
-  command[1] = static_cast<byte>(request.deviceId);
-
-  // Price digits (reversed order as per protocol)
-  command[2] = priceStr[5]; // Char(0)
-  command[3] = priceStr[4]; // Char(1)
-  command[4] = priceStr[3]; // Char(2)
-  command[5] = priceStr[2]; // Char(3)
-  command[6] = priceStr[1]; // Char(4)
-  command[7] = priceStr[0]; // Char(5)
-
-  // Calculate checksum: 0x5A XOR all data bytes (ID + Price chars)
-  uint8_t checksum = 0x5A ^ command[1] ^ command[2] ^ command[3] ^ command[4] ^ command[5] ^ command[6] ^ command[7];
-  command[8] = checksum;
-  command[9] = 10; // End byte (LF)
+  // Protocol: [PM(9)] [ID_Device] [Price_Char0-5 (6 bytes, reversed)] [Checksum 0x5A^1..7] [LF(10)]
+  uint8_t command[TTLPriceChange::kLength];
+  if (!TTLPriceChange::encode(command, request.deviceId, static_cast<uint32_t>(request.unitPrice)))
+  {
+    Serial.printf("[PRICE CMD] ERROR: Price %.2f out of range (max 999999)\n", request.unitPrice);
+    return;
+  }
 
   // DEBUG: Print full command for troubleshooting
   Serial.printf("[PRICE CMD] Raw bytes: [0x%02X][0x%02X]['%c']['%c']['%c']['%c']['%c']['%c'][0x%02X][0x%02X]\n",
@@ -3210,8 +5012,7 @@ void sendPriceChangeCommand(const PriceChangeRequest &request)
                 command[5], command[6], command[7], command[8], command[9]);
 
   // Send command
-  Serial2.write(command, 10);
-  Serial2.flush();
+  rs485Write(command, sizeof(command));
 
   Serial.printf("[PRICE CMD] ✓ Sent command for DeviceID=%d, waiting for response...\n", request.deviceId);
   
@@ -3220,37 +5021,6 @@ void sendPriceChangeCommand(const PriceChangeRequest &request)
   // If 'S' (Success) is received, it will trigger save and MQTT publish
 }
 
-void ConnectedKPLBox(void *param)
-{
-  digitalWrite(OUT1, HIGH);
-  digitalWrite(OUT2, HIGH);
-  vTaskDelay(pdMS_TO_TICKS(200));
-  digitalWrite(OUT1, LOW);
-  digitalWrite(OUT2, LOW);
-  vTaskDelete(NULL);
-}
-
-void BlinkOutput2Task(void *param)
-{
-  // Two quick blinks on OUT2
-  for (int i = 0; i < 1; i++)
-  {
-    digitalWrite(OUT1, HIGH);
-    digitalWrite(OUT2, HIGH);
-    vTaskDelay(pdMS_TO_TICKS(120));
-    digitalWrite(OUT1, LOW);
-    digitalWrite(OUT2, LOW);
-    vTaskDelay(pdMS_TO_TICKS(120));
-  }
-  vTaskDelete(NULL);
-}
-
-void blinkOutput2Connected()
-{
-  // Fire-and-forget non-blocking blink
-  xTaskCreate(BlinkOutput2Task, "BlinkOUT2", 1024, NULL, 1, NULL);
-}
-
 void wifiRescanTask(void *param)
 {
   // Perform a one-time WiFi scan and update list for config portal
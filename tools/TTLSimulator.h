@@ -0,0 +1,393 @@
+#ifndef TTL_SIMULATOR_H
+#define TTL_SIMULATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "TTLCodec.h"
+
+// ============================================================================
+// TTL BOX SIMULATOR - VIRTUAL KPL/TTL PUMP CONTROLLER (HOST LIBRARY)
+// ============================================================================
+// Plays the TTL box side of the RS485 bus so the gateway can be load / soak
+// tested without dispensers. Used by tools/ttl_sim.cpp (pty or serial line).
+//
+//   - Emits well-formed 32-byte pump logs for N nozzles at logsPerSec. Each
+//     log gets the next position of the 1..2046 ring and is stored, so a
+//     later [0xC8][hi][lo][cs][0xC9] request returns the same bytes.
+//   - Answers [9][ID][price][cs][10] with [7][ID][S/E][8] (ID 11..10+N, bad
+//     checksum or unknown ID → 'E') and [93][99]..[94] with [7][99][S][8].
+//   - Startup and printer frames are accepted silently.
+//   - Noise: 0xFF bursts before a log, truncated logs (still stored, so the
+//     gateway can recover them), echo of every received frame (half-duplex
+//     transceivers hear themselves) and reply delay + jitter.
+//
+// Plain C++ with an injected clock (nowMs) and a seeded PRNG, so a run with
+// the same seed and the same input produces the same byte stream.
+// ============================================================================
+
+#define TTL_SIM_MAX_NOZZLES 10
+#define TTL_SIM_LOG_RING 2046
+
+struct TTLSimConfig
+{
+  uint8_t nozzles = 4;          // 1..10, price IDs 11..10+nozzles
+  double logsPerSec = 1.0;      // Live transactions, all nozzles together (0 = none)
+  uint32_t replyDelayMs = 20;   // Box processing time before a reply / requested log
+  uint32_t replyJitterMs = 0;   // + uniform 0..jitter
+  double ffBurstProb = 0.0;     // Per live log: 1..16 bytes of 0xFF in front
+  double truncateProb = 0.0;    // Per live log: only the first 1..31 bytes go out
+  double echoProb = 0.0;        // Per received frame: echo it back immediately
+  uint32_t seed = 1;
+  uint16_t firstLogPos = 1;     // First live log position (1..2046)
+};
+
+struct TTLSimStats
+{
+  uint32_t logsEmitted;     // Live logs (truncated ones included)
+  uint32_t logsTruncated;
+  uint32_t ffBursts;
+  uint32_t echoes;
+  uint32_t logRequests;     // 0xC8 frames
+  uint32_t logRequestMiss;  // Position never written
+  uint32_t priceCommands;
+  uint32_t priceRejected;   // 'E' replies
+  uint32_t setTimes;
+  uint32_t otherFrames;     // Startup / printer
+  uint32_t badBytes;        // Bytes skipped while resyncing
+  uint64_t bytesIn;
+  uint64_t bytesOut;
+};
+
+class TTLSimulator
+{
+public:
+  explicit TTLSimulator(const TTLSimConfig &config) : cfg(config)
+  {
+    if (cfg.nozzles < 1)
+      cfg.nozzles = 1;
+    if (cfg.nozzles > TTL_SIM_MAX_NOZZLES)
+      cfg.nozzles = TTL_SIM_MAX_NOZZLES;
+    if (cfg.firstLogPos < 1 || cfg.firstLogPos > TTL_SIM_LOG_RING)
+      cfg.firstLogPos = 1;
+    rng = cfg.seed ? cfg.seed : 1;
+    memset(&stats, 0, sizeof(stats));
+    memset(stored, 0, sizeof(stored));
+    memset(nozzle, 0, sizeof(nozzle));
+    for (uint8_t i = 0; i < TTL_SIM_MAX_NOZZLES; i++)
+    {
+      nozzle[i].price = 20000 + 1000 * i;
+      nozzle[i].totalCl = 100000 * (i + 1);
+    }
+    nextPos = cfg.firstLogPos;
+    started = false;
+    nextLogMs = 0;
+    clock = {1, 1, 26, 0, 0, 0};
+  }
+
+  // Bytes from the gateway
+  void receive(const uint8_t *data, size_t len, uint32_t nowMs)
+  {
+    stats.bytesIn += len;
+    rx.insert(rx.end(), data, data + len);
+    size_t used = 0;
+    while (used < rx.size())
+    {
+      size_t n = parse(rx.data() + used, rx.size() - used, nowMs);
+      if (n == 0)
+        break; // Need more bytes
+      used += n;
+    }
+    rx.erase(rx.begin(), rx.begin() + used);
+  }
+
+  // Generate live logs due by nowMs and append every byte due by nowMs to out
+  void transmit(std::vector<uint8_t> &out, uint32_t nowMs)
+  {
+    generateLogs(nowMs);
+    size_t keep = 0;
+    for (size_t i = 0; i < pending.size(); i++)
+    {
+      Chunk &c = pending[i];
+      if ((int32_t)(nowMs - c.dueMs) >= 0)
+      {
+        out.insert(out.end(), c.bytes.begin(), c.bytes.end());
+        stats.bytesOut += c.bytes.size();
+      }
+      else
+      {
+        if (keep != i)
+          pending[keep] = c;
+        keep++;
+      }
+    }
+    pending.resize(keep);
+  }
+
+  // Milliseconds until transmit() has something new; 0xFFFFFFFF when idle
+  uint32_t msUntilNext(uint32_t nowMs) const
+  {
+    uint32_t wait = 0xFFFFFFFF;
+    for (size_t i = 0; i < pending.size(); i++)
+    {
+      int32_t d = (int32_t)(pending[i].dueMs - nowMs);
+      uint32_t w = d > 0 ? (uint32_t)d : 0;
+      if (w < wait)
+        wait = w;
+    }
+    if (cfg.logsPerSec > 0)
+    {
+      int32_t d = started ? (int32_t)(nextLogMs - nowMs) : 0;
+      uint32_t w = d > 0 ? (uint32_t)d : 0;
+      if (w < wait)
+        wait = w;
+    }
+    return wait;
+  }
+
+  uint32_t priceOf(uint8_t deviceId) const
+  {
+    return deviceId >= 11 && deviceId < 11 + cfg.nozzles ? nozzle[deviceId - 11].price : 0;
+  }
+
+  const TTLSimConfig &config() const { return cfg; }
+
+  TTLSimStats stats;
+
+private:
+  struct Chunk
+  {
+    uint32_t dueMs;
+    std::vector<uint8_t> bytes;
+  };
+
+  struct Nozzle
+  {
+    uint16_t logCot;   // Per-nozzle log counter (viTriLogCot)
+    uint16_t maLanBom; // Transaction number
+    uint32_t price;    // Set by [9][ID] commands
+    uint32_t totalCl;  // Totaliser
+  };
+
+  struct Clock
+  {
+    uint8_t ngay, thang, nam, gio, phut, giay;
+  };
+
+  // Same field names as PumpLog (structdata.h) for TTLPumpLog::encode
+  struct Log
+  {
+    uint8_t idVoi;
+    uint16_t viTriLogCot, viTriLogData, maLanBom;
+    uint32_t soLitBom;
+    uint16_t donGia;
+    uint32_t soTotalTong, soTienBom;
+    uint8_t ngay, thang, nam, gio, phut, giay;
+  };
+
+  uint32_t random()
+  {
+    // xorshift32
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+  }
+
+  bool chance(double p) { return p > 0 && (random() % 1000000) < (uint32_t)(p * 1000000); }
+
+  uint32_t replyDue(uint32_t nowMs)
+  {
+    return nowMs + cfg.replyDelayMs + (cfg.replyJitterMs ? random() % (cfg.replyJitterMs + 1) : 0);
+  }
+
+  void queue(uint32_t dueMs, const uint8_t *bytes, size_t len)
+  {
+    Chunk c;
+    c.dueMs = dueMs;
+    c.bytes.assign(bytes, bytes + len);
+    pending.push_back(c);
+  }
+
+  void reply(uint8_t deviceId, bool ok, uint32_t nowMs)
+  {
+    uint8_t frame[TTLCommandReply::kLength];
+    TTLCommandReply::encode(frame, deviceId, ok);
+    queue(replyDue(nowMs), frame, sizeof(frame));
+  }
+
+  // Frame at data[0..avail). Returns bytes consumed, 0 = incomplete.
+  size_t parse(const uint8_t *data, size_t avail, uint32_t nowMs)
+  {
+    size_t need;
+    switch (data[0])
+    {
+    case 0xC8:
+    case 0x7D:
+      need = 5;
+      break;
+    case 9:
+    case 93:
+      need = 10;
+      break;
+    case 1:
+      if (avail < 3)
+        return 0;
+      need = data[2] == 'W' ? (size_t)TTLPrinterCompany::kLength : (size_t)TTLPrinterFuel::kLength;
+      break;
+    default:
+      stats.badBytes++;
+      return 1;
+    }
+    if (avail < need)
+      return 0;
+
+    if (!frameOk(data, need))
+    {
+      stats.badBytes++;
+      return 1; // Resync on the next byte
+    }
+    if (chance(cfg.echoProb))
+    {
+      queue(nowMs, data, need);
+      stats.echoes++;
+    }
+    handle(data, nowMs);
+    return need;
+  }
+
+  bool frameOk(const uint8_t *f, size_t len) const
+  {
+    switch (f[0])
+    {
+    case 0xC8:
+      return f[4] == 0xC9 && TTLLogRequest::verify(f);
+    case 0x7D:
+      return f[4] == 0x7E && TTLStartup::verify(f);
+    case 9:
+      return f[9] == 10; // Bad checksum is answered with 'E'
+    case 93:
+      return f[1] == TTLSetTime::kBoxId && f[9] == 94 && TTLSetTime::verify(f);
+    default:
+      return f[1] == 2 && f[len - 2] == 3 && f[len - 1] == 4;
+    }
+  }
+
+  void handle(const uint8_t *f, uint32_t nowMs)
+  {
+    switch (f[0])
+    {
+    case 0xC8:
+    {
+      stats.logRequests++;
+      uint16_t pos = ttlGetU16(f + 1);
+      if (pos >= 1 && pos <= TTL_SIM_LOG_RING && stored[pos - 1][0] == 1)
+        queue(replyDue(nowMs), stored[pos - 1], TTLPumpLog::kLength);
+      else
+        stats.logRequestMiss++; // The box stays silent
+      break;
+    }
+    case 9:
+    {
+      stats.priceCommands++;
+      uint8_t id = f[1];
+      uint32_t price = 0;
+      bool ok = TTLPriceChange::decode(f, id, price) && id >= 11 && id < 11 + cfg.nozzles;
+      if (ok)
+        nozzle[id - 11].price = price;
+      else
+        stats.priceRejected++;
+      reply(f[1], ok, nowMs);
+      break;
+    }
+    case 93:
+      stats.setTimes++;
+      clock = {f[2], f[3], f[4], f[5], f[6], f[7]};
+      reply(TTLSetTime::kBoxId, true, nowMs);
+      break;
+    default:
+      stats.otherFrames++;
+      break;
+    }
+  }
+
+  void generateLogs(uint32_t nowMs)
+  {
+    if (cfg.logsPerSec <= 0)
+      return;
+    if (!started)
+    {
+      started = true;
+      nextLogMs = nowMs;
+    }
+    uint32_t periodMs = (uint32_t)(1000.0 / cfg.logsPerSec);
+    if (periodMs == 0)
+      periodMs = 1;
+    while ((int32_t)(nowMs - nextLogMs) >= 0)
+    {
+      emitLog(nextLogMs);
+      nextLogMs += periodMs;
+    }
+  }
+
+  void emitLog(uint32_t atMs)
+  {
+    uint8_t n = random() % cfg.nozzles;
+    Nozzle &z = nozzle[n];
+    Log log;
+    log.idVoi = n + 1;
+    log.viTriLogCot = ++z.logCot;
+    log.viTriLogData = nextPos;
+    log.maLanBom = ++z.maLanBom;
+    log.soLitBom = 500 + random() % 50000; // 0.5 .. 50 L in cL
+    log.donGia = (uint16_t)z.price;
+    z.totalCl += log.soLitBom;
+    log.soTotalTong = z.totalCl;
+    log.soTienBom = (uint32_t)((uint64_t)log.soLitBom * z.price / 100);
+    log.ngay = clock.ngay;
+    log.thang = clock.thang;
+    log.nam = clock.nam;
+    log.gio = clock.gio;
+    log.phut = clock.phut;
+    log.giay = clock.giay;
+
+    uint8_t frame[TTLPumpLog::kLength];
+    TTLPumpLog::encode(frame, log);
+    memcpy(stored[nextPos - 1], frame, sizeof(frame));
+    nextPos = nextPos >= TTL_SIM_LOG_RING ? 1 : nextPos + 1;
+    stats.logsEmitted++;
+
+    std::vector<uint8_t> bytes;
+    if (chance(cfg.ffBurstProb))
+    {
+      bytes.assign(1 + random() % 16, 0xFF);
+      stats.ffBursts++;
+    }
+    size_t len = TTLPumpLog::kLength;
+    if (chance(cfg.truncateProb))
+    {
+      len = 1 + random() % (TTLPumpLog::kLength - 1);
+      stats.logsTruncated++;
+    }
+    bytes.insert(bytes.end(), frame, frame + len);
+    Chunk c;
+    c.dueMs = atMs;
+    c.bytes.swap(bytes);
+    pending.push_back(c);
+  }
+
+  TTLSimConfig cfg;
+  uint32_t rng;
+  uint8_t stored[TTL_SIM_LOG_RING][TTLPumpLog::kLength]; // [0] == 1 once written
+  Nozzle nozzle[TTL_SIM_MAX_NOZZLES];
+  Clock clock;
+  uint16_t nextPos;
+  bool started;
+  uint32_t nextLogMs;
+  std::vector<uint8_t> rx;
+  std::vector<Chunk> pending;
+};
+
+#endif // TTL_SIMULATOR_H
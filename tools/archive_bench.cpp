@@ -0,0 +1,541 @@
+// ============================================================================
+// LOG ARCHIVE BENCHMARK - HOST TOOL
+// ============================================================================
+// Feeds LogArchive.h with a realistic log stream (TTLSimulator model: 4
+// nozzles, per-nozzle price / counters / running total, 0.5 .. 50 L per
+// sale, [logs per day] sales a day, occasional price changes, frame bytes
+// as ganLog() leaves them) on a RAM flash of 12 x 16 KB (the "/ar" files on
+// the device) and reports:
+//   - compression: archived bytes per log (block + segment headers included)
+//     against the 40-byte packed record and the 48-byte raw struct
+//   - codec cost: encode / decode ns per record (host CPU)
+//   - get(id) cost: random ids (one block read + decode) and sequential ids
+//   - retention: logs and days kept in 192 KB and in the 0xA0000 partition
+//   - date range queries (one day, one day + nozzle, a week): blocks read
+//     against a full scan, time per query, results equal to a brute-force
+//     filter, paged resume (50 logs per page, as RequestLogByDate) complete
+//   - cold tier: a small hot archive whose dropped segments move to a
+//     second one (the partition archive + /ac files on the device)
+// and checks: every id still on the medium reads back field-for-field
+// equal, dropped ids miss, a re-mount sees the same records, a torn tail
+// block loses only that block, late / duplicate positions are skipped,
+// reads and date queries span both tiers once per id, also after a move
+// that was cut short (segment left in both tiers), seeding from a ring that
+// has wrapped (legacy /log.bin import) numbers the logs in time order.
+//
+// Build:  g++ -std=c++17 -O2 -Iinclude -o archive_bench tools/archive_bench.cpp
+// Usage:  archive_bench [logs] [logs per day]   (default 40000 300)
+// ============================================================================
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "LogArchive.h"
+
+static const uint8_t kSegments = 12;
+static const uint32_t kSegmentSize = 16384;
+static const uint32_t kRawStruct = 48; // sizeof(PumpLog) on the ESP32
+
+class RamFlash : public JournalMedium
+{
+public:
+  RamFlash(uint8_t segments, uint32_t segSize) : count(segments), size(segSize), data(segments * segSize, 0xFF) {}
+
+  uint32_t segmentSize() const override { return size; }
+  uint8_t segmentCount() const override { return count; }
+
+  bool read(uint8_t seg, uint32_t off, void *buf, size_t len) override
+  {
+    memcpy(buf, &data[seg * size + off], len);
+    reads++;
+    return true;
+  }
+
+  bool program(uint8_t seg, uint32_t off, const void *buf, size_t len) override
+  {
+    if (tearAfter >= 0 && (size_t)tearAfter < len)
+      len = (size_t)tearAfter; // Simulated power cut
+    uint8_t *p = &data[seg * size + off];
+    for (size_t i = 0; i < len; i++)
+    {
+      if (p[i] != 0xFF)
+      {
+        fprintf(stderr, "program over non-erased byte seg %u off %zu\n", seg, off + i);
+        exit(1);
+      }
+    }
+    memcpy(p, buf, len);
+    return tearAfter < 0;
+  }
+
+  bool erase(uint8_t seg) override
+  {
+    memset(&data[seg * size], 0xFF, size);
+    return true;
+  }
+
+  uint8_t count;
+  uint32_t size;
+  std::vector<uint8_t> data;
+  uint64_t reads = 0;
+  long tearAfter = -1;
+};
+
+static uint32_t rng = 12345;
+static uint32_t nextRandom()
+{
+  rng ^= rng << 13;
+  rng ^= rng >> 17;
+  rng ^= rng << 5;
+  return rng;
+}
+
+// PumpLog as laid out by the ESP32 toolchain (structdata.h, 32-bit time_t)
+struct HostPumpLog
+{
+  uint8_t send1, send2, idVoi;
+  uint16_t viTriLogCot, viTriLogData, maLanBom;
+  uint32_t soLitBom;
+  uint16_t donGia;
+  uint32_t soTotalTong, soTienBom;
+  uint8_t ngay, thang, nam, gio, phut, giay;
+  uint16_t send3;
+  uint8_t checksum, send4;
+  uint16_t cycleSave;
+  uint8_t mqttSent;
+  int32_t mqttSentTime;
+};
+static_assert(sizeof(HostPumpLog) == kRawStruct, "Host mirror must match the ESP32 layout");
+
+static bool sameLog(const HostPumpLog &a, const HostPumpLog &b)
+{
+  uint8_t ra[PumpLogRecord::kLength], rb[PumpLogRecord::kLength];
+  PumpLogRecord::encode(ra, a);
+  PumpLogRecord::encode(rb, b);
+  return memcmp(ra, rb, sizeof(ra)) == 0;
+}
+
+// Log stream as the TTL box produces it, one sale at a time
+class LogStream
+{
+public:
+  explicit LogStream(uint32_t perDay) : meanGap(86400 / perDay ? 86400 / perDay : 1)
+  {
+    for (uint8_t i = 0; i < 4; i++)
+    {
+      noz[i].price = (uint16_t)(20000 + 1000 * i);
+      noz[i].total = 1000000 + nextRandom() % 100000000;
+      noz[i].cot = (uint16_t)(nextRandom() % 2046);
+      noz[i].lan = (uint16_t)nextRandom();
+    }
+  }
+
+  HostPumpLog next()
+  {
+    secs += meanGap / 10 + nextRandom() % (meanGap * 9 / 5 + 1);
+    while (secs >= 86400)
+    {
+      secs -= 86400;
+      nextDay();
+    }
+    if (nextRandom() % 2000 == 0) // Price change on every nozzle
+    {
+      for (uint8_t i = 0; i < 4; i++)
+        noz[i].price = (uint16_t)(noz[i].price + 100 * (nextRandom() % 11) - 500);
+    }
+    uint8_t n = nextRandom() % 4;
+    Nozzle &z = noz[n];
+    HostPumpLog log;
+    memset(&log, 0, sizeof(log));
+    log.idVoi = 11 + 3 * n; // 11, 14, 17, 20: both halves of the block nozzle mask
+    log.viTriLogCot = z.cot = z.cot >= 2046 ? 1 : z.cot + 1;
+    log.viTriLogData = pos;
+    pos = pos >= LOG_ARCHIVE_RING ? 1 : pos + 1;
+    log.maLanBom = ++z.lan;
+    log.soLitBom = 500 + nextRandom() % 50000;
+    log.donGia = z.price;
+    z.total += log.soLitBom;
+    log.soTotalTong = z.total;
+    log.soTienBom = (uint32_t)((uint64_t)log.soLitBom * z.price / 100);
+    log.ngay = day;
+    log.thang = month;
+    log.nam = year;
+    log.gio = (uint8_t)(secs / 3600);
+    log.phut = (uint8_t)(secs / 60 % 60);
+    log.giay = (uint8_t)(secs % 60);
+
+    // Fields as handlePumpLogFrame() fills them from the frame
+    uint8_t frame[TTLPumpLog::kLength];
+    TTLPumpLog::encode(frame, log);
+    log.send1 = frame[0];
+    log.send2 = frame[1];
+    log.checksum = frame[29];
+    log.send3 = frame[TTLPumpLog::kChecksumPos];
+    log.send4 = frame[31];
+    if (nextRandom() % 10 == 0) // Already delivered when it was committed
+    {
+      log.mqttSent = 1;
+      log.mqttSentTime = (int32_t)(1790000000 + day * 86400 + secs + nextRandom() % 5);
+    }
+    return log;
+  }
+
+private:
+  struct Nozzle
+  {
+    uint16_t price, cot, lan;
+    uint32_t total;
+  };
+
+  void nextDay()
+  {
+    if (++day > 28)
+    {
+      day = 1;
+      if (++month > 12)
+      {
+        month = 1;
+        year++;
+      }
+    }
+  }
+
+  Nozzle noz[4];
+  uint32_t meanGap;
+  uint16_t pos = 1;
+  uint32_t secs = 6 * 3600;
+  uint8_t day = 1, month = 1, year = 26;
+};
+
+static int failures = 0;
+static void check(bool ok, const char *what)
+{
+  if (!ok)
+  {
+    failures++;
+    printf("  FAILED: %s\n", what);
+  }
+}
+
+// Codec only: encode / decode a block-sized run of records in RAM
+static void codecCost(const std::vector<HostPumpLog> &logs)
+{
+  const size_t n = logs.size() < 20000 ? logs.size() : 20000;
+  std::vector<uint8_t> buf(n * LogArchiveCodec::kMaxRecord);
+  size_t bytes = 0;
+  auto t0 = std::chrono::steady_clock::now();
+  for (int rep = 0; rep < 10; rep++)
+  {
+    LogArchiveCodec::State st;
+    bytes = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+      if (i % LOG_ARCHIVE_BLOCK_RECORDS == 0)
+        st.reset((uint32_t)i + 1);
+      bytes += LogArchiveCodec::encode(st, (uint32_t)i + 1, logs[i], &buf[bytes]);
+    }
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  HostPumpLog out;
+  uint32_t id = 0;
+  bool ok = true;
+  for (int rep = 0; rep < 10; rep++)
+  {
+    LogArchiveCodec::State st;
+    const uint8_t *p = buf.data(), *end = buf.data() + bytes;
+    for (size_t i = 0; i < n && ok; i++)
+    {
+      if (i % LOG_ARCHIVE_BLOCK_RECORDS == 0)
+        st.reset((uint32_t)i + 1);
+      ok = LogArchiveCodec::decode(st, p, end, id, out);
+    }
+  }
+  auto t2 = std::chrono::steady_clock::now();
+  check(ok, "codec decode");
+  double enc = std::chrono::duration<double, std::nano>(t1 - t0).count() / (10.0 * n);
+  double dec = std::chrono::duration<double, std::nano>(t2 - t1).count() / (10.0 * n);
+  printf("Codec (host CPU): %.1f B/record payload, encode %.0f ns/record, decode %.0f ns/record\n",
+         (double)bytes / n, enc, dec);
+}
+
+// Date range queries against a brute-force filter of the kept logs
+// Hot archive of 6 segments over a cold tier of 12: every id of either tier reads
+// back, queries see each id once, oldest first; then the same after a power cut
+// between the copy to the cold tier and the erase of the hot segment
+static void coldTier(const std::vector<HostPumpLog> &logs)
+{
+  RamFlash hotFlash(6, kSegmentSize), coldFlash(12, kSegmentSize);
+  LogArchive<HostPumpLog> hot(hotFlash), cold(coldFlash);
+  check(hot.begin() && cold.begin(), "tiers begin");
+  hot.setColdTier(&cold);
+  RamFlash beforeMove = hotFlash, afterMove = coldFlash;
+  bool movedOnce = false;
+  for (uint32_t i = 0; i < logs.size(); i++)
+  {
+    if (!movedOnce)
+      beforeMove = hotFlash;
+    uint32_t moved = hot.stats.segmentsMoved;
+    check(hot.append(logs[i]), "tiered append");
+    if (!movedOnce && hot.stats.segmentsMoved != moved)
+    {
+      movedOnce = true;
+      afterMove = coldFlash;
+    }
+  }
+  check(hot.flush(), "tiered flush");
+
+  auto verify = [&](LogArchive<HostPumpLog> &h, LogArchive<HostPumpLog> &c, const char *what) {
+    uint32_t first = c.count() ? c.firstId() : h.firstId(), last = h.lastId();
+    HostPumpLog out;
+    uint32_t bad = 0;
+    for (uint32_t id = first; id <= last; id++)
+    {
+      if (!h.get(id, out) || !sameLog(out, logs[id - 1]))
+        bad++;
+    }
+    uint32_t expect = first, seen = 0;
+    h.forEachInDays(0, 0xFFFF, LogArchive<HostPumpLog>::kAnyNozzle, 0, [&](uint32_t id, const HostPumpLog &) {
+      bad += id == expect ? 0 : 1;
+      expect = id + 1;
+      seen++;
+      return true;
+    });
+    check(bad == 0 && seen == last - first + 1, what);
+    return last - first + 1;
+  };
+  uint32_t kept = verify(hot, cold, "tiered get() / query span both tiers once");
+  printf("Cold tier: hot 6 x 16 KB + cold 12 x 16 KB keep %u logs (hot alone %u), %u segments moved, "
+         "%u dropped for good\n",
+         kept, hot.count(), hot.stats.segmentsMoved, cold.stats.segmentsDropped);
+
+  // Power cut after the first move: the segment is in both tiers until the hot one is dropped again
+  if (movedOnce)
+  {
+    LogArchive<HostPumpLog> h(beforeMove), c(afterMove);
+    check(h.begin() && c.begin(), "re-mount after a cut move");
+    h.setColdTier(&c);
+    verify(h, c, "cut move: each id once");
+    for (uint32_t i = h.lastId(); i < logs.size(); i++)
+      h.append(logs[i]);
+    h.flush();
+    verify(h, c, "repeated move: each id once");
+  }
+}
+
+static void dateQueries(LogArchive<HostPumpLog> &archive, const std::vector<HostPumpLog> &logs, uint32_t first,
+                        uint32_t last, uint32_t perDay)
+{
+  uint32_t full = archive.stats.blockReads;
+  archive.forEachInDays(0, 0xFFFF, LogArchive<HostPumpLog>::kAnyNozzle, 0, [](uint32_t, const HostPumpLog &) { return true; });
+  full = archive.stats.blockReads - full;
+
+  uint32_t mid = first + (last - first) / 2;
+  uint32_t weekEnd = mid + 7 * perDay < last ? mid + 7 * perDay : last;
+  uint16_t day = LogArchiveCodec::dayOf(logs[mid - 1]);
+  struct
+  {
+    const char *name;
+    uint16_t from, to;
+    uint8_t idVoi;
+  } cases[3] = {{"1 day", day, day, LogArchive<HostPumpLog>::kAnyNozzle},
+                {"1 day, nozzle 17", day, day, 17},
+                {"7 days", day, LogArchiveCodec::dayOf(logs[weekEnd - 1]), LogArchive<HostPumpLog>::kAnyNozzle}};
+  printf("Date queries (full scan = %u block reads):\n", full);
+  for (auto &c : cases)
+  {
+    std::vector<uint32_t> expect, got, paged;
+    for (uint32_t id = first; id <= last; id++)
+    {
+      uint16_t d = LogArchiveCodec::dayOf(logs[id - 1]);
+      if (d >= c.from && d <= c.to && (c.idVoi == 0 || logs[id - 1].idVoi == c.idVoi))
+        expect.push_back(id);
+    }
+    uint32_t reads = archive.stats.blockReads;
+    bool exact = true;
+    auto t0 = std::chrono::steady_clock::now();
+    archive.forEachInDays(c.from, c.to, c.idVoi, 0, [&](uint32_t id, const HostPumpLog &log) {
+      exact = exact && sameLog(log, logs[id - 1]);
+      got.push_back(id);
+      return true;
+    });
+    auto t1 = std::chrono::steady_clock::now();
+    reads = archive.stats.blockReads - reads;
+    for (uint32_t from = 0;;)
+    {
+      uint32_t n = 0;
+      archive.forEachInDays(c.from, c.to, c.idVoi, from, [&](uint32_t id, const HostPumpLog &) {
+        paged.push_back(id);
+        from = id + 1;
+        return ++n < 50;
+      });
+      if (n < 50)
+        break;
+    }
+    check(exact && got == expect, "date query matches brute force");
+    check(paged == expect, "paged date query complete");
+    printf("  %-16s %5zu logs, %3u of %u blocks read, %.0f us\n", c.name, got.size(), reads, full,
+           std::chrono::duration<double, std::micro>(t1 - t0).count());
+  }
+}
+
+// Empty archive seeded from a 2046-slot ring that has wrapped: slots 1..k hold
+// the newest logs. The newest must come from the time stamps, not the slot order.
+static void seedWrappedRing(const std::vector<HostPumpLog> &logs)
+{
+  const uint32_t n = LOG_ARCHIVE_RING + 700;
+  if (logs.size() <= n)
+    return;
+  std::vector<HostPumpLog> ring(LOG_ARCHIVE_RING + 1);
+  for (uint32_t i = 0; i < n; i++)
+    ring[logs[i].viTriLogData] = logs[i];
+  auto read = [&ring](uint16_t pos, HostPumpLog &log) {
+    log = ring[pos];
+    return true;
+  };
+
+  RamFlash flash(kSegments, kSegmentSize);
+  LogArchive<HostPumpLog> archive(flash);
+  archive.begin();
+  check(archive.seedFromRing(read) == LOG_ARCHIVE_RING, "seed from wrapped ring: every slot archived");
+  bool ordered = true;
+  HostPumpLog prev = {}, log = {};
+  for (uint32_t id = archive.firstId(); id <= archive.lastId(); id++)
+  {
+    ordered = ordered && archive.get(id, log) &&
+              (id == archive.firstId() || LogArchiveCodec::stampOf(log) >= LogArchiveCodec::stampOf(prev));
+    prev = log;
+  }
+  check(ordered, "seed from wrapped ring: IDs in time order");
+  check(archive.get(archive.lastId(), log) && sameLog(log, logs[n - 1]), "seed from wrapped ring: newest log last");
+  check(archive.idFor(logs[n].viTriLogData) == archive.lastId() + 1, "seed from wrapped ring: next log continues");
+
+  // Slot order (a head taken from the last slot written by an import) gets it wrong
+  RamFlash flash2(kSegments, kSegmentSize);
+  LogArchive<HostPumpLog> bySlot(flash2);
+  bySlot.begin();
+  bySlot.seedFromRing(read, LOG_ARCHIVE_RING);
+  check(!bySlot.get(bySlot.lastId(), log) || !sameLog(log, logs[n - 1]), "seed in slot order misplaces the newest log");
+}
+
+int main(int argc, char **argv)
+{
+  uint32_t total = argc > 1 ? (uint32_t)strtoul(argv[1], nullptr, 10) : 40000;
+  uint32_t perDay = argc > 2 ? (uint32_t)strtoul(argv[2], nullptr, 10) : 300;
+  if (total < 100)
+    total = 100;
+  if (perDay == 0)
+    perDay = 1;
+
+  LogStream stream(perDay);
+  std::vector<HostPumpLog> logs(total);
+  for (uint32_t i = 0; i < total; i++)
+    logs[i] = stream.next();
+
+  RamFlash flash(kSegments, kSegmentSize);
+  LogArchive<HostPumpLog> archive(flash);
+  check(archive.begin(), "begin on blank medium");
+
+  // Append everything; re-mount halfway (pending block lost, like a reboot before a flush)
+  uint32_t lostAtRemount = 0;
+  bool remounted = false;
+  for (uint32_t i = 0; i < total; i++)
+  {
+    if (i == total / 2 && !remounted)
+    {
+      remounted = true;
+      lostAtRemount = archive.pending();
+      LogArchiveStats keep = archive.stats;
+      archive.begin();
+      archive.stats = keep;
+      i -= lostAtRemount; // The journal catch-up replays them
+    }
+    check(archive.append(logs[i]), "append");
+  }
+  check(archive.flush(), "flush");
+  HostPumpLog dup = logs[total - 1], late = logs[total - 100];
+  check(!archive.append(dup) && !archive.append(late), "duplicate / late log skipped");
+
+  uint32_t first = archive.firstId(), last = archive.lastId();
+  check(last == total, "last id = logs appended");
+  printf("Workload: %u logs (%.1f ring laps), %u per day, %u x %u KB archive\n", total,
+         (double)total / LOG_ARCHIVE_RING, perDay, kSegments, kSegmentSize / 1024);
+
+  // Every surviving id reads back exact; dropped ids miss
+  HostPumpLog out;
+  uint32_t bad = 0;
+  auto t0 = std::chrono::steady_clock::now();
+  for (uint32_t id = first; id <= last; id++)
+  {
+    if (!archive.get(id, out) || !sameLog(out, logs[id - 1]))
+      bad++;
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  check(bad == 0, "sequential get() round trip");
+  check(first == 1 || !archive.get(first - 1, out), "dropped id misses");
+  const uint32_t randomGets = 20000;
+  uint32_t blockReads = archive.stats.blockReads;
+  for (uint32_t i = 0; i < randomGets; i++)
+  {
+    uint32_t id = first + nextRandom() % (last - first + 1);
+    if (!archive.get(id, out) || !sameLog(out, logs[id - 1]))
+      bad++;
+  }
+  auto t2 = std::chrono::steady_clock::now();
+  check(bad == 0, "random get() round trip");
+
+  uint32_t kept = last - first + 1;
+  double perLog = (double)archive.bytesUsed() / archive.count();
+  printf("Archive: ids %u..%u kept (%u logs), %u segments dropped, %.1f B/log on flash\n", first, last, kept,
+         archive.stats.segmentsDropped, perLog);
+  printf("Compression: %.2fx vs 40 B packed record, %.2fx vs 48 B raw struct\n", 40.0 / perLog, kRawStruct / perLog);
+  codecCost(logs);
+  printf("get(): sequential %.2f us/log, random %.2f us/log (%.2f block reads per get)\n",
+         std::chrono::duration<double, std::micro>(t1 - t0).count() / kept,
+         std::chrono::duration<double, std::micro>(t2 - t1).count() / randomGets,
+         (double)(archive.stats.blockReads - blockReads) / randomGets);
+
+  dateQueries(archive, logs, first, last, perDay);
+  coldTier(logs);
+  seedWrappedRing(logs);
+
+  // Re-mount sees the same records
+  LogArchive<HostPumpLog> again(flash);
+  check(again.begin() && again.firstId() == first && again.lastId() == last && again.count() == kept,
+        "re-mount index");
+
+  // Torn tail: cut the next block write, re-mount, older logs intact
+  {
+    RamFlash copy = flash;
+    LogArchive<HostPumpLog> a(copy);
+    a.begin();
+    HostPumpLog extra = logs[total - 1];
+    for (uint32_t k = 0; k < 10; k++)
+    {
+      extra.viTriLogData = extra.viTriLogData >= LOG_ARCHIVE_RING ? 1 : extra.viTriLogData + 1;
+      a.append(extra);
+    }
+    copy.tearAfter = 30;
+    a.flush();
+    copy.tearAfter = -1;
+    LogArchive<HostPumpLog> b(copy);
+    check(b.begin() && b.lastId() == last && b.stats.tornTails == 1, "torn tail dropped");
+    check(b.get(last, out) && sameLog(out, logs[last - 1]), "log before the torn tail intact");
+  }
+
+  // Retention: what the same bytes per log buy
+  printf("Retention at %u logs/day (ring = 2046 logs = %.1f days):\n", perDay, 2046.0 / perDay);
+  const uint32_t sizes[3] = {(uint32_t)kSegments * kSegmentSize, 0xA0000 - 0x40000, 0xA0000 - 0x40000 + 24 * kSegmentSize};
+  const char *names[3] = {"192 KB (/ar files)", "384 KB partition", "+ 384 KB /ac cold"};
+  for (int i = 0; i < 3; i++)
+  {
+    double archived = sizes[i] * ((double)kSegments - 1) / kSegments / perLog; // One segment in flight
+    printf("  %-20s packed 40 B: %7u logs %6.1f days | archive: %7.0f logs %6.1f days\n", names[i], sizes[i] / 40,
+           sizes[i] / 40.0 / perDay, archived, archived / perDay);
+  }
+
+  printf("Remount lost %u pending logs (replayed); checks: %s\n", lostAtRemount, failures ? "FAILED" : "all passed");
+  return failures ? 1 : 0;
+}
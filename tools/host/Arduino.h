@@ -0,0 +1,10 @@
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+// Host builds of firmware headers (tools/): the little of Arduino.h they use
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#endif // HOST_ARDUINO_H
@@ -0,0 +1,229 @@
+#ifndef HOST_LITTLEFS_H
+#define HOST_LITTLEFS_H
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "Arduino.h"
+#include "lfs.h" // tools/littlefs (-Itools/littlefs)
+
+// ============================================================================
+// LITTLEFS FOR HOST TOOLS - ARDUINO FILE API ON THE REAL LITTLEFS CODE
+// ============================================================================
+// The subset of the Arduino LittleFS API the firmware's file paths use
+// (open / exists / remove, File read / write / seek / size / flush / close),
+// implemented on littlefs itself over a RAM block device with the geometry
+// of the "spiffs" partition LittleFS is mounted on (0xB0000 = 176 x 4 KB
+// blocks) and esp_littlefs' default sizes (read / prog 128 B, cache 512 B,
+// lookahead 128 B, block_cycles 512).
+//
+// Modes as the ESP32 VFS maps them: "r", "r+", "w", "w+", "a". flush() is
+// lfs_file_sync, like fsync on the device.
+//
+// The block device counts what littlefs asks of the flash: NOR page
+// programs (256 B pages touched per prog), block erases and bytes read.
+// ============================================================================
+
+enum SeekMode
+{
+  SeekSet = 0,
+  SeekCur = 1,
+  SeekEnd = 2
+};
+
+namespace fs
+{
+
+class File
+{
+public:
+  File() {}
+
+  explicit operator bool() const { return h && h->open; }
+
+  size_t write(const uint8_t *buf, size_t len)
+  {
+    if (!*this)
+      return 0;
+    lfs_ssize_t n = lfs_file_write(h->lfs, &h->file, buf, (lfs_size_t)len);
+    return n < 0 ? 0 : (size_t)n;
+  }
+  size_t write(uint8_t b) { return write(&b, 1); }
+
+  size_t read(uint8_t *buf, size_t len)
+  {
+    if (!*this)
+      return 0;
+    lfs_ssize_t n = lfs_file_read(h->lfs, &h->file, buf, (lfs_size_t)len);
+    return n < 0 ? 0 : (size_t)n;
+  }
+
+  bool seek(uint32_t pos, SeekMode mode = SeekSet)
+  {
+    return *this && lfs_file_seek(h->lfs, &h->file, (lfs_soff_t)pos, (int)mode) >= 0;
+  }
+
+  size_t size() const
+  {
+    if (!*this)
+      return 0;
+    lfs_soff_t n = lfs_file_size(h->lfs, &h->file);
+    return n < 0 ? 0 : (size_t)n;
+  }
+
+  void flush()
+  {
+    if (*this)
+      lfs_file_sync(h->lfs, &h->file);
+  }
+
+  void close() { h.reset(); }
+
+private:
+  friend class FS;
+
+  struct Handle
+  {
+    lfs_t *lfs;
+    lfs_file_t file;
+    bool open;
+    ~Handle()
+    {
+      if (open)
+        lfs_file_close(lfs, &file);
+    }
+  };
+
+  std::shared_ptr<Handle> h; // Copies share the open file, like the Arduino File
+};
+
+class FS
+{
+public:
+  enum : uint32_t
+  {
+    kBlockSize = 4096,
+    kBlockCount = 0xB0000 / 4096,
+    kPage = 256
+  };
+
+  FS() : data((size_t)kBlockCount * kBlockSize, 0xFF), mounted(false)
+  {
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.context = this;
+    cfg.read = bdRead;
+    cfg.prog = bdProg;
+    cfg.erase = bdErase;
+    cfg.sync = bdSync;
+    cfg.read_size = 128;
+    cfg.prog_size = 128;
+    cfg.block_size = kBlockSize;
+    cfg.block_count = kBlockCount;
+    cfg.block_cycles = 512;
+    cfg.cache_size = 512;
+    cfg.lookahead_size = 128;
+  }
+
+  bool begin(bool formatOnFail = false)
+  {
+    if (mounted)
+      return true;
+    if (lfs_mount(&lfs, &cfg) != 0 && (!formatOnFail || lfs_format(&lfs, &cfg) != 0 || lfs_mount(&lfs, &cfg) != 0))
+      return false;
+    mounted = true;
+    return true;
+  }
+
+  void end()
+  {
+    if (mounted)
+      lfs_unmount(&lfs);
+    mounted = false;
+  }
+
+  // Erase the whole device (all files gone) and format it
+  bool format()
+  {
+    end();
+    std::fill(data.begin(), data.end(), 0xFF);
+    return lfs_format(&lfs, &cfg) == 0;
+  }
+
+  File open(const char *path, const char *mode = "r")
+  {
+    File f;
+    if (!mounted)
+      return f;
+    int flags = LFS_O_RDONLY;
+    if (!strcmp(mode, "r+"))
+      flags = LFS_O_RDWR;
+    else if (!strcmp(mode, "w"))
+      flags = LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC;
+    else if (!strcmp(mode, "w+"))
+      flags = LFS_O_RDWR | LFS_O_CREAT | LFS_O_TRUNC;
+    else if (!strcmp(mode, "a"))
+      flags = LFS_O_WRONLY | LFS_O_CREAT | LFS_O_APPEND;
+    std::shared_ptr<File::Handle> h(new File::Handle());
+    h->lfs = &lfs;
+    h->open = lfs_file_open(&lfs, &h->file, path, flags) == 0;
+    if (h->open)
+      f.h = h;
+    return f;
+  }
+
+  bool exists(const char *path)
+  {
+    struct lfs_info info;
+    return mounted && lfs_stat(&lfs, path, &info) == 0;
+  }
+
+  bool remove(const char *path) { return mounted && lfs_remove(&lfs, path) == 0; }
+
+  uint64_t pages = 0;     // NOR page programs
+  uint64_t erases = 0;    // Block (sector) erases
+  uint64_t readBytes = 0;
+
+private:
+  static int bdRead(const struct lfs_config *c, lfs_block_t block, lfs_off_t off, void *buf, lfs_size_t size)
+  {
+    FS *fs = (FS *)c->context;
+    memcpy(buf, &fs->data[(size_t)block * kBlockSize + off], size);
+    fs->readBytes += size;
+    return 0;
+  }
+
+  static int bdProg(const struct lfs_config *c, lfs_block_t block, lfs_off_t off, const void *buf, lfs_size_t size)
+  {
+    FS *fs = (FS *)c->context;
+    uint8_t *p = &fs->data[(size_t)block * kBlockSize + off];
+    const uint8_t *src = (const uint8_t *)buf;
+    for (lfs_size_t i = 0; i < size; i++)
+      p[i] &= src[i]; // NOR: programming only clears bits
+    fs->pages += size ? (off + size - 1) / kPage - off / kPage + 1 : 0;
+    return 0;
+  }
+
+  static int bdErase(const struct lfs_config *c, lfs_block_t block)
+  {
+    FS *fs = (FS *)c->context;
+    memset(&fs->data[(size_t)block * kBlockSize], 0xFF, kBlockSize);
+    fs->erases++;
+    return 0;
+  }
+
+  static int bdSync(const struct lfs_config *) { return 0; }
+
+  std::vector<uint8_t> data;
+  struct lfs_config cfg;
+  lfs_t lfs;
+  bool mounted;
+};
+
+} // namespace fs
+
+using fs::File;
+
+inline fs::FS LittleFS;
+
+#endif // HOST_LITTLEFS_H
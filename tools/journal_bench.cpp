@@ -0,0 +1,428 @@
+// ============================================================================
+// LOG JOURNAL BENCHMARK - HOST TOOL
+// ============================================================================
+// Runs LogJournal.h on a RAM flash (4 KB erase sectors, 256 B program pages,
+// erased = 0xFF, programming a non-erased byte is an error) and compares it
+// with the old fixed-slot /log.bin scheme for the same workload:
+//   N transactions (one PumpLog each, slots 1..2046 in order) plus a
+//   fraction of MQTT status updates on random stored slots. log.bin held the
+//   raw 48-byte struct; the journal stores the packed 40-byte PumpLogRecord.
+//
+// Flash cost models (per write; littlefs 4 KB blocks):
+//   legacy   seek + overwrite inside log.bin. littlefs cannot modify a file in
+//            place: the block holding the record and every block after it up
+//            to the end of the file are copied to fresh blocks on close.
+//   jfs      journal on LittleFS files, open / append / close per record: the
+//            partly filled last block of the segment file is copied once.
+//   jfs-gc   same files kept open, one sync per group commit of
+//            LOG_COMMIT_BATCH (16) records, as storageTask does under load.
+//   jraw     journal on the raw medium: exactly what RamFlash counted.
+// Every file close / sync also commits one metadata entry (~64 B).
+// Device time estimate: 0.7 ms per 256 B page program, 45 ms per 4 KB sector
+// erase (typical W25Q32 figures), CPU time ignored.
+//
+// Also checks crash consistency: the image is cut mid-record at random
+// points, re-mounted, and every slot must read back the old or the new value;
+// and the PumpLogRecord codec: round trip, then the space 2046 logs take in
+// each record format and what that means for the 0xA0000 littlefs partition.
+//
+// Build:  g++ -std=c++17 -O2 -Iinclude -o journal_bench tools/journal_bench.cpp
+// Usage:  journal_bench [transactions] [status-update ratio]   (default 20000 0.2)
+// ============================================================================
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "LogJournal.h"
+#include "PumpLogRecord.h"
+
+static const uint32_t kSector = 4096;
+static const uint32_t kPage = 256;
+static const uint32_t kLegacyRecord = 48; // sizeof(PumpLog) on the ESP32 (padded, 32-bit time_t)
+static const uint32_t kRecord = PumpLogRecord::kLength;
+static const uint32_t kMetaCommit = 64;
+static const uint32_t kGroupCommit = 16; // LOG_COMMIT_BATCH in main.cpp
+static const double kPageMs = 0.7;
+static const double kEraseMs = 45.0;
+
+class RamFlash : public JournalMedium
+{
+public:
+  RamFlash(uint8_t segments, uint32_t segSize) : count(segments), size(segSize), data(segments * segSize, 0xFF) {}
+
+  uint32_t segmentSize() const override { return size; }
+  uint8_t segmentCount() const override { return count; }
+
+  bool read(uint8_t seg, uint32_t off, void *buf, size_t len) override
+  {
+    memcpy(buf, &data[seg * size + off], len);
+    return true;
+  }
+
+  bool program(uint8_t seg, uint32_t off, const void *buf, size_t len) override
+  {
+    if (tearAfter >= 0 && (size_t)tearAfter < len)
+    {
+      len = (size_t)tearAfter; // Simulated power cut
+      torn = true;
+    }
+    uint8_t *p = &data[seg * size + off];
+    for (size_t i = 0; i < len; i++)
+    {
+      if (p[i] != 0xFF)
+      {
+        fprintf(stderr, "program over non-erased byte seg %u off %zu\n", seg, off + i);
+        exit(1);
+      }
+    }
+    memcpy(p, buf, len);
+    programmed += len;
+    pages += len ? (off + len - 1) / kPage - off / kPage + 1 : 0;
+    return !torn;
+  }
+
+  bool erase(uint8_t seg) override
+  {
+    memset(&data[seg * size], 0xFF, size);
+    sectorErases += size / kSector;
+    return true;
+  }
+
+  uint8_t count;
+  uint32_t size;
+  std::vector<uint8_t> data;
+  uint64_t programmed = 0;
+  uint64_t pages = 0;
+  uint64_t sectorErases = 0;
+  long tearAfter = -1; // >= 0: next program() stops after this many bytes
+  bool torn = false;
+};
+
+struct Cost
+{
+  uint64_t bytes = 0;
+  uint64_t pages = 0;
+  uint64_t erases = 0;
+
+  void add(uint64_t programBytes)
+  {
+    bytes += programBytes;
+    pages += (programBytes + kPage - 1) / kPage;
+  }
+  double deviceMs() const { return pages * kPageMs + erases * kEraseMs; }
+};
+
+static uint32_t rng = 12345;
+static uint32_t nextRandom()
+{
+  rng ^= rng << 13;
+  rng ^= rng >> 17;
+  rng ^= rng << 5;
+  return rng;
+}
+
+// PumpLog as laid out by the ESP32 toolchain (structdata.h, 32-bit time_t)
+struct HostPumpLog
+{
+  uint8_t send1, send2, idVoi;
+  uint16_t viTriLogCot, viTriLogData, maLanBom;
+  uint32_t soLitBom;
+  uint16_t donGia;
+  uint32_t soTotalTong, soTienBom;
+  uint8_t ngay, thang, nam, gio, phut, giay;
+  uint16_t send3;
+  uint8_t checksum, send4;
+  uint16_t cycleSave;
+  uint8_t mqttSent;
+  int32_t mqttSentTime;
+};
+static_assert(sizeof(HostPumpLog) == kLegacyRecord, "Host mirror must match the ESP32 layout");
+
+static HostPumpLog hostLog(uint16_t slot, uint32_t tx)
+{
+  HostPumpLog log;
+  memset(&log, 0, sizeof(log));
+  log.send1 = 1;
+  log.send2 = 2;
+  log.idVoi = (uint8_t)(1 + tx % 4);
+  log.viTriLogCot = (uint16_t)nextRandom();
+  log.viTriLogData = slot;
+  log.maLanBom = (uint16_t)tx;
+  log.soLitBom = tx; // Read back by the checks below
+  log.donGia = (uint16_t)nextRandom();
+  log.soTotalTong = nextRandom();
+  log.soTienBom = nextRandom();
+  log.ngay = 17;
+  log.thang = 10;
+  log.nam = 26;
+  log.gio = (uint8_t)(tx % 24);
+  log.phut = (uint8_t)(tx % 60);
+  log.giay = (uint8_t)(nextRandom() % 60);
+  log.send3 = 3;
+  log.checksum = (uint8_t)nextRandom();
+  log.send4 = 4;
+  log.mqttSent = (uint8_t)(tx & 1);
+  log.mqttSentTime = (int32_t)(1700000000 + tx);
+  return log;
+}
+
+// Packed record for `slot`; tx comes back from bytes 9..12 (soLitBom, little-endian)
+static void makeLog(uint8_t *p, uint16_t slot, uint32_t tx)
+{
+  uint8_t (&out)[PumpLogRecord::kLength] = *reinterpret_cast<uint8_t(*)[PumpLogRecord::kLength]>(p);
+  PumpLogRecord::encode(out, hostLog(slot, tx));
+}
+
+static void report(const char *name, const Cost &c, uint32_t ops, uint32_t tx)
+{
+  double ms = c.deviceMs();
+  printf("  %-7s %10.1f B/tx %9.2f erases/1000tx %9.1f writes/s (device est.)\n", name, (double)c.bytes / tx,
+         1000.0 * c.erases / tx, ms > 0 ? ops * 1000.0 / ms : 0.0);
+}
+
+// Cut the image at random points inside a write (record, segment header or a
+// compaction copy), re-mount, and check every slot reads back the old or the
+// new log and a status that belongs to it. Five cuts in a row per image.
+static uint32_t rolledBack = 0;
+
+static int crashTest(int rounds)
+{
+  const uint16_t kSlots = 300;
+  int failures = 0;
+  for (int r = 0; r < rounds && failures == 0; r++)
+  {
+    RamFlash flash(8, 8192);
+    std::vector<uint32_t> expect(kSlots + 1, 0);
+    std::vector<uint8_t> expectStatus(kSlots + 1, 0); // 0 = none
+    uint8_t rec[kRecord];
+    uint32_t tx = 0;
+    for (int cut = 0; cut < 5 && failures == 0; cut++)
+    {
+      LogJournal j(flash);
+      j.begin();
+      uint32_t ops = 200 + nextRandom() % 3000;
+      for (uint32_t i = 0; i < ops; i++)
+      {
+        uint16_t slot = 1 + nextRandom() % kSlots;
+        if (expect[slot] && nextRandom() % 4 == 0)
+        {
+          uint8_t status = (uint8_t)(1 + nextRandom() % 250);
+          if (j.append(JOURNAL_REC_STATUS, slot, &status, 1))
+            expectStatus[slot] = status;
+          continue;
+        }
+        makeLog(rec, slot, ++tx);
+        if (j.append(JOURNAL_REC_LOG, slot, rec, kRecord))
+        {
+          expect[slot] = tx;
+          expectStatus[slot] = 0;
+        }
+      }
+      // Torn write of one more record
+      uint16_t slot = 1 + nextRandom() % kSlots;
+      makeLog(rec, slot, ++tx);
+      flash.tearAfter = nextRandom() % (LogJournal::recordSize(kRecord));
+      j.append(JOURNAL_REC_LOG, slot, rec, kRecord);
+      flash.tearAfter = -1;
+      flash.torn = false;
+
+      LogJournal again(flash);
+      again.begin();
+      rolledBack += j.stats.undoneCompactions + again.stats.undoneCompactions;
+      for (uint16_t s = 1; s <= kSlots; s++)
+      {
+        uint8_t got[LOG_JOURNAL_MAX_PAYLOAD];
+        uint8_t len = 0;
+        uint32_t gotTx = 0;
+        if (again.read(JOURNAL_REC_LOG, s, got, sizeof(got), len))
+          gotTx = PumpLogRecord::getU32(got + 9);
+        uint8_t status = 0;
+        if (!again.read(JOURNAL_REC_STATUS, s, &status, 1, len))
+          status = 0;
+        bool isNew = s == slot && gotTx == tx;
+        bool good = (gotTx == expect[s] && status == expectStatus[s]) || (isNew && status == 0);
+        if (!good)
+        {
+          printf("  crash round %d/%d: slot %u has tx %u status %u, expected %u status %u\n", r, cut, s, gotTx,
+                 status, expect[s], expectStatus[s]);
+          failures++;
+          break;
+        }
+        if (isNew)
+        {
+          expect[s] = tx;
+          expectStatus[s] = 0;
+        }
+      }
+      // The journal must keep working after the cut
+      makeLog(rec, 1, ++tx);
+      if (!again.append(JOURNAL_REC_LOG, 1, rec, kRecord))
+      {
+        printf("  crash round %d/%d: append after remount failed\n", r, cut);
+        failures++;
+      }
+      expect[1] = tx;
+      expectStatus[1] = 0;
+    }
+  }
+  return failures;
+}
+
+// Codec round trip, then 2046 logs written in each format on a fresh journal
+static int formatReport()
+{
+  int failures = 0;
+  for (uint32_t i = 0; i < 10000; i++)
+  {
+    HostPumpLog in = hostLog((uint16_t)(1 + i % LOG_JOURNAL_SLOTS), i), out;
+    uint8_t rec[PumpLogRecord::kLength];
+    PumpLogRecord::encode(rec, in);
+    if (!PumpLogRecord::decode(rec, sizeof(rec), PumpLogRecord::kFormat, out) || memcmp(&in, &out, sizeof(in)) != 0)
+    {
+      failures++;
+      break;
+    }
+  }
+  HostPumpLog dummy;
+  uint8_t raw[kLegacyRecord] = {0};
+  if (!PumpLogRecord::decode(raw, sizeof(raw), PumpLogRecord::kLegacyFormat, dummy) ||
+      PumpLogRecord::decode(raw, sizeof(raw) - 8, PumpLogRecord::kLegacyFormat, dummy) ||
+      PumpLogRecord::decode(raw, sizeof(raw), 9, dummy))
+    failures++;
+  printf("Record codec: %s\n", failures ? "FAILED" : "10000 round trips exact, bad length / format rejected");
+
+  const uint32_t partition = 0xA0000; // littlefs partition in min_spiffs.csv
+  const uint32_t segments = partition / LOG_JOURNAL_MAX_SEGMENT_SIZE - 1; // One spare segment
+  printf("Record format       payload  journal rec  2046 logs   per 0xA0000: fixed slots  journal\n");
+  uint32_t base = 0;
+  for (int f = 0; f < 3; f++)
+  {
+    uint32_t payload = f == 0 ? kLegacyRecord : f == 1 ? 56 : PumpLogRecord::kLength;
+    const char *name = f == 0 ? "raw, 32-bit time_t" : f == 1 ? "raw, 64-bit time_t" : "packed format 1";
+    RamFlash flash(16, 16384);
+    LogJournal j(flash);
+    j.begin();
+    uint8_t buf[LOG_JOURNAL_MAX_PAYLOAD] = {0};
+    for (uint16_t slot = 1; slot <= LOG_JOURNAL_SLOTS; slot++)
+      j.append(JOURNAL_REC_LOG, slot, buf, (uint8_t)payload, f == 2 ? PumpLogRecord::kFormat : 0);
+    uint32_t rec = LogJournal::recordSize((uint8_t)payload);
+    uint32_t perPartition = segments * ((LOG_JOURNAL_MAX_SEGMENT_SIZE - LogJournal::kSegmentHeader) / rec);
+    if (f == 0)
+      base = perPartition;
+    printf("  %-18s %5u B %9u B %9u B %21u %8u (%+.1f%%)\n", name, payload, rec, j.bytesUsed(), partition / payload,
+           perPartition, 100.0 * perPartition / base - 100.0);
+  }
+  return failures;
+}
+
+int main(int argc, char **argv)
+{
+  uint32_t transactions = argc > 1 ? (uint32_t)strtoul(argv[1], nullptr, 10) : 20000;
+  double statusRatio = argc > 2 ? strtod(argv[2], nullptr) : 0.2;
+  if (transactions == 0)
+    transactions = 1;
+
+  RamFlash flash(16, 16384);
+  LogJournal journal(flash);
+  if (!journal.begin())
+  {
+    fprintf(stderr, "journal begin failed\n");
+    return 1;
+  }
+
+  const uint32_t legacyFileSize = LOG_JOURNAL_SLOTS * kLegacyRecord;
+  Cost legacy, jfs, jfsGroup, jraw;
+  uint8_t rec[kRecord];
+  uint32_t ops = 0;
+  uint32_t stored = 0;
+
+  auto legacyWrite = [&](uint16_t slot) {
+    uint32_t blockStart = (slot - 1) * kLegacyRecord / kSector * kSector;
+    uint32_t copied = legacyFileSize - blockStart; // Tail of the file rewritten
+    legacy.add(copied + kMetaCommit);
+    legacy.erases += (copied + kSector - 1) / kSector;
+  };
+
+  auto t0 = std::chrono::steady_clock::now();
+  uint64_t lastErases = 0;
+  for (uint32_t tx = 0; tx < transactions; tx++)
+  {
+    uint16_t slot = (uint16_t)(tx % LOG_JOURNAL_SLOTS + 1);
+    makeLog(rec, slot, tx);
+    uint64_t before = flash.programmed;
+    if (!journal.append(JOURNAL_REC_LOG, slot, rec, kRecord))
+    {
+      fprintf(stderr, "append failed at tx %u\n", tx);
+      return 1;
+    }
+    legacyWrite(slot);
+    jfs.add(flash.programmed - before + kMetaCommit);
+    ops++;
+    stored = stored < LOG_JOURNAL_SLOTS ? stored + 1 : stored;
+
+    if (statusRatio > 0 && (nextRandom() % 1000) < statusRatio * 1000)
+    {
+      uint16_t s = (uint16_t)(1 + nextRandom() % stored);
+      uint8_t status[5] = {1, 1, 2, 3, 4};
+      before = flash.programmed;
+      journal.append(JOURNAL_REC_STATUS, s, status, sizeof(status));
+      legacyWrite(s); // The old scheme rewrites the whole record
+      jfs.add(flash.programmed - before + kMetaCommit);
+      ops++;
+    }
+
+    if (flash.sectorErases != lastErases)
+    {
+      jfs.erases += flash.sectorErases - lastErases; // Compaction deletes whole files
+      lastErases = flash.sectorErases;
+    }
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  double hostSec = std::chrono::duration<double>(t1 - t0).count();
+
+  jraw.bytes = flash.programmed;
+  jraw.pages = flash.pages;
+  jraw.erases = flash.sectorErases;
+  // jfs: partial last block copied on every reopen (average half a block) + a fresh block per append
+  jfs.add((uint64_t)ops * kSector / 2);
+  jfs.erases += ops;
+  // jfs-gc: the same per sync instead of per record
+  uint64_t syncs = (ops + kGroupCommit - 1) / kGroupCommit;
+  jfsGroup.add(flash.programmed);
+  jfsGroup.add(syncs * (kSector / 2 + kMetaCommit));
+  jfsGroup.erases = flash.sectorErases + syncs;
+
+  printf("Workload: %u transactions, %u status updates, %u slots\n", transactions, ops - transactions,
+         LOG_JOURNAL_SLOTS);
+  printf("Flash cost per transaction (littlefs models, see header):\n");
+  report("legacy", legacy, ops, transactions);
+  report("jfs", jfs, ops, transactions);
+  report("jfs-gc", jfsGroup, ops, transactions);
+  report("jraw", jraw, ops, transactions);
+  printf("Journal: %u compactions, %u records copied, %u/%u bytes in use, host %.0f appends/s\n",
+         journal.stats.compactions, journal.stats.recordsCopied, journal.bytesUsed(), journal.capacity(),
+         ops / hostSec);
+
+  // Remount: index rebuilt from the image must match
+  LogJournal remount(flash);
+  auto r0 = std::chrono::steady_clock::now();
+  remount.begin();
+  auto r1 = std::chrono::steady_clock::now();
+  int failures = 0;
+  if (remount.count() != journal.count())
+  {
+    printf("  remount: %u logs, expected %u\n", remount.count(), journal.count());
+    failures++;
+  }
+  printf("Remount: %u logs indexed in %.2f ms (host)\n", remount.count(),
+         std::chrono::duration<double, std::milli>(r1 - r0).count());
+
+  int crashFailures = crashTest(200);
+  printf("Crash consistency: %s (%u interrupted compactions rolled back)\n",
+         crashFailures ? "FAILED" : "1000 torn writes recovered", rolledBack);
+  failures += crashFailures + formatReport();
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,335 @@
+// ============================================================================
+// RAW PARTITION LOG STORE BENCHMARK - HOST TOOL
+// ============================================================================
+// The firmware keeps the log journal and the log archive on the "littlefs"
+// partition directly (LogJournalPartition.h) instead of LittleFS segment
+// files. This runs both on a file-backed image of that partition with the
+// same layout and the same address math:
+//   0x00000  journal  16 x 16 KB      0x40000  archive  24 x 16 KB
+// The image behaves like NOR flash: erase = 4 KB sectors set to 0xFF,
+// programming a byte that is not erased is an error, reads / writes go
+// through pread / pwrite on the file (so host latency includes the syscall,
+// as the ESP32's includes the SPI transfer).
+//
+// Workload: N transactions, each one journal LOG (packed 40 B record), one
+// archive append, and a fraction of MQTT STATUS updates; journal syncs every
+// LOG_COMMIT_BATCH (16) records as storageTask does under load.
+// Reported per transaction:
+//   host     p50 / p99 / max wall time of the store calls
+//   device   p50 / p99 / max modeled flash time: 0.7 ms per 256 B page
+//            program, 45 ms per 4 KB sector erase (W25Q32 figures)
+//   amp      flash bytes programmed / payload bytes (40 B per log)
+//   wear     sector erases per 1000 tx, spread between the most and least
+//            erased segment of each window
+// Compared with the LittleFS-files path modeled as in journal_bench (jfs-gc:
+// same records, plus per sync half a 4 KB block copied, a 64 B metadata
+// commit and one block erase). Finally the image is re-mounted from the file
+// and every log must read back.
+//
+// Build:  g++ -std=c++17 -O2 -Iinclude -Itools -o partition_bench tools/partition_bench.cpp
+// Usage:  partition_bench [transactions] [image path]   (default 20000 /tmp/kpl_littlefs.img)
+// ============================================================================
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <vector>
+
+#include "LogJournal.h"
+#include "LogArchive.h"
+#include "PumpLogRecord.h"
+
+static const uint32_t kPartition = 0xA0000; // littlefs in min_spiffs.csv
+static const uint32_t kSector = 4096;
+static const uint32_t kPage = 256;
+static const uint32_t kSegment = 16384;
+static const uint32_t kRecord = PumpLogRecord::kLength;
+static const uint32_t kMetaCommit = 64;
+static const uint32_t kGroupCommit = 16; // LOG_COMMIT_BATCH in main.cpp
+static const double kPageMs = 0.7;
+static const double kEraseMs = 45.0;
+
+// The partition image, shared by both windows
+struct Image
+{
+  int fd = -1;
+  uint64_t programmed = 0;
+  uint64_t pages = 0;
+  uint64_t sectorErases = 0;
+
+  bool open(const char *path)
+  {
+    fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+      return false;
+    std::vector<uint8_t> blank(kPartition, 0xFF);
+    return pwrite(fd, blank.data(), blank.size(), 0) == (ssize_t)blank.size();
+  }
+  double deviceMs() const { return pages * kPageMs + sectorErases * kEraseMs; }
+};
+
+// PartitionJournalMedium with the esp_partition_* calls replaced by the file
+class FilePartitionMedium : public JournalMedium
+{
+public:
+  FilePartitionMedium(Image &img, uint32_t offset, uint8_t segments)
+      : img(img), offset(offset), segments(segments), erases(segments, 0)
+  {
+  }
+
+  uint32_t segmentSize() const override { return kSegment; }
+  uint8_t segmentCount() const override { return segments; }
+
+  bool read(uint8_t seg, uint32_t off, void *buf, size_t len) override
+  {
+    return pread(img.fd, buf, len, address(seg, off)) == (ssize_t)len;
+  }
+
+  bool program(uint8_t seg, uint32_t off, const void *buf, size_t len) override
+  {
+    std::vector<uint8_t> old(len);
+    if (pread(img.fd, old.data(), len, address(seg, off)) != (ssize_t)len)
+      return false;
+    for (size_t i = 0; i < len; i++)
+    {
+      if (old[i] != 0xFF)
+      {
+        fprintf(stderr, "program over non-erased byte at 0x%05x\n", address(seg, off) + (uint32_t)i);
+        exit(1);
+      }
+    }
+    img.programmed += len;
+    img.pages += len ? (off + len - 1) / kPage - off / kPage + 1 : 0;
+    return pwrite(img.fd, buf, len, address(seg, off)) == (ssize_t)len;
+  }
+
+  bool erase(uint8_t seg) override
+  {
+    std::vector<uint8_t> blank(kSegment, 0xFF);
+    img.sectorErases += kSegment / kSector;
+    erases[seg]++;
+    return pwrite(img.fd, blank.data(), kSegment, address(seg, 0)) == (ssize_t)kSegment;
+  }
+
+  uint32_t eraseSpread() const
+  {
+    auto mm = std::minmax_element(erases.begin(), erases.end());
+    return *mm.second - *mm.first;
+  }
+  uint32_t eraseTotal() const
+  {
+    uint32_t n = 0;
+    for (uint32_t e : erases)
+      n += e;
+    return n;
+  }
+
+private:
+  uint32_t address(uint8_t seg, uint32_t off) const { return offset + (uint32_t)seg * kSegment + off; }
+
+  Image &img;
+  uint32_t offset;
+  uint8_t segments;
+  std::vector<uint32_t> erases;
+};
+
+static uint32_t rng = 12345;
+static uint32_t nextRandom()
+{
+  rng ^= rng << 13;
+  rng ^= rng >> 17;
+  rng ^= rng << 5;
+  return rng;
+}
+
+// PumpLog fields as the codecs see them (structdata.h)
+struct HostPumpLog
+{
+  uint8_t send1, send2, idVoi;
+  uint16_t viTriLogCot, viTriLogData, maLanBom;
+  uint32_t soLitBom;
+  uint16_t donGia;
+  uint32_t soTotalTong, soTienBom;
+  uint8_t ngay, thang, nam, gio, phut, giay;
+  uint16_t send3;
+  uint8_t checksum, send4;
+  uint16_t cycleSave;
+  uint8_t mqttSent;
+  int32_t mqttSentTime;
+};
+
+// A station's day: 4 nozzles, running totals, prices that rarely change
+static HostPumpLog nextLog(uint32_t tx)
+{
+  static uint32_t total[4] = {100000, 200000, 300000, 400000};
+  static uint16_t lan[4] = {0, 0, 0, 0};
+  HostPumpLog log;
+  memset(&log, 0, sizeof(log));
+  uint8_t voi = (uint8_t)(nextRandom() % 4);
+  uint32_t lit = 2000 + nextRandom() % 40000;
+  total[voi] += lit;
+  log.send1 = 7;
+  log.send2 = 0x81;
+  log.idVoi = (uint8_t)(voi + 1);
+  log.viTriLogCot = ++lan[voi];
+  log.viTriLogData = (uint16_t)(tx % LOG_JOURNAL_SLOTS + 1);
+  log.maLanBom = lan[voi];
+  log.soLitBom = lit;
+  log.donGia = (uint16_t)(20000 + voi * 1000);
+  log.soTotalTong = total[voi];
+  log.soTienBom = lit * log.donGia / 1000;
+  uint32_t minute = tx * 3; // ~480 logs a day
+  log.ngay = (uint8_t)(1 + minute / 1440 % 28);
+  log.thang = (uint8_t)(1 + minute / 40320 % 12);
+  log.nam = 26;
+  log.gio = (uint8_t)(minute / 60 % 24);
+  log.phut = (uint8_t)(minute % 60);
+  log.giay = (uint8_t)(nextRandom() % 60);
+  log.send3 = 0x0D0A;
+  log.checksum = (uint8_t)nextRandom();
+  log.send4 = 0x55;
+  return log;
+}
+
+struct Latency
+{
+  std::vector<double> v;
+  void add(double x) { v.push_back(x); }
+  double at(double q)
+  {
+    if (v.empty())
+      return 0;
+    std::sort(v.begin(), v.end());
+    return v[std::min(v.size() - 1, (size_t)(q * v.size()))];
+  }
+};
+
+int main(int argc, char **argv)
+{
+  uint32_t transactions = argc > 1 ? (uint32_t)strtoul(argv[1], nullptr, 10) : 20000;
+  const char *path = argc > 2 ? argv[2] : "/tmp/kpl_littlefs.img";
+  if (transactions == 0)
+    transactions = 1;
+
+  Image img;
+  if (!img.open(path))
+  {
+    fprintf(stderr, "cannot create %s\n", path);
+    return 1;
+  }
+  FilePartitionMedium journalMedium(img, 0x00000, LOG_JOURNAL_MAX_SEGMENTS);
+  FilePartitionMedium archiveMedium(img, 0x40000, 24);
+  LogJournal journal(journalMedium);
+  LogArchive<HostPumpLog> archive(archiveMedium);
+  if (!journal.begin() || !archive.begin())
+  {
+    fprintf(stderr, "begin failed\n");
+    return 1;
+  }
+
+  Latency host, device, files;
+  uint32_t ops = 0;
+  uint64_t fileBytes = 0, filePages = 0, fileErases = 0;
+  uint8_t rec[kRecord];
+  for (uint32_t tx = 0; tx < transactions; tx++)
+  {
+    HostPumpLog log = nextLog(tx);
+    PumpLogRecord::encode(rec, log);
+    uint64_t pages0 = img.pages, erases0 = img.sectorErases, bytes0 = img.programmed;
+    auto t0 = std::chrono::steady_clock::now();
+    bool ok = journal.append(JOURNAL_REC_LOG, log.viTriLogData, rec, kRecord, PumpLogRecord::kFormat);
+    if (nextRandom() % 5 == 0)
+    {
+      uint8_t status[5] = {1, 0, 0, 0, 0};
+      uint16_t slot = (uint16_t)(1 + nextRandom() % std::min<uint32_t>(tx + 1, LOG_JOURNAL_SLOTS));
+      ok = journal.append(JOURNAL_REC_STATUS, slot, status, sizeof(status)) && ok;
+      ops++;
+    }
+    ok = archive.append(log) && ok;
+    if (++ops % kGroupCommit == 0)
+      journal.sync();
+    auto t1 = std::chrono::steady_clock::now();
+    if (!ok)
+    {
+      fprintf(stderr, "store failed at tx %u\n", tx);
+      return 1;
+    }
+    uint64_t pages = img.pages - pages0, erases = img.sectorErases - erases0, bytes = img.programmed - bytes0;
+    host.add(std::chrono::duration<double, std::micro>(t1 - t0).count());
+    device.add(pages * kPageMs + erases * kEraseMs);
+
+    // Same writes through LittleFS files: a sync every kGroupCommit records copies
+    // half a block, commits metadata and erases a block
+    uint64_t fPages = pages, fErases = erases, fBytes = bytes;
+    if (ops % kGroupCommit == 0)
+    {
+      fBytes += kSector / 2 + kMetaCommit;
+      fPages += (kSector / 2 + kMetaCommit + kPage - 1) / kPage;
+      fErases++;
+    }
+    fileBytes += fBytes;
+    filePages += fPages;
+    fileErases += fErases;
+    files.add(fPages * kPageMs + fErases * kEraseMs);
+  }
+  archive.flush();
+
+  double payload = (double)transactions * kRecord;
+  printf("Workload: %u transactions, %u store ops, image %s (0x%X bytes)\n", transactions, ops, path, kPartition);
+  printf("Per transaction        host p50/p99/max us      device p50/p99/max ms   amp   erases/1000tx\n");
+  double hp50 = host.at(0.5), hp99 = host.at(0.99), hmax = host.at(1.0);
+  printf("  raw partition   %7.1f %7.1f %8.1f   %7.2f %7.2f %7.2f  %5.2fx %8.1f\n", hp50, hp99, hmax,
+         device.at(0.5), device.at(0.99), device.at(1.0), img.programmed / payload,
+         1000.0 * img.sectorErases / transactions);
+  printf("  littlefs files  %7s %7s %8s   %7.2f %7.2f %7.2f  %5.2fx %8.1f\n", "-", "-", "-", files.at(0.5),
+         files.at(0.99), files.at(1.0), fileBytes / payload, 1000.0 * fileErases / transactions);
+  printf("Device time total: raw %.1f s, files %.1f s (%.2fx)\n", img.deviceMs() / 1000,
+         (filePages * kPageMs + fileErases * kEraseMs) / 1000,
+         (filePages * kPageMs + fileErases * kEraseMs) / std::max(1.0, img.deviceMs()));
+  printf("Wear: journal %u segment erases (spread %u), archive %u (spread %u)\n", journalMedium.eraseTotal(),
+         journalMedium.eraseSpread(), archiveMedium.eraseTotal(), archiveMedium.eraseSpread());
+
+  // Re-mount from the file: the journal and the archive must read back
+  int failures = 0;
+  FilePartitionMedium journalAgain(img, 0x00000, LOG_JOURNAL_MAX_SEGMENTS);
+  FilePartitionMedium archiveAgain(img, 0x40000, 24);
+  LogJournal j2(journalAgain);
+  LogArchive<HostPumpLog> a2(archiveAgain);
+  auto r0 = std::chrono::steady_clock::now();
+  bool mounted = j2.begin() && a2.begin();
+  auto r1 = std::chrono::steady_clock::now();
+  if (!mounted || j2.count() != journal.count() || a2.lastId() != archive.lastId() || a2.count() != archive.count())
+  {
+    printf("  remount: %u logs / archive %u..%u, expected %u / %u..%u\n", j2.count(), a2.firstId(), a2.lastId(),
+           journal.count(), archive.firstId(), archive.lastId());
+    failures++;
+  }
+  for (uint16_t slot = 1; slot <= j2.count() && failures == 0; slot++)
+  {
+    uint8_t got[LOG_JOURNAL_MAX_PAYLOAD], len = 0, format = 0;
+    HostPumpLog log;
+    if (!j2.read(JOURNAL_REC_LOG, slot, got, sizeof(got), len, format) ||
+        !PumpLogRecord::decode(got, len, format, log) || log.viTriLogData != slot)
+    {
+      printf("  remount: journal slot %u unreadable\n", slot);
+      failures++;
+    }
+  }
+  for (uint32_t id = a2.firstId(); id <= a2.lastId() && failures == 0; id++)
+  {
+    HostPumpLog log;
+    if (!a2.get(id, log))
+    {
+      printf("  remount: archive id %u unreadable\n", id);
+      failures++;
+    }
+  }
+  printf("Remount: %u journal logs, archive IDs %u..%u, %.2f ms (host): %s\n", j2.count(), a2.firstId(),
+         a2.lastId(), std::chrono::duration<double, std::milli>(r1 - r0).count(), failures ? "FAILED" : "all readable");
+  close(img.fd);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,164 @@
+// ============================================================================
+// RS485 CAPTURE REPLAY - HOST TOOL
+// ============================================================================
+// Replays a capture downloaded from the device (MQTT {Mst}/RS485Capture/<id>
+// or http://<device>/rs485/capture) through the SAME RS485FrameDecoder used
+// by readRS485Data() and reports decoder throughput and error counters.
+//
+// Build:  g++ -std=c++17 -O2 -Iinclude -o rs485_replay tools/rs485_replay.cpp
+// Usage:  rs485_replay <capture.bin> [--realtime] [--loops N] [--tx] [--verbose]
+//   --realtime  feed records with their captured timing (1x); default is max speed
+//   --loops N   repeat the capture N times (max-speed benchmarking)
+//   --tx        also feed TX records (the TTL bus echoes our own commands)
+//   --verbose   print every decoded frame
+// ============================================================================
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "RS485Capture.h"
+#include "RS485FrameDecoder.h"
+
+static const char *kindName(RS485FrameKind kind)
+{
+  switch (kind)
+  {
+  case RS485_FRAME_PRICE_RESPONSE:
+    return "PRICE";
+  case RS485_FRAME_SET_TIME_REPLY:
+    return "SETTIME";
+  case RS485_FRAME_PUMP_LOG:
+    return "LOG";
+  case RS485_FRAME_ECHO:
+    return "ECHO";
+  default:
+    return "?";
+  }
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 2)
+  {
+    fprintf(stderr, "usage: %s <capture.bin> [--realtime] [--loops N] [--tx] [--verbose]\n", argv[0]);
+    return 2;
+  }
+
+  bool realtime = false;
+  bool feedTx = false;
+  bool verbose = false;
+  long loops = 1;
+  for (int i = 2; i < argc; i++)
+  {
+    if (strcmp(argv[i], "--realtime") == 0)
+      realtime = true;
+    else if (strcmp(argv[i], "--tx") == 0)
+      feedTx = true;
+    else if (strcmp(argv[i], "--verbose") == 0)
+      verbose = true;
+    else if (strcmp(argv[i], "--loops") == 0 && i + 1 < argc)
+      loops = strtol(argv[++i], nullptr, 10);
+  }
+  if (loops < 1)
+    loops = 1;
+
+  FILE *f = fopen(argv[1], "rb");
+  if (!f)
+  {
+    perror(argv[1]);
+    return 1;
+  }
+  std::vector<uint8_t> capture;
+  uint8_t chunk[4096];
+  size_t n;
+  while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0)
+  {
+    capture.insert(capture.end(), chunk, chunk + n);
+  }
+  fclose(f);
+
+  RS485CaptureReader reader;
+  if (!reader.open(capture.data(), capture.size()))
+  {
+    fprintf(stderr, "%s: not a v%d RS485 capture\n", argv[1], RS485_CAPTURE_VERSION);
+    return 1;
+  }
+
+  printf("Capture: %zu bytes, baud %u, %u record(s) evicted on device\n",
+         capture.size(), reader.baud(), reader.droppedRecords());
+
+  RS485FrameDecoder decoder;
+  RS485Frame frame;
+  uint64_t busUs = 0;          // Capture timeline
+  uint64_t rxBytes = 0, txBytes = 0, records = 0;
+  double decodeNs = 0;         // Time spent inside feed()/next()
+  auto wallStart = std::chrono::steady_clock::now();
+
+  for (long loop = 0; loop < loops; loop++)
+  {
+    reader.rewind();
+    RS485CaptureRecord rec;
+    while (reader.next(rec))
+    {
+      records++;
+      busUs += rec.deltaUs;
+      if (realtime && rec.deltaUs > 0)
+      {
+        std::this_thread::sleep_for(std::chrono::microseconds(rec.deltaUs));
+      }
+      if (rec.tx)
+      {
+        txBytes += rec.length;
+        if (!feedTx)
+          continue;
+      }
+      else
+      {
+        rxBytes += rec.length;
+      }
+
+      uint32_t nowMs = (uint32_t)(busUs / 1000);
+      auto t0 = std::chrono::steady_clock::now();
+      decoder.feed(rec.data, rec.length, nowMs);
+      while (decoder.next(frame, nowMs))
+      {
+        if (verbose)
+        {
+          printf("%10.3f ms  %-7s len=%2u  id=%u\n", busUs / 1000.0, kindName(frame.kind), frame.length, frame.data[1]);
+        }
+      }
+      decodeNs += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+    }
+  }
+
+  // Flush a trailing partial frame as the device would after an idle gap
+  uint32_t endMs = (uint32_t)(busUs / 1000) + RS485FrameDecoder::kStaleGapMs;
+  while (decoder.next(frame, endMs))
+  {
+  }
+
+  double wallSec = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+  const RS485DecoderStats &st = decoder.stats();
+  uint32_t frames = 0;
+  for (int k = 1; k < RS485_FRAME_KIND_COUNT; k++)
+  {
+    frames += st.frames[k];
+  }
+
+  printf("\n=== RS485 REPLAY (%s, %ld loop%s) ===\n", realtime ? "1x" : "max speed", loops, loops > 1 ? "s" : "");
+  printf("Records: %llu  RX bytes: %llu  TX bytes: %llu  bus time: %.3f s\n",
+         (unsigned long long)records, (unsigned long long)rxBytes, (unsigned long long)txBytes, busUs / 1e6);
+  printf("Frames: %u  (LOG %u, PRICE %u, SETTIME %u, ECHO %u)\n", frames,
+         st.frames[RS485_FRAME_PUMP_LOG], st.frames[RS485_FRAME_PRICE_RESPONSE],
+         st.frames[RS485_FRAME_SET_TIME_REPLY], st.frames[RS485_FRAME_ECHO]);
+  printf("Invalid: bad checksum %u, resyncs %u, discarded bytes %u, stale partials %u, overflow %u\n",
+         st.badChecksum, st.resyncs, st.bytesDiscarded, st.staleDrops, st.overflowBytes);
+  printf("Wall: %.3f s  frames/s: %.0f  decode time: %.1f ns/frame, %.2f ns/byte\n",
+         wallSec, wallSec > 0 ? frames / wallSec : 0.0,
+         frames ? decodeNs / frames : 0.0, st.bytesIn ? decodeNs / st.bytesIn : 0.0);
+  return 0;
+}
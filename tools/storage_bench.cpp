@@ -0,0 +1,620 @@
+// ============================================================================
+// STORAGE BENCHMARK SUITE - HOST TOOL
+// ============================================================================
+// How long each flash path of the firmware holds flashMutex, measured on the
+// same store code (LogJournal.h, LogArchive.h, PumpLogRecord.h) over a RAM
+// NOR flash with the ESP32's geometry: 4 KB erase sectors, 256 B program
+// pages, erased = 0xFF, the raw "littlefs" partition layout of
+// LogJournalPartition.h (journal 16 x 16 KB, archive 24 x 16 KB).
+// One "op" is one flashMutex hold, mirroring main.cpp:
+//   commit    commitLogBatch: 16 logs -> journal + archive, one sync
+//   status    readLogFromFlash after a publish: journalMarkSent + sync
+//   read      journalReadLog: one slot (RequestLog before the range read)
+//   bulk      RequestLog: one journalReadRange of 200 slots (LOG + STATUS pass)
+//   archive   RequestLog "Archive": one logArchive.get
+//   bydate    RequestLogByDate: one page of 50 logs (forEachInDays)
+//   price     saveNozzlePrices: /nozzle_prices.dat rewritten on LittleFS
+// The LittleFS paths (price, and the fallback scenario: journal and archive
+// on LittleFSJournalMedium /jlNN.seg + /arNN.seg files as without the raw
+// partition) run littlefs itself, tools/host/LittleFS.h over a RAM block
+// device. They are built in when the littlefs sources are in tools/littlefs
+// (lfs.c, lfs.h, lfs_util.c, lfs_util.h of the littlefs release esp_littlefs
+// ships) and left out otherwise - no modeled numbers.
+//
+// Scenarios: ingest (sequential commits), status (random status updates on
+// a full ring), range (RequestLog ranges, archive IDs, date pages), mixed
+// (all of it interleaved as on a busy station) and fallback (commits and
+// status updates on the LittleFS files). Per scenario and op:
+//   ops/s      host, store code only
+//   p99 us     host wall time of one hold
+//   p99 / max  modeled device time of one hold: 0.7 ms per page program,
+//   ms         45 ms per sector erase, 0.05 us per byte read (SPI 80 MHz QIO)
+//   er/1000tx  sector erases per 1000 transactions
+//
+// Regression deltas between commits: save the numbers of one build, compare
+// another against them (deterministic workload, fixed seed):
+//   git stash && g++ ... && ./storage_bench --save base.txt
+//   git stash pop && g++ ... && ./storage_bench --baseline base.txt
+// With a baseline, exits 1 if a modeled metric (device p99 / max, erases)
+// got more than 10% worse; host timings are shown but not gated (noise).
+//
+// Build:  g++ -std=c++17 -O2 -Iinclude -o storage_bench tools/storage_bench.cpp
+// With LittleFS paths:
+//   gcc -O2 -c -Itools/littlefs tools/littlefs/lfs.c tools/littlefs/lfs_util.c
+//   g++ -std=c++17 -O2 -Iinclude -Itools/host -Itools/littlefs -o storage_bench tools/storage_bench.cpp lfs.o lfs_util.o
+// Usage:  storage_bench [transactions] [--save FILE] [--baseline FILE]   (default 20000)
+// ============================================================================
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "LogJournal.h"
+#include "LogArchive.h"
+#include "PumpLogRecord.h"
+
+#if __has_include(<LittleFS.h>) && __has_include(<lfs.h>) // -Itools/host -Itools/littlefs
+#include <LittleFS.h>
+#include "LogJournalFS.h"
+#define STORAGE_BENCH_LITTLEFS 1
+#else
+#define STORAGE_BENCH_LITTLEFS 0
+#endif
+
+static const uint32_t kSector = 4096;
+static const uint32_t kPage = 256;
+static const uint32_t kSegment = 16384;
+static const uint8_t kJournalSegments = 16;
+static const uint8_t kArchiveSegments = 24;
+static const uint32_t kGroupCommit = 16; // LOG_COMMIT_BATCH in main.cpp
+static const uint32_t kDatePage = 50;    // LOG_DATE_QUERY_PAGE in main.cpp
+static const uint8_t kArchiveFileSegments = 12; // LOG_ARCHIVE_SEGMENTS in main.cpp
+static const uint32_t kPricesFile = 10 * 32 + 8; // sizeof(NozzlePrices), 32-bit time_t
+static const double kPageMs = 0.7;
+static const double kEraseMs = 45.0;
+static const double kReadUsPerByte = 0.05;
+static const double kRegression = 10.0; // Percent
+
+class RamFlash : public JournalMedium
+{
+public:
+  explicit RamFlash(uint8_t segments) : count(segments), data((size_t)segments * kSegment, 0xFF) {}
+
+  uint32_t segmentSize() const override { return kSegment; }
+  uint8_t segmentCount() const override { return count; }
+
+  bool read(uint8_t seg, uint32_t off, void *buf, size_t len) override
+  {
+    memcpy(buf, &data[(size_t)seg * kSegment + off], len);
+    readBytes += len;
+    return true;
+  }
+
+  bool program(uint8_t seg, uint32_t off, const void *buf, size_t len) override
+  {
+    uint8_t *p = &data[(size_t)seg * kSegment + off];
+    for (size_t i = 0; i < len; i++)
+    {
+      if (p[i] != 0xFF)
+      {
+        fprintf(stderr, "program over non-erased byte seg %u off %zu\n", seg, off + i);
+        exit(1);
+      }
+    }
+    memcpy(p, buf, len);
+    pages += len ? (off + len - 1) / kPage - off / kPage + 1 : 0;
+    return true;
+  }
+
+  bool erase(uint8_t seg) override
+  {
+    memset(&data[(size_t)seg * kSegment], 0xFF, kSegment);
+    sectorErases += kSegment / kSector;
+    return true;
+  }
+
+  uint8_t count;
+  std::vector<uint8_t> data;
+  uint64_t readBytes = 0;
+  uint64_t pages = 0;
+  uint64_t sectorErases = 0;
+};
+
+// PumpLog fields as the codecs see them (structdata.h)
+struct HostPumpLog
+{
+  uint8_t send1, send2, idVoi;
+  uint16_t viTriLogCot, viTriLogData, maLanBom;
+  uint32_t soLitBom;
+  uint16_t donGia;
+  uint32_t soTotalTong, soTienBom;
+  uint8_t ngay, thang, nam, gio, phut, giay;
+  uint16_t send3;
+  uint8_t checksum, send4;
+  uint16_t cycleSave;
+  uint8_t mqttSent;
+  int32_t mqttSentTime;
+};
+
+static uint32_t rng;
+static uint32_t nextRandom()
+{
+  rng ^= rng << 13;
+  rng ^= rng >> 17;
+  rng ^= rng << 5;
+  return rng;
+}
+
+// The firmware's stores plus the counters every op is measured against.
+// onLittleFS: journal and archive on the LittleFS segment files (fallback).
+struct Device
+{
+  explicit Device(bool onLittleFS = false) : journal(medium(onLittleFS, 0)), archive(medium(onLittleFS, 1)) {}
+
+  ~Device()
+  {
+#if STORAGE_BENCH_LITTLEFS
+    journalFiles.close();
+    archiveFiles.close();
+    LittleFS.end();
+#endif
+  }
+
+  RamFlash journalFlash{kJournalSegments};
+  RamFlash archiveFlash{kArchiveSegments};
+#if STORAGE_BENCH_LITTLEFS
+  LittleFSJournalMedium journalFiles{"/jl", LOG_JOURNAL_FS_SEGMENTS};
+  LittleFSJournalMedium archiveFiles{"/ar", kArchiveFileSegments};
+#endif
+  LogJournal journal;
+  LogArchive<HostPumpLog> archive;
+  uint32_t tx = 0;
+  uint32_t total[4] = {100000, 200000, 300000, 400000};
+  uint16_t lan[4] = {0, 0, 0, 0};
+  uint8_t prices[kPricesFile] = {};
+
+  JournalMedium &medium(bool onLittleFS, int store)
+  {
+#if STORAGE_BENCH_LITTLEFS
+    if (onLittleFS)
+      return store == 0 ? (JournalMedium &)journalFiles : (JournalMedium &)archiveFiles;
+#else
+    (void)onLittleFS;
+#endif
+    return store == 0 ? journalFlash : archiveFlash;
+  }
+
+  // A freshly formatted LittleFS per device (price file, fallback segment files)
+  bool begin()
+  {
+#if STORAGE_BENCH_LITTLEFS
+    if (!LittleFS.format() || !LittleFS.begin())
+      return false;
+#endif
+    return journal.begin() && archive.begin();
+  }
+
+#if STORAGE_BENCH_LITTLEFS
+  uint64_t pages() const { return journalFlash.pages + archiveFlash.pages + LittleFS.pages; }
+  uint64_t erases() const { return journalFlash.sectorErases + archiveFlash.sectorErases + LittleFS.erases; }
+  uint64_t readBytes() const { return journalFlash.readBytes + archiveFlash.readBytes + LittleFS.readBytes; }
+#else
+  uint64_t pages() const { return journalFlash.pages + archiveFlash.pages; }
+  uint64_t erases() const { return journalFlash.sectorErases + archiveFlash.sectorErases; }
+  uint64_t readBytes() const { return journalFlash.readBytes + archiveFlash.readBytes; }
+#endif
+
+  // Next transaction of a 4-nozzle station, ~480 a day
+  HostPumpLog nextLog()
+  {
+    HostPumpLog log;
+    memset(&log, 0, sizeof(log));
+    uint8_t voi = (uint8_t)(nextRandom() % 4);
+    uint32_t lit = 2000 + nextRandom() % 40000;
+    total[voi] += lit;
+    log.send1 = 7;
+    log.send2 = 0x81;
+    log.idVoi = (uint8_t)(voi + 1);
+    log.viTriLogCot = ++lan[voi];
+    log.viTriLogData = (uint16_t)(tx % LOG_JOURNAL_SLOTS + 1);
+    log.maLanBom = lan[voi];
+    log.soLitBom = lit;
+    log.donGia = (uint16_t)(20000 + voi * 1000);
+    log.soTotalTong = total[voi];
+    log.soTienBom = lit * log.donGia / 1000;
+    uint32_t minute = tx * 3;
+    log.ngay = (uint8_t)(1 + minute / 1440 % 28);
+    log.thang = (uint8_t)(1 + minute / 40320 % 12);
+    log.nam = 26;
+    log.gio = (uint8_t)(minute / 60 % 24);
+    log.phut = (uint8_t)(minute % 60);
+    log.giay = (uint8_t)(nextRandom() % 60);
+    log.send3 = 0x0D0A;
+    log.checksum = (uint8_t)nextRandom();
+    log.send4 = 0x55;
+    tx++;
+    return log;
+  }
+
+  // commitLogBatch
+  bool commit(uint32_t count)
+  {
+    bool ok = true;
+    for (uint32_t i = 0; i < count; i++)
+    {
+      HostPumpLog log = nextLog();
+      uint8_t rec[PumpLogRecord::kLength];
+      PumpLogRecord::encode(rec, log);
+      ok = journal.append(JOURNAL_REC_LOG, log.viTriLogData, rec, sizeof(rec), PumpLogRecord::kFormat) && ok;
+      archive.append(log);
+    }
+    journal.sync();
+    return ok;
+  }
+
+  // readLogFromFlash → journalMarkSent + sync
+  bool markSent(uint16_t pos)
+  {
+    uint8_t status[5] = {1, 0x80, 0x1F, 0x5E, 0x66};
+    bool ok = journal.append(JOURNAL_REC_STATUS, pos, status, sizeof(status));
+    journal.sync();
+    return ok;
+  }
+
+  // journalReadLog
+  bool readLog(uint16_t pos, HostPumpLog &log)
+  {
+    uint8_t rec[LOG_JOURNAL_MAX_PAYLOAD];
+    uint8_t len = 0, format = 0;
+    return journal.read(JOURNAL_REC_LOG, pos, rec, sizeof(rec), len, format) &&
+           PumpLogRecord::decode(rec, len, format, log) && log.viTriLogData == pos;
+  }
+
+  // journalReadRange: LOG pass, then STATUS pass
+  uint16_t readRange(uint16_t first, uint16_t count, std::vector<HostPumpLog> &logs)
+  {
+    uint16_t found = 0;
+    journal.forEachInRange(JOURNAL_REC_LOG, first, count, [&](uint16_t slot, const uint8_t *rec, uint8_t len, uint8_t format) {
+      HostPumpLog &log = logs[(slot + LOG_JOURNAL_SLOTS - first) % LOG_JOURNAL_SLOTS];
+      found += PumpLogRecord::decode(rec, len, format, log) && log.viTriLogData == slot ? 1 : 0;
+    });
+    journal.forEachInRange(JOURNAL_REC_STATUS, first, count, [&](uint16_t slot, const uint8_t *status, uint8_t, uint8_t) {
+      logs[(slot + LOG_JOURNAL_SLOTS - first) % LOG_JOURNAL_SLOTS].mqttSent = status[0];
+    });
+    return found;
+  }
+
+#if STORAGE_BENCH_LITTLEFS
+  // saveNozzlePrices (FlashFile.h): one nozzle's price changed, whole table rewritten
+  bool savePrices()
+  {
+    uint8_t nozzle = (uint8_t)(tx % 10); // Not from nextRandom: same workload with and without LittleFS
+    uint32_t price = 20000 + tx % 10000;
+    memcpy(&prices[nozzle * 32 + 24], &price, sizeof(price));
+    File file = LittleFS.open("/nozzle_prices.dat", "w"); // NOZZLE_PRICES_FILE
+    if (!file)
+      return false;
+    size_t written = file.write(prices, sizeof(prices));
+    file.close();
+    return written == sizeof(prices);
+  }
+#endif
+};
+
+struct Samples
+{
+  std::vector<double> hostUs, deviceMs;
+  double seconds = 0;
+
+  double at(std::vector<double> &v, double q)
+  {
+    if (v.empty())
+      return 0;
+    std::sort(v.begin(), v.end());
+    return v[std::min(v.size() - 1, (size_t)(q * v.size()))];
+  }
+};
+
+typedef std::map<std::string, double> Results;
+
+// Time one flashMutex hold: host wall clock and modeled flash time
+template <class Op>
+static bool measure(Device &d, Samples &s, Op op)
+{
+  uint64_t pages = d.pages(), erases = d.erases(), readBytes = d.readBytes();
+  auto t0 = std::chrono::steady_clock::now();
+  bool ok = op();
+  auto t1 = std::chrono::steady_clock::now();
+  double us = std::chrono::duration<double, std::micro>(t1 - t0).count();
+  s.hostUs.push_back(us);
+  s.seconds += us / 1e6;
+  s.deviceMs.push_back((d.pages() - pages) * kPageMs + (d.erases() - erases) * kEraseMs +
+                       (d.readBytes() - readBytes) * kReadUsPerByte / 1000);
+  return ok;
+}
+
+static void report(Results &out, const char *scenario, const char *op, Samples &s, uint64_t erases, uint32_t tx)
+{
+  if (s.hostUs.empty())
+    return;
+  std::string key = std::string(scenario) + "." + op;
+  double opsPerSec = s.seconds > 0 ? s.hostUs.size() / s.seconds : 0;
+  double hostP99 = s.at(s.hostUs, 0.99), devP99 = s.at(s.deviceMs, 0.99), devMax = s.at(s.deviceMs, 1.0);
+  double perTx = tx ? 1000.0 * erases / tx : 0;
+  printf("  %-8s %-8s %8zu %11.0f %9.1f %9.2f %9.2f %9.1f\n", scenario, op, s.hostUs.size(), opsPerSec, hostP99,
+         devP99, devMax, perTx);
+  out[key + ".ops_s"] = opsPerSec;
+  out[key + ".host_p99_us"] = hostP99;
+  out[key + ".dev_p99_ms"] = devP99;
+  out[key + ".dev_max_ms"] = devMax;
+  out[key + ".erases_1000tx"] = perTx;
+}
+
+// Fill the ring once so reads / status updates hit a steady-state journal
+static bool prefill(Device &d, uint32_t logs)
+{
+  for (uint32_t n = 0; n < logs; n += kGroupCommit)
+  {
+    if (!d.commit(kGroupCommit))
+      return false;
+  }
+  return true;
+}
+
+static bool ingest(Results &out, uint32_t transactions)
+{
+  Device d;
+  if (!d.begin())
+    return false;
+  Samples commit;
+  uint64_t erases = d.erases();
+  for (uint32_t n = 0; n < transactions; n += kGroupCommit)
+  {
+    if (!measure(d, commit, [&] { return d.commit(kGroupCommit); }))
+      return false;
+  }
+  report(out, "ingest", "commit", commit, d.erases() - erases, transactions);
+  return true;
+}
+
+static bool status(Results &out, uint32_t transactions)
+{
+  Device d;
+  if (!d.begin() || !prefill(d, 2 * LOG_JOURNAL_SLOTS))
+    return false;
+  Samples mark;
+  uint64_t erases = d.erases();
+  for (uint32_t n = 0; n < transactions; n++)
+  {
+    uint16_t pos = (uint16_t)(1 + nextRandom() % LOG_JOURNAL_SLOTS);
+    if (!measure(d, mark, [&] { return d.markSent(pos); }))
+      return false;
+  }
+  report(out, "status", "status", mark, d.erases() - erases, transactions);
+  return true;
+}
+
+static bool range(Results &out, uint32_t transactions)
+{
+  Device d;
+  if (!d.begin() || !prefill(d, std::max<uint32_t>(transactions, LOG_JOURNAL_SLOTS))) // Reads hit any slot
+    return false;
+  d.archive.flush();
+  Samples read, bulk, archive, bydate;
+  HostPumpLog log;
+  std::vector<HostPumpLog> logs(200);
+  uint32_t requests = std::max<uint32_t>(1, transactions / 100);
+  for (uint32_t r = 0; r < requests; r++)
+  {
+    // RequestLog: 50 consecutive slots, wrapping at the end of the ring
+    uint16_t begin = (uint16_t)(1 + nextRandom() % LOG_JOURNAL_SLOTS);
+    for (uint16_t i = 0; i < 50; i++)
+    {
+      uint16_t pos = (uint16_t)((begin - 1 + i) % LOG_JOURNAL_SLOTS + 1);
+      if (!measure(d, read, [&] { return d.readLog(pos, log); }))
+        return false;
+    }
+    // Whole 200-log RequestLog in one range read
+    measure(d, bulk, [&] { return d.readRange(begin, 200, logs) == 200; });
+    // Same with archive IDs
+    uint32_t first = d.archive.firstId(), span = d.archive.lastId() - first + 1;
+    uint32_t id = first + nextRandom() % (span > 50 ? span - 50 : 1);
+    for (uint32_t i = 0; i < 50; i++)
+    {
+      if (!measure(d, archive, [&] { return d.archive.get(id + i, log); }))
+        return false;
+    }
+    // RequestLogByDate: first page of one day, one nozzle
+    uint16_t day = LogArchiveCodec::dayOf(log);
+    uint8_t nozzle = (uint8_t)(1 + nextRandom() % 4);
+    measure(d, bydate, [&] {
+      uint32_t n = 0;
+      d.archive.forEachInDays(day, day, nozzle, 0, [&](uint32_t, const HostPumpLog &) { return ++n < kDatePage; });
+      return true;
+    });
+  }
+  report(out, "range", "read", read, 0, 0);
+  report(out, "range", "bulk", bulk, 0, 0);
+  report(out, "range", "archive", archive, 0, 0);
+  report(out, "range", "bydate", bydate, 0, 0);
+  return true;
+}
+
+// A busy station: logs committed in groups (sometimes fewer than 16 when the
+// commit delay runs out), every log published and marked sent, a price change
+// every ~200 logs and a RequestLog of 20 logs every ~500
+static bool mixed(Results &out, uint32_t transactions)
+{
+  Device d;
+  if (!d.begin() || !prefill(d, LOG_JOURNAL_SLOTS))
+    return false;
+  Samples commit, mark, read, price;
+  uint64_t erases = d.erases();
+  HostPumpLog log;
+  uint32_t done = 0;
+  while (done < transactions)
+  {
+    uint32_t group = nextRandom() % 4 == 0 ? 1 + nextRandom() % kGroupCommit : kGroupCommit;
+    uint32_t firstTx = d.tx;
+    if (!measure(d, commit, [&] { return d.commit(group); }))
+      return false;
+    for (uint32_t i = 0; i < group; i++)
+    {
+      uint16_t pos = (uint16_t)((firstTx + i) % LOG_JOURNAL_SLOTS + 1);
+      measure(d, read, [&] { return d.readLog(pos, log); });
+      if (!measure(d, mark, [&] { return d.markSent(pos); }))
+        return false;
+      if (nextRandom() % 200 == 0)
+      {
+#if STORAGE_BENCH_LITTLEFS
+        if (!measure(d, price, [&] { return d.savePrices(); }))
+          return false;
+#endif
+      }
+      if (nextRandom() % 500 == 0)
+      {
+        uint16_t begin = (uint16_t)(1 + nextRandom() % LOG_JOURNAL_SLOTS);
+        for (uint16_t k = 0; k < 20; k++)
+          measure(d, read, [&] { return d.readLog((uint16_t)((begin - 1 + k) % LOG_JOURNAL_SLOTS + 1), log); });
+      }
+    }
+    done += group;
+  }
+  uint64_t total = d.erases() - erases;
+  report(out, "mixed", "commit", commit, total, done);
+  report(out, "mixed", "status", mark, 0, 0);
+  report(out, "mixed", "read", read, 0, 0);
+  report(out, "mixed", "price", price, 0, 0);
+  return true;
+}
+
+#if STORAGE_BENCH_LITTLEFS
+// No raw partition: journal and archive on the LittleFS segment files, each
+// group commit followed by the status updates of its logs
+static bool fallback(Results &out, uint32_t transactions)
+{
+  Device d(true);
+  if (!d.begin())
+    return false;
+  Samples commit, mark;
+  uint64_t erases = d.erases();
+  for (uint32_t n = 0; n < transactions; n += kGroupCommit)
+  {
+    uint32_t firstTx = d.tx;
+    if (!measure(d, commit, [&] { return d.commit(kGroupCommit); }))
+      return false;
+    for (uint32_t i = 0; i < kGroupCommit; i++)
+    {
+      uint16_t pos = (uint16_t)((firstTx + i) % LOG_JOURNAL_SLOTS + 1);
+      if (!measure(d, mark, [&] { return d.markSent(pos); }))
+        return false;
+    }
+  }
+  report(out, "fallback", "commit", commit, d.erases() - erases, transactions);
+  report(out, "fallback", "status", mark, 0, 0);
+  return true;
+}
+#endif
+
+static bool saveResults(const char *path, const Results &r)
+{
+  FILE *f = fopen(path, "w");
+  if (!f)
+    return false;
+  for (const auto &kv : r)
+    fprintf(f, "%s %.4f\n", kv.first.c_str(), kv.second);
+  fclose(f);
+  return true;
+}
+
+// Deltas against a saved run; returns the number of gated regressions
+static int compareResults(const char *path, const Results &now)
+{
+  FILE *f = fopen(path, "r");
+  if (!f)
+  {
+    fprintf(stderr, "cannot read baseline %s\n", path);
+    return 1;
+  }
+  Results base;
+  char key[128];
+  double value;
+  while (fscanf(f, "%127s %lf", key, &value) == 2)
+    base[key] = value;
+  fclose(f);
+
+  int regressions = 0;
+  printf("Delta vs %s (+ = more; gated: dev_* and erases, >%.0f%% worse fails)\n", path, kRegression);
+  for (const auto &kv : now)
+  {
+    auto b = base.find(kv.first);
+    if (b == base.end())
+    {
+      printf("  %-36s %12.2f  (new)\n", kv.first.c_str(), kv.second);
+      continue;
+    }
+    double pct = b->second != 0 ? 100.0 * (kv.second - b->second) / b->second : (kv.second != 0 ? 100.0 : 0.0);
+    bool gated = kv.first.find(".dev_") != std::string::npos || kv.first.find(".erases") != std::string::npos;
+    bool worse = gated && pct > kRegression;
+    regressions += worse;
+    if (pct != 0 || worse)
+      printf("  %-36s %12.2f -> %12.2f  %+7.1f%%%s\n", kv.first.c_str(), b->second, kv.second, pct,
+             worse ? "  REGRESSION" : "");
+  }
+  return regressions;
+}
+
+int main(int argc, char **argv)
+{
+  uint32_t transactions = 20000;
+  const char *savePath = nullptr;
+  const char *basePath = nullptr;
+  for (int i = 1; i < argc; i++)
+  {
+    if (!strcmp(argv[i], "--save") && i + 1 < argc)
+      savePath = argv[++i];
+    else if (!strcmp(argv[i], "--baseline") && i + 1 < argc)
+      basePath = argv[++i];
+    else
+      transactions = (uint32_t)strtoul(argv[i], nullptr, 10);
+  }
+  if (transactions < kGroupCommit)
+    transactions = kGroupCommit;
+
+  Results results;
+  printf("Storage bench: %u transactions per scenario, journal %ux16 KB, archive %ux16 KB\n", transactions,
+         kJournalSegments, kArchiveSegments);
+  printf("  scenario op          holds       ops/s   p99 us  p99 ms    max ms  er/1000tx\n");
+  bool ok = true;
+  rng = 12345;
+  ok = ingest(results, transactions) && ok;
+  rng = 12345;
+  ok = status(results, transactions) && ok;
+  rng = 12345;
+  ok = range(results, transactions) && ok;
+  rng = 12345;
+  ok = mixed(results, transactions) && ok;
+#if STORAGE_BENCH_LITTLEFS
+  rng = 12345;
+  ok = fallback(results, transactions) && ok;
+#else
+  printf("  (LittleFS rows - mixed.price, fallback - not built: add lfs.c, lfs.h, lfs_util.c, lfs_util.h\n"
+         "   to tools/littlefs and build with the LittleFS command in the header)\n");
+#endif
+  if (!ok)
+  {
+    fprintf(stderr, "a store operation failed\n");
+    return 1;
+  }
+  if (savePath && !saveResults(savePath, results))
+  {
+    fprintf(stderr, "cannot write %s\n", savePath);
+    return 1;
+  }
+  return basePath && compareResults(basePath, results) ? 1 : 0;
+}
@@ -0,0 +1,297 @@
+// ============================================================================
+// TTL CODEC CHECK + MICRO-BENCHMARK - HOST TOOL
+// ============================================================================
+// Checks every TTLCodec.h frame against the hand-built frames the firmware
+// used before (same bytes, same checksums), round-trips the decoders, then
+// times encode/decode for each frame type. Exit code != 0 on any mismatch.
+//
+// Build:  g++ -std=c++17 -O2 -Iinclude -o ttl_codec_bench tools/ttl_codec_bench.cpp
+// Usage:  ttl_codec_bench [iterations]      (default 2000000)
+// ============================================================================
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "TTLCodec.h"
+
+// Field names as in structdata.h (which needs Arduino.h)
+struct HostTime
+{
+  uint8_t ngay, thang, nam, gio, phut, giay;
+};
+
+struct HostLog
+{
+  uint8_t send1, send2, idVoi;
+  uint16_t viTriLogCot, viTriLogData, maLanBom;
+  uint32_t soLitBom;
+  uint16_t donGia;
+  uint32_t soTotalTong, soTienBom;
+  uint8_t ngay, thang, nam, gio, phut, giay;
+  uint16_t send3;
+  uint8_t checksum;
+};
+
+static int failures = 0;
+
+static void expect(bool ok, const char *what)
+{
+  if (!ok)
+  {
+    printf("FAIL: %s\n", what);
+    failures++;
+  }
+}
+
+static void expectBytes(const uint8_t *got, const uint8_t *want, size_t len, const char *what)
+{
+  if (memcmp(got, want, len) == 0)
+    return;
+  printf("FAIL: %s\n  got :", what);
+  for (size_t i = 0; i < len; i++)
+    printf(" %02X", got[i]);
+  printf("\n  want:");
+  for (size_t i = 0; i < len; i++)
+    printf(" %02X", want[i]);
+  printf("\n");
+  failures++;
+}
+
+// ----------------------------------------------------------------------------
+// Reference frames, built the way TTL.h / main.cpp did before the codec
+// ----------------------------------------------------------------------------
+
+static void legacyPadded(uint8_t *dst, size_t width, const char *s)
+{
+  size_t n = strlen(s);
+  for (size_t i = 0; i < width; i++)
+    dst[i] = i < n ? (uint8_t)s[i] : ' ';
+}
+
+static void checkFrames()
+{
+  {
+    uint8_t want[23] = {1, 2, '@', 'A'};
+    legacyPadded(want + 4, 17, "RON-95");
+    want[21] = 3;
+    want[22] = 4;
+    uint8_t got[TTLPrinterFuel::kLength];
+    expect(TTLPrinterFuel::encode(got, 10, "RON-95"), "fuel encode voi 10");
+    expectBytes(got, want, sizeof(want), "printer fuel frame");
+    expect(!TTLPrinterFuel::encode(got, 0, "X") && !TTLPrinterFuel::encode(got, 11, "X"), "fuel rejects voi 0/11");
+    TTLPrinterFuel::encode(got, 1, "A-NAME-LONGER-THAN-17-CHARS");
+    expect(got[3] == '1' && got[20] == 'A' && got[21] == 3, "fuel truncates to 17");
+  }
+  {
+    uint8_t want[67] = {1, 2, 'W'};
+    legacyPadded(want + 3, 32, "CTY A");
+    legacyPadded(want + 35, 30, "So 12 Duong 3122");
+    want[65] = 3;
+    want[66] = 4;
+    uint8_t got[TTLPrinterCompany::kLength];
+    TTLPrinterCompany::encode(got, "CTY A", "So 12 Duong 3122");
+    expectBytes(got, want, sizeof(want), "printer company frame");
+  }
+  {
+    uint8_t want[23] = {1, 2, '#'};
+    legacyPadded(want + 3, 18, "0123456789");
+    want[21] = 3;
+    want[22] = 4;
+    uint8_t got[TTLPrinterMst::kLength];
+    TTLPrinterMst::encode(got, "0123456789");
+    expectBytes(got, want, sizeof(want), "printer MST frame");
+  }
+  {
+    uint16_t pos = 1234;
+    uint8_t hi = pos >> 8, lo = pos & 0xFF;
+    uint8_t want[5] = {0xC8, hi, lo, (uint8_t)(0xA5 ^ hi ^ lo), 0xC9};
+    uint8_t got[TTLLogRequest::kLength];
+    expect(TTLLogRequest::encode(got, pos), "log request encode");
+    expectBytes(got, want, sizeof(want), "log request frame");
+    expect(!TTLLogRequest::encode(got, 0) && !TTLLogRequest::encode(got, 2047), "log request range");
+  }
+  {
+    uint8_t want[5] = {0x7D, 0x33, 0x55, (uint8_t)(0xA5 ^ 0x33 ^ 0x55), 0x7E};
+    uint8_t got[TTLStartup::kLength];
+    TTLStartup::encode(got);
+    expectBytes(got, want, sizeof(want), "startup frame");
+  }
+  {
+    HostTime t = {17, 10, 26, 13, 45, 59};
+    uint8_t want[10] = {93, 99, 17, 10, 26, 13, 45, 59, 0, 94};
+    want[8] = 0xA5 ^ 99 ^ 17 ^ 10 ^ 26 ^ 13 ^ 45 ^ 59;
+    uint8_t got[TTLSetTime::kLength];
+    TTLSetTime::encode(got, t);
+    expectBytes(got, want, sizeof(want), "set time frame");
+  }
+  {
+    char priceStr[7];
+    snprintf(priceStr, sizeof(priceStr), "%06d", 24560);
+    uint8_t want[10] = {9, 15};
+    for (int i = 0; i < 6; i++)
+      want[2 + i] = priceStr[5 - i];
+    want[8] = 0x5A;
+    for (int i = 1; i < 8; i++)
+      want[8] ^= want[i];
+    want[9] = 10;
+    uint8_t got[TTLPriceChange::kLength];
+    expect(TTLPriceChange::encode(got, 15, 24560), "price encode");
+    expectBytes(got, want, sizeof(want), "price change frame");
+    uint8_t id = 0;
+    uint32_t price = 0;
+    expect(TTLPriceChange::decode(got, id, price) && id == 15 && price == 24560, "price round trip");
+    got[4] ^= 1;
+    expect(!TTLPriceChange::decode(got, id, price), "price decode rejects bad checksum");
+    expect(!TTLPriceChange::encode(got, 10, 1) && !TTLPriceChange::encode(got, 11, 1000000), "price range");
+  }
+  {
+    uint8_t got[TTLCommandReply::kLength];
+    TTLCommandReply::encode(got, 99, false);
+    uint8_t want[4] = {7, 99, 'E', 8};
+    expectBytes(got, want, sizeof(want), "command reply frame");
+    uint8_t id = 0;
+    bool ok = true;
+    expect(TTLCommandReply::decode(got, id, ok) && id == 99 && !ok, "reply round trip");
+  }
+  {
+    HostLog in = {};
+    in.idVoi = 3;
+    in.viTriLogCot = 812;
+    in.viTriLogData = 2045;
+    in.maLanBom = 40000;
+    in.soLitBom = 123456;
+    in.donGia = 24560;
+    in.soTotalTong = 98765432;
+    in.soTienBom = 3032000;
+    in.ngay = 17;
+    in.thang = 10;
+    in.nam = 26;
+    in.gio = 8;
+    in.phut = 5;
+    in.giay = 1;
+    uint8_t frame[TTLPumpLog::kLength];
+    TTLPumpLog::encode(frame, in);
+    uint8_t cs = 0xA5;
+    for (int i = 2; i < 29; i++)
+      cs ^= frame[i];
+    expect(frame[30] == cs && TTLPumpLog::valid(frame), "pump log checksum");
+    HostLog out = {};
+    TTLPumpLog::decode(frame, out);
+    expect(out.idVoi == 3 && out.viTriLogCot == 812 && out.viTriLogData == 2045 && out.maLanBom == 40000 &&
+               out.soLitBom == 123456 && out.donGia == 24560 && out.soTotalTong == 98765432 &&
+               out.soTienBom == 3032000 && out.ngay == 17 && out.giay == 1,
+           "pump log round trip");
+    expect(out.checksum == 3 && out.send3 == cs, "pump log keeps checksum/send3 mapping");
+    frame[12] ^= 0x40;
+    expect(!TTLPumpLog::valid(frame), "pump log rejects bad checksum");
+  }
+}
+
+// ----------------------------------------------------------------------------
+// Benchmark
+// ----------------------------------------------------------------------------
+
+static volatile uint32_t sink; // Keeps the optimiser from dropping the work
+
+template <class Fn>
+static void bench(const char *name, size_t frameLen, long iterations, Fn fn)
+{
+  auto t0 = std::chrono::steady_clock::now();
+  uint32_t acc = 0;
+  for (long i = 0; i < iterations; i++)
+    acc += fn((uint32_t)i);
+  auto t1 = std::chrono::steady_clock::now();
+  sink = acc;
+  double ns = std::chrono::duration<double, std::nano>(t1 - t0).count() / iterations;
+  printf("  %-20s %3zu B  %7.1f ns/frame  %8.1f MB/s\n", name, frameLen, ns, frameLen * 1e3 / ns);
+}
+
+int main(int argc, char **argv)
+{
+  long iterations = argc > 1 ? atol(argv[1]) : 2000000;
+  if (iterations <= 0)
+    iterations = 1;
+
+  checkFrames();
+  if (failures)
+  {
+    printf("%d check(s) failed\n", failures);
+    return 1;
+  }
+  printf("All frame checks passed. %ld iterations per frame type:\n", iterations);
+
+  static const char *names[] = {"RON-95", "E5 RON-92", "DO 0.05S-II", "DAU HOA"};
+  bench("encode printer fuel", TTLPrinterFuel::kLength, iterations, [](uint32_t i) {
+    uint8_t b[TTLPrinterFuel::kLength];
+    TTLPrinterFuel::encode(b, 1 + i % 10, names[i & 3]);
+    return (uint32_t)b[4 + (i & 7)];
+  });
+  bench("encode printer DN", TTLPrinterCompany::kLength, iterations, [](uint32_t i) {
+    uint8_t b[TTLPrinterCompany::kLength];
+    TTLPrinterCompany::encode(b, names[i & 3], names[(i + 1) & 3]);
+    return (uint32_t)b[3 + (i & 31)];
+  });
+  bench("encode printer MST", TTLPrinterMst::kLength, iterations, [](uint32_t i) {
+    uint8_t b[TTLPrinterMst::kLength];
+    TTLPrinterMst::encode(b, names[i & 3]);
+    return (uint32_t)b[3 + (i & 15)];
+  });
+  bench("encode log request", TTLLogRequest::kLength, iterations, [](uint32_t i) {
+    uint8_t b[TTLLogRequest::kLength];
+    TTLLogRequest::encode(b, 1 + i % 2046);
+    return (uint32_t)b[3];
+  });
+  bench("encode startup", TTLStartup::kLength, iterations, [](uint32_t i) {
+    uint8_t b[TTLStartup::kLength];
+    TTLStartup::encode(b);
+    return (uint32_t)b[3] + i;
+  });
+  bench("encode set time", TTLSetTime::kLength, iterations, [](uint32_t i) {
+    HostTime t = {(uint8_t)(1 + i % 28), 10, 26, (uint8_t)(i % 24), (uint8_t)(i % 60), (uint8_t)(i % 60)};
+    uint8_t b[TTLSetTime::kLength];
+    TTLSetTime::encode(b, t);
+    return (uint32_t)b[8];
+  });
+  bench("encode price", TTLPriceChange::kLength, iterations, [](uint32_t i) {
+    uint8_t b[TTLPriceChange::kLength];
+    TTLPriceChange::encode(b, 11 + i % 10, i % 1000000);
+    return (uint32_t)b[8];
+  });
+  bench("decode price", TTLPriceChange::kLength, iterations, [](uint32_t i) {
+    uint8_t b[TTLPriceChange::kLength];
+    TTLPriceChange::encode(b, 11 + i % 10, i % 1000000);
+    uint8_t id;
+    uint32_t price;
+    return TTLPriceChange::decode(b, id, price) ? price : 0;
+  });
+  bench("decode reply", TTLCommandReply::kLength, iterations, [](uint32_t i) {
+    uint8_t b[TTLCommandReply::kLength] = {7, (uint8_t)(11 + i % 10), (i & 1) ? (uint8_t)'S' : (uint8_t)'E', 8};
+    uint8_t id;
+    bool ok;
+    return TTLCommandReply::decode(b, id, ok) ? id + ok : 0u;
+  });
+  bench("encode pump log", TTLPumpLog::kLength, iterations, [](uint32_t i) {
+    HostLog log = {};
+    log.idVoi = 1 + i % 10;
+    log.viTriLogData = 1 + i % 2046;
+    log.soLitBom = i;
+    log.soTienBom = i * 3;
+    uint8_t b[TTLPumpLog::kLength];
+    TTLPumpLog::encode(b, log);
+    return (uint32_t)b[30];
+  });
+  bench("decode pump log", TTLPumpLog::kLength, iterations, [](uint32_t i) {
+    HostLog log = {};
+    log.soLitBom = i;
+    uint8_t b[TTLPumpLog::kLength];
+    TTLPumpLog::encode(b, log);
+    if (!TTLPumpLog::valid(b))
+      return 0u;
+    HostLog out;
+    TTLPumpLog::decode(b, out);
+    return out.soLitBom;
+  });
+  return 0;
+}
@@ -0,0 +1,242 @@
+// ============================================================================
+// TTL BOX SIMULATOR - HOST TOOL (LOAD / SOAK TEST OF THE GATEWAY)
+// ============================================================================
+// Runs TTLSimulator.h on a pseudo terminal or a real serial line (USB-RS485
+// adapter wired to the gateway's Serial2). Output is paced to the line rate
+// (8N1 at --baud), like the real bus, so --rate above ~baud/320 logs/s
+// saturates the wire before it saturates the gateway.
+//
+// Build:  g++ -std=c++17 -O2 -Iinclude -Itools -o ttl_sim tools/ttl_sim.cpp
+// Usage:  ttl_sim [--device /dev/ttyUSB0] [--baud 9600] [--nozzles N] [--rate logs/s]
+//                 [--duration s] [--delay ms] [--jitter ms] [--ff p] [--trunc p]
+//                 [--echo p] [--seed n] [--first-pos n] [--stats-every s]
+//   no --device  create a pty and print its slave path (socat / a test harness
+//                connects it to the gateway or to a second adapter)
+//   --ff/--trunc/--echo  probability 0..1 per live log / received frame
+//
+// Finding the sustained maximum: step --rate up (e.g. 1, 2, 4, 8 ...) with a
+// fixed --duration and watch the gateway's device status: the first rate
+// where "mqttQueueDrops" or "saveLogQueueDrops" moves, or where the
+// queue low-water mark ("mqttQueueMinFree" / "saveLogQueueMinFree") reaches 0,
+// is over the limit. logsEmitted here vs. logs published is the loss.
+// ============================================================================
+
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include <vector>
+
+#include "TTLSimulator.h"
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void onSignal(int) { stopRequested = 1; }
+
+static uint32_t nowMs()
+{
+  using namespace std::chrono;
+  static const steady_clock::time_point start = steady_clock::now();
+  return (uint32_t)duration_cast<milliseconds>(steady_clock::now() - start).count();
+}
+
+static speed_t baudConstant(long baud)
+{
+  switch (baud)
+  {
+  case 4800:
+    return B4800;
+  case 9600:
+    return B9600;
+  case 19200:
+    return B19200;
+  case 38400:
+    return B38400;
+  case 57600:
+    return B57600;
+  case 115200:
+    return B115200;
+  default:
+    return 0;
+  }
+}
+
+static bool makeRaw(int fd, long baud)
+{
+  struct termios tio;
+  if (tcgetattr(fd, &tio) != 0)
+    return false;
+  cfmakeraw(&tio);
+  tio.c_cflag |= CLOCAL | CREAD;
+  tio.c_cflag &= ~(CSTOPB | PARENB);
+  speed_t speed = baudConstant(baud);
+  if (speed)
+  {
+    cfsetispeed(&tio, speed);
+    cfsetospeed(&tio, speed);
+  }
+  return tcsetattr(fd, TCSANOW, &tio) == 0;
+}
+
+static void printStats(const TTLSimulator &sim, uint32_t elapsedMs)
+{
+  const TTLSimStats &st = sim.stats;
+  double secs = elapsedMs / 1000.0;
+  printf("[SIM] %6.1fs logs=%u (%.2f/s) trunc=%u ff=%u echo=%u | req=%u miss=%u price=%u rej=%u time=%u other=%u "
+         "bad=%u | in=%llu out=%llu B\n",
+         secs, st.logsEmitted, secs > 0 ? st.logsEmitted / secs : 0.0, st.logsTruncated, st.ffBursts, st.echoes,
+         st.logRequests, st.logRequestMiss, st.priceCommands, st.priceRejected, st.setTimes, st.otherFrames,
+         st.badBytes, (unsigned long long)st.bytesIn, (unsigned long long)st.bytesOut);
+  fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+  setvbuf(stdout, nullptr, _IOLBF, 0); // pty path / stats visible through a pipe
+
+  TTLSimConfig cfg;
+  const char *device = nullptr;
+  long baud = 9600;
+  double durationSec = 0; // 0 = until Ctrl+C
+  double statsEverySec = 10;
+  for (int i = 1; i < argc; i++)
+  {
+    bool more = i + 1 < argc;
+    if (strcmp(argv[i], "--device") == 0 && more)
+      device = argv[++i];
+    else if (strcmp(argv[i], "--baud") == 0 && more)
+      baud = strtol(argv[++i], nullptr, 10);
+    else if (strcmp(argv[i], "--nozzles") == 0 && more)
+      cfg.nozzles = (uint8_t)strtol(argv[++i], nullptr, 10);
+    else if (strcmp(argv[i], "--rate") == 0 && more)
+      cfg.logsPerSec = strtod(argv[++i], nullptr);
+    else if (strcmp(argv[i], "--duration") == 0 && more)
+      durationSec = strtod(argv[++i], nullptr);
+    else if (strcmp(argv[i], "--delay") == 0 && more)
+      cfg.replyDelayMs = (uint32_t)strtoul(argv[++i], nullptr, 10);
+    else if (strcmp(argv[i], "--jitter") == 0 && more)
+      cfg.replyJitterMs = (uint32_t)strtoul(argv[++i], nullptr, 10);
+    else if (strcmp(argv[i], "--ff") == 0 && more)
+      cfg.ffBurstProb = strtod(argv[++i], nullptr);
+    else if (strcmp(argv[i], "--trunc") == 0 && more)
+      cfg.truncateProb = strtod(argv[++i], nullptr);
+    else if (strcmp(argv[i], "--echo") == 0 && more)
+      cfg.echoProb = strtod(argv[++i], nullptr);
+    else if (strcmp(argv[i], "--seed") == 0 && more)
+      cfg.seed = (uint32_t)strtoul(argv[++i], nullptr, 10);
+    else if (strcmp(argv[i], "--first-pos") == 0 && more)
+      cfg.firstLogPos = (uint16_t)strtoul(argv[++i], nullptr, 10);
+    else if (strcmp(argv[i], "--stats-every") == 0 && more)
+      statsEverySec = strtod(argv[++i], nullptr);
+    else
+    {
+      fprintf(stderr,
+              "usage: %s [--device path] [--baud n] [--nozzles n] [--rate logs/s] [--duration s] [--delay ms]\n"
+              "          [--jitter ms] [--ff p] [--trunc p] [--echo p] [--seed n] [--first-pos n] [--stats-every s]\n",
+              argv[0]);
+      return 2;
+    }
+  }
+  if (baud <= 0)
+    baud = 9600;
+
+  int fd;
+  if (device)
+  {
+    fd = open(device, O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (fd < 0)
+    {
+      perror(device);
+      return 1;
+    }
+  }
+  else
+  {
+    fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (fd < 0 || grantpt(fd) != 0 || unlockpt(fd) != 0)
+    {
+      perror("posix_openpt");
+      return 1;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    printf("[SIM] pty: %s\n", ptsname(fd));
+  }
+  if (!makeRaw(fd, baud))
+    perror("[SIM] termios (continuing)");
+
+  // 8N1: 10 bits per byte
+  const double bytesPerMs = baud / 10000.0;
+  double wireLogsPerSec = baud / 10.0 / TTLPumpLog::kLength;
+  if (cfg.logsPerSec > wireLogsPerSec)
+    printf("[SIM] WARNING: %.1f logs/s needs more than %ld baud can carry (%.1f logs/s)\n", cfg.logsPerSec, baud,
+           wireLogsPerSec);
+
+  TTLSimulator sim(cfg);
+  printf("[SIM] %u nozzles, %.2f logs/s, reply delay %u+%ums, ff=%.3f trunc=%.3f echo=%.3f seed=%u\n",
+         sim.config().nozzles, cfg.logsPerSec, cfg.replyDelayMs, cfg.replyJitterMs, cfg.ffBurstProb,
+         cfg.truncateProb, cfg.echoProb, cfg.seed);
+
+  signal(SIGINT, onSignal);
+  signal(SIGTERM, onSignal);
+
+  std::vector<uint8_t> txq;   // Due bytes waiting for line time
+  double credit = 0;          // Bytes the line may carry now
+  uint32_t lastMs = nowMs();
+  uint32_t lastStatsMs = lastMs;
+  const uint32_t startMs = lastMs;
+  uint8_t rxbuf[256];
+
+  while (!stopRequested)
+  {
+    uint32_t now = nowMs();
+    if (durationSec > 0 && now - startMs >= (uint32_t)(durationSec * 1000))
+      break;
+
+    // Gateway → box
+    ssize_t n;
+    while ((n = read(fd, rxbuf, sizeof(rxbuf))) > 0)
+      sim.receive(rxbuf, (size_t)n, now);
+
+    // Box → gateway, paced to the line rate
+    sim.transmit(txq, now);
+    credit += (now - lastMs) * bytesPerMs;
+    lastMs = now;
+    if (txq.empty() && credit > 1)
+      credit = 1; // An idle line does not bank air time
+    size_t allowed = (size_t)credit;
+    if (allowed > txq.size())
+      allowed = txq.size();
+    if (allowed > 0)
+    {
+      ssize_t w = write(fd, txq.data(), allowed);
+      if (w > 0)
+      {
+        txq.erase(txq.begin(), txq.begin() + w);
+        credit -= w;
+      }
+    }
+
+    if (statsEverySec > 0 && now - lastStatsMs >= (uint32_t)(statsEverySec * 1000))
+    {
+      lastStatsMs = now;
+      printStats(sim, now - startMs);
+      if (txq.size() > 1024)
+        printf("[SIM] backlog %zu bytes - rate above line capacity\n", txq.size());
+    }
+
+    uint32_t wait = sim.msUntilNext(now);
+    if (!txq.empty() || wait > 5)
+      wait = txq.empty() ? 5 : 1; // Poll at least every 5ms for gateway bytes
+    struct pollfd p = {fd, POLLIN, 0};
+    poll(&p, 1, (int)wait);
+  }
+
+  printStats(sim, nowMs() - startMs);
+  close(fd);
+  return 0;
+}